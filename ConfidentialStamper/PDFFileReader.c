@@ -0,0 +1,1051 @@
+/*
+*  File:    PDFFileReader.c
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#include "PDFFileReader.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ctype.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+// Deeper nesting than this is taken to be a damaged file.
+#define kMyMaxNesting		64
+// More updates than this are taken to be a loop of Prev entries.
+#define kMyMaxXRefSections	4096
+// The PDF Reference limits a file to 8,388,607 objects.
+#define kMyMaxObjects		8388608
+// Names longer than this are cut short when decoded.
+#define kMyMaxNameLength	128
+
+/* Where the latest update put an object. */
+typedef struct MyXRefEntry
+{
+    // The offset of the object, or for an object kept in an object
+    // stream, the number of that stream.
+    unsigned long long offset;
+    unsigned int index;		// Within the object stream.
+    unsigned char type;		// 1 for an object, 2 for one in a stream.
+    bool found;
+}MyXRefEntry;
+
+/* A decoded object stream. */
+typedef struct MyObjectStream
+{
+    unsigned char *data;
+    size_t length;
+    size_t count;
+    size_t *numbers;
+    size_t *offsets;		// From the start of data.
+}MyObjectStream;
+
+struct MyPDFFileReader
+{
+    const unsigned char *bytes;
+    size_t length;
+    MyXRefEntry *entries;	// Indexed by object number.
+    size_t numEntries;
+    MyPDFValue trailer;
+    off_t xrefOffset;
+    bool xrefStream;
+    size_t size;
+    // Object streams decoded so far, keyed by object number, and 
+    // kMyLoadingObjectStream for those being decoded.
+    CFMutableDictionaryRef objectStreams;
+};
+
+/* Reads the tokens of a run of bytes. */
+typedef struct MyPDFLexer
+{
+    const unsigned char *p;
+    const unsigned char *end;
+}MyPDFLexer;
+
+static bool isWhitespace(unsigned char c)
+{
+    return c == 0 || c == '\t' || c == '\n' || c == '\f' || c == '\r' || 
+		c == ' ';
+}
+
+static bool isDelimiter(unsigned char c)
+{
+    return c != 0 && strchr("()<>[]{}/%", c) != NULL;
+}
+
+static void skipWhitespace(MyPDFLexer *lexer)
+{
+    while(lexer->p < lexer->end){
+		if(*lexer->p == '%'){
+			while(lexer->p < lexer->end && 
+					*lexer->p != '\n' && *lexer->p != '\r')
+				lexer->p++;
+		}else if(isWhitespace(*lexer->p))
+			lexer->p++;
+		else
+			break;
+    }
+}
+
+/* Skip the body of a name, number or keyword. */
+static void skipRegular(MyPDFLexer *lexer)
+{
+    while(lexer->p < lexer->end && 
+		!isWhitespace(*lexer->p) && !isDelimiter(*lexer->p))
+		lexer->p++;
+}
+
+/* Skip a keyword if it comes next. */
+static bool skipKeyword(MyPDFLexer *lexer, const char *keyword)
+{
+    size_t length = strlen(keyword);
+    
+    skipWhitespace(lexer);
+    if((size_t)(lexer->end - lexer->p) < length || 
+		memcmp(lexer->p, keyword, length) != 0)
+		return false;
+    if(lexer->p + length < lexer->end && 
+		!isWhitespace(lexer->p[length]) && !isDelimiter(lexer->p[length]))
+		return false;
+    lexer->p += length;
+    return true;
+}
+
+static bool readInteger(MyPDFLexer *lexer, unsigned long long *value)
+{
+    skipWhitespace(lexer);
+    if(lexer->p >= lexer->end || !isdigit(*lexer->p))
+		return false;
+    for(*value = 0; lexer->p < lexer->end && isdigit(*lexer->p); lexer->p++){
+		if(*value > ULLONG_MAX/10 - 10)
+			return false;
+		*value = *value * 10 + (*lexer->p - '0');
+    }
+    return true;
+}
+
+/* Skip a literal string, whose parentheses nest. */
+static bool skipLiteralString(MyPDFLexer *lexer)
+{
+    int nesting = 0;
+    
+    while(lexer->p < lexer->end){
+		unsigned char c = *lexer->p++;
+		if(c == '\\'){
+			if(lexer->p < lexer->end)
+				lexer->p++;
+		}else if(c == '(')
+			nesting++;
+		else if(c == ')' && --nesting == 0)
+			return true;
+    }
+    return false;
+}
+
+static bool parseValue(MyPDFLexer *lexer, MyPDFValue *value, int depth);
+
+/* Parse the value of an integer that starts a reference, "n g R". */
+static void parseReference(MyPDFLexer *lexer, MyPDFValue *value)
+{
+    MyPDFLexer reference = { value->bytes, lexer->end };
+    unsigned long long number, generation;
+    
+    if(!readInteger(&reference, &number) || reference.p != lexer->p ||
+		!readInteger(&reference, &generation) || 
+		!skipKeyword(&reference, "R"))
+		return;
+    value->type = kMyPDFValueReference;
+    value->number = (size_t)number;
+    value->generation = (size_t)generation;
+    lexer->p = reference.p;
+}
+
+static bool parseValue(MyPDFLexer *lexer, MyPDFValue *value, int depth)
+{
+    MyPDFValue element, key;
+    size_t length;
+    
+    memset(value, 0, sizeof(MyPDFValue));
+    skipWhitespace(lexer);
+    if(lexer->p >= lexer->end || depth > kMyMaxNesting)
+		return false;
+    value->bytes = lexer->p;
+    switch(*lexer->p){
+		case '/':
+			lexer->p++;
+			skipRegular(lexer);
+			value->type = kMyPDFValueName;
+			break;
+		case '(':
+			if(!skipLiteralString(lexer))
+				return false;
+			value->type = kMyPDFValueString;
+			break;
+		case '[':
+			for(lexer->p++;;){
+				skipWhitespace(lexer);
+				if(lexer->p < lexer->end && *lexer->p == ']')
+					break;
+				if(!parseValue(lexer, &element, depth + 1))
+					return false;
+			}
+			lexer->p++;
+			value->type = kMyPDFValueArray;
+			break;
+		case '<':
+			if(lexer->p + 1 < lexer->end && lexer->p[1] == '<'){
+				for(lexer->p += 2;;){
+					skipWhitespace(lexer);
+					if(lexer->p + 1 < lexer->end && 
+						lexer->p[0] == '>' && lexer->p[1] == '>')
+						break;
+					if(!parseValue(lexer, &key, depth + 1) || 
+						key.type != kMyPDFValueName ||
+						!parseValue(lexer, &element, depth + 1))
+						return false;
+				}
+				lexer->p += 2;
+				value->type = kMyPDFValueDictionary;
+			}else{
+				while(lexer->p < lexer->end && *lexer->p != '>')
+					lexer->p++;
+				if(lexer->p >= lexer->end)
+					return false;
+				lexer->p++;
+				value->type = kMyPDFValueString;
+			}
+			break;
+		default:
+			if(isDelimiter(*lexer->p))
+				return false;
+			skipRegular(lexer);
+			length = lexer->p - value->bytes;
+			if(isdigit(value->bytes[0]) || value->bytes[0] == '+' ||
+				value->bytes[0] == '-' || value->bytes[0] == '.')
+			{
+				value->type = kMyPDFValueNumber;
+				// An integer followed by another and R is a reference.
+				parseReference(lexer, value);
+			}else if((length == 4 && memcmp(value->bytes, "true", 4) == 0) ||
+				(length == 5 && memcmp(value->bytes, "false", 5) == 0))
+				value->type = kMyPDFValueBoolean;
+			else if(length == 4 && memcmp(value->bytes, "null", 4) == 0)
+				value->type = kMyPDFValueNull;
+			else{
+				// Some other keyword, such as endobj.
+				return false;
+			}
+			break;
+    }
+    value->length = lexer->p - value->bytes;
+    return true;
+}
+
+/* Decode a name, without its slash, into name. */
+static void decodeName(const MyPDFValue *value, char name[kMyMaxNameLength])
+{
+    const unsigned char *p = value->bytes + 1, *end = value->bytes + value->length;
+    size_t length = 0;
+    char hex[3] = { 0, 0, 0 };
+    
+    while(p < end && length < kMyMaxNameLength - 1){
+		if(*p == '#' && end - p >= 3 && isxdigit(p[1]) && isxdigit(p[2])){
+			hex[0] = p[1];
+			hex[1] = p[2];
+			name[length++] = (char)strtol(hex, NULL, 16);
+			p += 3;
+		}else
+			name[length++] = *p++;
+    }
+    name[length] = 0;
+}
+
+/* Read the entries of a dictionary, or the elements of an array, one
+    at a time. */
+static void beginContents(const MyPDFValue *value, MyPDFLexer *lexer)
+{
+    size_t delimiter = value->type == kMyPDFValueDictionary ? 2 : 1;
+    
+    lexer->p = value->bytes + delimiter;
+    lexer->end = value->bytes + value->length - delimiter;
+}
+
+static bool nextEntry(MyPDFLexer *lexer, MyPDFValue *key, MyPDFValue *value)
+{
+    return parseValue(lexer, key, 0) && key->type == kMyPDFValueName &&
+		parseValue(lexer, value, 0);
+}
+
+bool pdfValueGetEntry(const MyPDFValue *dict, const char *key, 
+			MyPDFValue *value)
+{
+    MyPDFLexer lexer;
+    MyPDFValue entryKey;
+    char name[kMyMaxNameLength];
+    
+    if(dict->type != kMyPDFValueDictionary)
+		return false;
+    beginContents(dict, &lexer);
+    while(nextEntry(&lexer, &entryKey, value)){
+		decodeName(&entryKey, name);
+		if(strcmp(name, key) == 0)
+			return true;
+    }
+    return false;
+}
+
+void pdfValueApplyEntries(const MyPDFValue *dict, 
+			MyPDFEntryFunction function, void *info)
+{
+    MyPDFLexer lexer;
+    MyPDFValue key, value;
+    char name[kMyMaxNameLength];
+    
+    if(dict->type != kMyPDFValueDictionary)
+		return;
+    beginContents(dict, &lexer);
+    while(nextEntry(&lexer, &key, &value)){
+		decodeName(&key, name);
+		function(name, &key, &value, info);
+    }
+}
+
+void pdfValueApplyElements(const MyPDFValue *array, 
+			MyPDFElementFunction function, void *info)
+{
+    MyPDFLexer lexer;
+    MyPDFValue value;
+    
+    if(array->type != kMyPDFValueArray)
+		return;
+    beginContents(array, &lexer);
+    while(parseValue(&lexer, &value, 0))
+		function(&value, info);
+}
+
+/* Get the value of a number that should be a non-negative integer. */
+static bool getInteger(const MyPDFValue *value, unsigned long long *integer)
+{
+    MyPDFLexer lexer = { value->bytes, value->bytes + value->length };
+    
+    return value->type == kMyPDFValueNumber && 
+		readInteger(&lexer, integer) && lexer.p == lexer.end;
+}
+
+static bool getIntegerEntry(MyPDFFileReader *reader, const MyPDFValue *dict,
+			const char *key, unsigned long long *integer)
+{
+    MyPDFValue value, resolved;
+    
+    return pdfValueGetEntry(dict, key, &value) && 
+		pdfReaderResolve(reader, &value, &resolved) &&
+		getInteger(&resolved, integer);
+}
+
+/* Parse the object at offset, which should be numbered number. The 
+    dictionary of a stream gets the start of the stream's data. */
+static bool parseIndirectObject(MyPDFFileReader *reader, 
+			unsigned long long offset, size_t number, MyPDFValue *value)
+{
+    MyPDFLexer lexer = { reader->bytes + offset, reader->bytes + reader->length };
+    unsigned long long objectNumber, generation;
+    
+    if(offset >= reader->length ||
+		!readInteger(&lexer, &objectNumber) || objectNumber != number || 
+		!readInteger(&lexer, &generation) || !skipKeyword(&lexer, "obj") ||
+		!parseValue(&lexer, value, 0))
+		return false;
+    if(value->type == kMyPDFValueDictionary && skipKeyword(&lexer, "stream")){
+		// The keyword is followed by a carriage return and line feed or
+		// by a line feed alone.
+		if(lexer.p < lexer.end && *lexer.p == '\r')
+			lexer.p++;
+		if(lexer.p < lexer.end && *lexer.p == '\n')
+			lexer.p++;
+		value->streamData = lexer.p;
+    }
+    return true;
+}
+
+/* Inflate Flate-encoded data. */
+static unsigned char *inflateData(const unsigned char *data, size_t length,
+			size_t *inflatedLength)
+{
+    z_stream stream;
+    size_t capacity = 4*length + 1024;
+    unsigned char *inflated = malloc(capacity), *grown;
+    int status;
+    
+    memset(&stream, 0, sizeof(stream));
+    if(!inflated || inflateInit(&stream) != Z_OK){
+		free(inflated);
+		return NULL;
+    }
+    stream.next_in = (Bytef *)data;
+    stream.avail_in = (uInt)length;
+    for(;;){
+		if(stream.total_out == capacity){
+			grown = realloc(inflated, 2*capacity);
+			if(!grown){
+				status = Z_MEM_ERROR;
+				break;
+			}
+			inflated = grown;
+			capacity *= 2;
+		}
+		stream.next_out = inflated + stream.total_out;
+		stream.avail_out = (uInt)(capacity - stream.total_out);
+		status = inflate(&stream, Z_NO_FLUSH);
+		if(status != Z_OK && 
+			!(status == Z_BUF_ERROR && stream.avail_out == 0))
+			break;
+    }
+    inflateEnd(&stream);
+    // Streams whose end is missing are common enough to be accepted.
+    if(status != Z_STREAM_END && 
+		!(status == Z_BUF_ERROR && stream.avail_in == 0)){
+		free(inflated);
+		return NULL;
+    }
+    *inflatedLength = stream.total_out;
+    return inflated;
+}
+
+/* Undo PNG prediction, in place, where each row of the data begins 
+    with a byte giving how that row was predicted. */
+static bool undoPNGPredictor(unsigned char *data, size_t *length,
+			unsigned long long columns, unsigned long long colors, 
+			unsigned long long bitsPerComponent)
+{
+    size_t bytesPerPixel = (colors * bitsPerComponent + 7) / 8;
+    size_t rowLength = (columns * colors * bitsPerComponent + 7) / 8;
+    size_t numRows, i, j;
+    
+    if(rowLength == 0 || bytesPerPixel == 0)
+		return false;
+    numRows = *length / (rowLength + 1);
+    // Each row is moved back over its predictor byte as it is decoded, 
+    // which never overwrites data still to be read.
+    for(i = 0; i < numRows; i++){
+		const unsigned char *in = data + i*(rowLength + 1);
+		unsigned char *out = data + i*rowLength;
+		const unsigned char *previous = i ? out - rowLength : NULL;
+		unsigned char predictor = in[0];
+		
+		for(j = 0; j < rowLength; j++){
+			int left = j >= bytesPerPixel ? out[j - bytesPerPixel] : 0;
+			int up = previous ? previous[j] : 0;
+			int upLeft = previous && j >= bytesPerPixel ? 
+					previous[j - bytesPerPixel] : 0;
+			int p, pa, pb, pc;
+			
+			switch(predictor){
+				case 0: out[j] = in[j + 1]; break;
+				case 1: out[j] = in[j + 1] + left; break;
+				case 2: out[j] = in[j + 1] + up; break;
+				case 3: out[j] = in[j + 1] + (left + up)/2; break;
+				case 4:
+					p = left + up - upLeft;
+					pa = abs(p - left);
+					pb = abs(p - up);
+					pc = abs(p - upLeft);
+					if(pa <= pb && pa <= pc)
+						out[j] = in[j + 1] + left;
+					else if(pb <= pc)
+						out[j] = in[j + 1] + up;
+					else
+						out[j] = in[j + 1] + upLeft;
+					break;
+				default:
+					return false;
+			}
+		}
+    }
+    *length = numRows * rowLength;
+    return true;
+}
+
+/* Get the only element of a one-element array, or the value itself. */
+static bool getSoleValue(const MyPDFValue *value, MyPDFValue *sole)
+{
+    MyPDFLexer lexer;
+    MyPDFValue extra;
+    
+    if(value->type != kMyPDFValueArray){
+		*sole = *value;
+		return true;
+    }
+    beginContents(value, &lexer);
+    return parseValue(&lexer, sole, 0) && !parseValue(&lexer, &extra, 0);
+}
+
+/* Decode the data of a cross-reference or object stream, which may be
+    encoded with the Flate filter alone. */
+static unsigned char *copyDecodedStream(MyPDFFileReader *reader, 
+			const MyPDFValue *dict, size_t *decodedLength)
+{
+    MyPDFValue value, filter, parms;
+    unsigned long long length, predictor = 1, columns = 1, colors = 1, 
+		bitsPerComponent = 8;
+    unsigned char *decoded;
+    char name[kMyMaxNameLength];
+    
+    if(!dict->streamData || !getIntegerEntry(reader, dict, "Length", &length) ||
+		length > (unsigned long long)(reader->bytes + reader->length - 
+			dict->streamData))
+		return NULL;
+    if(!pdfValueGetEntry(dict, "Filter", &value)){
+		decoded = malloc(length ? length : 1);
+		if(decoded)
+			memcpy(decoded, dict->streamData, length);
+		*decodedLength = length;
+		return decoded;
+    }
+    if(!getSoleValue(&value, &filter) || filter.type != kMyPDFValueName)
+		return NULL;
+    decodeName(&filter, name);
+    if(strcmp(name, "FlateDecode") != 0 && strcmp(name, "Fl") != 0)
+		return NULL;
+    decoded = inflateData(dict->streamData, length, decodedLength);
+    if(!decoded)
+		return NULL;
+    if(pdfValueGetEntry(dict, "DecodeParms", &value) && 
+		getSoleValue(&value, &parms) && 
+		parms.type == kMyPDFValueDictionary)
+    {
+		getIntegerEntry(reader, &parms, "Predictor", &predictor);
+		getIntegerEntry(reader, &parms, "Columns", &columns);
+		getIntegerEntry(reader, &parms, "Colors", &colors);
+		getIntegerEntry(reader, &parms, "BitsPerComponent", 
+				&bitsPerComponent);
+    }
+    if(predictor >= 10){
+		if(!undoPNGPredictor(decoded, decodedLength, columns, colors, 
+				bitsPerComponent)){
+			free(decoded);
+			return NULL;
+		}
+    }else if(predictor != 1){
+		// TIFF prediction isn't used for these streams in practice.
+		free(decoded);
+		return NULL;
+    }
+    return decoded;
+}
+
+/* Record where an object is unless a later update already has. */
+static bool setXRefEntry(MyPDFFileReader *reader, unsigned long long number, 
+			unsigned char type, unsigned long long offset, unsigned int index)
+{
+    if(number >= kMyMaxObjects)
+		return false;
+    if(number >= reader->numEntries){
+		size_t newCount = reader->numEntries ? reader->numEntries : 1024;
+		MyXRefEntry *entries;
+		
+		while(newCount <= number)
+			newCount *= 2;
+		entries = realloc(reader->entries, newCount * sizeof(MyXRefEntry));
+		if(!entries)
+			return false;
+		memset(entries + reader->numEntries, 0, 
+				(newCount - reader->numEntries) * sizeof(MyXRefEntry));
+		reader->entries = entries;
+		reader->numEntries = newCount;
+    }
+    if(!reader->entries[number].found){
+		reader->entries[number].found = true;
+		reader->entries[number].type = type;
+		reader->entries[number].offset = offset;
+		reader->entries[number].index = index;
+    }
+    if(number >= reader->size)
+		reader->size = number + 1;
+    return true;
+}
+
+/* Read a cross-reference table, up to and including its trailer 
+    keyword. */
+static bool readXRefTable(MyPDFFileReader *reader, MyPDFLexer *lexer)
+{
+    unsigned long long first, count, offset, generation, i;
+    
+    while(!skipKeyword(lexer, "trailer")){
+		if(!readInteger(lexer, &first) || !readInteger(lexer, &count))
+			return false;
+		for(i = 0; i < count; i++){
+			if(!readInteger(lexer, &offset) || 
+				!readInteger(lexer, &generation))
+				return false;
+			skipWhitespace(lexer);
+			if(lexer->p >= lexer->end || 
+				(*lexer->p != 'n' && *lexer->p != 'f'))
+				return false;
+			// Free entries aren't recorded, so that an entry a hybrid 
+			// file's table marks free can still be found in its 
+			// cross-reference stream.
+			if(*lexer->p++ == 'n' && 
+				!setXRefEntry(reader, first + i, 1, offset, 0))
+				return false;
+		}
+    }
+    return true;
+}
+
+/* Read the cross-reference stream at offset, returning its dictionary
+    in trailer if that isn't NULL. */
+static bool readXRefStream(MyPDFFileReader *reader, 
+			unsigned long long offset, MyPDFValue *trailer)
+{
+    MyPDFLexer lexer = { reader->bytes + offset, reader->bytes + reader->length };
+    MyPDFLexer ranges;
+    MyPDFValue dict, value, start, count;
+    unsigned long long number, widths[3], size, first, numEntries, i, b,
+		fields[3];
+    unsigned char *data, *p;
+    size_t length, entryLength;
+    bool succeeded = true;
+    int j, k;
+    
+    if(offset >= reader->length ||
+		!readInteger(&lexer, &number) || 
+		!parseIndirectObject(reader, offset, (size_t)number, &dict) ||
+		!pdfValueGetEntry(&dict, "W", &value) || 
+		value.type != kMyPDFValueArray)
+		return false;
+    beginContents(&value, &ranges);
+    for(j = 0; j < 3; j++){
+		if(!parseValue(&ranges, &start, 0) || !getInteger(&start, &widths[j]) ||
+			widths[j] > 8)
+			return false;
+    }
+    entryLength = (size_t)(widths[0] + widths[1] + widths[2]);
+    if(!getIntegerEntry(reader, &dict, "Size", &size) || entryLength == 0)
+		return false;
+    data = copyDecodedStream(reader, &dict, &length);
+    if(!data)
+		return false;
+    
+    // Without an Index the stream lists objects from 0 to Size - 1.
+    if(!pdfValueGetEntry(&dict, "Index", &value) || 
+		value.type != kMyPDFValueArray)
+		value.type = kMyPDFValueNone;
+    else
+		beginContents(&value, &ranges);
+    p = data;
+    for(k = 0; succeeded; k++){
+		if(value.type == kMyPDFValueNone){
+			if(k > 0)
+				break;
+			first = 0;
+			numEntries = size;
+		}else if(!parseValue(&ranges, &start, 0))
+			break;
+		else if(!parseValue(&ranges, &count, 0) || 
+			!getInteger(&start, &first) || !getInteger(&count, &numEntries)){
+			succeeded = false;
+			break;
+		}
+		for(i = 0; i < numEntries && succeeded; i++){
+			if(p + entryLength > data + length){
+				succeeded = false;
+				break;
+			}
+			for(j = 0; j < 3; j++){
+				fields[j] = 0;
+				for(b = 0; b < widths[j]; b++)
+					fields[j] = (fields[j] << 8) | *p++;
+			}
+			// A missing type field means an object in the file.
+			if(widths[0] == 0)
+				fields[0] = 1;
+			if(fields[0] == 1 || fields[0] == 2)
+				succeeded = setXRefEntry(reader, first + i, 
+						(unsigned char)fields[0], fields[1], 
+						(unsigned int)fields[2]);
+		}
+    }
+    free(data);
+    if(succeeded && trailer)
+		*trailer = dict;
+    return succeeded;
+}
+
+/* Read every cross-reference section, latest first. */
+static bool readXRefSections(MyPDFFileReader *reader, 
+			unsigned long long offset)
+{
+    MyPDFValue trailer;
+    unsigned long long previous, streamOffset, size;
+    int section;
+    
+    for(section = 0; section < kMyMaxXRefSections; section++){
+		MyPDFLexer lexer = { reader->bytes + offset, 
+				reader->bytes + reader->length };
+		bool isStream = false;
+		
+		if(offset >= reader->length)
+			return false;
+		if(skipKeyword(&lexer, "xref")){
+			if(!readXRefTable(reader, &lexer) || 
+				!parseValue(&lexer, &trailer, 0) || 
+				trailer.type != kMyPDFValueDictionary)
+				return false;
+			// A hybrid file lists the objects kept in object streams
+			// in a cross-reference stream as well.
+			if(getIntegerEntry(reader, &trailer, "XRefStm", &streamOffset) &&
+				!readXRefStream(reader, streamOffset, NULL))
+				return false;
+		}else{
+			if(!readXRefStream(reader, offset, &trailer))
+				return false;
+			isStream = true;
+		}
+		if(section == 0){
+			reader->trailer = trailer;
+			reader->xrefStream = isStream;
+			if(getIntegerEntry(reader, &trailer, "Size", &size) &&
+				size > reader->size)
+				reader->size = (size_t)size;
+		}
+		if(!getIntegerEntry(reader, &trailer, "Prev", &previous))
+			return true;
+		offset = previous;
+    }
+    return false;
+}
+
+/* Find the offset given after the last startxref keyword. */
+static bool findStartXRef(MyPDFFileReader *reader, unsigned long long *offset)
+{
+    static const char keyword[] = "startxref";
+    size_t keywordLength = sizeof(keyword) - 1;
+    const unsigned char *p, *start;
+    
+    // The keyword is within the last kilobyte or so of the file.
+    start = reader->length > 2048 ? 
+		reader->bytes + reader->length - 2048 : reader->bytes;
+    for(p = reader->bytes + reader->length - keywordLength; p >= start; p--){
+		if(memcmp(p, keyword, keywordLength) == 0){
+			MyPDFLexer lexer = { p + keywordLength, 
+					reader->bytes + reader->length };
+			return readInteger(&lexer, offset);
+		}
+    }
+    return false;
+}
+
+MyPDFFileReader *openPDFFileReader(const char *path)
+{
+    MyPDFFileReader *reader = calloc(1, sizeof(MyPDFFileReader));
+    unsigned long long offset;
+    struct stat info;
+    void *map;
+    int fd;
+    
+    if(!reader)
+		return NULL;
+    fd = open(path, O_RDONLY);
+    if(fd < 0 || fstat(fd, &info) != 0){
+		fprintf(stderr, "Can't open %s: %s\n", path, strerror(errno));
+		if(fd >= 0)
+			close(fd);
+		free(reader);
+		return NULL;
+    }
+    map = info.st_size > 0 ? 
+		mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if(map == MAP_FAILED){
+		fprintf(stderr, "Can't read %s!\n", path);
+		free(reader);
+		return NULL;
+    }
+    reader->bytes = map;
+    reader->length = info.st_size;
+    reader->objectStreams = CFDictionaryCreateMutable(NULL, 0, NULL, NULL);
+    if(!reader->objectStreams){
+		closePDFFileReader(reader);
+		return NULL;
+    }
+    if(!findStartXRef(reader, &offset) || 
+		!readXRefSections(reader, offset)){
+		fprintf(stderr, "Can't read the cross-reference information "
+				"of %s!\n", path);
+		closePDFFileReader(reader);
+		return NULL;
+    }
+    reader->xrefOffset = offset;
+    return reader;
+}
+
+static void releaseObjectStream(const void *key, const void *value, 
+			void *info)
+{
+    MyObjectStream *stream = (MyObjectStream *)value;
+    
+    free(stream->data);
+    free(stream->numbers);
+    free(stream->offsets);
+    free(stream);
+}
+
+void closePDFFileReader(MyPDFFileReader *reader)
+{
+    if(!reader)
+		return;
+    if(reader->objectStreams){
+		CFDictionaryApplyFunction(reader->objectStreams, 
+				releaseObjectStream, NULL);
+		CFRelease(reader->objectStreams);
+    }
+    munmap((void *)reader->bytes, reader->length);
+    free(reader->entries);
+    free(reader);
+}
+
+const MyPDFValue *pdfReaderGetTrailer(MyPDFFileReader *reader)
+{
+    return &reader->trailer;
+}
+
+off_t pdfReaderGetXRefOffset(MyPDFFileReader *reader)
+{
+    return reader->xrefOffset;
+}
+
+bool pdfReaderUsesXRefStream(MyPDFFileReader *reader)
+{
+    return reader->xrefStream;
+}
+
+size_t pdfReaderGetSize(MyPDFFileReader *reader)
+{
+    return reader->size;
+}
+
+/* Decode an object stream and find the objects in it. */
+static MyObjectStream *loadObjectStream(MyPDFFileReader *reader, 
+			size_t number)
+{
+    MyObjectStream *stream;
+    MyPDFValue dict;
+    MyPDFLexer lexer;
+    unsigned long long count, first, objectNumber, offset;
+    size_t i;
+    
+    // An object stream can't itself be in an object stream.
+    if(number >= reader->numEntries || reader->entries[number].type != 1 ||
+		!pdfReaderGetObject(reader, number, &dict) ||
+		!getIntegerEntry(reader, &dict, "N", &count) ||
+		!getIntegerEntry(reader, &dict, "First", &first) ||
+		count > kMyMaxObjects)
+		return NULL;
+    stream = calloc(1, sizeof(MyObjectStream));
+    if(!stream)
+		return NULL;
+    stream->data = copyDecodedStream(reader, &dict, &stream->length);
+    stream->numbers = malloc((count ? count : 1) * sizeof(size_t));
+    stream->offsets = malloc((count ? count : 1) * sizeof(size_t));
+    if(!stream->data || !stream->numbers || !stream->offsets || 
+		first > stream->length){
+		releaseObjectStream(NULL, stream, NULL);
+		return NULL;
+    }
+    // The stream begins with pairs of object numbers and offsets.
+    lexer.p = stream->data;
+    lexer.end = stream->data + first;
+    for(i = 0; i < count; i++){
+		if(!readInteger(&lexer, &objectNumber) || 
+			!readInteger(&lexer, &offset) ||
+			first + offset > stream->length){
+			releaseObjectStream(NULL, stream, NULL);
+			return NULL;
+		}
+		stream->numbers[i] = (size_t)objectNumber;
+		stream->offsets[i] = (size_t)(first + offset);
+    }
+    stream->count = (size_t)count;
+    return stream;
+}
+
+/* Stands in for an object stream while it is decoded. An object 
+    stream whose N, First or Length is in itself, or in another stream
+    that needs this one, would otherwise be decoded without end. */
+static MyObjectStream gLoadingObjectStream;
+#define kMyLoadingObjectStream	(&gLoadingObjectStream)
+
+static bool getCompressedObject(MyPDFFileReader *reader, size_t streamNumber,
+			size_t index, size_t number, MyPDFValue *value)
+{
+    MyObjectStream *stream = (MyObjectStream *)CFDictionaryGetValue(
+				reader->objectStreams, (const void *)streamNumber);
+    MyPDFLexer lexer;
+    
+    if(stream == kMyLoadingObjectStream)
+		return false;
+    if(!stream){
+		CFDictionarySetValue(reader->objectStreams, 
+				(const void *)streamNumber, kMyLoadingObjectStream);
+		stream = loadObjectStream(reader, streamNumber);
+		if(!stream){
+			CFDictionaryRemoveValue(reader->objectStreams, 
+					(const void *)streamNumber);
+			return false;
+		}
+		CFDictionarySetValue(reader->objectStreams, 
+				(const void *)streamNumber, stream);
+    }
+    // Trust the index only if it gives the right object.
+    if(index >= stream->count || stream->numbers[index] != number){
+		for(index = 0; index < stream->count; index++){
+			if(stream->numbers[index] == number)
+				break;
+		}
+		if(index == stream->count)
+			return false;
+    }
+    lexer.p = stream->data + stream->offsets[index];
+    lexer.end = stream->data + stream->length;
+    return parseValue(&lexer, value, 0);
+}
+
+bool pdfReaderGetObject(MyPDFFileReader *reader, size_t number, 
+			MyPDFValue *value)
+{
+    MyXRefEntry *entry;
+    
+    if(number >= reader->numEntries || !reader->entries[number].found)
+		return false;
+    entry = &reader->entries[number];
+    if(entry->type == 1)
+		return parseIndirectObject(reader, entry->offset, number, value);
+    return getCompressedObject(reader, (size_t)entry->offset, entry->index,
+			number, value);
+}
+
+bool pdfReaderResolve(MyPDFFileReader *reader, const MyPDFValue *value,
+			MyPDFValue *resolved)
+{
+    if(value->type != kMyPDFValueReference){
+		*resolved = *value;
+		return true;
+    }
+    return pdfReaderGetObject(reader, value->number, resolved);
+}
+
+bool pdfReaderGetInheritedEntry(MyPDFFileReader *reader, 
+			const MyPDFValue *pageDict, const char *key, MyPDFValue *value)
+{
+    MyPDFValue node = *pageDict, parent;
+    int depth;
+    
+    for(depth = 0; depth < kMyMaxNesting; depth++){
+		if(pdfValueGetEntry(&node, key, value))
+			return true;
+		if(!pdfValueGetEntry(&node, "Parent", &parent) ||
+			!pdfReaderResolve(reader, &parent, &node) ||
+			node.type != kMyPDFValueDictionary)
+			return false;
+    }
+    return false;
+}
+
+/* The pages found so far while walking the page tree. */
+typedef struct MyPageList
+{
+    MyPDFValue *pages;
+    size_t count;
+    size_t capacity;
+}MyPageList;
+
+static bool collectPages(MyPDFFileReader *reader, const MyPDFValue *node,
+			MyPageList *list, int depth)
+{
+    MyPDFValue dict, value, kids, kid;
+    MyPDFLexer lexer;
+    
+    if(node->type != kMyPDFValueReference || depth > kMyMaxNesting ||
+		!pdfReaderGetObject(reader, node->number, &dict) ||
+		dict.type != kMyPDFValueDictionary)
+		return false;
+    // Intermediate nodes have kids; pages don't.
+    if(pdfValueGetEntry(&dict, "Kids", &value)){
+		if(!pdfReaderResolve(reader, &value, &kids) || 
+			kids.type != kMyPDFValueArray)
+			return false;
+		beginContents(&kids, &lexer);
+		while(parseValue(&lexer, &kid, 0)){
+			if(!collectPages(reader, &kid, list, depth + 1))
+				return false;
+		}
+		return true;
+    }
+    // A tree with more pages than objects must have a loop in it.
+    if(list->count >= reader->numEntries)
+		return false;
+    if(list->count == list->capacity){
+		size_t newCapacity = list->capacity ? 2*list->capacity : 256;
+		MyPDFValue *pages = realloc(list->pages, 
+					newCapacity * sizeof(MyPDFValue));
+		if(!pages)
+			return false;
+		list->pages = pages;
+		list->capacity = newCapacity;
+    }
+    list->pages[list->count++] = *node;
+    return true;
+}
+
+MyPDFValue *pdfReaderCopyPages(MyPDFFileReader *reader, size_t *numPages)
+{
+    MyPDFValue value, catalog, pages;
+    MyPageList list;
+    
+    memset(&list, 0, sizeof(list));
+    if(!pdfValueGetEntry(&reader->trailer, "Root", &value) ||
+		!pdfReaderResolve(reader, &value, &catalog) ||
+		!pdfValueGetEntry(&catalog, "Pages", &pages) ||
+		!collectPages(reader, &pages, &list, 0)){
+		free(list.pages);
+		return NULL;
+    }
+    *numPages = list.count;
+    return list.pages;
+}
@@ -0,0 +1,133 @@
+/*
+*  File:    PDFFileReader.h
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef __PDFFileReader__
+#define __PDFFileReader__
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <ApplicationServices/ApplicationServices.h>
+
+/*  A PDF file reader finds the objects of a PDF file by their object 
+    numbers and returns them as the bytes they are written with, which
+    is what an incremental update needs: it can copy an object's 
+    entries exactly as they are while replacing a few, without decoding
+    anything it doesn't change. The CGPDF functions can't do this since
+    they hide which objects are indirect and what they are numbered.
+    
+    The reader follows cross-reference tables and cross-reference 
+    streams back through every earlier update, and finds objects kept
+    in object streams. Only the Flate filter, with or without PNG 
+    predictors, is supported for those streams. The file is mapped 
+    into memory rather than read. */
+typedef struct MyPDFFileReader MyPDFFileReader;
+
+typedef enum MyPDFValueType
+{
+    kMyPDFValueNone = 0,
+    kMyPDFValueNull,
+    kMyPDFValueBoolean,
+    kMyPDFValueNumber,
+    kMyPDFValueName,
+    kMyPDFValueString,
+    kMyPDFValueArray,
+    kMyPDFValueDictionary,
+    kMyPDFValueReference
+}MyPDFValueType;
+
+/* A value as it is written in the file. For a reference, number and
+    generation identify the object referred to. For the dictionary of a
+    stream object, streamData points to the start of the stream's 
+    data. The bytes stay valid until the reader is closed. */
+typedef struct MyPDFValue
+{
+    MyPDFValueType type;
+    const unsigned char *bytes;
+    size_t length;
+    size_t number;
+    size_t generation;
+    const unsigned char *streamData;
+}MyPDFValue;
+
+/* Open a PDF file and read its cross-reference information. Returns
+    NULL, having said why, if the file can't be read. */
+MyPDFFileReader *openPDFFileReader(const char *path);
+void closePDFFileReader(MyPDFFileReader *reader);
+
+/* The trailer of the latest update, which for a file ending in a 
+    cross-reference stream is that stream's dictionary. */
+const MyPDFValue *pdfReaderGetTrailer(MyPDFFileReader *reader);
+
+/* The offset of the latest cross-reference section, whether it is a 
+    stream, and one more than the highest object number in use. */
+off_t pdfReaderGetXRefOffset(MyPDFFileReader *reader);
+bool pdfReaderUsesXRefStream(MyPDFFileReader *reader);
+size_t pdfReaderGetSize(MyPDFFileReader *reader);
+
+/* Get an object by number. Returns false if there is no such object. */
+bool pdfReaderGetObject(MyPDFFileReader *reader, size_t number, 
+			MyPDFValue *value);
+
+/* Get the object a value refers to, or a copy of the value itself if
+    it isn't a reference. */
+bool pdfReaderResolve(MyPDFFileReader *reader, const MyPDFValue *value,
+			MyPDFValue *resolved);
+
+/* Return the page objects in page order as references, or NULL if the
+    page tree can't be read. The caller frees the list. */
+MyPDFValue *pdfReaderCopyPages(MyPDFFileReader *reader, size_t *numPages);
+
+/* Get an entry of a dictionary, or of a page dictionary or any of its
+    ancestors in the page tree. */
+bool pdfValueGetEntry(const MyPDFValue *dict, const char *key, 
+			MyPDFValue *value);
+bool pdfReaderGetInheritedEntry(MyPDFFileReader *reader, 
+			const MyPDFValue *pageDict, const char *key, MyPDFValue *value);
+
+/* Call a function with each key and value of a dictionary, or with
+    each element of an array. Keys are passed decoded as well as in 
+    the form they were written in. */
+typedef void (*MyPDFEntryFunction)(const char *key, const MyPDFValue *keyValue,
+			const MyPDFValue *value, void *info);
+typedef void (*MyPDFElementFunction)(const MyPDFValue *value, void *info);
+void pdfValueApplyEntries(const MyPDFValue *dict, 
+			MyPDFEntryFunction function, void *info);
+void pdfValueApplyElements(const MyPDFValue *array, 
+			MyPDFElementFunction function, void *info);
+
+#endif	// __PDFFileReader__
@@ -0,0 +1,366 @@
+/*
+*  File:    PDFObjectCopier.c
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#include "PDFObjectCopier.h"
+#include <pthread.h>
+
+/* A dictionary or stream waiting to be written. */
+typedef struct MyPendingObject
+{
+    const void *object;
+    size_t number;
+    bool isStream;
+}MyPendingObject;
+
+struct MyPDFObjectTable
+{
+    MyPDFWriter *writer;
+    // Maps each dictionary or stream to its object number.
+    CFMutableDictionaryRef objectNumbers;
+    pthread_mutex_t lock;
+};
+
+struct MyPDFObjectCopier
+{
+    MyPDFObjectTable *table;
+    // The objects this copier referred to first and has yet to write.
+    MyPendingObject *pending;
+    size_t numPending;
+    size_t pendingCapacity;
+    bool failed;
+};
+
+/* What a dictionary applier function needs. */
+typedef struct MyDictionaryWriting
+{
+    MyPDFObjectCopier *copier;
+    MyPDFBuffer *buffer;
+    const char * const *skipKeys;
+}MyDictionaryWriting;
+
+// Page-piece dictionaries hold private application data that can be
+// very large and means nothing in the new file.
+static const char * const kMyAlwaysSkippedKey = "PieceInfo";
+
+// The entries of a stream dictionary that describe how the data was
+// encoded in the source file.
+static const char * const kMyStreamEncodingKeys[] = {
+    "Length", "Filter", "DecodeParms", "DL", NULL
+};
+
+MyPDFObjectTable *createPDFObjectTable(MyPDFWriter *writer)
+{
+    MyPDFObjectTable *table = calloc(1, sizeof(MyPDFObjectTable));
+    
+    if(!table)
+		return NULL;
+    table->writer = writer;
+    // The keys are the CGPDF objects themselves, compared by address.
+    table->objectNumbers = CFDictionaryCreateMutable(NULL, 0, NULL, NULL);
+    if(!table->objectNumbers){
+		free(table);
+		return NULL;
+    }
+    pthread_mutex_init(&table->lock, NULL);
+    return table;
+}
+
+void releasePDFObjectTable(MyPDFObjectTable *table)
+{
+    if(!table)
+		return;
+    CFRelease(table->objectNumbers);
+    pthread_mutex_destroy(&table->lock);
+    free(table);
+}
+
+MyPDFObjectCopier *createPDFObjectCopier(MyPDFObjectTable *table)
+{
+    MyPDFObjectCopier *copier = calloc(1, sizeof(MyPDFObjectCopier));
+    
+    if(copier)
+		copier->table = table;
+    return copier;
+}
+
+void releasePDFObjectCopier(MyPDFObjectCopier *copier)
+{
+    if(!copier)
+		return;
+    free(copier->pending);
+    free(copier);
+}
+
+static size_t referenceObject(MyPDFObjectCopier *copier, 
+			const void *object, bool isStream)
+{
+    MyPDFObjectTable *table = copier->table;
+    const void *value;
+    size_t number;
+    
+    // Make room first so that an object is never numbered without 
+    // being pending somewhere.
+    if(copier->numPending == copier->pendingCapacity){
+		size_t newCapacity = copier->pendingCapacity ? 
+				2*copier->pendingCapacity : 64;
+		MyPendingObject *pending = realloc(copier->pending, 
+					newCapacity * sizeof(MyPendingObject));
+		if(!pending){
+			copier->failed = true;
+			return 0;
+		}
+		copier->pending = pending;
+		copier->pendingCapacity = newCapacity;
+    }
+    pthread_mutex_lock(&table->lock);
+    if(CFDictionaryGetValueIfPresent(table->objectNumbers, object, &value)){
+		pthread_mutex_unlock(&table->lock);
+		return (size_t)value;
+    }
+    number = pdfWriterNewObject(table->writer);
+    if(number)
+		CFDictionarySetValue(table->objectNumbers, object, 
+				(const void *)number);
+    pthread_mutex_unlock(&table->lock);
+    if(!number){
+		copier->failed = true;
+		return 0;
+    }
+    copier->pending[copier->numPending].object = object;
+    copier->pending[copier->numPending].number = number;
+    copier->pending[copier->numPending].isStream = isStream;
+    copier->numPending++;
+    return number;
+}
+
+size_t pdfCopierReferenceDictionary(MyPDFObjectCopier *copier, 
+			CGPDFDictionaryRef dict)
+{
+    return referenceObject(copier, dict, false);
+}
+
+size_t pdfCopierReferenceStream(MyPDFObjectCopier *copier, 
+			CGPDFStreamRef stream)
+{
+    return referenceObject(copier, stream, true);
+}
+
+static void writeArray(MyPDFObjectCopier *copier, MyPDFBuffer *buffer,
+			CGPDFArrayRef array)
+{
+    size_t i, count = CGPDFArrayGetCount(array);
+    CGPDFObjectRef object;
+    
+    pdfBufferPrintf(buffer, " [");
+    for(i = 0; i < count; i++){
+		if(CGPDFArrayGetObject(array, i, &object))
+			pdfCopierWriteObject(copier, buffer, object);
+		else
+			pdfBufferPrintf(buffer, " null");
+    }
+    pdfBufferPrintf(buffer, " ]");
+}
+
+void pdfCopierWriteObject(MyPDFObjectCopier *copier, MyPDFBuffer *buffer,
+			CGPDFObjectRef object)
+{
+    CGPDFBoolean boolean;
+    CGPDFInteger integer;
+    CGPDFReal real;
+    const char *name;
+    CGPDFStringRef string;
+    CGPDFArrayRef array;
+    CGPDFDictionaryRef dict;
+    CGPDFStreamRef stream;
+    
+    switch(CGPDFObjectGetType(object)){
+		case kCGPDFObjectTypeBoolean:
+			CGPDFObjectGetValue(object, kCGPDFObjectTypeBoolean, &boolean);
+			pdfBufferPrintf(buffer, boolean ? " true" : " false");
+			break;
+		case kCGPDFObjectTypeInteger:
+			CGPDFObjectGetValue(object, kCGPDFObjectTypeInteger, &integer);
+			pdfBufferWriteInteger(buffer, integer);
+			break;
+		case kCGPDFObjectTypeReal:
+			CGPDFObjectGetValue(object, kCGPDFObjectTypeReal, &real);
+			pdfBufferWriteReal(buffer, real);
+			break;
+		case kCGPDFObjectTypeName:
+			CGPDFObjectGetValue(object, kCGPDFObjectTypeName, &name);
+			pdfBufferWriteName(buffer, name);
+			break;
+		case kCGPDFObjectTypeString:
+			CGPDFObjectGetValue(object, kCGPDFObjectTypeString, &string);
+			pdfBufferWriteString(buffer, CGPDFStringGetBytePtr(string),
+					CGPDFStringGetLength(string));
+			break;
+		case kCGPDFObjectTypeArray:
+			CGPDFObjectGetValue(object, kCGPDFObjectTypeArray, &array);
+			writeArray(copier, buffer, array);
+			break;
+		case kCGPDFObjectTypeDictionary:
+			CGPDFObjectGetValue(object, kCGPDFObjectTypeDictionary, &dict);
+			pdfBufferWriteReference(buffer, 
+					pdfCopierReferenceDictionary(copier, dict));
+			break;
+		case kCGPDFObjectTypeStream:
+			CGPDFObjectGetValue(object, kCGPDFObjectTypeStream, &stream);
+			pdfBufferWriteReference(buffer, 
+					pdfCopierReferenceStream(copier, stream));
+			break;
+		default:
+			pdfBufferPrintf(buffer, " null");
+			break;
+    }
+}
+
+static bool isSkippedKey(const char *key, const char * const *skipKeys)
+{
+    if(strcmp(key, kMyAlwaysSkippedKey) == 0)
+		return true;
+    for(; skipKeys && *skipKeys; skipKeys++){
+		if(strcmp(key, *skipKeys) == 0)
+			return true;
+    }
+    return false;
+}
+
+static void writeDictionaryEntry(const char *key, CGPDFObjectRef object, 
+			void *info)
+{
+    MyDictionaryWriting *writing = info;
+    
+    if(isSkippedKey(key, writing->skipKeys))
+		return;
+    pdfBufferWriteName(writing->buffer, key);
+    pdfCopierWriteObject(writing->copier, writing->buffer, object);
+}
+
+void pdfCopierWriteDictionaryEntries(MyPDFObjectCopier *copier, 
+			MyPDFBuffer *buffer, CGPDFDictionaryRef dict, 
+			const char * const *skipKeys)
+{
+    MyDictionaryWriting writing = { copier, buffer, skipKeys };
+    
+    CGPDFDictionaryApplyFunction(dict, writeDictionaryEntry, &writing);
+}
+
+/* Write the Filter and DecodeParms entries for image data that is 
+    being copied still encoded with filter, which was the last filter
+    applied to it in the source file. */
+static void writeEncodedImageFilter(MyPDFObjectCopier *copier, 
+			MyPDFBuffer *buffer, CGPDFDictionaryRef dict, 
+			const char *filter)
+{
+    CGPDFDictionaryRef parms = NULL;
+    CGPDFArrayRef parmsArray;
+    size_t count;
+    
+    pdfBufferWriteName(buffer, "Filter");
+    pdfBufferWriteName(buffer, filter);
+    // With several filters there is an array of parameters, one for each.
+    if(CGPDFDictionaryGetArray(dict, "DecodeParms", &parmsArray)){
+		count = CGPDFArrayGetCount(parmsArray);
+		if(count > 0)
+			CGPDFArrayGetDictionary(parmsArray, count - 1, &parms);
+    }else
+		CGPDFDictionaryGetDictionary(dict, "DecodeParms", &parms);
+    if(parms){
+		pdfBufferWriteName(buffer, "DecodeParms");
+		pdfBufferPrintf(buffer, " <<");
+		pdfCopierWriteDictionaryEntries(copier, buffer, parms, NULL);
+		pdfBufferPrintf(buffer, " >>");
+    }
+}
+
+static bool writeStream(MyPDFObjectCopier *copier, MyPDFBuffer *buffer,
+			CGPDFStreamRef stream, size_t number)
+{
+    CGPDFDictionaryRef dict = CGPDFStreamGetDictionary(stream);
+    CGPDFDataFormat format;
+    CFDataRef data = CGPDFStreamCopyData(stream, &format);
+    
+    if(!data){
+		fprintf(stderr, "Couldn't read the data of a stream!\n");
+		return false;
+    }
+    pdfBufferBeginStream(buffer, number);
+    pdfCopierWriteDictionaryEntries(copier, buffer, dict, 
+			kMyStreamEncodingKeys);
+    if(format == CGPDFDataFormatRaw)
+		pdfBufferEndStream(buffer, CFDataGetBytePtr(data), 
+				CFDataGetLength(data), true);
+    else{
+		writeEncodedImageFilter(copier, buffer, dict, 
+				format == CGPDFDataFormatJPEGEncoded ? 
+					"DCTDecode" : "JPXDecode");
+		pdfBufferEndStream(buffer, CFDataGetBytePtr(data), 
+				CFDataGetLength(data), false);
+    }
+    CFRelease(data);
+    return true;
+}
+
+bool pdfCopierWritePendingObjects(MyPDFObjectCopier *copier, 
+			MyPDFBuffer *buffer)
+{
+    bool succeeded = !copier->failed;
+    size_t i;
+    
+    // Writing an object can add more to the list, so its length is
+    // checked each time around.
+    for(i = 0; i < copier->numPending; i++){
+		MyPendingObject pending = copier->pending[i];
+		if(pending.isStream){
+			if(!writeStream(copier, buffer, 
+					(CGPDFStreamRef)pending.object, pending.number))
+				succeeded = false;
+		}else{
+			pdfBufferBeginObject(buffer, pending.number);
+			pdfBufferPrintf(buffer, "<<");
+			pdfCopierWriteDictionaryEntries(copier, buffer, 
+					(CGPDFDictionaryRef)pending.object, NULL);
+			pdfBufferPrintf(buffer, " >>");
+			pdfBufferEndObject(buffer);
+		}
+    }
+    copier->numPending = 0;
+    copier->failed = false;
+    return succeeded;
+}
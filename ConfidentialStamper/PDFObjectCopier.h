@@ -0,0 +1,102 @@
+/*
+*  File:    PDFObjectCopier.h
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef __PDFObjectCopier__
+#define __PDFObjectCopier__
+
+#include "PDFWriter.h"
+
+/*  A PDF object copier writes objects read with the CGPDF functions
+    into the file being written by a PDF writer.
+    
+    The CGPDF functions don't say which objects were indirect in the 
+    file they were read from, so the copier writes every dictionary 
+    and stream as an indirect object of its own and every other object
+    directly. Each dictionary or stream is written once however many 
+    times it is referred to, so resources shared by many pages, such
+    as fonts, are shared in the new file too. Streams are written 
+    decoded and then compressed with the Flate filter, except for JPEG
+    and JPEG 2000 image data, which is copied still encoded.
+    
+    Referring to a dictionary or stream gives it an object number 
+    straight away, but the object itself is only written by 
+    pdfCopierWritePendingObjects, along with everything it refers to. 
+    The source document must stay open until the pending objects are 
+    written.
+    
+    Which objects have been given numbers is recorded in an object 
+    table, which any number of copiers, each used by one thread at a
+    time, can share. An object is then written only by the copier that
+    first referred to it, and every copier refers to it by the same 
+    number. */
+typedef struct MyPDFObjectTable MyPDFObjectTable;
+typedef struct MyPDFObjectCopier MyPDFObjectCopier;
+
+/* Create a table for objects written to the supplied writer. */
+MyPDFObjectTable *createPDFObjectTable(MyPDFWriter *writer);
+void releasePDFObjectTable(MyPDFObjectTable *table);
+
+MyPDFObjectCopier *createPDFObjectCopier(MyPDFObjectTable *table);
+void releasePDFObjectCopier(MyPDFObjectCopier *copier);
+
+/* Write the value of an object, preceded by a space. */
+void pdfCopierWriteObject(MyPDFObjectCopier *copier, MyPDFBuffer *buffer,
+			CGPDFObjectRef object);
+
+/* Write the keys and values of a dictionary, without the enclosing
+    << and >>, so that the caller can add entries of its own. Keys in
+    the NULL terminated skipKeys list, which may itself be NULL, are 
+    left out. */
+void pdfCopierWriteDictionaryEntries(MyPDFObjectCopier *copier, 
+			MyPDFBuffer *buffer, CGPDFDictionaryRef dict, 
+			const char * const *skipKeys);
+
+/* Return the object number under which a dictionary or stream is, or
+    will be, written. */
+size_t pdfCopierReferenceDictionary(MyPDFObjectCopier *copier, 
+			CGPDFDictionaryRef dict);
+size_t pdfCopierReferenceStream(MyPDFObjectCopier *copier, 
+			CGPDFStreamRef stream);
+
+/* Write every object that has been referred to but not yet written
+    into the buffer. Returns false if a stream's data couldn't be 
+    read. */
+bool pdfCopierWritePendingObjects(MyPDFObjectCopier *copier, 
+			MyPDFBuffer *buffer);
+
+#endif	// __PDFObjectCopier__
@@ -0,0 +1,725 @@
+/*
+*  File:    PDFWriter.c
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#include "PDFWriter.h"
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+// The size of each read and write copying the file an incremental 
+// update is appended to.
+#define kMyCopyBufferSize	(1024*1024)
+
+struct MyPDFWriter
+{
+    FILE *file;
+    char path[PATH_MAX];
+    char temporaryPath[PATH_MAX];
+    off_t position;
+    // The offset of each object, indexed by object number; 0 until the
+    // object is written.
+    off_t *offsets;
+    unsigned short *generations;	// Likewise.
+    size_t numObjects;		// Including object 0, which is never used.
+    size_t capacity;
+    bool failed;
+    // Objects numbered below this belong to the file an incremental
+    // update is appended to, and are only listed in the cross-reference
+    // section if they are written again. 1 for a new file.
+    size_t firstNewObject;
+    // The offset of the cross-reference section an incremental update
+    // follows, or -1 for a new file.
+    off_t previousXRef;
+    bool xrefStream;
+    // Trailer entries added by pdfWriterAddTrailerEntries.
+    char *trailerEntries;
+    size_t trailerEntriesLength;
+    // Guards offsets, numObjects and capacity, since object numbers
+    // can be handed out on any thread.
+    pthread_mutex_t lock;
+};
+
+/* Where an object starts within a buffer. */
+typedef struct MyPDFBufferObject
+{
+    size_t number;
+    size_t generation;
+    size_t offset;
+}MyPDFBufferObject;
+
+struct MyPDFBuffer
+{
+    unsigned char *bytes;
+    size_t length;
+    size_t capacity;
+    MyPDFBufferObject *objects;
+    size_t numObjects;
+    size_t objectCapacity;
+    bool failed;
+};
+
+/* The process's umask, which can only be read by setting it. Every 
+    file a writer creates goes through createWriterFile, so reading it
+    once, before any writer creates a file, can't affect one being 
+    created on another thread. */
+static pthread_once_t gFileModeOnce = PTHREAD_ONCE_INIT;
+static mode_t gFileMode;
+
+static void readFileMode(void)
+{
+    mode_t mask = umask(0);
+    
+    umask(mask);
+    gFileMode = 0666 & ~mask;
+}
+
+/* Create a writer and its temporary file. The temporary file is 
+    created readable only by its owner, so it is given the permissions
+    the file would have had if created directly. */
+static MyPDFWriter *createWriterFile(const char *path)
+{
+    MyPDFWriter *writer = calloc(1, sizeof(MyPDFWriter));
+    int fd;
+    
+    if(!writer)
+		return NULL;
+    strlcpy(writer->path, path, sizeof(writer->path));
+    snprintf(writer->temporaryPath, sizeof(writer->temporaryPath), 
+			"%s.XXXXXX", path);
+    pthread_once(&gFileModeOnce, readFileMode);
+    fd = mkstemp(writer->temporaryPath);
+    if(fd >= 0)
+		(void)fchmod(fd, gFileMode);
+    writer->file = (fd >= 0) ? fdopen(fd, "wb") : NULL;
+    if(!writer->file){
+		fprintf(stderr, "Couldn't create %s: %s\n", path, strerror(errno));
+		if(fd >= 0){
+			close(fd);
+			unlink(writer->temporaryPath);
+		}
+		free(writer);
+		return NULL;
+    }
+    // Object 0 heads the list of free objects.
+    writer->numObjects = writer->firstNewObject = 1;
+    writer->previousXRef = -1;
+    pthread_mutex_init(&writer->lock, NULL);
+    return writer;
+}
+
+/* Make room for objects numbered below capacity. The caller must hold
+    writer->lock. */
+static bool growObjectTable(MyPDFWriter *writer, size_t capacity)
+{
+    off_t *offsets;
+    unsigned short *generations;
+    
+    if(capacity <= writer->capacity)
+		return true;
+    offsets = realloc(writer->offsets, capacity * sizeof(off_t));
+    if(offsets)
+		writer->offsets = offsets;
+    generations = realloc(writer->generations, 
+				capacity * sizeof(unsigned short));
+    if(generations)
+		writer->generations = generations;
+    if(!offsets || !generations)
+		return false;
+    memset(offsets + writer->capacity, 0, 
+			(capacity - writer->capacity) * sizeof(off_t));
+    memset(generations + writer->capacity, 0, 
+			(capacity - writer->capacity) * sizeof(unsigned short));
+    writer->capacity = capacity;
+    return true;
+}
+
+MyPDFWriter *createPDFWriter(const char *path, 
+			int majorVersion, int minorVersion)
+{
+    MyPDFWriter *writer = createWriterFile(path);
+    
+    if(!writer)
+		return NULL;
+    // The comment of high bytes marks the file as binary.
+    writer->position = fprintf(writer->file, "%%PDF-%d.%d\n%%\xE2\xE3\xCF\xD3\n",
+				majorVersion, minorVersion);
+    return writer;
+}
+
+MyPDFWriter *createPDFUpdateWriter(const char *path, 
+			const char *originalPath, size_t firstNewObject, 
+			off_t previousXRef, bool xrefStream)
+{
+    MyPDFWriter *writer;
+    FILE *original = fopen(originalPath, "rb");
+    char *copyBuffer = malloc(kMyCopyBufferSize);
+    size_t length;
+    char lastByte = '\n';
+    
+    if(!original || !copyBuffer){
+		fprintf(stderr, "Couldn't read %s!\n", originalPath);
+		if(original)
+			fclose(original);
+		free(copyBuffer);
+		return NULL;
+    }
+    writer = createWriterFile(path);
+    if(writer){
+		writer->firstNewObject = writer->numObjects = firstNewObject;
+		writer->previousXRef = previousXRef;
+		writer->xrefStream = xrefStream;
+		if(!growObjectTable(writer, firstNewObject + 1024))
+			writer->failed = true;
+		// The original bytes are copied unchanged.
+		while(!writer->failed && 
+			(length = fread(copyBuffer, 1, kMyCopyBufferSize, original)) > 0)
+		{
+			if(fwrite(copyBuffer, 1, length, writer->file) != length)
+				writer->failed = true;
+			writer->position += length;
+			lastByte = copyBuffer[length - 1];
+		}
+		if(ferror(original))
+			writer->failed = true;
+		// The update must start on a line of its own.
+		if(lastByte != '\n' && lastByte != '\r')
+			writer->position += fprintf(writer->file, "\n");
+		if(writer->failed){
+			fprintf(stderr, "Couldn't copy %s!\n", originalPath);
+			cancelPDFWriter(writer);
+			writer = NULL;
+		}
+    }
+    fclose(original);
+    free(copyBuffer);
+    return writer;
+}
+
+void pdfWriterAddTrailerEntries(MyPDFWriter *writer, 
+			const void *entries, size_t length)
+{
+    char *trailerEntries = realloc(writer->trailerEntries, 
+				writer->trailerEntriesLength + length + 1);
+    
+    if(!trailerEntries){
+		writer->failed = true;
+		return;
+    }
+    trailerEntries[writer->trailerEntriesLength] = ' ';
+    memcpy(trailerEntries + writer->trailerEntriesLength + 1, entries, 
+			length);
+    writer->trailerEntries = trailerEntries;
+    writer->trailerEntriesLength += length + 1;
+}
+
+size_t pdfWriterNewObject(MyPDFWriter *writer)
+{
+    return pdfWriterNewObjects(writer, 1);
+}
+
+size_t pdfWriterNewObjects(MyPDFWriter *writer, size_t count)
+{
+    size_t number = 0, capacity;
+    
+    pthread_mutex_lock(&writer->lock);
+    if(writer->numObjects + count > writer->capacity){
+		capacity = writer->capacity ? 2*writer->capacity : 1024;
+		if(capacity < writer->numObjects + count)
+			capacity = writer->numObjects + count;
+		growObjectTable(writer, capacity);
+    }
+    if(writer->numObjects + count <= writer->capacity){
+		number = writer->numObjects;
+		writer->numObjects += count;
+    }else
+		writer->failed = true;
+    pthread_mutex_unlock(&writer->lock);
+    return number;
+}
+
+bool pdfWriterAppendBuffer(MyPDFWriter *writer, MyPDFBuffer *buffer)
+{
+    size_t i;
+    
+    if(buffer->failed || writer->failed ||
+		fwrite(buffer->bytes, 1, buffer->length, writer->file) != 
+			buffer->length)
+		writer->failed = true;
+    else{
+		pthread_mutex_lock(&writer->lock);
+		for(i = 0; i < buffer->numObjects; i++){
+			size_t number = buffer->objects[i].number;
+			if(number > 0 && number < writer->numObjects){
+				writer->offsets[number] = 
+					writer->position + buffer->objects[i].offset;
+				writer->generations[number] = 
+					(unsigned short)buffer->objects[i].generation;
+			}
+		}
+		pthread_mutex_unlock(&writer->lock);
+		writer->position += buffer->length;
+    }
+    buffer->length = 0;
+    buffer->numObjects = 0;
+    buffer->failed = false;
+    return !writer->failed;
+}
+
+static void closePDFWriter(MyPDFWriter *writer)
+{
+    pthread_mutex_destroy(&writer->lock);
+    free(writer->offsets);
+    free(writer->generations);
+    free(writer->trailerEntries);
+    free(writer);
+}
+
+/* Whether an object is listed in the cross-reference section. */
+static bool isListedObject(MyPDFWriter *writer, size_t number)
+{
+    if(number == 0)
+		return writer->previousXRef < 0;
+    return number >= writer->firstNewObject || writer->offsets[number];
+}
+
+/* Write the entries of the trailer that refer to other sections and
+    objects. */
+static void writeTrailerEntries(MyPDFWriter *writer, MyPDFBuffer *buffer,
+			size_t catalog, size_t info)
+{
+    if(catalog)
+		pdfBufferPrintf(buffer, " /Root %zd 0 R", catalog);
+    if(info)
+		pdfBufferPrintf(buffer, " /Info %zd 0 R", info);
+    if(writer->previousXRef >= 0)
+		pdfBufferPrintf(buffer, " /Prev %lld", 
+				(long long)writer->previousXRef);
+    if(writer->trailerEntries)
+		pdfBufferAppend(buffer, writer->trailerEntries, 
+				writer->trailerEntriesLength);
+}
+
+/* Write a cross-reference table and trailer. Listed objects with 
+    consecutive numbers share a subsection. */
+static void writeXRefTable(MyPDFWriter *writer, MyPDFBuffer *buffer,
+			size_t catalog, size_t info)
+{
+    size_t i, j;
+    
+    pdfBufferPrintf(buffer, "xref\n");
+    for(i = 0; i < writer->numObjects; i = j){
+		if(!isListedObject(writer, i)){
+			j = i + 1;
+			continue;
+		}
+		for(j = i; j < writer->numObjects && isListedObject(writer, j); j++)
+			;
+		pdfBufferPrintf(buffer, "%zd %zd\n", i, j - i);
+		// Each entry is exactly 20 bytes long, including its end of line.
+		for(; i < j; i++){
+			if(i == 0)
+				pdfBufferPrintf(buffer, "0000000000 65535 f \n");
+			else if(writer->offsets[i])
+				pdfBufferPrintf(buffer, "%010lld %05d n \n", 
+						(long long)writer->offsets[i], 
+						writer->generations[i]);
+			else{
+				// Numbers handed out but never written are free.
+				pdfBufferPrintf(buffer, "0000000000 00001 f \n");
+			}
+		}
+    }
+    pdfBufferPrintf(buffer, "trailer\n<< /Size %zd", writer->numObjects);
+    writeTrailerEntries(writer, buffer, catalog, info);
+    pdfBufferPrintf(buffer, " >>\n");
+}
+
+/* Write a cross-reference stream, which is itself the last object 
+    listed, with the trailer entries in its dictionary. Each entry is a
+    type byte, an offset as wide as the largest needs and a two byte
+    generation number. */
+static void writeXRefStream(MyPDFWriter *writer, MyPDFBuffer *buffer,
+			size_t catalog, size_t info)
+{
+    size_t number = pdfWriterNewObject(writer), i, j, k;
+    int offsetWidth = 1, entryWidth;
+    unsigned char *entries, *p;
+    
+    if(!number)
+		return;
+    writer->offsets[number] = writer->position;
+    while(offsetWidth < 8 && (writer->position >> (8*offsetWidth)) > 0)
+		offsetWidth++;
+    entryWidth = 1 + offsetWidth + 2;
+    entries = malloc(writer->numObjects * entryWidth);
+    if(!entries){
+		writer->failed = true;
+		return;
+    }
+    pdfBufferBeginStream(buffer, number);
+    pdfBufferPrintf(buffer, " /Type /XRef /Size %zd /W [1 %d 2] /Index [",
+			writer->numObjects, offsetWidth);
+    p = entries;
+    for(i = 0; i < writer->numObjects; i = j){
+		if(!isListedObject(writer, i)){
+			j = i + 1;
+			continue;
+		}
+		for(j = i; j < writer->numObjects && isListedObject(writer, j); j++){
+			off_t offset = writer->offsets[j];
+			unsigned short generation = offset ? writer->generations[j] : 
+					(j == 0 ? 65535 : 1);
+			*p++ = offset ? 1 : 0;
+			for(k = offsetWidth; k > 0; k--)
+				*p++ = (unsigned char)(offset >> (8*(k - 1)));
+			*p++ = (unsigned char)(generation >> 8);
+			*p++ = (unsigned char)generation;
+		}
+		pdfBufferPrintf(buffer, " %zd %zd", i, j - i);
+    }
+    pdfBufferPrintf(buffer, " ]");
+    writeTrailerEntries(writer, buffer, catalog, info);
+    pdfBufferEndStream(buffer, entries, p - entries, true);
+    free(entries);
+}
+
+bool finishPDFWriter(MyPDFWriter *writer, size_t catalog, size_t info)
+{
+    off_t xrefOffset = writer->position;
+    MyPDFBuffer *buffer = createPDFBuffer();
+    
+    if(!buffer){
+		cancelPDFWriter(writer);
+		return false;
+    }
+    if(writer->xrefStream)
+		writeXRefStream(writer, buffer, catalog, info);
+    else
+		writeXRefTable(writer, buffer, catalog, info);
+    pdfBufferPrintf(buffer, "startxref\n%lld\n%%%%EOF\n", 
+			(long long)xrefOffset);
+    if(buffer->failed || 
+		fwrite(buffer->bytes, 1, buffer->length, writer->file) != 
+			buffer->length)
+		writer->failed = true;
+    releasePDFBuffer(buffer);
+    
+    if(ferror(writer->file))
+		writer->failed = true;
+    if(fclose(writer->file) != 0)
+		writer->failed = true;
+    if(!writer->failed && rename(writer->temporaryPath, writer->path) != 0){
+		fprintf(stderr, "Couldn't write %s: %s\n", writer->path, 
+				strerror(errno));
+		writer->failed = true;
+    }
+    if(writer->failed){
+		unlink(writer->temporaryPath);
+		closePDFWriter(writer);
+		return false;
+    }
+    closePDFWriter(writer);
+    return true;
+}
+
+void cancelPDFWriter(MyPDFWriter *writer)
+{
+    if(!writer)
+		return;
+    fclose(writer->file);
+    unlink(writer->temporaryPath);
+    closePDFWriter(writer);
+}
+
+MyPDFBuffer *createPDFBuffer(void)
+{
+    return calloc(1, sizeof(MyPDFBuffer));
+}
+
+void releasePDFBuffer(MyPDFBuffer *buffer)
+{
+    if(!buffer)
+		return;
+    free(buffer->bytes);
+    free(buffer->objects);
+    free(buffer);
+}
+
+/* Make room for length more bytes, returning false if there isn't any. */
+static bool reserveBufferSpace(MyPDFBuffer *buffer, size_t length)
+{
+    size_t newCapacity;
+    unsigned char *bytes;
+    
+    if(buffer->failed)
+		return false;
+    if(buffer->length + length <= buffer->capacity)
+		return true;
+    newCapacity = buffer->capacity ? buffer->capacity : 4096;
+    while(newCapacity < buffer->length + length)
+		newCapacity *= 2;
+    bytes = realloc(buffer->bytes, newCapacity);
+    if(!bytes){
+		buffer->failed = true;
+		return false;
+    }
+    buffer->bytes = bytes;
+    buffer->capacity = newCapacity;
+    return true;
+}
+
+void pdfBufferAppend(MyPDFBuffer *buffer, const void *bytes, size_t length)
+{
+    if(!reserveBufferSpace(buffer, length))
+		return;
+    memcpy(buffer->bytes + buffer->length, bytes, length);
+    buffer->length += length;
+}
+
+void pdfBufferPrintf(MyPDFBuffer *buffer, const char *format, ...)
+{
+    char text[256];
+    va_list args;
+    int length;
+    
+    va_start(args, format);
+    length = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if(length < 0){
+		buffer->failed = true;
+		return;
+    }
+    if((size_t)length < sizeof(text)){
+		pdfBufferAppend(buffer, text, length);
+		return;
+    }
+    // Too long for the stack, so format straight into the buffer.
+    if(!reserveBufferSpace(buffer, length + 1))
+		return;
+    va_start(args, format);
+    vsnprintf((char *)buffer->bytes + buffer->length, length + 1, 
+			format, args);
+    va_end(args);
+    buffer->length += length;
+}
+
+void pdfBufferBeginObject(MyPDFBuffer *buffer, size_t number)
+{
+    pdfBufferBeginUpdatedObject(buffer, number, 0);
+}
+
+void pdfBufferBeginUpdatedObject(MyPDFBuffer *buffer, size_t number,
+			size_t generation)
+{
+    if(buffer->numObjects == buffer->objectCapacity){
+		size_t newCapacity = buffer->objectCapacity ? 
+				2*buffer->objectCapacity : 16;
+		MyPDFBufferObject *objects = realloc(buffer->objects, 
+					newCapacity * sizeof(MyPDFBufferObject));
+		if(!objects){
+			buffer->failed = true;
+			return;
+		}
+		buffer->objects = objects;
+		buffer->objectCapacity = newCapacity;
+    }
+    buffer->objects[buffer->numObjects].number = number;
+    buffer->objects[buffer->numObjects].generation = generation;
+    buffer->objects[buffer->numObjects].offset = buffer->length;
+    buffer->numObjects++;
+    pdfBufferPrintf(buffer, "%zd %zd obj\n", number, generation);
+}
+
+void pdfBufferEndObject(MyPDFBuffer *buffer)
+{
+    pdfBufferPrintf(buffer, "\nendobj\n");
+}
+
+void pdfBufferBeginStream(MyPDFBuffer *buffer, size_t number)
+{
+    pdfBufferBeginObject(buffer, number);
+    pdfBufferPrintf(buffer, "<<");
+}
+
+/* Compress data into the buffer with zlib, which is what the Flate 
+    filter decodes, returning the compressed length or 0 on failure. */
+static size_t appendCompressed(MyPDFBuffer *buffer, 
+			const void *data, size_t length)
+{
+    uLongf compressedLength = compressBound(length);
+    
+    if(!reserveBufferSpace(buffer, compressedLength))
+		return 0;
+    if(compress2(buffer->bytes + buffer->length, &compressedLength, 
+			data, length, Z_DEFAULT_COMPRESSION) != Z_OK)
+		return 0;
+    return compressedLength;
+}
+
+void pdfBufferEndStream(MyPDFBuffer *buffer, 
+			const void *data, size_t length, bool compress)
+{
+    size_t compressedLength = 0;
+    char header[64];
+    int headerLength;
+    
+    /*	The Length entry comes before the data, but the compressed length
+	isn't known until the data has been compressed. So the data is
+	compressed into the buffer first and then moved along to make room
+	for the end of the dictionary. */
+    if(compress && length > 0)
+		compressedLength = appendCompressed(buffer, data, length);
+    if(compressedLength){
+		headerLength = snprintf(header, sizeof(header), 
+				" /Length %zd /Filter /FlateDecode >>\nstream\n", 
+				compressedLength);
+		if(!reserveBufferSpace(buffer, compressedLength + headerLength))
+			return;
+		memmove(buffer->bytes + buffer->length + headerLength, 
+				buffer->bytes + buffer->length, compressedLength);
+		memcpy(buffer->bytes + buffer->length, header, headerLength);
+		buffer->length += headerLength + compressedLength;
+    }else{
+		pdfBufferPrintf(buffer, " /Length %zd >>\nstream\n", length);
+		pdfBufferAppend(buffer, data, length);
+    }
+    pdfBufferPrintf(buffer, "\nendstream");
+    pdfBufferEndObject(buffer);
+}
+
+/* Characters that can't appear in a name without being escaped. */
+static bool isNameDelimiter(unsigned char c)
+{
+    return c < 0x21 || c > 0x7E || strchr("()<>[]{}/%#", c) != NULL;
+}
+
+void pdfBufferWriteName(MyPDFBuffer *buffer, const char *name)
+{
+    const unsigned char *p;
+    
+    pdfBufferAppend(buffer, " /", 2);
+    for(p = (const unsigned char *)name; *p; p++){
+		if(isNameDelimiter(*p))
+			pdfBufferPrintf(buffer, "#%02X", *p);
+		else
+			pdfBufferAppend(buffer, p, 1);
+    }
+}
+
+void pdfBufferWriteString(MyPDFBuffer *buffer, 
+			const unsigned char *bytes, size_t length)
+{
+    static const char hexDigits[] = "0123456789ABCDEF";
+    size_t i;
+    
+    // Hexadecimal strings need no escaping whatever the bytes are.
+    pdfBufferAppend(buffer, " <", 2);
+    if(!reserveBufferSpace(buffer, 2*length))
+		return;
+    for(i = 0; i < length; i++){
+		buffer->bytes[buffer->length++] = hexDigits[bytes[i] >> 4];
+		buffer->bytes[buffer->length++] = hexDigits[bytes[i] & 0x0F];
+    }
+    pdfBufferAppend(buffer, ">", 1);
+}
+
+void pdfBufferWriteInteger(MyPDFBuffer *buffer, long long value)
+{
+    pdfBufferPrintf(buffer, " %lld", value);
+}
+
+// The largest real written; larger ones are written as this.
+#define kMyMaxPDFReal	3.403e38
+
+size_t pdfFormatReal(double value, char text[kMyPDFRealSize])
+{
+    int length;
+    
+    // PDF has no exponents, so reals are written in fixed point with 
+    // trailing zeros removed. Clamping them keeps even the largest 
+    // within kMyPDFRealSize.
+    if(!isfinite(value))
+		value = 0;
+    else if(value > kMyMaxPDFReal)
+		value = kMyMaxPDFReal;
+    else if(value < -kMyMaxPDFReal)
+		value = -kMyMaxPDFReal;
+    length = snprintf(text, kMyPDFRealSize, "%.6f", value);
+    if(length <= 0 || length >= kMyPDFRealSize){
+		strlcpy(text, "0", kMyPDFRealSize);
+		return 1;
+    }
+    while(length > 1 && text[length - 1] == '0')
+		length--;
+    if(text[length - 1] == '.')
+		length--;
+    if(length == 2 && strncmp(text, "-0", 2) == 0){
+		text[0] = '0';
+		length = 1;
+    }
+    text[length] = 0;
+    return length;
+}
+
+void pdfBufferWriteReal(MyPDFBuffer *buffer, double value)
+{
+    char text[kMyPDFRealSize];
+    size_t length = pdfFormatReal(value, text);
+    
+    pdfBufferAppend(buffer, " ", 1);
+    pdfBufferAppend(buffer, text, length);
+}
+
+void pdfBufferWriteReference(MyPDFBuffer *buffer, size_t number)
+{
+    pdfBufferPrintf(buffer, " %zd 0 R", number);
+}
+
+void pdfBufferWriteRect(MyPDFBuffer *buffer, CGRect rect)
+{
+    pdfBufferPrintf(buffer, " [");
+    pdfBufferWriteReal(buffer, rect.origin.x);
+    pdfBufferWriteReal(buffer, rect.origin.y);
+    pdfBufferWriteReal(buffer, rect.origin.x + rect.size.width);
+    pdfBufferWriteReal(buffer, rect.origin.y + rect.size.height);
+    pdfBufferPrintf(buffer, " ]");
+}
@@ -0,0 +1,145 @@
+/*
+*  File:    PDFWriter.h
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef __PDFWriter__
+#define __PDFWriter__
+
+#include <stdio.h>
+#include <ApplicationServices/ApplicationServices.h>
+
+/*  A PDF writer writes the objects of a PDF file and, once they are all
+    written, the cross-reference table and trailer that locate them.
+    
+    Objects are put together in PDF buffers, each holding any number of
+    complete objects, and a buffer is then appended to the file as a 
+    whole. Object numbers are handed out by the writer rather than 
+    taken from the order objects are written in, so an object can 
+    refer to another before that one is written. The file is written 
+    under a temporary name and only takes its own name once finished. */
+typedef struct MyPDFWriter MyPDFWriter;
+
+/* Start writing a PDF file with the supplied version at path. Returns
+    NULL if the file couldn't be created. */
+MyPDFWriter *createPDFWriter(const char *path, 
+			int majorVersion, int minorVersion);
+
+/* Start writing an incremental update of the PDF file at originalPath
+    to path: a copy of the original file followed by new objects and 
+    new versions of existing ones. Objects new to the file are numbered
+    from firstNewObject, the original trailer's Size, and the update's
+    cross-reference section refers back to the one at previousXRef. 
+    Files whose last section is a cross-reference stream get one as 
+    well. */
+MyPDFWriter *createPDFUpdateWriter(const char *path, 
+			const char *originalPath, size_t firstNewObject, 
+			off_t previousXRef, bool xrefStream);
+
+/* Add entries, written as they are, to the trailer. An update uses 
+    this to carry over the original file's Root, Info and ID. */
+void pdfWriterAddTrailerEntries(MyPDFWriter *writer, 
+			const void *entries, size_t length);
+
+/* Return a new object number, or 0 if there is no memory for another
+    object. Numbers may be handed out on any thread, but only one 
+    thread at a time may append buffers or finish the file. */
+size_t pdfWriterNewObject(MyPDFWriter *writer);
+
+/* Return the first of count consecutive new object numbers, or 0 if
+    there is no memory for them. */
+size_t pdfWriterNewObjects(MyPDFWriter *writer, size_t count);
+
+/* Write the cross-reference table and a trailer naming the supplied 
+    catalog and document information objects, either of which may be 0
+    to leave it out, then close the file and give it its name.
+    The writer is released whether or not this succeeds. Returns false
+    if anything couldn't be written. */
+bool finishPDFWriter(MyPDFWriter *writer, size_t catalog, size_t info);
+
+/* Abandon the file, removing anything written, and release the writer. */
+void cancelPDFWriter(MyPDFWriter *writer);
+
+/* A PDF buffer collects complete objects in memory. */
+typedef struct MyPDFBuffer MyPDFBuffer;
+
+MyPDFBuffer *createPDFBuffer(void);
+void releasePDFBuffer(MyPDFBuffer *buffer);
+
+/* Append the objects in a buffer to the file and empty the buffer.
+    Returns false if the buffer couldn't be filled or written. */
+bool pdfWriterAppendBuffer(MyPDFWriter *writer, MyPDFBuffer *buffer);
+
+/* Begin and end an object. Everything written in between is the 
+    object's value. */
+void pdfBufferBeginObject(MyPDFBuffer *buffer, size_t number);
+/* Begin a new version of an object of the file being updated. */
+void pdfBufferBeginUpdatedObject(MyPDFBuffer *buffer, size_t number,
+			size_t generation);
+void pdfBufferEndObject(MyPDFBuffer *buffer);
+
+/* Begin a stream object and its dictionary, whose entries other than
+    Length and Filter are written next. pdfBufferEndStream finishes 
+    the dictionary and writes the stream's data, compressed with the 
+    Flate filter if compress is true, and ends the object. */
+void pdfBufferBeginStream(MyPDFBuffer *buffer, size_t number);
+void pdfBufferEndStream(MyPDFBuffer *buffer, 
+			const void *data, size_t length, bool compress);
+
+/* Write text exactly as formatted. */
+void pdfBufferPrintf(MyPDFBuffer *buffer, const char *format, ...);
+
+/* Write one PDF token, preceded by a space so that tokens never run 
+    together. */
+void pdfBufferWriteName(MyPDFBuffer *buffer, const char *name);
+void pdfBufferWriteString(MyPDFBuffer *buffer, 
+			const unsigned char *bytes, size_t length);
+void pdfBufferWriteInteger(MyPDFBuffer *buffer, long long value);
+void pdfBufferWriteReal(MyPDFBuffer *buffer, double value);
+void pdfBufferWriteReference(MyPDFBuffer *buffer, size_t number);
+void pdfBufferWriteRect(MyPDFBuffer *buffer, CGRect rect);
+
+/* Format a real as pdfBufferWriteReal does, without the space, for 
+    data such as content streams that is put together elsewhere. Reals
+    too large for PDF are clamped and those that aren't finite written
+    as 0. Returns the length of the text, which is NUL terminated. */
+#define kMyPDFRealSize	64
+size_t pdfFormatReal(double value, char text[kMyPDFRealSize]);
+
+/* Append bytes as they are. */
+void pdfBufferAppend(MyPDFBuffer *buffer, const void *bytes, size_t length);
+
+#endif	// __PDFWriter__
@@ -37,10 +37,49 @@
 */
 
 #include <stdio.h>
+#include <math.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <ApplicationServices/ApplicationServices.h>
+#include "PDFObjectCopier.h"
+#include "PDFFileReader.h"
+
+// The name each page's resources give the stamp, with a number added
+// if the page already has an XObject of that name.
+#define kMyStampName		"CSStamp"
+#define kMyStampNameSize	32
+
+// How many stamped pages each worker may have waiting to be written.
+#define kMyPagesAheadPerWorker	4
 
 static void usage(const char *name){
-    fprintf(stderr, "Usage: %s [inputfile] \n", name);
+    fprintf(stderr, "Usage: %s [-a] [-j workers] [-s pages] [inputfile] \n", 
+			name);
+    fprintf(stderr, "       %s [-a] [-j workers] [-s pages] -d socket\n", 
+			name);
+    fprintf(stderr, "    -a           append the stamp to the input as an "
+			"incremental update,\n"
+			"                 leaving the original bytes unchanged\n");
+    fprintf(stderr, "    -j workers   stamp pages on this many threads "
+			"(0 uses one per processor)\n");
+    fprintf(stderr, "    -s pages     reopen the input every this many "
+			"pages, so that memory\n"
+			"                 use doesn't grow with the length of the "
+			"document\n");
+    fprintf(stderr, "    -d socket    run as a daemon stamping the files "
+			"named by connections\n"
+			"                 to this Unix socket, running as many "
+			"jobs at once as\n"
+			"                 there are workers (one per processor "
+			"unless -j is given);\n"
+			"                 only the same user may connect\n");
 }
 
 /* This is a data type useful for passing around a PDF document
@@ -61,35 +100,20 @@ static CFURLRef createURL(const char *path)
 }
 
 
-/* For the supplied URL and media box, create a PDF context
-that creates a PDF file at that URL and uses supplied rect
-as its document media box. */
-CGContextRef myCreatePDFContext(CFURLRef url, CGRect mediaBox)
-{
-    CGContextRef pdfContext = NULL;
-    CFMutableDictionaryRef dict = CFDictionaryCreateMutable(
-				kCFAllocatorDefault, 0,
-				&kCFTypeDictionaryKeyCallBacks, 
-				&kCFTypeDictionaryValueCallBacks);
-    // Add some creator information to the generated PDF file.
-    if(dict){
-		CFDictionarySetValue(dict, kCGPDFContextCreator, 
-					CFSTR("PDF Stamper Application"));
-		pdfContext = CGPDFContextCreateWithURL(url, &mediaBox, dict);
-		CFRelease(dict);
-    }
-    return pdfContext;
-}
-
 /* For a URL corresponding to an existing PDF document on disk,
 create a CGPDFDocumentRef and obtain the media box of the first
-page. */
+page, or an empty rect if the document has no pages. */
 MyPDFData myCreatePDFSourceDocument(CFURLRef url)
 {
     MyPDFData myPDFData;
+    CGPDFPageRef page;
+    
     myPDFData.pdfDoc = CGPDFDocumentCreateWithURL(url);
+    myPDFData.mediaRect = CGRectZero;
     if(myPDFData.pdfDoc){
-		myPDFData.mediaRect = CGPDFPageGetBoxRect(myPDFData.pdfDoc, kCGPDFMediaBox);
+		page = CGPDFDocumentGetPage(myPDFData.pdfDoc, 1);
+		if(page)
+			myPDFData.mediaRect = CGPDFPageGetBoxRect(page, kCGPDFMediaBox);
 		// Make the media rect origin at 0,0. 
 		myPDFData.mediaRect.origin.x = 
 		myPDFData.mediaRect.origin.y = 0.;
@@ -97,110 +121,1442 @@ MyPDFData myCreatePDFSourceDocument(CFURLRef url)
     return myPDFData;
 }
 
-/* Draw the source PDF document into the context and then draw the stamp PDF document
-on top of it. When drawing the stamp on top, place it along the diagonal from the lower
-left corner to the upper right corner and center its media rect to the center of that
-diagonal. */
-void StampWithPDFDocument(CGContextRef context, 
-			CGPDFDocumentRef sourcePDFDoc, 
-			CGPDFDocumentRef stampFileDoc, CGRect stampMediaRect)
+/* Look up an attribute of a page that may be inherited from the 
+page tree above it. */
+static bool getInheritedObject(CGPDFDictionaryRef pageDict, 
+			const char *key, CGPDFObjectRef *value)
+{
+    int depth;
+    
+    // Give up after a generous depth in case the tree has a loop in it.
+    for(depth = 0; depth < 64; depth++){
+		if(CGPDFDictionaryGetObject(pageDict, key, value))
+			return true;
+		if(!CGPDFDictionaryGetDictionary(pageDict, "Parent", &pageDict))
+			break;
+    }
+    return false;
+}
+
+/* Append the decoded data of a content stream to contents. */
+static bool appendStreamData(CFMutableDataRef contents, 
+			CGPDFStreamRef stream)
+{
+    CGPDFDataFormat format;
+    CFDataRef data = CGPDFStreamCopyData(stream, &format);
+    
+    if(!data)
+		return false;
+    CFDataAppendBytes(contents, CFDataGetBytePtr(data), 
+			CFDataGetLength(data));
+    // A page's content streams divide between tokens, so keep them
+    // apart when joining them.
+    CFDataAppendBytes(contents, (const UInt8 *)"\n", 1);
+    CFRelease(data);
+    return true;
+}
+
+/* Return the decoded contents of a page, whose Contents entry may be
+a single stream or an array of them, joined into one. */
+static CFMutableDataRef copyPageContents(CGPDFDictionaryRef pageDict)
+{
+    CFMutableDataRef contents = CFDataCreateMutable(NULL, 0);
+    CGPDFStreamRef stream;
+    CGPDFArrayRef array;
+    size_t i, count;
+    bool succeeded = true;
+    
+    if(!contents)
+		return NULL;
+    if(CGPDFDictionaryGetStream(pageDict, "Contents", &stream))
+		succeeded = appendStreamData(contents, stream);
+    else if(CGPDFDictionaryGetArray(pageDict, "Contents", &array)){
+		count = CGPDFArrayGetCount(array);
+		for(i = 0; succeeded && i < count; i++){
+			if(CGPDFArrayGetStream(array, i, &stream))
+				succeeded = appendStreamData(contents, stream);
+		}
+    }
+    if(!succeeded){
+		CFRelease(contents);
+		return NULL;
+    }
+    return contents;
+}
+
+/* The stamp as it is shared by every page of the new document. */
+typedef struct MyStamp
+{
+    size_t form;		// The Form XObject drawing the stamp.
+    size_t saveState;	// A content stream saving the graphics state.
+    CGRect mediaRect;
+}MyStamp;
+
+/* Write the first page of the stamp document as a Form XObject, so
+that every page can draw it without its contents being repeated. 
+Returns false if the stamp page couldn't be read. */
+static bool writeStampForm(MyPDFWriter *writer, MyPDFObjectCopier *copier,
+			MyPDFBuffer *buffer, CGPDFDocumentRef stampFileDoc, 
+			MyStamp *stamp)
+{
+    CGPDFPageRef page = CGPDFDocumentGetPage(stampFileDoc, 1);
+    CGPDFDictionaryRef pageDict;
+    CGPDFObjectRef object;
+    CFMutableDataRef contents;
+    
+    if(!page)
+		return false;
+    pageDict = CGPDFPageGetDictionary(page);
+    contents = copyPageContents(pageDict);
+    if(!contents)
+		return false;
+    stamp->mediaRect = CGPDFPageGetBoxRect(page, kCGPDFMediaBox);
+    stamp->form = pdfWriterNewObject(writer);
+    pdfBufferBeginStream(buffer, stamp->form);
+    pdfBufferPrintf(buffer, " /Type /XObject /Subtype /Form /BBox");
+    pdfBufferWriteRect(buffer, stamp->mediaRect);
+    if(getInheritedObject(pageDict, "Resources", &object)){
+		pdfBufferWriteName(buffer, "Resources");
+		pdfCopierWriteObject(copier, buffer, object);
+    }
+    // A transparency group on the page belongs to the form instead.
+    if(CGPDFDictionaryGetObject(pageDict, "Group", &object)){
+		pdfBufferWriteName(buffer, "Group");
+		pdfCopierWriteObject(copier, buffer, object);
+    }
+    pdfBufferEndStream(buffer, CFDataGetBytePtr(contents), 
+			CFDataGetLength(contents), true);
+    CFRelease(contents);
+    
+    // Each page's own contents are bracketed by a save and a restore 
+    // of the graphics state, so that nothing they leave in effect 
+    // changes where the stamp is drawn.
+    stamp->saveState = pdfWriterNewObject(writer);
+    pdfBufferBeginStream(buffer, stamp->saveState);
+    pdfBufferEndStream(buffer, "q\n", 2, false);
+    return pdfCopierWritePendingObjects(copier, buffer);
+}
+
+/* Compute the transform that places the stamp along the diagonal from
+the lower left corner to the upper right corner of the page and 
+centers its media rect on the center of that diagonal. */
+static CGAffineTransform stampTransform(CGRect pageRect, CGRect stampRect)
+{
+    CGAffineTransform transform;
+    
+    // Translate to center of destination rect, that is the center of 
+    // the media box of content to draw on top of.
+    transform = CGAffineTransformMakeTranslation(
+			CGRectGetMidX(pageRect), CGRectGetMidY(pageRect));
+    // Rotate by an amount so that drawn content goes along a diagonal
+    // axis across the page.
+    // A page with no area leaves the stamp unrotated rather than 
+    // rotated by NaN.
+    transform = CGAffineTransformRotate(transform, 
+			atan2(pageRect.size.height, pageRect.size.width));
+    // Move the origin so that the media box of the PDF to stamp
+    // is centered around center point of destination.
+    return CGAffineTransformTranslate(transform, 
+			-CGRectGetMidX(stampRect), -CGRectGetMidY(stampRect));
+}
+
+/* The stamp transforms for the last few page geometries seen, so that
+the pages of a document, which mostly come in a handful of sizes, 
+share them. A cache is for one stamp and one thread. */
+#define kMyCachedTransforms	8
+typedef struct MyTransformCache
+{
+    CGRect pageRects[kMyCachedTransforms];
+    CGAffineTransform transforms[kMyCachedTransforms];
+    size_t count;
+    size_t next;	// The entry to replace when the cache is full.
+}MyTransformCache;
+
+static CGAffineTransform cachedStampTransform(MyTransformCache *cache,
+			CGRect pageRect, CGRect stampRect)
+{
+    size_t i;
+    
+    for(i = 0; i < cache->count; i++){
+		if(CGRectEqualToRect(cache->pageRects[i], pageRect))
+			return cache->transforms[i];
+    }
+    i = cache->next;
+    cache->next = (cache->next + 1) % kMyCachedTransforms;
+    if(cache->count < kMyCachedTransforms)
+		cache->count++;
+    cache->pageRects[i] = pageRect;
+    cache->transforms[i] = stampTransform(pageRect, stampRect);
+    return cache->transforms[i];
+}
+
+/* Choose the name the page's resources give the stamp, one the page
+doesn't already use for an XObject of its own. */
+static void chooseStampName(CGPDFDictionaryRef xobjects, 
+			char name[kMyStampNameSize])
+{
+    CGPDFObjectRef object;
+    int i;
+    
+    strlcpy(name, kMyStampName, kMyStampNameSize);
+    for(i = 1; xobjects && 
+			CGPDFDictionaryGetObject(xobjects, name, &object); i++)
+		snprintf(name, kMyStampNameSize, "%s%d", kMyStampName, i);
+}
+
+/* Write the content stream that restores the graphics state left by
+the page's contents and draws the stamp with the supplied transform. */
+static void writeStampInvocation(MyPDFBuffer *buffer, size_t number,
+			CGAffineTransform transform, const char *stampName)
+{
+    const double operands[6] = {
+		transform.a, transform.b, transform.c, transform.d,
+		transform.tx, transform.ty
+    };
+    char text[6*kMyPDFRealSize + kMyStampNameSize + 32];
+    size_t i, length;
+    
+    // Each operand, however large, takes at most kMyPDFRealSize - 1 
+    // characters and its space, so the text always fits.
+    strlcpy(text, "Q q", sizeof(text));
+    length = strlen(text);
+    for(i = 0; i < 6; i++){
+		text[length++] = ' ';
+		length += pdfFormatReal(operands[i], text + length);
+    }
+    length += snprintf(text + length, sizeof(text) - length, 
+			" cm /%s Do Q\n", stampName);
+    pdfBufferBeginStream(buffer, number);
+    pdfBufferEndStream(buffer, text, length, false);
+}
+
+/* Write a page of the source document with the stamp drawn on top of
+it, along with everything the page refers to that hasn't already been
+written. The page keeps its own contents and resources; the stamp is
+added to its resources and drawn by a small content stream of its own
+after the page's. */
+static bool writeStampedPage(MyPDFWriter *writer, 
+			MyPDFObjectCopier *copier, MyPDFBuffer *buffer, 
+			CGPDFPageRef page, size_t pageObject, size_t pagesObject,
+			const MyStamp *stamp, MyTransformCache *transforms)
 {
-    CGRect pageRect;
-    float angle;
-    size_t i, numPages = CGPDFDocumentGetNumberOfPages(sourcePDFDoc);
+    static const char * const resourceSkipKeys[] = { "XObject", NULL };
+    // Page attributes other than the inheritable ones that affect how
+    // the page looks or is printed.
+    static const char * const copiedKeys[] = { 
+		"BleedBox", "TrimBox", "ArtBox", "Group", "UserUnit", NULL 
+    };
+    CGPDFDictionaryRef pageDict = CGPDFPageGetDictionary(page);
+    CGPDFDictionaryRef resources = NULL, xobjects = NULL;
+    CGPDFObjectRef object;
+    CGPDFStreamRef stream;
+    CGPDFArrayRef array;
+    CGRect mediaRect = CGPDFPageGetBoxRect(page, kCGPDFMediaBox);
+    CGRect cropRect = CGPDFPageGetBoxRect(page, kCGPDFCropBox);
+    int rotation = CGPDFPageGetRotationAngle(page);
+    size_t i, count, stampInvocation = pdfWriterNewObject(writer);
+    const char * const *key;
+    char stampName[kMyStampNameSize];
     
-    // Loop over document pages and stamp each one appropriately.
-    for(i = 1 ; i <= numPages ; i++)
+    if(getInheritedObject(pageDict, "Resources", &object) &&
+		CGPDFObjectGetValue(object, kCGPDFObjectTypeDictionary, &resources))
+		CGPDFDictionaryGetDictionary(resources, "XObject", &xobjects);
+    chooseStampName(xobjects, stampName);
+    
+    pdfBufferBeginObject(buffer, pageObject);
+    pdfBufferPrintf(buffer, "<< /Type /Page /Parent %zd 0 R /MediaBox", 
+			pagesObject);
+    pdfBufferWriteRect(buffer, mediaRect);
+    if(!CGRectEqualToRect(cropRect, mediaRect)){
+		pdfBufferWriteName(buffer, "CropBox");
+		pdfBufferWriteRect(buffer, cropRect);
+    }
+    if(rotation){
+		pdfBufferWriteName(buffer, "Rotate");
+		pdfBufferWriteInteger(buffer, rotation);
+    }
+    for(key = copiedKeys; *key; key++){
+		if(CGPDFDictionaryGetObject(pageDict, *key, &object)){
+			pdfBufferWriteName(buffer, *key);
+			pdfCopierWriteObject(copier, buffer, object);
+		}
+    }
+    
+    pdfBufferPrintf(buffer, " /Resources <<");
+    if(resources)
+		pdfCopierWriteDictionaryEntries(copier, buffer, resources, 
+				resourceSkipKeys);
+    pdfBufferPrintf(buffer, " /XObject <<");
+    if(xobjects)
+		pdfCopierWriteDictionaryEntries(copier, buffer, xobjects, NULL);
+    pdfBufferWriteName(buffer, stampName);
+    pdfBufferWriteReference(buffer, stamp->form);
+    pdfBufferPrintf(buffer, " >> >>");
+    
+    pdfBufferPrintf(buffer, " /Contents [");
+    pdfBufferWriteReference(buffer, stamp->saveState);
+    if(CGPDFDictionaryGetStream(pageDict, "Contents", &stream))
+		pdfBufferWriteReference(buffer, 
+				pdfCopierReferenceStream(copier, stream));
+    else if(CGPDFDictionaryGetArray(pageDict, "Contents", &array)){
+		count = CGPDFArrayGetCount(array);
+		for(i = 0; i < count; i++){
+			if(CGPDFArrayGetStream(array, i, &stream))
+				pdfBufferWriteReference(buffer, 
+						pdfCopierReferenceStream(copier, stream));
+		}
+    }
+    pdfBufferWriteReference(buffer, stampInvocation);
+    pdfBufferPrintf(buffer, " ] >>");
+    pdfBufferEndObject(buffer);
+    
+    writeStampInvocation(buffer, stampInvocation, 
+			cachedStampTransform(transforms, mediaRect, stamp->mediaRect), 
+			stampName);
+    return pdfCopierWritePendingObjects(copier, buffer);
+}
+
+/* This is the state shared by the workers stamping the pages of one 
+document. Workers take the next unstamped page under the lock and 
+stamp it into a buffer of its own; then, still under the lock, every
+stamped page whose predecessors have all been written is appended to
+the file. Pages are therefore written in order whatever the number of
+workers, and no worker runs more than maxPagesAhead pages ahead of the
+writing so that only that many stamped pages are ever held in memory. */
+typedef struct MyStampJob
+{
+    MyPDFWriter *writer;
+    MyPDFObjectTable *objects;	// For the current window.
+    CGPDFDocumentRef sourcePDFDoc;
+    const MyStamp *stamp;
+    size_t pagesObject;
+    size_t firstPageObject;	// Pages are numbered consecutively.
+    size_t numPages;
+    size_t windowEnd;		// The pages being stamped end here.
+    // Stamped pages waiting to be written, NULL until stamped. Page i
+    // waits in pageBuffers[i % maxPagesAhead].
+    MyPDFBuffer **pageBuffers;
+    size_t nextPageToStamp;	// Page indexes, not numbers.
+    size_t nextPageToWrite;
+    size_t maxPagesAhead;
+    bool failed;
+    pthread_mutex_t lock;
+    pthread_cond_t pageWritten;
+}MyStampJob;
+
+/* Write every stamped page that follows the last page written, 
+stopping at the first page still being stamped. The caller must hold
+job->lock. */
+static void writeStampedPages(MyStampJob *job)
+{
+    while(!job->failed && job->nextPageToWrite < job->windowEnd &&
+		job->pageBuffers[job->nextPageToWrite % job->maxPagesAhead])
     {
-		// Use the page rectangle of each page from the source to compute
-		// the destination media box for each page and the location of
-		// the stamp.
-		CGRect pageRect = CGPDFDocumentGetMediaBox(sourcePDFDoc, i);
-		CGContextBeginPage(context, &pageRect);
-		CGContextSaveGState(context);
-			// Clip to the media box of the page.
-			CGContextClipToRect(context, pageRect);	    
-			// First draw the content of the source document.
-			CGContextDrawPDFDocument(context, pageRect, sourcePDFDoc, i);
-			// Translate to center of destination rect, that is the center of 
-			// the media box of content to draw on top of.
-			CGContextTranslateCTM(context, 
-				pageRect.size.width/2, pageRect.size.height/2);
-			// Compute angle of the diagonal across the destination page.
-			angle = atan(pageRect.size.height/pageRect.size.width);
-			// Rotate by an amount so that drawn content goes along a diagonal
-			// axis across the page.
-			CGContextRotateCTM(context, angle);
-			// Move the origin so that the media box of the PDF to stamp
-			// is centered around center point of destination.
-			CGContextTranslateCTM(context, 
-			-stampMediaRect.size.width/2, 
-			-stampMediaRect.size.height/2);
-			// Now draw the document to stamp with on top of original content.
-			CGContextDrawPDFDocument(context, stampMediaRect, 
-					stampFileDoc, 1);
-		CGContextRestoreGState(context);
-		CGContextEndPage(context);
+		size_t slot = job->nextPageToWrite % job->maxPagesAhead;
+		MyPDFBuffer *buffer = job->pageBuffers[slot];
+		if(!pdfWriterAppendBuffer(job->writer, buffer)){
+			fprintf(stderr, "Can't write page %zd!\n", 
+					job->nextPageToWrite + 1);
+			job->failed = true;
+		}
+		releasePDFBuffer(buffer);
+		job->pageBuffers[slot] = NULL;
+		job->nextPageToWrite++;
     }
+    pthread_cond_broadcast(&job->pageWritten);
 }
 
-/*	From an input PDF document and a PDF document whose contents you
-    want to draw on top of the other, create a new PDF document
-    containing all the pages of the input document with the first page
-    of the "stamping" overlayed. 
+/* The body of each worker thread. With a single worker this is called
+directly on the main thread. */
+static void *stampPagesWorker(void *info)
+{
+    MyStampJob *job = (MyStampJob *)info;
+    MyPDFObjectCopier *copier = createPDFObjectCopier(job->objects);
+    MyTransformCache transforms;
+    
+    memset(&transforms, 0, sizeof(transforms));
+    for(;;){
+		MyPDFBuffer *buffer;
+		CGPDFPageRef page;
+		size_t index;
+		bool stamped;
+		
+		pthread_mutex_lock(&job->lock);
+		if(!copier)
+			job->failed = true;
+		// Wait while this worker is too far ahead of the writing.
+		while(!job->failed && job->nextPageToStamp < job->windowEnd &&
+			job->nextPageToStamp >= job->nextPageToWrite + job->maxPagesAhead)
+			pthread_cond_wait(&job->pageWritten, &job->lock);
+		// Stop taking pages once all in the window have been handed out
+		// or once any page has failed.
+		if(job->failed || job->nextPageToStamp >= job->windowEnd){
+			pthread_mutex_unlock(&job->lock);
+			break;
+		}
+		index = job->nextPageToStamp++;
+		pthread_mutex_unlock(&job->lock);
+		
+		buffer = createPDFBuffer();
+		page = CGPDFDocumentGetPage(job->sourcePDFDoc, index + 1);
+		stamped = buffer && page && writeStampedPage(job->writer, copier, 
+				buffer, page, job->firstPageObject + index, job->pagesObject, 
+				job->stamp, &transforms);
+		
+		pthread_mutex_lock(&job->lock);
+		if(stamped){
+			job->pageBuffers[index % job->maxPagesAhead] = buffer;
+			writeStampedPages(job);
+		}else{
+			fprintf(stderr, "Can't stamp page %zd!\n", index + 1);
+			releasePDFBuffer(buffer);
+			job->failed = true;
+			pthread_cond_broadcast(&job->pageWritten);
+		}
+		pthread_mutex_unlock(&job->lock);
+    }
+    releasePDFObjectCopier(copier);
+    return NULL;
+}
+
+/* Stamp the pages of the job's window on numWorkers threads, the 
+calling thread among them. Returns the number of threads used. */
+static int stampWindow(MyStampJob *job, int numWorkers)
+{
+    pthread_t *workers = NULL;
+    int numStarted = 0, i;
+    
+    if(!job->failed && numWorkers > 1)
+		workers = malloc(numWorkers * sizeof(pthread_t));
+    if(workers){
+		for(i = 0; i < numWorkers; i++){
+			if(pthread_create(&workers[numStarted], NULL, 
+					stampPagesWorker, job) == 0)
+				numStarted++;
+			else
+				fprintf(stderr, "Couldn't start worker thread #%d!\n", i);
+		}
+		for(i = 0; i < numStarted; i++)
+			pthread_join(workers[i], NULL);
+		free(workers);
+    }
+    // Stamp on this thread when running serially or to pick up any 
+    // pages left over because no worker thread could be started.
+    if(!job->failed)
+		stampPagesWorker(job);
+    return numStarted ? numStarted : 1;
+}
+
+/* Write the pages of the source PDF document with the stamp PDF 
+document drawn on top of each. The stamp is written once, as a Form 
+XObject, and each page draws it placed along the diagonal from the 
+lower left corner to the upper right corner with its media rect 
+centered on the center of that diagonal. Pages are stamped on 
+numWorkers threads. Returns the object number of the page tree, or 0
+if the pages couldn't be written.
+
+Each page is written out, and its memory released, as soon as it and
+the pages before it are stamped, so the pages held in memory are only 
+those being stamped or waiting on an earlier page: at most 
+kMyPagesAheadPerWorker per worker. What does grow with the document
+is the cross-reference table, which costs 10 bytes per object 
+written, and the objects that the source document has parsed and that
+the copier has written, which are remembered so that shared resources
+such as fonts are written once. If pagesPerWindow isn't 0, those are
+forgotten after every pagesPerWindow pages by stamping each window 
+from its own copy of the source document, opened from sourceURL, so 
+memory is then bounded by the cross-
+reference table plus one window of pages, whatever the length of the 
+document. The price is that a resource shared by pages in different
+windows is written once in each. */
+size_t StampWithPDFDocument(MyPDFWriter *writer, 
+			CGPDFDocumentRef sourcePDFDoc, CFURLRef sourceURL,
+			CGPDFDocumentRef stampFileDoc, int numWorkers, 
+			size_t pagesPerWindow)
+{
+    MyStampJob job;
+    MyStamp stamp;
+    MyPDFObjectTable *stampObjects;
+    MyPDFObjectCopier *copier;
+    MyPDFBuffer *buffer;
+    CFAbsoluteTime startTime, elapsed;
+    int numUsed = 1;
+    size_t i;
+    bool windowed;
+    
+    memset(&job, 0, sizeof(job));
+    job.writer = writer;
+    job.sourcePDFDoc = sourcePDFDoc;
+    job.stamp = &stamp;
+    job.numPages = CGPDFDocumentGetNumberOfPages(sourcePDFDoc);
+    if(!pagesPerWindow || !sourceURL || pagesPerWindow > job.numPages)
+		pagesPerWindow = job.numPages;
+    windowed = pagesPerWindow < job.numPages;
+    
+    // There is no point starting more workers than there are pages.
+    if(numWorkers > 1 && (size_t)numWorkers > pagesPerWindow)
+		numWorkers = (int)pagesPerWindow;
+    if(numWorkers < 1)
+		numWorkers = 1;
+    job.maxPagesAhead = numWorkers * kMyPagesAheadPerWorker;
+    job.pageBuffers = calloc(job.maxPagesAhead, sizeof(MyPDFBuffer *));
+    stampObjects = createPDFObjectTable(writer);
+    copier = stampObjects ? createPDFObjectCopier(stampObjects) : NULL;
+    buffer = createPDFBuffer();
+    if(!job.pageBuffers || !copier || !buffer){
+		fprintf(stderr, "Couldn't allocate page buffers!\n");
+		job.failed = true;
+    }
+    
+    // The stamp and the page numbers come first so that every page 
+    // can refer to them.
+    if(!job.failed){
+		if(!writeStampForm(writer, copier, buffer, stampFileDoc, &stamp) ||
+			!pdfWriterAppendBuffer(writer, buffer))
+		{
+			fprintf(stderr, "Can't write the stamp!\n");
+			job.failed = true;
+		}
+		job.pagesObject = pdfWriterNewObject(writer);
+		job.firstPageObject = pdfWriterNewObjects(writer, job.numPages);
+    }
+    releasePDFObjectCopier(copier);
+    releasePDFObjectTable(stampObjects);
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.pageWritten, NULL);
+    
+    startTime = CFAbsoluteTimeGetCurrent();
+    while(!job.failed && job.windowEnd < job.numPages){
+		/*	Stamp each window, the first included, from a copy of the
+		source document of its own that goes away with the window, 
+		taking everything parsed from it along. The caller's copy is
+		then used only for its page count, so what it has parsed 
+		stays small. */
+		if(windowed){
+			job.sourcePDFDoc = CGPDFDocumentCreateWithURL(sourceURL);
+			if(!job.sourcePDFDoc || 
+				CGPDFDocumentGetNumberOfPages(job.sourcePDFDoc) != job.numPages)
+			{
+				fprintf(stderr, "Can't reopen the source input file!\n");
+				job.failed = true;
+				break;
+			}
+		}
+		job.objects = createPDFObjectTable(writer);
+		if(!job.objects){
+			fprintf(stderr, "Couldn't allocate page buffers!\n");
+			job.failed = true;
+			break;
+		}
+		job.windowEnd += pagesPerWindow;
+		if(job.windowEnd > job.numPages)
+			job.windowEnd = job.numPages;
+		numUsed = stampWindow(&job, numWorkers);
+		releasePDFObjectTable(job.objects);
+		job.objects = NULL;
+		if(windowed){
+			CGPDFDocumentRelease(job.sourcePDFDoc);
+			job.sourcePDFDoc = NULL;
+		}
+    }
+    elapsed = CFAbsoluteTimeGetCurrent() - startTime;
+    if(windowed && job.sourcePDFDoc)
+		CGPDFDocumentRelease(job.sourcePDFDoc);
+    
+    if(!job.failed){
+		pdfBufferBeginObject(buffer, job.pagesObject);
+		pdfBufferPrintf(buffer, "<< /Type /Pages /Count %zd /Kids [", 
+				job.numPages);
+		for(i = 0; i < job.numPages; i++)
+			pdfBufferWriteReference(buffer, job.firstPageObject + i);
+		pdfBufferPrintf(buffer, " ] >>");
+		pdfBufferEndObject(buffer);
+		if(!pdfWriterAppendBuffer(writer, buffer))
+			job.failed = true;
+		fprintf(stderr, "Stamped %zd pages in %.3f seconds "
+				"(%.1f pages/sec) with %d worker%s.\n",
+				job.numPages, elapsed, 
+				elapsed > 0 ? job.numPages/elapsed : 0.,
+				numUsed, numUsed > 1 ? "s" : "");
+    }
+    
+    // Pages stamped but left unwritten by a failure.
+    for(i = 0; job.pageBuffers && i < job.maxPagesAhead; i++)
+		releasePDFBuffer(job.pageBuffers[i]);
+    pthread_cond_destroy(&job.pageWritten);
+    pthread_mutex_destroy(&job.lock);
+    free(job.pageBuffers);
+    releasePDFBuffer(buffer);
+    return job.failed ? 0 : job.pagesObject;
+}
+
+/* Write the catalog and the document information dictionary, which
+records the application that created the file, and finish the file. */
+static bool finishStampedFile(MyPDFWriter *writer, size_t pagesObject)
+{
+    static const char *creator = "PDF Stamper Application";
+    MyPDFBuffer *buffer = createPDFBuffer();
+    size_t catalog = pdfWriterNewObject(writer);
+    size_t info = pdfWriterNewObject(writer);
+    
+    if(!buffer){
+		cancelPDFWriter(writer);
+		return false;
+    }
+    pdfBufferBeginObject(buffer, catalog);
+    pdfBufferPrintf(buffer, "<< /Type /Catalog /Pages %zd 0 R >>", 
+			pagesObject);
+    pdfBufferEndObject(buffer);
+    pdfBufferBeginObject(buffer, info);
+    pdfBufferPrintf(buffer, "<< /Creator");
+    pdfBufferWriteString(buffer, (const unsigned char *)creator, 
+			strlen(creator));
+    pdfBufferPrintf(buffer, " >>");
+    pdfBufferEndObject(buffer);
+    if(!pdfWriterAppendBuffer(writer, buffer)){
+		releasePDFBuffer(buffer);
+		cancelPDFWriter(writer);
+		return false;
+    }
+    releasePDFBuffer(buffer);
+    return finishPDFWriter(writer, catalog, info);
+}
+
+/*	From an input PDF document and an already parsed PDF document 
+    whose contents you want to draw on top of the other, create a new
+    PDF document containing all the pages of the input document with
+    the first page of the "stamping" overlayed. Returns false if the 
+    new document couldn't be written.
 */
-void createStampedFileWithFile(CFURLRef inURL, 
-			CFURLRef stampURL, CFURLRef outURL)
+static bool createStampedFileWithDocument(CFURLRef inURL, 
+			CGPDFDocumentRef stampDoc, CFURLRef outURL, int numWorkers,
+			size_t pagesPerWindow)
 {
-    CGContextRef pdfContext = NULL;
-    MyPDFData stampFileData, sourceFileData;
+    MyPDFWriter *writer = NULL;
+    MyPDFData sourceFileData;
+    char outPath[PATH_MAX];
+    int majorVersion, minorVersion, stampMajorVersion, stampMinorVersion;
+    size_t pagesObject;
+    bool result = false;
+    
     sourceFileData = myCreatePDFSourceDocument(inURL);
     if(!sourceFileData.pdfDoc){
 		fprintf(stderr, 
 			"Can't create PDFDocumentRef for source input file!\n");
-		return;
+		return false;
+    }
+    
+    // The new file has the later of the two documents' versions, since
+    // it holds objects from both.
+    CGPDFDocumentGetVersion(sourceFileData.pdfDoc, 
+			&majorVersion, &minorVersion);
+    CGPDFDocumentGetVersion(stampDoc, 
+			&stampMajorVersion, &stampMinorVersion);
+    if(stampMajorVersion > majorVersion || 
+		(stampMajorVersion == majorVersion && 
+			stampMinorVersion > minorVersion)){
+		majorVersion = stampMajorVersion;
+		minorVersion = stampMinorVersion;
     }
+    
+    if(CFURLGetFileSystemRepresentation(outURL, true, 
+			(UInt8 *)outPath, sizeof(outPath)))
+		writer = createPDFWriter(outPath, majorVersion, minorVersion);
+    if(!writer){
+		CGPDFDocumentRelease(sourceFileData.pdfDoc);
+		fprintf(stderr, 
+			"Can't create PDF writer for output file!\n");
+		return false;
+    }
+    
+    pagesObject = StampWithPDFDocument(writer, sourceFileData.pdfDoc, 
+	    inURL, stampDoc, numWorkers, pagesPerWindow);
+    if(!pagesObject)
+		cancelPDFWriter(writer);
+    else if(!finishStampedFile(writer, pagesObject))
+		fprintf(stderr, "Can't write output file!\n");
+    else
+		result = true;
+    
+    CGPDFDocumentRelease(sourceFileData.pdfDoc);
+    return result;
+}
 
-    stampFileData = myCreatePDFSourceDocument(stampURL);
+void createStampedFileWithFile(CFURLRef inURL, 
+			CFURLRef stampURL, CFURLRef outURL, int numWorkers,
+			size_t pagesPerWindow)
+{
+    MyPDFData stampFileData = myCreatePDFSourceDocument(stampURL);
+    
     if(!stampFileData.pdfDoc){
-		CGPDFDocumentRelease(sourceFileData.pdfDoc);
 		fprintf(stderr, 
 			"Can't create PDFDocumentRef for file to stamp with!\n");
 		return;
     }
+    createStampedFileWithDocument(inURL, stampFileData.pdfDoc, outURL, 
+			numWorkers, pagesPerWindow);
+    CGPDFDocumentRelease(stampFileData.pdfDoc);
+}
+
+
+/* What copying the raw entries of a dictionary needs. */
+typedef struct MyRawCopying
+{
+    MyPDFBuffer *buffer;
+    const char * const *skipKeys;
+}MyRawCopying;
+
+/* Copy a dictionary entry of the original file as it is written. */
+static void copyRawEntry(const char *key, const MyPDFValue *keyValue,
+			const MyPDFValue *value, void *info)
+{
+    MyRawCopying *copying = info;
+    const char * const *skipKey;
+    
+    for(skipKey = copying->skipKeys; skipKey && *skipKey; skipKey++){
+		if(strcmp(key, *skipKey) == 0)
+			return;
+    }
+    pdfBufferAppend(copying->buffer, " ", 1);
+    pdfBufferAppend(copying->buffer, keyValue->bytes, keyValue->length);
+    pdfBufferAppend(copying->buffer, " ", 1);
+    pdfBufferAppend(copying->buffer, value->bytes, value->length);
+}
+
+/* Copy an array element of the original file as it is written. */
+static void copyRawElement(const MyPDFValue *value, void *info)
+{
+    MyPDFBuffer *buffer = info;
+    
+    pdfBufferAppend(buffer, " ", 1);
+    pdfBufferAppend(buffer, value->bytes, value->length);
+}
+
+/* Write a copy of a resource dictionary of the original file, which 
+may be NULL for none, with the stamp added to its XObjects. */
+static void writeUpdatedResources(MyPDFFileReader *reader, 
+			MyPDFBuffer *buffer, const MyPDFValue *resources,
+			const char *stampName, size_t stampForm)
+{
+    static const char * const resourceSkipKeys[] = { "XObject", NULL };
+    MyRawCopying copying = { buffer, resourceSkipKeys };
+    MyPDFValue value, xobjects;
+    
+    pdfBufferPrintf(buffer, " <<");
+    if(resources)
+		pdfValueApplyEntries(resources, copyRawEntry, &copying);
+    pdfBufferPrintf(buffer, " /XObject <<");
+    copying.skipKeys = NULL;
+    if(resources && pdfValueGetEntry(resources, "XObject", &value) &&
+		pdfReaderResolve(reader, &value, &xobjects))
+		pdfValueApplyEntries(&xobjects, copyRawEntry, &copying);
+    pdfBufferWriteName(buffer, stampName);
+    pdfBufferWriteReference(buffer, stampForm);
+    pdfBufferPrintf(buffer, " >> >>");
+}
+
+/* Write a new version of a page of the original file that draws the
+stamp after its own contents. Everything else about the page is copied
+as it is written, and its contents aren't read at all. Pages whose 
+resources are shared share the updated resources, which are recorded
+in updatedResources by the number of the original resources. */
+static bool writeAppendedPage(MyPDFFileReader *reader, 
+			MyPDFWriter *writer, MyPDFBuffer *buffer, 
+			const MyPDFValue *pageReference, CGPDFPageRef page,
+			const MyStamp *stamp, MyTransformCache *transforms,
+			CFMutableDictionaryRef updatedResources)
+{
+    static const char * const pageSkipKeys[] = { 
+		"Contents", "Resources", NULL 
+    };
+    MyRawCopying copying = { buffer, pageSkipKeys };
+    MyPDFValue pageDict, value, resolved;
+    CGPDFDictionaryRef resources = NULL, xobjects = NULL;
+    CGPDFObjectRef object;
+    size_t stampInvocation, resourcesObject = 0;
+    bool writeResources = false;
+    char stampName[kMyStampNameSize];
+    
+    if(!pdfReaderGetObject(reader, pageReference->number, &pageDict) ||
+		pageDict.type != kMyPDFValueDictionary)
+		return false;
+    if(getInheritedObject(CGPDFPageGetDictionary(page), "Resources", 
+			&object) &&
+		CGPDFObjectGetValue(object, kCGPDFObjectTypeDictionary, &resources))
+		CGPDFDictionaryGetDictionary(resources, "XObject", &xobjects);
+    chooseStampName(xobjects, stampName);
+    stampInvocation = pdfWriterNewObject(writer);
+    
+    pdfBufferBeginUpdatedObject(buffer, pageReference->number, 
+			pageReference->generation);
+    pdfBufferPrintf(buffer, "<<");
+    pdfValueApplyEntries(&pageDict, copyRawEntry, &copying);
     
-    pdfContext = myCreatePDFContext(outURL, sourceFileData.mediaRect);
-    if(!pdfContext){
+    pdfBufferWriteName(buffer, "Resources");
+    if(!pdfReaderGetInheritedEntry(reader, &pageDict, "Resources", &value))
+		writeUpdatedResources(reader, buffer, NULL, stampName, stamp->form);
+    else if(value.type == kMyPDFValueReference){
+		resourcesObject = (size_t)CFDictionaryGetValue(updatedResources, 
+					(const void *)value.number);
+		if(!resourcesObject){
+			resourcesObject = pdfWriterNewObject(writer);
+			CFDictionarySetValue(updatedResources, 
+					(const void *)value.number, 
+					(const void *)resourcesObject);
+			writeResources = true;
+		}
+		pdfBufferWriteReference(buffer, resourcesObject);
+    }else
+		writeUpdatedResources(reader, buffer, &value, stampName, 
+				stamp->form);
+    
+    pdfBufferPrintf(buffer, " /Contents [");
+    pdfBufferWriteReference(buffer, stamp->saveState);
+    if(pdfValueGetEntry(&pageDict, "Contents", &value)){
+		// The contents are a stream or an array of them, either of 
+		// which may be referred to.
+		if(value.type == kMyPDFValueReference && 
+			pdfReaderResolve(reader, &value, &resolved) &&
+			resolved.type == kMyPDFValueArray)
+			pdfValueApplyElements(&resolved, copyRawElement, buffer);
+		else if(value.type == kMyPDFValueArray)
+			pdfValueApplyElements(&value, copyRawElement, buffer);
+		else
+			copyRawElement(&value, buffer);
+    }
+    pdfBufferWriteReference(buffer, stampInvocation);
+    pdfBufferPrintf(buffer, " ] >>");
+    pdfBufferEndObject(buffer);
+    
+    if(writeResources){
+		if(!pdfReaderGetInheritedEntry(reader, &pageDict, "Resources", 
+				&value) || !pdfReaderResolve(reader, &value, &resolved))
+			return false;
+		pdfBufferBeginObject(buffer, resourcesObject);
+		writeUpdatedResources(reader, buffer, &resolved, stampName, 
+				stamp->form);
+		pdfBufferEndObject(buffer);
+    }
+    writeStampInvocation(buffer, stampInvocation, 
+			cachedStampTransform(transforms, 
+				CGPDFPageGetBoxRect(page, kCGPDFMediaBox), stamp->mediaRect),
+			stampName);
+    return true;
+}
+
+/* Carry the original file's catalog, information dictionary and file
+identifier over to the trailer of the update. */
+static void addOriginalTrailerEntry(const char *key, 
+			const MyPDFValue *keyValue, const MyPDFValue *value, void *info)
+{
+    MyPDFWriter *writer = info;
+    
+    if(strcmp(key, "Root") == 0 || strcmp(key, "Info") == 0 || 
+		strcmp(key, "ID") == 0)
+		pdfWriterAddTrailerEntries(writer, keyValue->bytes, 
+				value->bytes + value->length - keyValue->bytes);
+}
+
+/* Write the stamp and the pages of the source document that draw it as
+an incremental update appended to a copy of the source document. */
+static bool appendStampedPages(MyPDFFileReader *reader, MyPDFWriter *writer,
+			CGPDFDocumentRef sourcePDFDoc, CGPDFDocumentRef stampFileDoc,
+			const MyPDFValue *pages, size_t numPages)
+{
+    MyPDFObjectTable *objects = createPDFObjectTable(writer);
+    MyPDFObjectCopier *copier = objects ? createPDFObjectCopier(objects) : NULL;
+    MyPDFBuffer *buffer = createPDFBuffer();
+    CFMutableDictionaryRef updatedResources = 
+		CFDictionaryCreateMutable(NULL, 0, NULL, NULL);
+    MyStamp stamp;
+    MyTransformCache transforms;
+    bool succeeded = false;
+    size_t i;
+    
+    memset(&transforms, 0, sizeof(transforms));
+    if(copier && buffer && updatedResources){
+		succeeded = writeStampForm(writer, copier, buffer, 
+					stampFileDoc, &stamp) && 
+				pdfWriterAppendBuffer(writer, buffer);
+		if(!succeeded)
+			fprintf(stderr, "Can't write the stamp!\n");
+    }
+    for(i = 0; succeeded && i < numPages; i++){
+		CGPDFPageRef page = CGPDFDocumentGetPage(sourcePDFDoc, i + 1);
+		succeeded = page && writeAppendedPage(reader, writer, buffer, 
+					&pages[i], page, &stamp, &transforms, updatedResources) &&
+				pdfWriterAppendBuffer(writer, buffer);
+		if(!succeeded)
+			fprintf(stderr, "Can't write page %zd!\n", i + 1);
+    }
+    
+    if(updatedResources)
+		CFRelease(updatedResources);
+    releasePDFBuffer(buffer);
+    releasePDFObjectCopier(copier);
+    releasePDFObjectTable(objects);
+    return succeeded;
+}
+
+/*	From an input PDF document and a PDF document whose contents you
+    want to draw on top of the other, create a new PDF document that is
+    the input document unchanged followed by an incremental update 
+    adding the first page of the "stamping" to each page. The stamp is
+    written once and each page gets a small content stream drawing it,
+    so the cost depends on the number of pages and not on what is on 
+    them. Returns false if the new document couldn't be written.
+*/
+static bool createAppendedFileWithDocument(CFURLRef inURL, 
+			CGPDFDocumentRef stampDoc, CFURLRef outURL)
+{
+    MyPDFFileReader *reader;
+    MyPDFWriter *writer = NULL;
+    MyPDFData sourceFileData;
+    MyPDFValue *pages, value;
+    char inPath[PATH_MAX], outPath[PATH_MAX];
+    size_t numPages;
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent(), elapsed;
+    bool result = false;
+    
+    if(!CFURLGetFileSystemRepresentation(inURL, true, 
+			(UInt8 *)inPath, sizeof(inPath)) ||
+		!CFURLGetFileSystemRepresentation(outURL, true, 
+			(UInt8 *)outPath, sizeof(outPath))){
+		fprintf(stderr, "Can't get the paths of the files!\n");
+		return false;
+    }
+    reader = openPDFFileReader(inPath);
+    if(!reader)
+		return false;
+    // Strings in the new objects would have to be encrypted too.
+    if(pdfValueGetEntry(pdfReaderGetTrailer(reader), "Encrypt", &value)){
+		closePDFFileReader(reader);
+		fprintf(stderr, "Can't append to an encrypted file!\n");
+		return false;
+    }
+    pages = pdfReaderCopyPages(reader, &numPages);
+    if(!pages){
+		closePDFFileReader(reader);
+		fprintf(stderr, "Can't read the page tree of the input file!\n");
+		return false;
+    }
+    
+    sourceFileData = myCreatePDFSourceDocument(inURL);
+    if(!sourceFileData.pdfDoc)
+		fprintf(stderr, 
+			"Can't create PDFDocumentRef for source input file!\n");
+    else if(CGPDFDocumentGetNumberOfPages(sourceFileData.pdfDoc) != numPages)
+		fprintf(stderr, "The page tree of the input file is damaged!\n");
+    else
+		writer = createPDFUpdateWriter(outPath, inPath, 
+				pdfReaderGetSize(reader), pdfReaderGetXRefOffset(reader), 
+				pdfReaderUsesXRefStream(reader));
+    
+    if(writer){
+		pdfValueApplyEntries(pdfReaderGetTrailer(reader), 
+				addOriginalTrailerEntry, writer);
+		if(!appendStampedPages(reader, writer, sourceFileData.pdfDoc, 
+				stampDoc, pages, numPages))
+			cancelPDFWriter(writer);
+		else if(!finishPDFWriter(writer, 0, 0))
+			fprintf(stderr, "Can't write output file!\n");
+		else{
+			result = true;
+			elapsed = CFAbsoluteTimeGetCurrent() - startTime;
+			fprintf(stderr, "Stamped %zd pages in %.3f seconds "
+					"(%.1f pages/sec) by appending an update.\n",
+					numPages, elapsed, 
+					elapsed > 0 ? numPages/elapsed : 0.);
+		}
+    }
+    
+    if(sourceFileData.pdfDoc)
 		CGPDFDocumentRelease(sourceFileData.pdfDoc);
-		CGPDFDocumentRelease(stampFileData.pdfDoc);
+    free(pages);
+    closePDFFileReader(reader);
+    return result;
+}
+
+void createAppendedFileWithFile(CFURLRef inURL, 
+			CFURLRef stampURL, CFURLRef outURL)
+{
+    MyPDFData stampFileData = myCreatePDFSourceDocument(stampURL);
+    
+    if(!stampFileData.pdfDoc){
 		fprintf(stderr, 
-			"Can't create PDFContext for output file!\n");
+			"Can't create PDFDocumentRef for file to stamp with!\n");
 		return;
     }
+    createAppendedFileWithDocument(inURL, stampFileData.pdfDoc, outURL);
+    CGPDFDocumentRelease(stampFileData.pdfDoc);
+}
+
+
+/* A daemon keeps the stamp documents it has parsed, keyed by path, so
+    that a job only pays for parsing its own input. A cached stamp is
+    parsed again if the file has changed since, and once there are
+    kMyMaxCachedStamps the one used least recently is dropped. */
+typedef struct MyCachedStamp
+{
+    CGPDFDocumentRef pdfDoc;
+    time_t modified;
+    off_t size;
+    unsigned long lastUsed;
+}MyCachedStamp;
+
+/* Connections are accepted on the main thread and queued for a fixed 
+    pool of workers, each of which reads a job from its connection, 
+    runs it and replies. Once the queue is full the main thread stops
+    accepting, so further clients wait in the socket's listen backlog
+    rather than piling up in memory. */
+typedef struct MyStampDaemon
+{
+    bool append;
+    size_t pagesPerWindow;
+    const char *defaultStamp;
     
-    StampWithPDFDocument(pdfContext, sourceFileData.pdfDoc, 
-	    stampFileData.pdfDoc, stampFileData.mediaRect);
+    pthread_mutex_t lock;
+    pthread_cond_t connectionQueued;
+    pthread_cond_t connectionTaken;
+    int *queue;
+    size_t queueCapacity;
+    size_t queueStart;
+    size_t queueLength;
     
-    CGContextRelease(pdfContext);
-    CGPDFDocumentRelease(sourceFileData.pdfDoc);
-    CGPDFDocumentRelease(stampFileData.pdfDoc);
+    pthread_mutex_t stampLock;
+    CFMutableDictionaryRef stamps;
+    unsigned long useCount;
+}MyStampDaemon;
+
+// Room for the three paths of a job and the tabs between them.
+#define kMyMaxRequestLength	(3*PATH_MAX + 2)
+
+// How many stamp documents a daemon keeps parsed.
+#define kMyMaxCachedStamps	16
+
+// How many accepted connections may wait for each worker.
+#define kMyConnectionsPerWorker	2
+
+// How long, in seconds, a client may take to send its request or to 
+// accept its reply before the connection is dropped.
+#define kMyConnectionTimeout	30
+
+static void releaseCachedStamp(MyCachedStamp *cached)
+{
+    CGPDFDocumentRelease(cached->pdfDoc);
+    free(cached);
+}
+
+static void evictLeastRecentlyUsedStamp(MyStampDaemon *daemon)
+{
+    CFIndex i, count = CFDictionaryGetCount(daemon->stamps);
+    const void **keys, **values;
+    CFIndex oldest = 0;
+    
+    if(count == 0)
+		return;
+    keys = malloc(2 * count * sizeof(void *));
+    if(!keys)
+		return;
+    values = keys + count;
+    CFDictionaryGetKeysAndValues(daemon->stamps, keys, values);
+    for(i = 1; i < count; i++){
+		if(((const MyCachedStamp *)values[i])->lastUsed < 
+				((const MyCachedStamp *)values[oldest])->lastUsed)
+			oldest = i;
+    }
+    releaseCachedStamp((MyCachedStamp *)values[oldest]);
+    CFDictionaryRemoveValue(daemon->stamps, keys[oldest]);
+    free(keys);
+}
+
+/* Return the parsed stamp document at the supplied path, which the 
+    caller must release, parsing it only if it isn't cached or the 
+    file has changed. Returns NULL if the document can't be opened. */
+static CGPDFDocumentRef copyCachedStamp(MyStampDaemon *daemon, 
+			const char *path)
+{
+    struct stat info;
+    CFStringRef key;
+    CFURLRef url;
+    MyCachedStamp *cached;
+    MyPDFData stampFileData;
+    CGPDFDocumentRef pdfDoc = NULL;
+    
+    if(stat(path, &info) != 0)
+		return NULL;
+    key = CFStringCreateWithFileSystemRepresentation(NULL, path);
+    if(!key)
+		return NULL;
+    
+    pthread_mutex_lock(&daemon->stampLock);
+    cached = (MyCachedStamp *)CFDictionaryGetValue(daemon->stamps, key);
+    if(cached && (cached->modified != info.st_mtime || 
+			cached->size != info.st_size)){
+		CFDictionaryRemoveValue(daemon->stamps, key);
+		releaseCachedStamp(cached);
+		cached = NULL;
+    }
+    if(cached){
+		cached->lastUsed = ++daemon->useCount;
+		pdfDoc = CGPDFDocumentRetain(cached->pdfDoc);
+    }
+    pthread_mutex_unlock(&daemon->stampLock);
+    if(pdfDoc){
+		CFRelease(key);
+		return pdfDoc;
+    }
+    
+    // Parse outside the lock so that a new stamp doesn't hold up jobs
+    // using the stamps already cached. If two jobs race to parse the 
+    // same stamp the first to finish is the one kept.
+    url = createURL(path);
+    stampFileData.pdfDoc = NULL;
+    if(url){
+		stampFileData = myCreatePDFSourceDocument(url);
+		CFRelease(url);
+    }
+    if(!stampFileData.pdfDoc){
+		CFRelease(key);
+		return NULL;
+    }
+    pthread_mutex_lock(&daemon->stampLock);
+    if(!CFDictionaryGetValue(daemon->stamps, key) &&
+			(cached = malloc(sizeof(MyCachedStamp)))){
+		if(CFDictionaryGetCount(daemon->stamps) >= kMyMaxCachedStamps)
+			evictLeastRecentlyUsedStamp(daemon);
+		cached->pdfDoc = CGPDFDocumentRetain(stampFileData.pdfDoc);
+		cached->modified = info.st_mtime;
+		cached->size = info.st_size;
+		cached->lastUsed = ++daemon->useCount;
+		CFDictionarySetValue(daemon->stamps, key, cached);
+    }
+    pthread_mutex_unlock(&daemon->stampLock);
+    CFRelease(key);
+    return stampFileData.pdfDoc;
+}
+
+/* Read one newline terminated request from a connection into request,
+    without the newline. Returns false if the connection closed or timed
+    out first or the request is too long. */
+static bool readRequest(int connection, char *request, size_t size)
+{
+    size_t length = 0;
+    ssize_t count;
+    
+    while(length < size - 1){
+		count = read(connection, request + length, 1);
+		if(count < 0 && errno == EINTR)
+			continue;
+		if(count <= 0)
+			return false;
+		if(request[length] == '\n'){
+			request[length] = 0;
+			return true;
+		}
+		length++;
+    }
+    return false;
+}
+
+static void writeReply(int connection, const char *reply)
+{
+    size_t length = strlen(reply);
+    ssize_t count;
+    
+    while(length > 0){
+		count = write(connection, reply, length);
+		if(count < 0 && errno == EINTR)
+			continue;
+		if(count <= 0)
+			return;
+		reply += count;
+		length -= count;
+    }
+}
+
+/* Run the job on a connection. A job is a line holding the input path,
+    the output path and optionally the stamp path, separated by tabs; 
+    the reply is a line reading "ok" or "error" and what went wrong. 
+    Relative paths are relative to the daemon's working directory. */
+static void runStampJob(MyStampDaemon *daemon, int connection)
+{
+    char request[kMyMaxRequestLength + 1];
+    char *inputPath, *outputPath, *stampPath;
+    CFURLRef inURL, outURL;
+    CGPDFDocumentRef stampDoc;
+    bool stamped = false;
+    
+    if(!readRequest(connection, request, sizeof(request))){
+		writeReply(connection, "error unreadable request\n");
+		return;
+    }
+    inputPath = request;
+    outputPath = strchr(inputPath, '\t');
+    if(!outputPath || !*inputPath || !outputPath[1]){
+		writeReply(connection, "error expected input and output paths\n");
+		return;
+    }
+    *outputPath++ = 0;
+    stampPath = strchr(outputPath, '\t');
+    if(stampPath)
+		*stampPath++ = 0;
+    if(!stampPath || !*stampPath)
+		stampPath = (char *)daemon->defaultStamp;
+    
+    stampDoc = copyCachedStamp(daemon, stampPath);
+    if(!stampDoc){
+		writeReply(connection, "error can't open the stamp\n");
+		return;
+    }
+    inURL = createURL(inputPath);
+    outURL = createURL(outputPath);
+    // Each job is stamped on a single thread; the pool runs jobs side
+    // by side instead.
+    if(inURL && outURL)
+		stamped = daemon->append ? 
+				createAppendedFileWithDocument(inURL, stampDoc, outURL) :
+				createStampedFileWithDocument(inURL, stampDoc, outURL, 1,
+						daemon->pagesPerWindow);
+    writeReply(connection, stamped ? "ok\n" : "error can't stamp the input\n");
+    
+    if(inURL)
+		CFRelease(inURL);
+    if(outURL)
+		CFRelease(outURL);
+    CGPDFDocumentRelease(stampDoc);
+}
+
+static void *stampDaemonWorker(void *info)
+{
+    MyStampDaemon *daemon = info;
+    int connection;
+    
+    for(;;){
+		pthread_mutex_lock(&daemon->lock);
+		while(daemon->queueLength == 0)
+			pthread_cond_wait(&daemon->connectionQueued, &daemon->lock);
+		connection = daemon->queue[daemon->queueStart];
+		daemon->queueStart = 
+				(daemon->queueStart + 1) % daemon->queueCapacity;
+		daemon->queueLength--;
+		pthread_cond_signal(&daemon->connectionTaken);
+		pthread_mutex_unlock(&daemon->lock);
+		
+		runStampJob(daemon, connection);
+		close(connection);
+    }
+    return NULL;
+}
+
+/* Remove the socket at path, if there is one, so that a socket left by
+    a daemon that didn't exit cleanly doesn't stop another starting. 
+    Returns false, leaving it alone, if something else is at path. */
+static bool removeSocket(const char *path)
+{
+    struct stat info;
+    
+    if(lstat(path, &info) != 0)
+		return errno == ENOENT;
+    if(!S_ISSOCK(info.st_mode)){
+		fprintf(stderr, "%s exists and isn't a socket!\n", path);
+		return false;
+    }
+    return unlink(path) == 0 || errno == ENOENT;
+}
+
+// How long, in microseconds, to wait before accepting again when out of
+// file descriptors or memory.
+#define kMyAcceptRetryDelay	100000
+
+/* Listen on a Unix socket at the supplied path, which only the user 
+    running the daemon may connect to, and stamp the files named by 
+    each connection, on numWorkers threads. Doesn't return 
+    unless the socket can't be set up or stops accepting connections. */
+static int runStampDaemon(const char *socketPath, const char *stampPath,
+			bool append, size_t pagesPerWindow, int numWorkers)
+{
+    MyStampDaemon daemon;
+    struct sockaddr_un address;
+    struct timeval timeout = { kMyConnectionTimeout, 0 };
+    pthread_t thread;
+    int listener, connection, i, started = 0, bound;
+    mode_t oldMask;
+    
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(strlen(socketPath) >= sizeof(address.sun_path)){
+		fprintf(stderr, "The socket path is too long!\n");
+		return 1;
+    }
+    strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+    
+    memset(&daemon, 0, sizeof(daemon));
+    daemon.append = append;
+    daemon.pagesPerWindow = pagesPerWindow;
+    daemon.defaultStamp = stampPath;
+    daemon.queueCapacity = (size_t)numWorkers * kMyConnectionsPerWorker;
+    daemon.queue = malloc(daemon.queueCapacity * sizeof(int));
+    daemon.stamps = CFDictionaryCreateMutable(NULL, 0, 
+			&kCFTypeDictionaryKeyCallBacks, NULL);
+    if(!daemon.queue || !daemon.stamps){
+		fprintf(stderr, "Couldn't allocate the daemon!\n");
+		return 1;
+    }
+    pthread_mutex_init(&daemon.lock, NULL);
+    pthread_cond_init(&daemon.connectionQueued, NULL);
+    pthread_cond_init(&daemon.connectionTaken, NULL);
+    pthread_mutex_init(&daemon.stampLock, NULL);
+    
+    // A client that goes away before its reply shouldn't end the daemon.
+    signal(SIGPIPE, SIG_IGN);
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener < 0){
+		perror("socket");
+		return 1;
+    }
+    /*	Clients name any paths they like to be read and written with 
+	the daemon's permissions, so only the daemon's own user may 
+	connect. The socket is created with no other permissions at all,
+	rather than changed afterwards, so there is no moment when others
+	could connect. No workers are running yet to be affected by the
+	change of umask. */
+    if(!removeSocket(socketPath)){
+		close(listener);
+		return 1;
+    }
+    oldMask = umask(S_IRWXG | S_IRWXO | S_IXUSR);
+    bound = bind(listener, (struct sockaddr *)&address, sizeof(address));
+    umask(oldMask);
+    if(bound != 0 || listen(listener, SOMAXCONN) != 0){
+		perror(socketPath);
+		close(listener);
+		return 1;
+    }
+    
+    for(i = 0; i < numWorkers; i++){
+		if(pthread_create(&thread, NULL, stampDaemonWorker, &daemon) == 0){
+			pthread_detach(thread);
+			started++;
+		}
+    }
+    if(!started){
+		fprintf(stderr, "Couldn't start any workers!\n");
+		close(listener);
+		(void)removeSocket(socketPath);
+		return 1;
+    }
+    fprintf(stderr, "Listening on %s with %d workers.\n", 
+			socketPath, started);
+    
+    for(;;){
+		pthread_mutex_lock(&daemon.lock);
+		while(daemon.queueLength == daemon.queueCapacity)
+			pthread_cond_wait(&daemon.connectionTaken, &daemon.lock);
+		pthread_mutex_unlock(&daemon.lock);
+		
+		connection = accept(listener, NULL, NULL);
+		if(connection < 0){
+			if(errno == EINTR || errno == ECONNABORTED)
+				continue;
+			// Running short of descriptors or memory under load 
+			// passes as jobs finish, so wait for them rather than
+			// abandon the jobs in progress.
+			if(errno == EMFILE || errno == ENFILE || 
+				errno == ENOBUFS || errno == ENOMEM)
+			{
+				perror("accept");
+				usleep(kMyAcceptRetryDelay);
+				continue;
+			}
+			perror("accept");
+			break;
+		}
+		// A client that stalls would otherwise hold a worker forever.
+		if(setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, 
+				sizeof(timeout)) != 0 ||
+			setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, 
+				sizeof(timeout)) != 0)
+		{
+			perror("setsockopt");
+			close(connection);
+			continue;
+		}
+		pthread_mutex_lock(&daemon.lock);
+		daemon.queue[(daemon.queueStart + daemon.queueLength) % 
+				daemon.queueCapacity] = connection;
+		daemon.queueLength++;
+		pthread_cond_signal(&daemon.connectionQueued);
+		pthread_mutex_unlock(&daemon.lock);
+    }
+    
+    // The workers may still be running jobs, so leave the daemon's 
+    // state to go away with the process.
+    close(listener);
+    (void)removeSocket(socketPath);
+    return 1;
 }
 
 
 int main (int argc, const char * argv[]) {
     static char *suffix = ".watermarked.pdf";
     static char *stampFileName = "confidential.pdf";
-    const char *inputFileName = NULL;
+    const char *inputFileName = NULL, *socketPath = NULL;
     char *outputFileName = NULL;
     CFURLRef inURL = NULL, outURL = NULL, stampURL = NULL;
-    int outputnamelength;
+    int outputnamelength, ch, numWorkers = 1;
+    size_t pagesPerWindow = 0;
+    bool append = false, workersGiven = false;
     
-    if(argc != 2){
+    while((ch = getopt(argc, (char * const *)argv, "ad:j:s:")) != -1){
+		switch(ch){
+			case 'a':
+				append = true;
+				break;
+			case 'd':
+				socketPath = optarg;
+				break;
+			case 'j':
+				numWorkers = atoi(optarg);
+				// Zero means use one worker per processor.
+				if(numWorkers == 0)
+					numWorkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+				if(numWorkers < 1){
+					usage(argv[0]);
+					return 1;
+				}
+				workersGiven = true;
+				break;
+			case 's':
+				pagesPerWindow = strtoul(optarg, NULL, 10);
+				if(pagesPerWindow < 1){
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+    }
+    if(socketPath){
+		if(argc != optind){
+			usage(argv[0]);
+			return 1;
+		}
+		if(!workersGiven)
+			numWorkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		if(numWorkers < 1)
+			numWorkers = 1;
+		return runStampDaemon(socketPath, stampFileName, append, 
+				pagesPerWindow, numWorkers);
+    }
+    if(argc - optind != 1){
 		usage(argv[0]);
         return 1;
     }
 
-    inputFileName = argv[1];
+    inputFileName = argv[optind];
     outputnamelength = strlen(inputFileName) + strlen(suffix) + 1;
     outputFileName = (char *)malloc(outputnamelength);
     strncpy(outputFileName, inputFileName, outputnamelength);
@@ -227,7 +1583,11 @@ int main (int argc, const char * argv[]) {
 		return 1;
     }
     
-    createStampedFileWithFile(inURL, stampURL, outURL);
+    if(append)
+		createAppendedFileWithFile(inURL, stampURL, outURL);
+    else
+		createStampedFileWithFile(inURL, stampURL, outURL, numWorkers,
+				pagesPerWindow);
     
     CFRelease(stampURL);
     CFRelease(outURL);
@@ -0,0 +1,183 @@
+/*
+*  File:    DSCLayout.c
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#include "DSCLayout.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*  Return whether the line, of the supplied length, starts 
+    with the comment keyword. */
+static bool
+lineHasKeyword(const char *line, size_t length, const char *keyword)
+{
+    size_t keywordLength = strlen(keyword);
+
+    return length >= keywordLength && 
+		memcmp(line, keyword, keywordLength) == 0;
+}
+
+/*  Parse the unsigned number that ends a line, after any 
+    spaces. Returns false if the line doesn't end in one. */
+static bool
+getLastNumber(const char *line, size_t length, size_t *number)
+{
+    size_t end = length, start;
+
+    while(end > 0 && (line[end - 1] == ' ' || line[end - 1] == '\t'))
+	end--;
+    start = end;
+    while(start > 0 && line[start - 1] >= '0' && line[start - 1] <= '9')
+	start--;
+    if(start == end || end - start > 9)
+	return false;
+    *number = 0;
+    for(; start < end; start++)
+	*number = 10 * *number + (line[start] - '0');
+    return true;
+}
+
+static bool
+addPageOffset(MyDSCLayout *layout, size_t *capacity, size_t offset)
+{
+    size_t *offsets;
+
+    if(layout->numPages + 1 >= *capacity){
+	*capacity = *capacity ? 2 * *capacity : 256;
+	offsets = realloc(layout->pageOffsets, *capacity * sizeof(size_t));
+	if(!offsets)
+	    return false;
+	layout->pageOffsets = offsets;
+    }
+    layout->pageOffsets[layout->numPages++] = offset;
+    return true;
+}
+
+bool
+parseDSCLayout(const char *bytes, size_t length, MyDSCLayout *layout)
+{
+    size_t offset = 0, lineLength, capacity = 0, ordinal;
+    size_t declaredPages = 0, trailerOffset = length;
+    bool pagesDeclared = false, inHeader = true, inSetup = false;
+    bool prologEnded = false, inTrailer = false, trusted = true;
+    int embeddedDepth = 0;
+    const char *line;
+
+    memset(layout, 0, sizeof(*layout));
+    layout->length = length;
+    if(!lineHasKeyword(bytes, length, "%!PS-Adobe-"))
+	return false;
+
+    while(trusted && offset < length){
+	line = bytes + offset;
+	lineLength = 0;
+	while(offset + lineLength < length && 
+		line[lineLength] != '\n' && line[lineLength] != '\r')
+	    lineLength++;
+	offset += lineLength;
+	// A line may end with CR, LF or both.
+	if(offset < length && bytes[offset] == '\r')
+	    offset++;
+	if(offset < length && bytes[offset] == '\n')
+	    offset++;
+	
+	// Only lines starting "%%" are structure comments, and
+	// the header ends at the first line that isn't a comment.
+	if(lineLength < 2 || line[0] != '%' || line[1] != '%'){
+	    if(lineLength > 0 && line[0] != '%')
+		inHeader = false;
+	    continue;
+	}
+	if(lineHasKeyword(line, lineLength, "%%BeginData") ||
+		lineHasKeyword(line, lineLength, "%%BeginBinary"))
+	    trusted = false;
+	else if(lineHasKeyword(line, lineLength, "%%BeginDocument"))
+	    embeddedDepth++;
+	else if(lineHasKeyword(line, lineLength, "%%EndDocument")){
+	    if(--embeddedDepth < 0)
+		trusted = false;
+	}else if(embeddedDepth > 0)
+	    continue;
+	else if(lineHasKeyword(line, lineLength, "%%EndComments"))
+	    inHeader = false;
+	else if(lineHasKeyword(line, lineLength, "%%Pages:")){
+	    // The header may defer the count to the trailer 
+	    // with "(atend)", which doesn't parse as a number.
+	    if((inHeader || inTrailer) && 
+		    getLastNumber(line, lineLength, &declaredPages))
+		pagesDeclared = true;
+	}else if(lineHasKeyword(line, lineLength, "%%EndProlog"))
+	    prologEnded = true;
+	else if(lineHasKeyword(line, lineLength, "%%BeginSetup"))
+	    inSetup = true;
+	else if(lineHasKeyword(line, lineLength, "%%EndSetup"))
+	    inSetup = false;
+	else if(lineHasKeyword(line, lineLength, "%%Page:")){
+	    // Pages must follow the prolog and setup, come before
+	    // the trailer and be numbered in order.
+	    if(!prologEnded || inSetup || inTrailer ||
+		    !getLastNumber(line, lineLength, &ordinal) ||
+		    ordinal != layout->numPages + 1 ||
+		    !addPageOffset(layout, &capacity, line - bytes))
+		trusted = false;
+	}else if(lineHasKeyword(line, lineLength, "%%Trailer")){
+	    if(inTrailer)
+		trusted = false;
+	    inTrailer = true;
+	    trailerOffset = line - bytes;
+	}
+    }
+
+    if(!trusted || embeddedDepth != 0 || !pagesDeclared || 
+	    layout->numPages == 0 || declaredPages != layout->numPages ||
+	    !addPageOffset(layout, &capacity, trailerOffset))
+    {
+	releaseDSCLayout(layout);
+	return false;
+    }
+    // The final offset marks the trailer, not a page.
+    layout->numPages--;
+    return true;
+}
+
+void
+releaseDSCLayout(MyDSCLayout *layout)
+{
+    free(layout->pageOffsets);
+    layout->pageOffsets = NULL;
+    layout->numPages = 0;
+}
@@ -0,0 +1,78 @@
+/*
+*  File:    DSCLayout.h
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef __DSCLayout__
+#define __DSCLayout__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*  The layout of a PostScript file that follows the Document
+    Structuring Conventions: the offsets at which its prolog and 
+    setup end, each page begins and the trailer begins. A file 
+    whose comments can be trusted can be cut into independent 
+    jobs, each the prolog and setup, a range of pages and the 
+    trailer.
+    
+    The comments are only trusted if the file claims to conform
+    ("%!PS-Adobe-"), has an %%EndProlog before its first page and
+    ends any %%BeginSetup before it too, and has as many %%Page 
+    comments, numbered in order from 1, as its %%Pages comment 
+    says. Pages of documents embedded between %%BeginDocument and
+    %%EndDocument are not the file's own. A file holding %%BeginData
+    or %%BeginBinary sections isn't trusted, since their bytes could
+    look like comments. */
+typedef struct MyDSCLayout
+{
+    size_t numPages;
+    // Page i runs from pageOffsets[i] to pageOffsets[i + 1], 
+    // and the last entry is where the trailer begins. The 
+    // header, prolog and setup run up to pageOffsets[0].
+    size_t *pageOffsets;
+    size_t length;
+}MyDSCLayout;
+
+/*  Find the layout of the PostScript file in bytes. Returns 
+    false, with nothing to release, if the file's comments can't
+    be trusted; otherwise the layout must be released with 
+    releaseDSCLayout. */
+bool parseDSCLayout(const char *bytes, size_t length, 
+		MyDSCLayout *layout);
+void releaseDSCLayout(MyDSCLayout *layout);
+
+#endif	// __DSCLayout__
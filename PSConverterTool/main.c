@@ -38,22 +38,80 @@
 
 #include <CoreFoundation/CoreFoundation.h>
 #include <ApplicationServices/ApplicationServices.h>
+#include <limits.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "DSCLayout.h"
 
 #define DEBUG 0
 
+// How many parts a file converted in parts is cut into
+// for each worker.
+#define kMyPartsPerWorker 2
+
+/*  The progress of work shared by several worker threads,
+    each with a converter of its own: a batch of files, or 
+    the parts of one file. */
+typedef struct MyProgress
+{
+    const char *unitName;	// "files" or "parts".
+    size_t numUnits;
+    FILE *outStatusFile;
+    // The rest is shared by the workers and guarded by lock.
+    size_t nextUnit;
+    size_t unitsDone;
+    size_t unitsSucceeded;
+    size_t pagesDone;
+    pthread_mutex_t lock;
+}MyProgress;
+
+/*  A batch of files converted several at a time. Each worker
+    takes the next file from the batch until there are none 
+    left. */
+typedef struct MyBatch
+{
+    MyProgress progress;
+    const char * const *inputPaths;
+    const char *outputDirectory;
+}MyBatch;
+
 typedef struct MyConverterData
 {
     bool doProgress;
     bool abortConverter;
     FILE *outStatusFile;
     CGPSConverterRef converter;
+    // When converting on several threads, the shared
+    // progress and the file being converted. NULL otherwise.
+    MyProgress *progress;
+    const char *inputPath;
 }MyConverterData;
 
+/*  Update the progress line, which counts everything 
+    converted so far by every worker. The caller must hold
+    progress->lock. */
+static void
+reportProgress(MyProgress *progress)
+{
+    fprintf(progress->outStatusFile, 
+	"\rConverted %zd of %zd %s, %zd pages", 
+	progress->unitsDone, progress->numUnits, 
+	progress->unitName, progress->pagesDone);
+    fflush(progress->outStatusFile);
+}
+
 /* Converter callbacks */
 
 static void
 begin_document_callback(void *info)
 {
+    // Workers report each file or part when it is done instead.
+    if(((MyConverterData *)info)->progress)
+	return;
     fprintf( ((MyConverterData *)info)->outStatusFile, 
 		    "\nBegin document\n");
 }
@@ -61,6 +119,8 @@ begin_document_callback(void *info)
 static void
 end_document_callback(void *info, bool success)
 {
+    if(((MyConverterData *)info)->progress)
+	return;
     fprintf( ((MyConverterData *)info)->outStatusFile,
 	"\nEnd document: %s\n",
 	success ? "success" : "failed");
@@ -70,6 +130,8 @@ static void
 begin_page_callback(void *info, size_t pageno, 
 			CFDictionaryRef page_info)
 {
+    if(((MyConverterData *)info)->progress)
+	return;
     fprintf( ((MyConverterData *)info)->outStatusFile,
 		"\nBeginning page %zd\n", pageno);
 #if DEBUG
@@ -82,6 +144,15 @@ static void
 end_page_callback(void *info, size_t pageno, 
 			CFDictionaryRef page_info)
 {
+    MyProgress *progress = ((MyConverterData *)info)->progress;
+
+    if(progress){
+	pthread_mutex_lock(&progress->lock);
+	progress->pagesDone++;
+	reportProgress(progress);
+	pthread_mutex_unlock(&progress->lock);
+	return;
+    }
     fprintf(((MyConverterData *)info)->outStatusFile,
 	"\nEnding page %zd\n", pageno);
 #if DEBUG
@@ -125,8 +196,14 @@ message_callback(void *info, CFStringRef cfmessage)
     if(CFStringGetCString(cfmessage, message, 
 	sizeof(message), kCFStringEncodingASCII)
     ){
-	fprintf(((MyConverterData *)info)->outStatusFile,
-	    "\nMessage: %s\n", message);
+	// Messages from workers say which file they are about.
+	if(((MyConverterData *)info)->progress)
+	    fprintf(((MyConverterData *)info)->outStatusFile,
+		"\nMessage from %s: %s\n", 
+		((MyConverterData *)info)->inputPath, message);
+	else
+	    fprintf(((MyConverterData *)info)->outStatusFile,
+		"\nMessage: %s\n", message);
     }
 }
 
@@ -146,16 +223,33 @@ static const CGPSConverterCallbacks myCallbacks = {
     NULL
 };
 
-/*  Given an input URL and a destination output URL, convert
-    an input PS or EPS file to an output PDF file. This conversion
-    can be time intensive and perhaps should be performed on
-    a secondary thread or by another process. */
-bool convertPStoPDF(CFURLRef inputPSURL, CFURLRef outPDFURL)
+/*  Convert the PostScript data from provider to PDF data
+    written to consumer, using the converter already created
+    in converterDataP. */
+static bool 
+convertDataWithConverter(MyConverterData *converterDataP,
+		    CGDataProviderRef provider, CGDataConsumerRef consumer)
+{
+    bool success;
+
+    // There are no conversion options so the options
+    // dictionary for the conversion is NULL.
+    success = CGPSConverterConvert(converterDataP->converter, 
+		    provider, consumer, NULL);
+    if(!success && !converterDataP->progress)
+	fprintf(stderr, "Conversion failed!\n");
+    return success;
+}
+
+/*  Convert an input PS or EPS file to an output PDF file 
+    using the converter already created in converterDataP. */
+static bool 
+convertWithConverter(MyConverterData *converterDataP,
+		    CFURLRef inputPSURL, CFURLRef outPDFURL)
 {
     CGDataProviderRef provider = NULL;
     CGDataConsumerRef consumer = NULL;
     bool success = false;
-    MyConverterData myConverterData;
 
     provider = CGDataProviderCreateWithURL(inputPSURL);
     consumer = CGDataConsumerCreateWithURL(outPDFURL);
@@ -173,6 +267,24 @@ bool convertPStoPDF(CFURLRef inputPSURL, CFURLRef outPDFURL)
 	return false;
     }
 
+    success = convertDataWithConverter(converterDataP, 
+		    provider, consumer);
+
+    CGDataProviderRelease(provider);
+    CGDataConsumerRelease(consumer);
+    
+    return success;
+}
+
+/*  Given an input URL and a destination output URL, convert
+    an input PS or EPS file to an output PDF file. This conversion
+    can be time intensive and perhaps should be performed on
+    a secondary thread or by another process. */
+bool convertPStoPDF(CFURLRef inputPSURL, CFURLRef outPDFURL)
+{
+    bool success = false;
+    MyConverterData myConverterData;
+
     // Setup the info data for the callbacks to
     // do progress reporting, set the initial state
     // of the abort flag to false and use stdout
@@ -180,6 +292,8 @@ bool convertPStoPDF(CFURLRef inputPSURL, CFURLRef outPDFURL)
     myConverterData.doProgress = true;
     myConverterData.abortConverter = false;
     myConverterData.outStatusFile = stdout;
+    myConverterData.progress = NULL;
+    myConverterData.inputPath = NULL;
 
     // Create a converter object with myConverterData as the
     // info parameter and myCallbacks as the set of callbacks
@@ -188,46 +302,558 @@ bool convertPStoPDF(CFURLRef inputPSURL, CFURLRef outPDFURL)
     myConverterData.converter = CGPSConverterCreate(&myConverterData, 
 						    &myCallbacks, NULL);
     if(myConverterData.converter == NULL){
-	CGDataProviderRelease(provider);
-	CGDataConsumerRelease(consumer);
 	fprintf(stderr, "Couldn't create converter object!\n");
 	return false;
     }
 
-    // There are no conversion options so the options
-    // dictionary for the conversion is NULL.
-    success = CGPSConverterConvert(myConverterData.converter, 
-		    provider, consumer, NULL);
-    if(!success)
-	fprintf(stderr, "Conversion failed!\n");
+    success = convertWithConverter(&myConverterData, 
+		    inputPSURL, outPDFURL);
 
     // There is no CGPSConverterRelease function. Since
     // a CGPSConverter object is a CF object, use CFRelease
     // instead.
     CFRelease(myConverterData.converter);
-    CGDataProviderRelease(provider);
-    CGDataConsumerRelease(consumer);
     
     return success;
 }
 
+/*  Set up the converter data for a worker thread, with a 
+    converter that the worker uses for everything it converts. */
+static bool
+createWorkerConverter(MyConverterData *converterDataP,
+		MyProgress *progress)
+{
+    converterDataP->doProgress = false;
+    converterDataP->abortConverter = false;
+    converterDataP->outStatusFile = progress->outStatusFile;
+    converterDataP->progress = progress;
+    converterDataP->inputPath = NULL;
+    converterDataP->converter = CGPSConverterCreate(converterDataP, 
+						    &myCallbacks, NULL);
+    if(converterDataP->converter == NULL){
+	fprintf(stderr, "Couldn't create converter object!\n");
+	return false;
+    }
+    return true;
+}
+
+/*  Take the next file or part to convert, returning false 
+    once there are none left. */
+static bool
+takeNextUnit(MyProgress *progress, size_t *unit)
+{
+    bool taken;
+
+    pthread_mutex_lock(&progress->lock);
+    taken = progress->nextUnit < progress->numUnits;
+    if(taken)
+	*unit = progress->nextUnit++;
+    pthread_mutex_unlock(&progress->lock);
+    return taken;
+}
+
+/*  Record that a file or part is done and update the 
+    progress line. */
+static void
+finishUnit(MyProgress *progress, bool success)
+{
+    pthread_mutex_lock(&progress->lock);
+    progress->unitsDone++;
+    if(success)
+	progress->unitsSucceeded++;
+    reportProgress(progress);
+    pthread_mutex_unlock(&progress->lock);
+}
+
+/*  Run worker on numWorkers threads, the calling thread
+    among them, and wait for them all to finish. Returns
+    the number of threads that ran. */
+static int
+runWorkers(void *(*worker)(void *), void *info, int numWorkers)
+{
+    pthread_t *workers = NULL;
+    int i, numStarted = 0;
+
+    if(numWorkers > 1)
+	workers = malloc((numWorkers - 1) * sizeof(pthread_t));
+    for(i = 0; workers && i < numWorkers - 1; i++){
+	if(pthread_create(&workers[numStarted], NULL, worker, info) == 0)
+	    numStarted++;
+	else
+	    fprintf(stderr, "Couldn't start worker thread #%d!\n", i);
+    }
+    worker(info);
+    for(i = 0; i < numStarted; i++)
+	pthread_join(workers[i], NULL);
+    free(workers);
+    return numStarted + 1;
+}
+
+/*  Make the path of the PDF file that a batch converts
+    inputPath to: the input's file name, with its extension 
+    replaced by ".pdf", in the output directory. */
+static bool
+makeOutputPath(const char *outputDirectory, const char *inputPath,
+		char *outputPath, size_t size)
+{
+    const char *name = strrchr(inputPath, '/');
+    const char *extension;
+    int length;
+
+    name = name ? name + 1 : inputPath;
+    extension = strrchr(name, '.');
+    length = extension && extension != name ? 
+		(int)(extension - name) : (int)strlen(name);
+    return snprintf(outputPath, size, "%s/%.*s.pdf", 
+		outputDirectory, length, name) < (int)size;
+}
+
+/*  An input of a batch and the output it would be converted
+    to, for finding inputs that would share an output. */
+typedef struct MyBatchOutput
+{
+    char path[PATH_MAX];
+    size_t index;
+}MyBatchOutput;
+
+/*  Compare outputs ignoring case, as the default file system
+    on Mac OS X does, and then by input. */
+static int
+compareBatchOutputs(const void *a, const void *b)
+{
+    const MyBatchOutput *outputA = a, *outputB = b;
+    int order = strcasecmp(outputA->path, outputB->path);
+
+    if(order)
+	return order;
+    return outputA->index < outputB->index ? -1 : 
+		outputA->index > outputB->index;
+}
+
+/*  Report any inputs that would be converted to the same
+    output file, such as "a/x.ps" and "b/x.ps" or "x.ps" and 
+    "x.eps", each of which would overwrite the others. Returns
+    true if there are none. */
+static bool
+checkBatchOutputs(const char * const *inputPaths, size_t numFiles,
+		const char *outputDirectory)
+{
+    MyBatchOutput *outputs = malloc(numFiles * sizeof(MyBatchOutput));
+    bool unique = true;
+    size_t i;
+
+    if(!outputs){
+	fprintf(stderr, "Couldn't allocate the batch!\n");
+	return false;
+    }
+    for(i = 0; i < numFiles; i++){
+	outputs[i].index = i;
+	// Paths too long to make fail when they are converted.
+	if(!makeOutputPath(outputDirectory, inputPaths[i], 
+		outputs[i].path, sizeof(outputs[i].path)))
+	    outputs[i].path[0] = 0;
+    }
+    qsort(outputs, numFiles, sizeof(MyBatchOutput), compareBatchOutputs);
+    for(i = 1; i < numFiles; i++){
+	if(outputs[i].path[0] && 
+		strcasecmp(outputs[i - 1].path, outputs[i].path) == 0)
+	{
+	    fprintf(stderr, "%s and %s would both be converted to %s!\n",
+		    inputPaths[outputs[i - 1].index], 
+		    inputPaths[outputs[i].index], outputs[i].path);
+	    unique = false;
+	}
+    }
+    free(outputs);
+    return unique;
+}
+
+/*  The body of each batch worker thread. */
+static void *
+convertBatchWorker(void *info)
+{
+    MyBatch *batch = (MyBatch *)info;
+    MyConverterData myConverterData;
+    CFURLRef inputURL, outputURL;
+    CFAbsoluteTime startTime, elapsed;
+    char outputPath[PATH_MAX];
+    const char *inputPath;
+    size_t index;
+    bool success;
+
+    if(!createWorkerConverter(&myConverterData, &batch->progress))
+	return NULL;
+
+    while(takeNextUnit(&batch->progress, &index)){
+	inputPath = batch->inputPaths[index];
+	myConverterData.inputPath = inputPath;
+	success = false;
+	startTime = CFAbsoluteTimeGetCurrent();
+	if(makeOutputPath(batch->outputDirectory, inputPath, 
+		outputPath, sizeof(outputPath)))
+	{
+	    inputURL = CFURLCreateFromFileSystemRepresentation(NULL, 
+			(const UInt8 *)inputPath, strlen(inputPath), false);
+	    outputURL = CFURLCreateFromFileSystemRepresentation(NULL, 
+			(const UInt8 *)outputPath, strlen(outputPath), false);
+	    if(inputURL && outputURL)
+		success = convertWithConverter(&myConverterData, 
+				inputURL, outputURL);
+	    if(inputURL)CFRelease(inputURL);
+	    if(outputURL)CFRelease(outputURL);
+	}
+	elapsed = CFAbsoluteTimeGetCurrent() - startTime;
+
+	fprintf(batch->progress.outStatusFile, 
+		"\n%s: %s in %.3f seconds\n", 
+		inputPath, success ? "converted" : "FAILED", elapsed);
+	finishUnit(&batch->progress, success);
+    }
+
+    CFRelease(myConverterData.converter);
+    return NULL;
+}
+
+/*  Convert each of the input files to a PDF file in the
+    output directory, converting as many files at once as
+    there are workers. Returns the number of files that 
+    couldn't be converted, which is all of them if any two
+    would be converted to the same output file. */
+static size_t
+convertBatch(const char * const *inputPaths, size_t numFiles,
+		const char *outputDirectory, int numWorkers)
+{
+    MyBatch batch;
+    CFAbsoluteTime startTime, elapsed;
+    int numUsed;
+
+    if(!checkBatchOutputs(inputPaths, numFiles, outputDirectory))
+	return numFiles;
+    memset(&batch, 0, sizeof(batch));
+    batch.inputPaths = inputPaths;
+    batch.outputDirectory = outputDirectory;
+    batch.progress.unitName = "files";
+    batch.progress.numUnits = numFiles;
+    batch.progress.outStatusFile = stdout;
+    pthread_mutex_init(&batch.progress.lock, NULL);
+
+    // There is no point starting more workers than there are files.
+    if((size_t)numWorkers > numFiles)
+	numWorkers = (int)numFiles;
+    startTime = CFAbsoluteTimeGetCurrent();
+    numUsed = runWorkers(convertBatchWorker, &batch, numWorkers);
+    elapsed = CFAbsoluteTimeGetCurrent() - startTime;
+
+    fprintf(stdout, "\nConverted %zd of %zd files "
+	    "(%zd pages) in %.3f seconds with %d worker%s.\n",
+	    batch.progress.unitsSucceeded, numFiles, 
+	    batch.progress.pagesDone, elapsed, 
+	    numUsed, numUsed > 1 ? "s" : "");
+    pthread_mutex_destroy(&batch.progress.lock);
+    return numFiles - batch.progress.unitsSucceeded;
+}
+
+/*  One part of a file converted in parts: the file's prolog
+    and setup, a range of its pages and its trailer, converted
+    to PDF data in memory. */
+typedef struct MyPart
+{
+    size_t firstPage;	// Page indexes, not including endPage.
+    size_t endPage;
+    CFMutableDataRef pdfData;
+    bool success;
+}MyPart;
+
+typedef struct MySplitJob
+{
+    MyProgress progress;
+    const char *inputPath;
+    const char *bytes;
+    MyDSCLayout layout;
+    MyPart *parts;
+}MySplitJob;
+
+/*  Return the PostScript of a part, which the caller must 
+    release. */
+static CFDataRef
+createPartData(const MySplitJob *job, const MyPart *part)
+{
+    const size_t *offsets = job->layout.pageOffsets;
+    size_t trailer = offsets[job->layout.numPages];
+    CFMutableDataRef data = CFDataCreateMutable(NULL, 0);
+
+    if(data == NULL)
+	return NULL;
+    CFDataAppendBytes(data, (const UInt8 *)job->bytes, offsets[0]);
+    CFDataAppendBytes(data, (const UInt8 *)job->bytes + 
+		offsets[part->firstPage], 
+		offsets[part->endPage] - offsets[part->firstPage]);
+    CFDataAppendBytes(data, (const UInt8 *)job->bytes + trailer,
+		job->layout.length - trailer);
+    return data;
+}
+
+/*  The body of each thread converting the parts of a file. */
+static void *
+convertPartsWorker(void *info)
+{
+    MySplitJob *job = (MySplitJob *)info;
+    MyConverterData myConverterData;
+    CGDataProviderRef provider;
+    CGDataConsumerRef consumer;
+    CFDataRef psData;
+    MyPart *part;
+    size_t index;
+
+    if(!createWorkerConverter(&myConverterData, &job->progress))
+	return NULL;
+    myConverterData.inputPath = job->inputPath;
+
+    while(takeNextUnit(&job->progress, &index)){
+	part = &job->parts[index];
+	psData = createPartData(job, part);
+	part->pdfData = CFDataCreateMutable(NULL, 0);
+	if(psData && part->pdfData){
+	    provider = CGDataProviderCreateWithCFData(psData);
+	    consumer = CGDataConsumerCreateWithCFData(part->pdfData);
+	    if(provider && consumer)
+		part->success = convertDataWithConverter(&myConverterData,
+				    provider, consumer);
+	    CGDataProviderRelease(provider);
+	    CGDataConsumerRelease(consumer);
+	}
+	if(psData)CFRelease(psData);
+	finishUnit(&job->progress, part->success);
+    }
+
+    CFRelease(myConverterData.converter);
+    return NULL;
+}
+
+/*  Draw the pages of each part's PDF data, in order, into a
+    new PDF file. Returns false, without creating the file, 
+    if a part doesn't have one PDF page for each of its 
+    PostScript pages, since then the file's comments didn't 
+    describe it. */
+static bool
+joinParts(const MySplitJob *job, CFURLRef outPDFURL)
+{
+    size_t numParts = job->progress.numUnits, i, j, count;
+    CGPDFDocumentRef *pdfDocs = calloc(numParts, sizeof(CGPDFDocumentRef));
+    CGDataProviderRef provider;
+    CGContextRef pdfContext = NULL;
+    CGPDFPageRef page;
+    CGRect mediaBox;
+    bool success = pdfDocs != NULL;
+
+    for(i = 0; success && i < numParts; i++){
+	provider = CGDataProviderCreateWithCFData(job->parts[i].pdfData);
+	if(provider){
+	    pdfDocs[i] = CGPDFDocumentCreateWithProvider(provider);
+	    CGDataProviderRelease(provider);
+	}
+	success = pdfDocs[i] && CGPDFDocumentGetNumberOfPages(pdfDocs[i]) ==
+		    job->parts[i].endPage - job->parts[i].firstPage;
+    }
+    if(success){
+	pdfContext = CGPDFContextCreateWithURL(outPDFURL, NULL, NULL);
+	if(pdfContext == NULL){
+	    fprintf(stderr, "Couldn't create PDF context!\n");
+	    success = false;
+	}
+    }
+    for(i = 0; success && i < numParts; i++){
+	count = CGPDFDocumentGetNumberOfPages(pdfDocs[i]);
+	for(j = 1; j <= count; j++){
+	    page = CGPDFDocumentGetPage(pdfDocs[i], j);
+	    mediaBox = CGPDFPageGetBoxRect(page, kCGPDFMediaBox);
+	    CGContextBeginPage(pdfContext, &mediaBox);
+	    CGContextDrawPDFPage(pdfContext, page);
+	    CGContextEndPage(pdfContext);
+	}
+    }
+
+    if(pdfContext)CGContextRelease(pdfContext);
+    for(i = 0; pdfDocs && i < numParts; i++){
+	if(pdfDocs[i])CGPDFDocumentRelease(pdfDocs[i]);
+    }
+    free(pdfDocs);
+    return success;
+}
+
+/*  Convert the parts of a file laid out by its DSC comments
+    on numWorkers threads and join them into the output file.
+    Returns false if the parts didn't convert as the comments
+    describe. */
+static bool
+convertParts(MySplitJob *job, CFURLRef outPDFURL, int numWorkers)
+{
+    size_t numPages = job->layout.numPages, numParts, i;
+    CFAbsoluteTime startTime, elapsed;
+    int numUsed;
+    bool success;
+
+    // More parts than workers lets a worker that finishes 
+    // early take another part, but each part repeats the 
+    // prolog and setup.
+    numParts = (size_t)numWorkers * kMyPartsPerWorker;
+    if(numParts > numPages)
+	numParts = numPages;
+    job->parts = calloc(numParts, sizeof(MyPart));
+    if(job->parts == NULL)
+	return false;
+    for(i = 0; i < numParts; i++){
+	job->parts[i].firstPage = i * numPages / numParts;
+	job->parts[i].endPage = (i + 1) * numPages / numParts;
+    }
+    job->progress.unitName = "parts";
+    job->progress.numUnits = numParts;
+    job->progress.outStatusFile = stdout;
+    pthread_mutex_init(&job->progress.lock, NULL);
+
+    if((size_t)numWorkers > numParts)
+	numWorkers = (int)numParts;
+    startTime = CFAbsoluteTimeGetCurrent();
+    numUsed = runWorkers(convertPartsWorker, job, numWorkers);
+    success = job->progress.unitsSucceeded == numParts &&
+		joinParts(job, outPDFURL);
+    elapsed = CFAbsoluteTimeGetCurrent() - startTime;
+    if(success)
+	fprintf(stdout, "\nConverted %zd pages in %zd parts in "
+		"%.3f seconds with %d worker%s.\n", numPages, numParts, 
+		elapsed, numUsed, numUsed > 1 ? "s" : "");
+
+    for(i = 0; i < numParts; i++){
+	if(job->parts[i].pdfData)CFRelease(job->parts[i].pdfData);
+    }
+    free(job->parts);
+    pthread_mutex_destroy(&job->progress.lock);
+    return success;
+}
+
+/*  Convert a PS file on numWorkers threads by cutting it
+    into parts along the page boundaries given by its DSC 
+    comments, each part the prolog and setup followed by a 
+    range of pages and the trailer, and joining the PDF 
+    pages of the parts in order. A file whose comments can't
+    be trusted, or whose parts don't convert as the comments
+    describe, is converted serially with convertPStoPDF. */
+static bool
+convertPStoPDFInParts(const char *inputPath, CFURLRef inputPSURL, 
+		CFURLRef outPDFURL, int numWorkers)
+{
+    MySplitJob job;
+    struct stat info;
+    void *bytes = MAP_FAILED;
+    bool converted = false, trusted = false;
+    int fd;
+
+    memset(&job, 0, sizeof(job));
+    job.inputPath = inputPath;
+    fd = open(inputPath, O_RDONLY);
+    if(fd >= 0 && fstat(fd, &info) == 0 && info.st_size > 0)
+	bytes = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(bytes != MAP_FAILED){
+	job.bytes = bytes;
+	trusted = parseDSCLayout(job.bytes, info.st_size, &job.layout);
+	if(!trusted)
+	    fprintf(stdout, "The DSC comments of %s can't be trusted; "
+		    "converting serially.\n", inputPath);
+	// A single page gains nothing from being split.
+	else if(numWorkers > 1 && job.layout.numPages > 1){
+	    converted = convertParts(&job, outPDFURL, numWorkers);
+	    if(!converted)
+		fprintf(stdout, "\nThe parts of %s didn't convert as its "
+			"DSC comments describe; converting serially.\n", 
+			inputPath);
+	}
+	if(trusted)
+	    releaseDSCLayout(&job.layout);
+	munmap(bytes, info.st_size);
+    }
+    if(fd >= 0)
+	close(fd);
+
+    if(converted)
+	return true;
+    return convertPStoPDF(inputPSURL, outPDFURL);
+}
+
+static void
+usage(const char *name)
+{
+    printf("Usage: %s [-s] [-j workers] inputfile outputfile. \n", name);
+    printf("       %s [-j workers] -o outputdirectory inputfile ... \n\n",
+	    name);
+    printf("    -s             split the input file into parts along "
+	    "the pages its\n"
+	    "                   DSC comments give and convert them at once\n");
+    printf("    -o directory   convert each input file to a PDF file "
+	    "of the same\n"
+	    "                   name in this directory\n");
+    printf("    -j workers     convert this many files or parts at once "
+	    "(0, the\n"
+	    "                   default, uses one per processor)\n\n");
+}
+
 int main (int argc, const char * argv[]) {
     CFURLRef inputURL, outputURL;
+    const char *outputDirectory = NULL;
+    int ch, numWorkers = 0;
+    bool split = false;
+
+    while((ch = getopt(argc, (char * const *)argv, "j:o:s")) != -1){
+	switch(ch){
+	    case 'j':
+		numWorkers = atoi(optarg);
+		if(numWorkers < 0){
+		    usage(argv[0]);
+		    return 0;
+		}
+		break;
+	    case 'o':
+		outputDirectory = optarg;
+		break;
+	    case 's':
+		split = true;
+		break;
+	    default:
+		usage(argv[0]);
+		return 0;
+	}
+    }
+    if(numWorkers == 0)
+	numWorkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(numWorkers < 1)
+	numWorkers = 1;
+
+    if(outputDirectory){
+	if(optind >= argc){
+	    usage(argv[0]);
+	    return 0;
+	}
+	return convertBatch(argv + optind, argc - optind, 
+			outputDirectory, numWorkers) ? 1 : 0;
+    }
 
-    if( argc != 3 )
+    if( argc - optind != 2 )
     {
-	printf("Usage: %s inputfile outputfile. \n\n", argv[0]);
+	usage(argv[0]);
 	return 0;
     }
 
     // Create the data provider and data consumer.
     inputURL = CFURLCreateFromFileSystemRepresentation(NULL, 
-			argv[1], strlen(argv[1]), false);
+			argv[optind], strlen(argv[optind]), false);
 
     outputURL = CFURLCreateFromFileSystemRepresentation(NULL, 
-			argv[2], strlen(argv[2]), false);
+			argv[optind + 1], strlen(argv[optind + 1]), false);
     if(inputURL && outputURL){
-	(void)convertPStoPDF(inputURL, outputURL);
+	if(split)
+	    (void)convertPStoPDFInParts(argv[optind], inputURL, 
+			outputURL, numWorkers);
+	else
+	    (void)convertPStoPDF(inputURL, outputURL);
     }
 
     if(inputURL)CFRelease(inputURL);
@@ -0,0 +1,610 @@
+/*
+*  File:    ExtractionStore.c
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#include "ExtractionStore.h"
+#include <CommonCrypto/CommonDigest.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <dirent.h>
+
+// Blobs are written with a few large writes of at most this size.
+#define kMyWriteChunkSize	(1024*1024)
+// Manifest lines are small so they are buffered into large writes.
+#define kMyManifestBufferSize	(256*1024)
+// As are packed blobs.
+#define kMyPackBufferSize	(1024*1024)
+
+struct MyExtractionStore
+{
+    char *directory;
+    FILE *manifest;
+    char *manifestBuffer;
+    // The IDs, as CFStrings, of blobs known to be in the store as files
+    // of their own, and of those known to be in its packs.
+    CFMutableSetRef knownBlobs;
+    CFMutableSetRef packedBlobs;
+    // And of blobs being written, which other workers wait for.
+    CFMutableSetRef pendingBlobs;
+    pthread_cond_t blobSettled;
+    // This run's pack file, created when the first blob is packed.
+    FILE *pack;
+    char *packBuffer;
+    size_t blobsWritten;
+    size_t blobsPacked;
+    size_t blobsReused;
+    unsigned long long bytesWritten;
+    pthread_mutex_t lock;
+};
+
+static bool makeDirectory(const char *path)
+{
+    if(mkdir(path, 0755) == 0 || errno == EEXIST)
+		return true;
+    fprintf(stderr, "Couldn't create directory %s: %s\n", 
+			path, strerror(errno));
+    return false;
+}
+
+/* Add the IDs of the blobs in one pack file to the packed blobs. A 
+    record cut short, as by a run that was killed while writing, ends
+    the pack. */
+static void loadPackFile(MyExtractionStore *store, const char *path)
+{
+    FILE *pack = fopen(path, "r");
+    char header[kMyBlobIDSize + 64], blobID[kMyBlobIDSize];
+    unsigned long long length;
+    struct stat sb;
+    
+    if(!pack)
+		return;
+    if(fstat(fileno(pack), &sb) != 0){
+		fclose(pack);
+		return;
+    }
+    while(fgets(header, sizeof(header), pack) &&
+		sscanf(header, "blob %79s %llu", blobID, &length) == 2)
+    {
+		CFStringRef blobKey;
+		off_t end = ftello(pack) + (off_t)length + 1;
+		
+		if(end > sb.st_size || fseeko(pack, end, SEEK_SET) != 0)
+			break;
+		blobKey = CFStringCreateWithCString(NULL, blobID, 
+					kCFStringEncodingASCII);
+		if(blobKey){
+			CFSetAddValue(store->packedBlobs, blobKey);
+			CFRelease(blobKey);
+		}
+    }
+    fclose(pack);
+}
+
+/* Learn which blobs are in the store's pack files. */
+static void loadPackedBlobs(MyExtractionStore *store)
+{
+    char packsPath[PATH_MAX], path[PATH_MAX];
+    struct dirent *entry;
+    DIR *packs;
+    
+    snprintf(packsPath, sizeof(packsPath), "%s/packs", store->directory);
+    packs = opendir(packsPath);
+    if(!packs)
+		return;
+    while((entry = readdir(packs)) != NULL){
+		if(entry->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", packsPath, entry->d_name);
+		loadPackFile(store, path);
+    }
+    closedir(packs);
+}
+
+MyExtractionStore *createExtractionStore(const char *directory)
+{
+    MyExtractionStore *store;
+    char manifestPath[PATH_MAX];
+    
+    if(!makeDirectory(directory))
+		return NULL;
+    
+    store = calloc(1, sizeof(MyExtractionStore));
+    if(!store)
+		return NULL;
+    store->directory = strdup(directory);
+    store->knownBlobs = CFSetCreateMutable(NULL, 0, &kCFTypeSetCallBacks);
+    store->packedBlobs = CFSetCreateMutable(NULL, 0, &kCFTypeSetCallBacks);
+    store->pendingBlobs = CFSetCreateMutable(NULL, 0, &kCFTypeSetCallBacks);
+    snprintf(manifestPath, sizeof(manifestPath), "%s/manifest.txt", directory);
+    store->manifest = fopen(manifestPath, "a");
+    if(!store->directory || !store->knownBlobs || !store->packedBlobs ||
+		!store->pendingBlobs ||
+		!store->manifest)
+    {
+		fprintf(stderr, "Couldn't create extraction store in %s!\n", 
+				directory);
+		releaseExtractionStore(store);
+		return NULL;
+    }
+    store->manifestBuffer = malloc(kMyManifestBufferSize);
+    if(store->manifestBuffer)
+		setvbuf(store->manifest, store->manifestBuffer, _IOFBF, 
+				kMyManifestBufferSize);
+    loadPackedBlobs(store);
+    pthread_mutex_init(&store->lock, NULL);
+    pthread_cond_init(&store->blobSettled, NULL);
+    return store;
+}
+
+void releaseExtractionStore(MyExtractionStore *store)
+{
+    if(!store)
+		return;
+    if(store->manifest){
+		if(fclose(store->manifest) != 0)
+			fprintf(stderr, "Couldn't write extraction manifest!\n");
+		pthread_mutex_destroy(&store->lock);
+		pthread_cond_destroy(&store->blobSettled);
+    }
+    if(store->pack && fclose(store->pack) != 0)
+		fprintf(stderr, "Couldn't write extraction pack!\n");
+    if(store->knownBlobs)
+		CFRelease(store->knownBlobs);
+    if(store->packedBlobs)
+		CFRelease(store->packedBlobs);
+    if(store->pendingBlobs)
+		CFRelease(store->pendingBlobs);
+    free(store->packBuffer);
+    free(store->manifestBuffer);
+    free(store->directory);
+    free(store);
+}
+
+/* Write all of the supplied bytes to a file descriptor, returning
+    false on any error. */
+static bool writeAll(int fd, const unsigned char *bytes, size_t length)
+{
+    while(length){
+		ssize_t written = write(fd, bytes, 
+			length < kMyWriteChunkSize ? length : kMyWriteChunkSize);
+		if(written < 0){
+			if(errno == EINTR)
+				continue;
+			return false;
+		}
+		bytes += written;
+		length -= written;
+    }
+    return true;
+}
+
+/* Write a blob to a temporary file in the store and rename it into
+    place once complete, so that neither this process nor any other
+    sharing the store ever sees a partially written blob. */
+static bool writeBlob(MyExtractionStore *store, const char *blobID,
+			const void *bytes, size_t length)
+{
+    char subdirectory[PATH_MAX], tempPath[PATH_MAX], finalPath[PATH_MAX];
+    int fd;
+    
+    // The first two digits of the digest name a subdirectory so that
+    // no one directory holds too many blobs.
+    snprintf(subdirectory, sizeof(subdirectory), "%s/%.2s", 
+			store->directory, blobID);
+    if(!makeDirectory(subdirectory))
+		return false;
+    
+    snprintf(tempPath, sizeof(tempPath), "%s/.blob.XXXXXX", subdirectory);
+    snprintf(finalPath, sizeof(finalPath), "%s/%s", 
+			store->directory, blobID);
+    fd = mkstemp(tempPath);
+    if(fd < 0){
+		fprintf(stderr, "Couldn't create temporary file in %s: %s\n",
+				subdirectory, strerror(errno));
+		return false;
+    }
+    (void)fchmod(fd, 0644);
+    if(!writeAll(fd, bytes, length) || close(fd) != 0){
+		fprintf(stderr, "Couldn't write blob %s: %s\n", 
+				blobID, strerror(errno));
+		unlink(tempPath);
+		return false;
+    }
+    if(rename(tempPath, finalPath) != 0){
+		fprintf(stderr, "Couldn't rename blob %s: %s\n", 
+				blobID, strerror(errno));
+		unlink(tempPath);
+		return false;
+    }
+    return true;
+}
+
+/* Format the ID of a blob from its digest and extension. */
+static void makeBlobID(const unsigned char digest[CC_SHA256_DIGEST_LENGTH],
+			const char *extension, char blobID[kMyBlobIDSize])
+{
+    char *p = blobID;
+    int i;
+    
+    p += sprintf(p, "%02x/", digest[0]);
+    for(i = 0; i < CC_SHA256_DIGEST_LENGTH; i++)
+		p += sprintf(p, "%02x", digest[i]);
+    snprintf(p, kMyBlobIDSize - (p - blobID), ".%s", extension);
+}
+
+/* Claim a blob for writing while holding the lock so that two workers
+    extracting the same image at once write it only once. A worker that
+    finds the blob being written by another waits to learn whether that
+    succeeded, and claims the blob itself if it didn't. Sets *present 
+    if the blob is already in the store, including one left on disk by
+    an earlier run. A blob to be packed is present if it is in the store
+    in any form, but one to be added as a file is present only if it is
+    a file, since its ID must name that file. Returns the key to pass 
+    to settleBlob, or NULL on failure. */
+static CFStringRef claimBlob(MyExtractionStore *store, const char *blobID,
+			unsigned long long length, bool packed, bool *present)
+{
+    char path[PATH_MAX];
+    struct stat sb;
+    CFStringRef blobKey;
+    
+    blobKey = CFStringCreateWithCString(NULL, blobID, kCFStringEncodingASCII);
+    if(!blobKey)
+		return NULL;
+    
+    pthread_mutex_lock(&store->lock);
+    while(CFSetContainsValue(store->pendingBlobs, blobKey))
+		pthread_cond_wait(&store->blobSettled, &store->lock);
+    *present = CFSetContainsValue(store->knownBlobs, blobKey) ||
+		(packed && CFSetContainsValue(store->packedBlobs, blobKey));
+    if(!*present)
+		CFSetAddValue(store->pendingBlobs, blobKey);
+    pthread_mutex_unlock(&store->lock);
+    
+    if(!*present){
+		snprintf(path, sizeof(path), "%s/%s", store->directory, blobID);
+		*present = (stat(path, &sb) == 0 && 
+				(unsigned long long)sb.st_size == length);
+    }
+    return blobKey;
+}
+
+/* End a claim, publishing the blob to other workers only if it is
+    now in place, as a file or packed. The caller must hold the lock. */
+static void publishBlob(MyExtractionStore *store, CFStringRef blobKey,
+			bool success, bool packed)
+{
+    if(!CFSetContainsValue(store->pendingBlobs, blobKey))
+		return;
+    if(success)
+		CFSetAddValue(packed ? store->packedBlobs : store->knownBlobs, 
+				blobKey);
+    CFSetRemoveValue(store->pendingBlobs, blobKey);
+    pthread_cond_broadcast(&store->blobSettled);
+}
+
+/* Account for a claimed blob once it has been written, or give up the
+    claim if writing it failed. Releases the key. */
+static void settleBlob(MyExtractionStore *store, CFStringRef blobKey,
+			bool success, bool present, unsigned long long length)
+{
+    pthread_mutex_lock(&store->lock);
+    publishBlob(store, blobKey, success, false);
+    if(success && present)
+		store->blobsReused++;
+    else if(success){
+		store->blobsWritten++;
+		store->bytesWritten += length;
+    }
+    pthread_mutex_unlock(&store->lock);
+    CFRelease(blobKey);
+}
+
+bool extractionStoreAddBlob(MyExtractionStore *store, 
+			const void *bytes, size_t length,
+			const char *extension, char blobID[kMyBlobIDSize])
+{
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    CFStringRef blobKey;
+    bool present, success = true;
+    
+    CC_SHA256(bytes, (CC_LONG)length, digest);
+    makeBlobID(digest, extension, blobID);
+    
+    blobKey = claimBlob(store, blobID, length, false, &present);
+    if(!blobKey)
+		return false;
+    if(!present)
+		success = writeBlob(store, blobID, bytes, length);
+    settleBlob(store, blobKey, success, present, length);
+    return success;
+}
+
+/* Create this run's pack file. The caller must hold the lock. */
+static bool openPack(MyExtractionStore *store)
+{
+    char packsPath[PATH_MAX], path[PATH_MAX];
+    int fd;
+    
+    snprintf(packsPath, sizeof(packsPath), "%s/packs", store->directory);
+    if(!makeDirectory(packsPath))
+		return false;
+    snprintf(path, sizeof(path), "%s/pack-XXXXXX", packsPath);
+    fd = mkstemp(path);
+    if(fd < 0 || !(store->pack = fdopen(fd, "w"))){
+		fprintf(stderr, "Couldn't create pack file in %s: %s\n",
+				packsPath, strerror(errno));
+		if(fd >= 0)
+			close(fd);
+		return false;
+    }
+    (void)fchmod(fd, 0644);
+    store->packBuffer = malloc(kMyPackBufferSize);
+    if(store->packBuffer)
+		setvbuf(store->pack, store->packBuffer, _IOFBF, kMyPackBufferSize);
+    return true;
+}
+
+bool extractionStoreAddPackedBlob(MyExtractionStore *store, 
+			const void *bytes, size_t length,
+			const char *extension, char blobID[kMyBlobIDSize])
+{
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    CFStringRef blobKey;
+    bool present, success = true;
+    
+    if(length > kMyMaxPackedBlobSize)
+		return extractionStoreAddBlob(store, bytes, length, 
+				extension, blobID);
+    
+    CC_SHA256(bytes, (CC_LONG)length, digest);
+    makeBlobID(digest, extension, blobID);
+    
+    blobKey = claimBlob(store, blobID, length, true, &present);
+    if(!blobKey)
+		return false;
+    // Records go into the pack whole, one after another.
+    pthread_mutex_lock(&store->lock);
+    if(present){
+		// Only a blob found on disk is still claimed, and it is a file.
+		publishBlob(store, blobKey, true, false);
+		store->blobsReused++;
+    }else{
+		success = (store->pack || openPack(store)) &&
+			fprintf(store->pack, "blob %s %zd\n", blobID, length) > 0 &&
+			fwrite(bytes, 1, length, store->pack) == length &&
+			putc('\n', store->pack) != EOF;
+		if(success){
+			store->blobsPacked++;
+			store->bytesWritten += length;
+		}else
+			fprintf(stderr, "Couldn't pack blob %s!\n", blobID);
+		publishBlob(store, blobKey, success, true);
+    }
+    pthread_mutex_unlock(&store->lock);
+    CFRelease(blobKey);
+    return success;
+}
+
+// Small writes to a blob writer are gathered into writes of this size.
+#define kMyBlobWriterBufferSize	(64*1024)
+
+struct MyBlobWriter
+{
+    MyExtractionStore *store;
+    int fd;
+    char tempPath[PATH_MAX];
+    CC_SHA256_CTX digestContext;
+    unsigned long long length;
+    unsigned char *buffer;
+    size_t bufferUsed;
+    bool failed;
+};
+
+MyBlobWriter *extractionStoreBeginBlob(MyExtractionStore *store)
+{
+    MyBlobWriter *writer = calloc(1, sizeof(MyBlobWriter));
+    
+    if(!writer)
+		return NULL;
+    writer->store = store;
+    writer->buffer = malloc(kMyBlobWriterBufferSize);
+    snprintf(writer->tempPath, sizeof(writer->tempPath), 
+			"%s/.blob.XXXXXX", store->directory);
+    writer->fd = writer->buffer ? mkstemp(writer->tempPath) : -1;
+    if(writer->fd < 0){
+		fprintf(stderr, "Couldn't create temporary file in %s: %s\n",
+				store->directory, strerror(errno));
+		free(writer->buffer);
+		free(writer);
+		return NULL;
+    }
+    (void)fchmod(writer->fd, 0644);
+    CC_SHA256_Init(&writer->digestContext);
+    return writer;
+}
+
+static bool flushBlobWriter(MyBlobWriter *writer)
+{
+    if(writer->bufferUsed && !writer->failed &&
+		!writeAll(writer->fd, writer->buffer, writer->bufferUsed))
+    {
+		fprintf(stderr, "Couldn't write blob: %s\n", strerror(errno));
+		writer->failed = true;
+    }
+    writer->bufferUsed = 0;
+    return !writer->failed;
+}
+
+bool blobWriterAppend(MyBlobWriter *writer, 
+			const void *bytes, size_t length)
+{
+    if(writer->failed)
+		return false;
+    CC_SHA256_Update(&writer->digestContext, bytes, (CC_LONG)length);
+    writer->length += length;
+    
+    if(writer->bufferUsed + length <= kMyBlobWriterBufferSize){
+		memcpy(writer->buffer + writer->bufferUsed, bytes, length);
+		writer->bufferUsed += length;
+		return true;
+    }
+    // Large writes bypass the buffer.
+    if(!flushBlobWriter(writer))
+		return false;
+    if(!writeAll(writer->fd, bytes, length)){
+		fprintf(stderr, "Couldn't write blob: %s\n", strerror(errno));
+		writer->failed = true;
+    }
+    return !writer->failed;
+}
+
+static void releaseBlobWriter(MyBlobWriter *writer, bool keepFile)
+{
+    if(writer->fd >= 0)
+		close(writer->fd);
+    if(!keepFile)
+		unlink(writer->tempPath);
+    free(writer->buffer);
+    free(writer);
+}
+
+bool extractionStoreFinishBlob(MyBlobWriter *writer, 
+			const char *extension, char blobID[kMyBlobIDSize])
+{
+    MyExtractionStore *store = writer->store;
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    char subdirectory[PATH_MAX], finalPath[PATH_MAX];
+    CFStringRef blobKey;
+    bool present, success;
+    int fd;
+    
+    if(!flushBlobWriter(writer)){
+		releaseBlobWriter(writer, false);
+		return false;
+    }
+    fd = writer->fd;
+    writer->fd = -1;
+    if(close(fd) != 0){
+		fprintf(stderr, "Couldn't write blob: %s\n", strerror(errno));
+		releaseBlobWriter(writer, false);
+		return false;
+    }
+    CC_SHA256_Final(digest, &writer->digestContext);
+    makeBlobID(digest, extension, blobID);
+    
+    blobKey = claimBlob(store, blobID, writer->length, false, &present);
+    if(!blobKey){
+		releaseBlobWriter(writer, false);
+		return false;
+    }
+    success = true;
+    if(!present){
+		snprintf(subdirectory, sizeof(subdirectory), "%s/%.2s", 
+				store->directory, blobID);
+		snprintf(finalPath, sizeof(finalPath), "%s/%s", 
+				store->directory, blobID);
+		success = makeDirectory(subdirectory);
+		if(success && rename(writer->tempPath, finalPath) != 0){
+			fprintf(stderr, "Couldn't rename blob %s: %s\n", 
+					blobID, strerror(errno));
+			success = false;
+		}
+    }
+    settleBlob(store, blobKey, success, present, writer->length);
+    // Once renamed, the temporary path no longer names anything.
+    releaseBlobWriter(writer, success && !present);
+    return success;
+}
+
+void extractionStoreCancelBlob(MyBlobWriter *writer)
+{
+    releaseBlobWriter(writer, false);
+}
+
+/* Write a manifest field with the tabs and line ends that would split
+    it, and the backslashes that introduce escapes, escaped. The caller
+    must hold the lock. */
+static void writeManifestField(FILE *manifest, const char *field)
+{
+    for(; *field; field++){
+		switch(*field){
+			case '\t':
+				fputs("\\t", manifest);
+				break;
+			case '\n':
+				fputs("\\n", manifest);
+				break;
+			case '\r':
+				fputs("\\r", manifest);
+				break;
+			case '\\':
+				fputs("\\\\", manifest);
+				break;
+			default:
+				putc(*field, manifest);
+				break;
+		}
+    }
+}
+
+void extractionStoreRecordReference(MyExtractionStore *store, 
+			const char *document, size_t pageNum,
+			const char *resourceName, const char *blobID)
+{
+    pthread_mutex_lock(&store->lock);
+    writeManifestField(store->manifest, document);
+    fprintf(store->manifest, "\t%zd\t", pageNum);
+    writeManifestField(store->manifest, resourceName);
+    fprintf(store->manifest, "\t%s\n", blobID);
+    pthread_mutex_unlock(&store->lock);
+}
+
+void printExtractionStoreResults(FILE *outFile, MyExtractionStore *store)
+{
+    pthread_mutex_lock(&store->lock);
+    fprintf(outFile, 
+		"Extraction store: %zd blobs written and %zd packed "
+		"(%llu bytes), %zd already present.\n",
+		store->blobsWritten, store->blobsPacked, store->bytesWritten, 
+		store->blobsReused);
+    pthread_mutex_unlock(&store->lock);
+}
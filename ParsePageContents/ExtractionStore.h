@@ -0,0 +1,131 @@
+/*
+*  File:    ExtractionStore.h
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef __ExtractionStore__
+#define __ExtractionStore__
+
+#include <ApplicationServices/ApplicationServices.h>
+
+/*  An extraction store is a directory of extracted image data in which
+    each blob is named by the SHA-256 digest of its contents, so the
+    same image extracted from any number of documents is stored once.
+    Alongside the blobs, the store keeps a manifest recording which
+    document, page and resource name each blob came from.
+    
+    Small blobs can instead be packed: appended, with large buffered
+    writes, to a pack file in the store's "packs" subdirectory rather
+    than each written to a file of its own. Each run that packs blobs
+    creates its own pack file. A pack is a sequence of records, each a
+    header line "blob <ID> <length>" followed by the blob's bytes and a
+    newline, so the packed blobs can be found by reading the headers.
+    Packed blobs have IDs of the same form as other blobs, and a blob 
+    already stored in either form isn't packed again. A blob added as a
+    file is written even if it is already packed, so that its ID always
+    names a file.
+    
+    All of the functions below may be called from several threads at
+    once on the same store. */
+typedef struct MyExtractionStore MyExtractionStore;
+
+// Large enough for the hex digest, a subdirectory and an extension.
+#define kMyBlobIDSize 80
+
+/* Create a store in the supplied directory, creating the directory
+    if needed. The manifest is appended to so that one store can 
+    accumulate the images of a whole corpus over many runs. */
+MyExtractionStore *createExtractionStore(const char *directory);
+void releaseExtractionStore(MyExtractionStore *store);
+
+/* Add a blob with the supplied file name extension (such as "jpg")
+    to the store. The blob ID, which is also its path relative to the
+    store directory, is returned in blobID. If a blob with the same
+    contents is already present nothing is written. Returns false if
+    the blob couldn't be written. */
+bool extractionStoreAddBlob(MyExtractionStore *store, 
+			const void *bytes, size_t length,
+			const char *extension, char blobID[kMyBlobIDSize]);
+
+/* Add a blob like extractionStoreAddBlob, packing it if it is no 
+    larger than kMyMaxPackedBlobSize. */
+#define kMyMaxPackedBlobSize	(64*1024)
+bool extractionStoreAddPackedBlob(MyExtractionStore *store, 
+			const void *bytes, size_t length,
+			const char *extension, char blobID[kMyBlobIDSize]);
+
+/* A blob writer streams a blob of unknown contents into the store,
+    so that a blob larger than the memory available for it can be 
+    added. The data goes to a temporary file as it is written and the
+    digest is computed along the way; finishing the blob moves the 
+    file into place, or discards it if the store already holds a blob
+    with the same contents. A writer may be used by one thread at a 
+    time. */
+typedef struct MyBlobWriter MyBlobWriter;
+
+/* Start writing a new blob. Returns NULL if no temporary file could
+    be created. */
+MyBlobWriter *extractionStoreBeginBlob(MyExtractionStore *store);
+
+/* Append bytes to a blob, returning false if they couldn't be written.
+    Once a write has failed, finishing the blob fails too. */
+bool blobWriterAppend(MyBlobWriter *writer, 
+			const void *bytes, size_t length);
+
+/* Finish a blob, giving it the supplied file name extension and 
+    returning its ID as extractionStoreAddBlob does. The writer is 
+    released whether or not this succeeds. */
+bool extractionStoreFinishBlob(MyBlobWriter *writer, 
+			const char *extension, char blobID[kMyBlobIDSize]);
+
+/* Abandon a blob, removing anything written so far and releasing the
+    writer. */
+void extractionStoreCancelBlob(MyBlobWriter *writer);
+
+/* Record in the manifest that the named resource on the supplied 
+    page of a document refers to the blob. Each reference is a line of
+    tab-separated fields, in which tabs, line ends and backslashes are
+    escaped as \t, \n, \r and \\. */
+void extractionStoreRecordReference(MyExtractionStore *store, 
+			const char *document, size_t pageNum,
+			const char *resourceName, const char *blobID);
+
+/* Report how many blobs were written or packed, how many additions
+    were satisfied by a blob already in the store and the number of 
+    bytes written. */
+void printExtractionStoreResults(FILE *outFile, MyExtractionStore *store);
+
+#endif	// __ExtractionStore__
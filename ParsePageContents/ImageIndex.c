@@ -0,0 +1,464 @@
+/*
+*  File:    ImageIndex.c
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+#include "ImageIndex.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdint.h>
+
+#define kMyImageIndexSuffix	".imageindex"
+#define kMyImageIndexVersion	1
+// Written as is, this reads differently on a machine of the other
+// byte order.
+#define kMyImageIndexByteOrder	0x01020304
+
+/* The layout of the file. Every field is naturally aligned, so the
+    tables can be used in place once the file is mapped. */
+typedef struct MyIndexHeader
+{
+    char magic[8];		// "PDFIMIX" and a NUL.
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t documentSize;
+    int64_t documentModTime;	// Seconds since 1970.
+    uint32_t numPages;
+    uint32_t numImages;
+    uint32_t stringsLength;
+    uint32_t reserved;
+}MyIndexHeader;
+
+static const char kMyImageIndexMagic[8] = "PDFIMIX";
+
+typedef struct MyIndexPage
+{
+    uint32_t pageNum;
+    uint32_t firstImage;
+    uint32_t numImages;
+}MyIndexPage;
+
+/* Strings are offsets into the string block. The block starts with a
+    NUL, so offset 0 is the empty string, which stands for NULL. */
+typedef struct MyIndexImage
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t resourceName;
+    uint32_t filter;
+    uint32_t colorSpace;
+    uint32_t blobID;
+    uint16_t bitsPerComponent;
+    uint8_t kind;
+    uint8_t reserved;
+}MyIndexImage;
+
+struct MyImageIndexWriter
+{
+    char path[PATH_MAX];
+    MyIndexHeader header;
+    MyIndexPage *pages;
+    size_t pagesCapacity;
+    MyIndexImage *images;
+    size_t imagesCapacity;
+    char *strings;
+    size_t stringsCapacity;
+    // The offset of each distinct string, keyed by CFString.
+    CFMutableDictionaryRef stringOffsets;
+    bool failed;
+};
+
+struct MyImageIndex
+{
+    const void *map;
+    size_t mapLength;
+    const MyIndexHeader *header;
+    const MyIndexPage *pages;
+    const MyIndexImage *images;
+    const char *strings;
+};
+
+static bool makeIndexPath(const char *documentPath, char path[PATH_MAX])
+{
+    return snprintf(path, PATH_MAX, "%s%s", documentPath, 
+			kMyImageIndexSuffix) < PATH_MAX;
+}
+
+/* Grow a table so it has room for one more entry. */
+static bool growTable(void **table, size_t *capacity, size_t count, 
+			size_t entrySize)
+{
+    size_t newCapacity;
+    void *newTable;
+    
+    if(count < *capacity)
+		return true;
+    newCapacity = *capacity ? 2 * *capacity : 64;
+    newTable = realloc(*table, newCapacity * entrySize);
+    if(!newTable)
+		return false;
+    *table = newTable;
+    *capacity = newCapacity;
+    return true;
+}
+
+MyImageIndexWriter *createImageIndexWriter(const char *documentPath)
+{
+    MyImageIndexWriter *writer;
+    struct stat info;
+    
+    if(stat(documentPath, &info) != 0){
+		fprintf(stderr, "Couldn't examine %s: %s\n", documentPath, 
+				strerror(errno));
+		return NULL;
+    }
+    writer = calloc(1, sizeof(MyImageIndexWriter));
+    if(!writer)
+		return NULL;
+    if(!makeIndexPath(documentPath, writer->path)){
+		free(writer);
+		return NULL;
+    }
+    memcpy(writer->header.magic, kMyImageIndexMagic, 
+			sizeof(writer->header.magic));
+    writer->header.version = kMyImageIndexVersion;
+    writer->header.byteOrder = kMyImageIndexByteOrder;
+    writer->header.documentSize = info.st_size;
+    writer->header.documentModTime = info.st_mtime;
+    writer->stringOffsets = CFDictionaryCreateMutable(NULL, 0, 
+				&kCFTypeDictionaryKeyCallBacks, NULL);
+    writer->strings = malloc(1);
+    if(!writer->stringOffsets || !writer->strings){
+		cancelImageIndex(writer);
+		return NULL;
+    }
+    writer->strings[0] = '\0';
+    writer->stringsCapacity = writer->header.stringsLength = 1;
+    return writer;
+}
+
+/* Return the offset of a string in the string block, adding it if it
+    isn't there yet. */
+static uint32_t addIndexString(MyImageIndexWriter *writer, const char *string)
+{
+    size_t length, newCapacity;
+    CFStringRef key;
+    const void *value;
+    uint32_t offset;
+    
+    if(!string || !*string)
+		return 0;
+    key = CFStringCreateWithCString(NULL, string, kCFStringEncodingUTF8);
+    if(!key){
+		writer->failed = true;
+		return 0;
+    }
+    if(CFDictionaryGetValueIfPresent(writer->stringOffsets, key, &value)){
+		CFRelease(key);
+		return (uint32_t)(uintptr_t)value;
+    }
+    length = strlen(string) + 1;
+    offset = writer->header.stringsLength;
+    if(offset + length > UINT32_MAX){
+		CFRelease(key);
+		writer->failed = true;
+		return 0;
+    }
+    if(offset + length > writer->stringsCapacity){
+		char *newStrings;
+		newCapacity = 2*writer->stringsCapacity;
+		if(newCapacity < offset + length)
+			newCapacity = offset + length;
+		newStrings = realloc(writer->strings, newCapacity);
+		if(!newStrings){
+			CFRelease(key);
+			writer->failed = true;
+			return 0;
+		}
+		writer->strings = newStrings;
+		writer->stringsCapacity = newCapacity;
+    }
+    memcpy(writer->strings + offset, string, length);
+    writer->header.stringsLength += length;
+    CFDictionarySetValue(writer->stringOffsets, key, 
+			(const void *)(uintptr_t)offset);
+    CFRelease(key);
+    return offset;
+}
+
+bool imageIndexAddPage(MyImageIndexWriter *writer, size_t pageNum)
+{
+    MyIndexPage *page;
+    
+    if(writer->failed || !growTable((void **)&writer->pages, 
+			&writer->pagesCapacity, writer->header.numPages,
+			sizeof(MyIndexPage)))
+    {
+		writer->failed = true;
+		return false;
+    }
+    page = &writer->pages[writer->header.numPages++];
+    page->pageNum = pageNum;
+    page->firstImage = writer->header.numImages;
+    page->numImages = 0;
+    return true;
+}
+
+bool imageIndexAddImage(MyImageIndexWriter *writer, 
+			const MyImageIndexEntry *image)
+{
+    MyIndexImage *entry;
+    
+    if(writer->failed || !writer->header.numPages || 
+		writer->header.numImages == UINT32_MAX ||
+		!growTable((void **)&writer->images, &writer->imagesCapacity, 
+			writer->header.numImages, sizeof(MyIndexImage)))
+    {
+		writer->failed = true;
+		return false;
+    }
+    entry = &writer->images[writer->header.numImages++];
+    memset(entry, 0, sizeof(MyIndexImage));
+    entry->width = image->width;
+    entry->height = image->height;
+    entry->bitsPerComponent = image->bitsPerComponent;
+    entry->kind = image->kind;
+    entry->resourceName = addIndexString(writer, image->resourceName);
+    entry->filter = addIndexString(writer, image->filter);
+    entry->colorSpace = addIndexString(writer, image->colorSpace);
+    entry->blobID = addIndexString(writer, image->blobID);
+    writer->pages[writer->header.numPages - 1].numImages++;
+    return !writer->failed;
+}
+
+void cancelImageIndex(MyImageIndexWriter *writer)
+{
+    if(!writer)
+		return;
+    if(writer->stringOffsets)
+		CFRelease(writer->stringOffsets);
+    free(writer->pages);
+    free(writer->images);
+    free(writer->strings);
+    free(writer);
+}
+
+/* The index is written to a temporary file that is renamed over the 
+    old index, so a reader never sees a partly written one. */
+bool finishImageIndex(MyImageIndexWriter *writer)
+{
+    char tempPath[PATH_MAX];
+    FILE *file = NULL;
+    int fd;
+    bool success = false;
+    
+    if(writer->failed){
+		fprintf(stderr, "Couldn't build image index %s!\n", writer->path);
+		cancelImageIndex(writer);
+		return false;
+    }
+    snprintf(tempPath, sizeof(tempPath), "%s.XXXXXX", writer->path);
+    fd = mkstemp(tempPath);
+    if(fd >= 0 && !(file = fdopen(fd, "w")))
+		close(fd);
+    if(file){
+		(void)fchmod(fd, 0644);
+		success = 
+			fwrite(&writer->header, sizeof(MyIndexHeader), 1, file) == 1 &&
+			fwrite(writer->pages, sizeof(MyIndexPage), 
+				writer->header.numPages, file) == writer->header.numPages &&
+			fwrite(writer->images, sizeof(MyIndexImage), 
+				writer->header.numImages, file) == writer->header.numImages &&
+			fwrite(writer->strings, 1, writer->header.stringsLength, file) ==
+				writer->header.stringsLength;
+		success = fclose(file) == 0 && success;
+		success = success && rename(tempPath, writer->path) == 0;
+		if(!success)
+			unlink(tempPath);
+    }
+    if(!success)
+		fprintf(stderr, "Couldn't write image index %s: %s\n", 
+				writer->path, strerror(errno));
+    cancelImageIndex(writer);
+    return success;
+}
+
+/* Check that a mapped index is complete and consistent, so that no
+    offset in it can lead outside the mapping. */
+static bool validateImageIndex(const MyImageIndex *index)
+{
+    const MyIndexHeader *header = index->header;
+    unsigned long long expectedLength;
+    size_t i;
+    
+    if(index->mapLength < sizeof(MyIndexHeader) ||
+		memcmp(header->magic, kMyImageIndexMagic, sizeof(header->magic)) ||
+		header->version != kMyImageIndexVersion ||
+		header->byteOrder != kMyImageIndexByteOrder)
+		return false;
+    expectedLength = sizeof(MyIndexHeader) + 
+			(unsigned long long)header->numPages * sizeof(MyIndexPage) +
+			(unsigned long long)header->numImages * sizeof(MyIndexImage) +
+			header->stringsLength;
+    if(expectedLength != index->mapLength || !header->stringsLength ||
+		index->strings[0] != '\0' ||
+		index->strings[header->stringsLength - 1] != '\0')
+		return false;
+    for(i = 0; i < header->numPages; i++){
+		const MyIndexPage *page = &index->pages[i];
+		if(page->firstImage > header->numImages ||
+			page->numImages > header->numImages - page->firstImage)
+			return false;
+    }
+    for(i = 0; i < header->numImages; i++){
+		const MyIndexImage *image = &index->images[i];
+		if(image->resourceName >= header->stringsLength ||
+			image->filter >= header->stringsLength ||
+			image->colorSpace >= header->stringsLength ||
+			image->blobID >= header->stringsLength)
+			return false;
+    }
+    return true;
+}
+
+MyImageIndex *openImageIndex(const char *documentPath)
+{
+    char path[PATH_MAX];
+    struct stat documentInfo, info;
+    MyImageIndex *index;
+    const char *bytes;
+    int fd;
+    
+    if(!makeIndexPath(documentPath, path))
+		return NULL;
+    if(stat(documentPath, &documentInfo) != 0){
+		fprintf(stderr, "Couldn't examine %s: %s\n", documentPath, 
+				strerror(errno));
+		return NULL;
+    }
+    fd = open(path, O_RDONLY);
+    if(fd < 0){
+		fprintf(stderr, "Couldn't open image index %s: %s\n", path, 
+				strerror(errno));
+		return NULL;
+    }
+    index = calloc(1, sizeof(MyImageIndex));
+    if(!index || fstat(fd, &info) != 0 || info.st_size == 0){
+		fprintf(stderr, "Couldn't read image index %s!\n", path);
+		free(index);
+		close(fd);
+		return NULL;
+    }
+    index->mapLength = info.st_size;
+    index->map = mmap(NULL, index->mapLength, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid once the file is closed.
+    close(fd);
+    if(index->map == MAP_FAILED){
+		fprintf(stderr, "Couldn't map image index %s: %s\n", path, 
+				strerror(errno));
+		free(index);
+		return NULL;
+    }
+    bytes = index->map;
+    index->header = (const MyIndexHeader *)bytes;
+    if(index->mapLength >= sizeof(MyIndexHeader)){
+		bytes += sizeof(MyIndexHeader);
+		index->pages = (const MyIndexPage *)bytes;
+		bytes += index->header->numPages * sizeof(MyIndexPage);
+		index->images = (const MyIndexImage *)bytes;
+		bytes += index->header->numImages * sizeof(MyIndexImage);
+		index->strings = bytes;
+    }
+    if(!validateImageIndex(index)){
+		fprintf(stderr, "Image index %s is damaged!\n", path);
+		closeImageIndex(index);
+		return NULL;
+    }
+    if(index->header->documentSize != (uint64_t)documentInfo.st_size ||
+		index->header->documentModTime != documentInfo.st_mtime)
+    {
+		fprintf(stderr, "Image index %s is out of date!\n", path);
+		closeImageIndex(index);
+		return NULL;
+    }
+    return index;
+}
+
+void closeImageIndex(MyImageIndex *index)
+{
+    if(!index)
+		return;
+    munmap((void *)index->map, index->mapLength);
+    free(index);
+}
+
+size_t imageIndexGetPageCount(const MyImageIndex *index)
+{
+    return index->header->numPages;
+}
+
+void imageIndexGetPage(const MyImageIndex *index, size_t i, 
+			size_t *pageNum, size_t *firstImage, size_t *numImages)
+{
+    const MyIndexPage *page = &index->pages[i];
+    
+    *pageNum = page->pageNum;
+    *firstImage = page->firstImage;
+    *numImages = page->numImages;
+}
+
+static const char *indexString(const MyImageIndex *index, uint32_t offset)
+{
+    return offset ? index->strings + offset : NULL;
+}
+
+void imageIndexGetImage(const MyImageIndex *index, size_t i,
+			MyImageIndexEntry *image)
+{
+    const MyIndexImage *entry = &index->images[i];
+    
+    image->resourceName = indexString(index, entry->resourceName);
+    image->filter = indexString(index, entry->filter);
+    image->colorSpace = indexString(index, entry->colorSpace);
+    image->blobID = indexString(index, entry->blobID);
+    image->width = entry->width;
+    image->height = entry->height;
+    image->bitsPerComponent = entry->bitsPerComponent;
+    image->kind = entry->kind;
+}
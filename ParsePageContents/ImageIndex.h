@@ -0,0 +1,107 @@
+/*
+*  File:    ImageIndex.h
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+#ifndef __ImageIndex__
+#define __ImageIndex__
+
+#include <ApplicationServices/ApplicationServices.h>
+
+/*  An image index is a sidecar file next to a PDF document, named by
+    appending ".imageindex" to the document's path, that lists the 
+    images used on each page of the document. Queries about the images
+    can then be answered from the index alone, without the document 
+    being opened at all.
+    
+    The index is a binary file in the byte order of the machine that 
+    wrote it: a header, a table of pages, a table of images and a block
+    of NUL terminated strings the images refer to by offset, each 
+    distinct string stored once. It is read by mapping it into memory,
+    so opening even a large index costs almost nothing. The header
+    records the size and modification time the document had when it 
+    was scanned, and an index that no longer matches its document is
+    ignored. */
+
+/* One use of an image on a page, as stored in the index. Strings that
+    aren't known are NULL. */
+typedef struct MyImageIndexEntry
+{
+    const char *resourceName;
+    const char *filter;
+    const char *colorSpace;
+    const char *blobID;		// Where the image was extracted to.
+    size_t width;
+    size_t height;
+    size_t bitsPerComponent;
+    unsigned kind;		// Whatever the writer uses to classify images.
+}MyImageIndexEntry;
+
+/* Write an index for a document as its pages are scanned. The writer
+    is created before scanning starts so that a document changed while
+    it is being scanned leaves an index that is already out of date. */
+typedef struct MyImageIndexWriter MyImageIndexWriter;
+
+/* Returns NULL if the document can't be examined. */
+MyImageIndexWriter *createImageIndexWriter(const char *documentPath);
+
+/* Start the entry for a page; the images added after this are those 
+    used on it. Pages must be added in order. */
+bool imageIndexAddPage(MyImageIndexWriter *writer, size_t pageNum);
+bool imageIndexAddImage(MyImageIndexWriter *writer, 
+			const MyImageIndexEntry *image);
+
+/* Write the index next to the document, replacing any index already
+    there, and release the writer. */
+bool finishImageIndex(MyImageIndexWriter *writer);
+/* Release the writer without writing anything. */
+void cancelImageIndex(MyImageIndexWriter *writer);
+
+typedef struct MyImageIndex MyImageIndex;
+
+/* Open the index of a document. Returns NULL, saying why on stderr,
+    if there is no index or it is damaged or out of date. */
+MyImageIndex *openImageIndex(const char *documentPath);
+void closeImageIndex(MyImageIndex *index);
+
+size_t imageIndexGetPageCount(const MyImageIndex *index);
+/* Get the page number of one of the pages in the index and the range
+    of indexes of the images used on it. */
+void imageIndexGetPage(const MyImageIndex *index, size_t i, 
+			size_t *pageNum, size_t *firstImage, size_t *numImages);
+void imageIndexGetImage(const MyImageIndex *index, size_t i,
+			MyImageIndexEntry *image);
+
+#endif	// __ImageIndex__
@@ -0,0 +1,126 @@
+/*
+*  File:    MemoryBudget.c
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#include "MemoryBudget.h"
+#include <pthread.h>
+#include <sys/resource.h>
+
+struct MyMemoryBudget
+{
+    unsigned long long limit;
+    unsigned long long inUse;
+    unsigned long long peak;
+    size_t numReservations;
+    size_t numWaits;
+    size_t numRefused;
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+};
+
+MyMemoryBudget *createMemoryBudget(unsigned long long limit)
+{
+    MyMemoryBudget *budget = calloc(1, sizeof(MyMemoryBudget));
+    
+    if(!budget)
+		return NULL;
+    budget->limit = limit;
+    pthread_mutex_init(&budget->lock, NULL);
+    pthread_cond_init(&budget->available, NULL);
+    return budget;
+}
+
+void releaseMemoryBudget(MyMemoryBudget *budget)
+{
+    if(!budget)
+		return;
+    pthread_cond_destroy(&budget->available);
+    pthread_mutex_destroy(&budget->lock);
+    free(budget);
+}
+
+bool memoryBudgetReserve(MyMemoryBudget *budget, unsigned long long bytes)
+{
+    pthread_mutex_lock(&budget->lock);
+    if(budget->limit && bytes > budget->limit){
+		budget->numRefused++;
+		pthread_mutex_unlock(&budget->lock);
+		return false;
+    }
+    if(budget->limit && budget->inUse + bytes > budget->limit){
+		budget->numWaits++;
+		// Nothing that fits on its own waits forever: once every 
+		// other reservation is returned the budget is empty.
+		while(budget->inUse + bytes > budget->limit)
+			pthread_cond_wait(&budget->available, &budget->lock);
+    }
+    budget->inUse += bytes;
+    if(budget->inUse > budget->peak)
+		budget->peak = budget->inUse;
+    budget->numReservations++;
+    pthread_mutex_unlock(&budget->lock);
+    return true;
+}
+
+void memoryBudgetRelinquish(MyMemoryBudget *budget, unsigned long long bytes)
+{
+    pthread_mutex_lock(&budget->lock);
+    budget->inUse -= bytes;
+    pthread_cond_broadcast(&budget->available);
+    pthread_mutex_unlock(&budget->lock);
+}
+
+void printMemoryBudgetResults(FILE *outFile, MyMemoryBudget *budget)
+{
+    struct rusage usage;
+    
+    pthread_mutex_lock(&budget->lock);
+    if(budget->limit)
+		fprintf(outFile, "Memory ceiling: %llu bytes for image data, "
+			"%llu bytes peak in use.\n", budget->limit, budget->peak);
+    else
+		fprintf(outFile, "Memory: %llu bytes peak in use for image data.\n",
+			budget->peak);
+    fprintf(outFile, "Memory: %zd images decoded, %zd waited for memory, "
+			"%zd refused as too large.\n", budget->numReservations,
+			budget->numWaits, budget->numRefused);
+    pthread_mutex_unlock(&budget->lock);
+    // ru_maxrss is in bytes on Mac OS X.
+    if(getrusage(RUSAGE_SELF, &usage) == 0)
+		fprintf(outFile, "Memory: %ld bytes peak resident.\n", 
+				(long)usage.ru_maxrss);
+}
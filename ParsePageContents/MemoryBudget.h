@@ -0,0 +1,73 @@
+/*
+*  File:    MemoryBudget.h
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef __MemoryBudget__
+#define __MemoryBudget__
+
+#include <ApplicationServices/ApplicationServices.h>
+
+/*  A memory budget puts a ceiling on the bytes that the workers of a
+    scan hold at once for image data. Before decoding an image a worker
+    reserves the memory the image will need, waiting while other 
+    workers' images would take the total over the ceiling, and gives 
+    the memory back when it is done. An image that needs more than the
+    whole ceiling is refused rather than decoded.
+    
+    All of the functions below may be called from several threads at
+    once on the same budget. */
+typedef struct MyMemoryBudget MyMemoryBudget;
+
+/* Create a budget with the supplied ceiling in bytes. A ceiling of 0
+    means there is no limit; reservations are still counted so that 
+    the peak can be reported. */
+MyMemoryBudget *createMemoryBudget(unsigned long long limit);
+void releaseMemoryBudget(MyMemoryBudget *budget);
+
+/* Reserve bytes from the budget, blocking until they fit. Returns 
+    false, without waiting, if the request is larger than the ceiling. */
+bool memoryBudgetReserve(MyMemoryBudget *budget, unsigned long long bytes);
+
+/* Return bytes reserved with memoryBudgetReserve. */
+void memoryBudgetRelinquish(MyMemoryBudget *budget, unsigned long long bytes);
+
+/* Report the ceiling, the most bytes reserved at once, how many 
+    reservations had to wait or were refused and the peak resident 
+    size of the process. */
+void printMemoryBudgetResults(FILE *outFile, MyMemoryBudget *budget);
+
+#endif	// __MemoryBudget__
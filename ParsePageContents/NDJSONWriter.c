@@ -0,0 +1,287 @@
+/*
+*  File:    NDJSONWriter.c
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#include "NDJSONWriter.h"
+
+// Complete records are written out once this much has been buffered.
+#define kMyNDJSONFlushSize	(64*1024)
+
+struct MyNDJSONWriter
+{
+    FILE *outFile;
+    char *buffer;
+    size_t length;
+    size_t capacity;
+    // The end of the last complete record in the buffer, which is 
+    // where the record being built starts.
+    size_t recordEnd;
+    // False right after an object or array is opened, when the next
+    // value needs no separating comma.
+    bool needComma;
+    // Set if part of the record being built couldn't be buffered.
+    bool failed;
+};
+
+MyNDJSONWriter *createNDJSONWriter(FILE *outFile)
+{
+    MyNDJSONWriter *writer = calloc(1, sizeof(MyNDJSONWriter));
+    
+    if(!writer)
+		return NULL;
+    writer->outFile = outFile;
+    writer->capacity = 2*kMyNDJSONFlushSize;
+    writer->buffer = malloc(writer->capacity);
+    if(!writer->buffer){
+		free(writer);
+		return NULL;
+    }
+    return writer;
+}
+
+void releaseNDJSONWriter(MyNDJSONWriter *writer)
+{
+    if(!writer)
+		return;
+    ndjsonFlush(writer);
+    free(writer->buffer);
+    free(writer);
+}
+
+static void appendBytes(MyNDJSONWriter *writer, const char *bytes, 
+			size_t length)
+{
+    if(writer->length + length > writer->capacity){
+		size_t newCapacity = writer->capacity;
+		char *newBuffer;
+		
+		while(writer->length + length > newCapacity)
+			newCapacity *= 2;
+		newBuffer = realloc(writer->buffer, newCapacity);
+		if(!newBuffer){
+			writer->failed = true;
+			return;
+		}
+		writer->buffer = newBuffer;
+		writer->capacity = newCapacity;
+    }
+    memcpy(writer->buffer + writer->length, bytes, length);
+    writer->length += length;
+}
+
+static void appendCharacter(MyNDJSONWriter *writer, char c)
+{
+    appendBytes(writer, &c, 1);
+}
+
+/* Return the length of the well formed UTF-8 sequence starting at 
+    bytes, or 0 if it isn't one: a stray continuation byte, a sequence
+    cut short, an overlong form, a surrogate or a code point past 
+    U+10FFFF. */
+static size_t utf8SequenceLength(const unsigned char *bytes)
+{
+    unsigned char c = bytes[0];
+    size_t length, i;
+    unsigned long codePoint;
+    
+    if(c < 0x80)
+		return 1;
+    if(c >= 0xC2 && c <= 0xDF){
+		length = 2;
+		codePoint = c & 0x1F;
+    }else if(c >= 0xE0 && c <= 0xEF){
+		length = 3;
+		codePoint = c & 0x0F;
+    }else if(c >= 0xF0 && c <= 0xF4){
+		length = 4;
+		codePoint = c & 0x07;
+    }else
+		return 0;
+    // A terminating zero stops this loop, since it isn't a 
+    // continuation byte.
+    for(i = 1; i < length; i++){
+		if((bytes[i] & 0xC0) != 0x80)
+			return 0;
+		codePoint = (codePoint << 6) | (bytes[i] & 0x3F);
+    }
+    if((length == 3 && codePoint < 0x800) || 
+		(length == 4 && (codePoint < 0x10000 || codePoint > 0x10FFFF)) ||
+		(codePoint >= 0xD800 && codePoint <= 0xDFFF))
+		return 0;
+    return length;
+}
+
+/* Append a JSON string literal, escaping what JSON requires. Strings
+    from PDF files, such as resource names, are arbitrary bytes, so any
+    that aren't well formed UTF-8 are each written as U+FFFD, the 
+    replacement character. */
+static void appendQuoted(MyNDJSONWriter *writer, const char *string)
+{
+    const char *run = string;
+    char escape[8];
+    size_t length;
+    
+    appendCharacter(writer, '"');
+    while(*string){
+		unsigned char c = *string;
+		if(c >= 0x80){
+			length = utf8SequenceLength((const unsigned char *)string);
+			if(length){
+				string += length;
+				continue;
+			}
+			appendBytes(writer, run, string - run);
+			appendBytes(writer, "\xEF\xBF\xBD", 3);
+			run = ++string;
+			continue;
+		}
+		if(c >= 0x20 && c != '"' && c != '\\'){
+			string++;
+			continue;
+		}
+		appendBytes(writer, run, string - run);
+		switch(c){
+			case '"':	appendBytes(writer, "\\\"", 2); break;
+			case '\\':	appendBytes(writer, "\\\\", 2); break;
+			case '\n':	appendBytes(writer, "\\n", 2); break;
+			case '\r':	appendBytes(writer, "\\r", 2); break;
+			case '\t':	appendBytes(writer, "\\t", 2); break;
+			default:
+				snprintf(escape, sizeof(escape), "\\u%04x", c);
+				appendBytes(writer, escape, 6);
+				break;
+		}
+		run = ++string;
+    }
+    appendBytes(writer, run, string - run);
+    appendCharacter(writer, '"');
+}
+
+/* Start a value, adding the separating comma and the key if any. */
+static void beginValue(MyNDJSONWriter *writer, const char *key)
+{
+    if(writer->needComma)
+		appendCharacter(writer, ',');
+    if(key){
+		appendQuoted(writer, key);
+		appendCharacter(writer, ':');
+    }
+    writer->needComma = true;
+}
+
+void ndjsonBeginRecord(MyNDJSONWriter *writer)
+{
+    writer->needComma = false;
+    appendCharacter(writer, '{');
+}
+
+void ndjsonEndRecord(MyNDJSONWriter *writer)
+{
+    appendBytes(writer, "}\n", 2);
+    // A record with a piece missing wouldn't be valid JSON, so it is
+    // dropped whole.
+    if(writer->failed){
+		fprintf(stderr, "Couldn't buffer NDJSON output; record dropped!\n");
+		writer->length = writer->recordEnd;
+		writer->failed = false;
+		return;
+    }
+    writer->recordEnd = writer->length;
+    if(writer->recordEnd >= kMyNDJSONFlushSize)
+		ndjsonFlush(writer);
+}
+
+void ndjsonBeginObject(MyNDJSONWriter *writer, const char *key)
+{
+    beginValue(writer, key);
+    appendCharacter(writer, '{');
+    writer->needComma = false;
+}
+
+void ndjsonEndObject(MyNDJSONWriter *writer)
+{
+    appendCharacter(writer, '}');
+    writer->needComma = true;
+}
+
+void ndjsonBeginArray(MyNDJSONWriter *writer, const char *key)
+{
+    beginValue(writer, key);
+    appendCharacter(writer, '[');
+    writer->needComma = false;
+}
+
+void ndjsonEndArray(MyNDJSONWriter *writer)
+{
+    appendCharacter(writer, ']');
+    writer->needComma = true;
+}
+
+void ndjsonAddString(MyNDJSONWriter *writer, const char *key, 
+			const char *value)
+{
+    beginValue(writer, key);
+    if(value)
+		appendQuoted(writer, value);
+    else
+		appendBytes(writer, "null", 4);
+}
+
+void ndjsonAddInteger(MyNDJSONWriter *writer, const char *key, 
+			long long value)
+{
+    char number[32];
+    
+    beginValue(writer, key);
+    appendBytes(writer, number, 
+			snprintf(number, sizeof(number), "%lld", value));
+}
+
+void ndjsonFlush(MyNDJSONWriter *writer)
+{
+    if(!writer->recordEnd)
+		return;
+    if(fwrite(writer->buffer, 1, writer->recordEnd, writer->outFile) 
+			!= writer->recordEnd)
+		fprintf(stderr, "Couldn't write NDJSON output!\n");
+    fflush(writer->outFile);
+    // Keep any record still being built.
+    memmove(writer->buffer, writer->buffer + writer->recordEnd, 
+			writer->length - writer->recordEnd);
+    writer->length -= writer->recordEnd;
+    writer->recordEnd = 0;
+}
@@ -0,0 +1,79 @@
+/*
+*  File:    NDJSONWriter.h
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef __NDJSONWriter__
+#define __NDJSONWriter__
+
+#include <ApplicationServices/ApplicationServices.h>
+
+/*  An NDJSON writer formats records as compact JSON objects, one per
+    line, into a single buffer and writes the buffer to its file in 
+    large blocks. A record is only ever written whole, so a reader 
+    following the file never sees part of one, and a record that 
+    couldn't all be buffered isn't written at all.
+    
+    A writer isn't thread safe; callers writing records from several
+    threads must serialize whole records. */
+typedef struct MyNDJSONWriter MyNDJSONWriter;
+
+MyNDJSONWriter *createNDJSONWriter(FILE *outFile);
+/* Write anything still buffered and release the writer. */
+void releaseNDJSONWriter(MyNDJSONWriter *writer);
+
+/* Start and finish a record, which is a top level object. */
+void ndjsonBeginRecord(MyNDJSONWriter *writer);
+void ndjsonEndRecord(MyNDJSONWriter *writer);
+
+/* Start and finish a nested object or array. The key is NULL for 
+    elements of an array. */
+void ndjsonBeginObject(MyNDJSONWriter *writer, const char *key);
+void ndjsonEndObject(MyNDJSONWriter *writer);
+void ndjsonBeginArray(MyNDJSONWriter *writer, const char *key);
+void ndjsonEndArray(MyNDJSONWriter *writer);
+
+/* Add a member to the current object, or an element to the current 
+    array if key is NULL. A NULL string is written as null. */
+void ndjsonAddString(MyNDJSONWriter *writer, const char *key, 
+			const char *value);
+void ndjsonAddInteger(MyNDJSONWriter *writer, const char *key, 
+			long long value);
+
+/* Write out all complete records buffered so far. */
+void ndjsonFlush(MyNDJSONWriter *writer);
+
+#endif	// __NDJSONWriter__
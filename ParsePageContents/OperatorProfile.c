@@ -0,0 +1,126 @@
+/*
+*  File:    OperatorProfile.c
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#include "OperatorProfile.h"
+
+// In the order of the operator summary in the PDF Reference.
+const char * const kMyPDFOperatorNames[kMyNumPDFOperators] = {
+    "b", "B", "b*", "B*", "BDC", "BI", "BMC", "BT", "BX", "c",
+    "cm", "CS", "cs", "d", "d0", "d1", "Do", "DP", "EI", "EMC",
+    "ET", "EX", "f", "F", "f*", "G", "g", "gs", "h", "i",
+    "ID", "j", "J", "K", "k", "l", "m", "M", "MP", "n",
+    "q", "Q", "re", "RG", "rg", "ri", "s", "S", "SC", "sc",
+    "SCN", "scn", "sh", "T*", "Tc", "Td", "TD", "Tf", "Tj", "TJ",
+    "TL", "Tm", "Tr", "Ts", "Tw", "Tz", "v", "w", "W", "W*",
+    "y", "'", "\""
+};
+
+/* An entry in one of the rankings below. */
+typedef struct MyRankedItem
+{
+    size_t index;
+    double value;
+}MyRankedItem;
+
+static int compareRankedItems(const void *a, const void *b)
+{
+    const MyRankedItem *itemA = a, *itemB = b;
+    
+    // Largest first, ties in index order so the report is stable.
+    if(itemA->value != itemB->value)
+		return itemA->value < itemB->value ? 1 : -1;
+    return itemA->index < itemB->index ? -1 : 1;
+}
+
+static size_t countOperatorsOnPage(const MyPageProfile *profile)
+{
+    size_t i, count = 0;
+    
+    for(i = 0; i < kMyNumPDFOperators; i++)
+		count += profile->operatorCounts[i];
+    return count;
+}
+
+void printOperatorProfile(FILE *outFile, const MyPageProfile *profiles,
+			size_t numPages, size_t numSlowest, size_t numFrequent)
+{
+    MyRankedItem *pages, operators[kMyNumPDFOperators];
+    size_t i, j, totalOperators = 0;
+    
+    pages = malloc((numPages ? numPages : 1) * sizeof(MyRankedItem));
+    if(!pages){
+		fprintf(stderr, "Couldn't allocate operator profile!\n");
+		return;
+    }
+    for(i = 0; i < kMyNumPDFOperators; i++){
+		operators[i].index = i;
+		operators[i].value = 0;
+    }
+    for(i = 0; i < numPages; i++){
+		pages[i].index = i;
+		pages[i].value = profiles[i].seconds;
+		for(j = 0; j < kMyNumPDFOperators; j++)
+			operators[j].value += profiles[i].operatorCounts[j];
+    }
+    for(i = 0; i < kMyNumPDFOperators; i++)
+		totalOperators += (size_t)operators[i].value;
+    qsort(pages, numPages, sizeof(MyRankedItem), compareRankedItems);
+    qsort(operators, kMyNumPDFOperators, sizeof(MyRankedItem), 
+			compareRankedItems);
+    
+    if(numSlowest > numPages)
+		numSlowest = numPages;
+    fprintf(outFile, "Slowest %zd pages:\n", numSlowest);
+    for(i = 0; i < numSlowest; i++){
+		const MyPageProfile *profile = &profiles[pages[i].index];
+		fprintf(outFile, "    Page %zd: %.3f ms, %zd operators, "
+				"%llu bytes of image data.\n", profile->pageNum, 
+				profile->seconds * 1000., 
+				countOperatorsOnPage(profile), profile->imageBytes);
+    }
+    
+    fprintf(outFile, "Most frequent operators (%zd in all):\n", 
+			totalOperators);
+    for(i = 0; i < numFrequent && i < kMyNumPDFOperators && 
+			operators[i].value > 0; i++)
+		fprintf(outFile, "    %-4s %.0f (%.1f%%)\n", 
+				kMyPDFOperatorNames[operators[i].index], 
+				operators[i].value, 
+				100. * operators[i].value / totalOperators);
+    free(pages);
+}
@@ -0,0 +1,173 @@
+/*
+*  File:    PageSelection.c
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#include "PageSelection.h"
+
+// Samples are drawn with this seed so that they can be reproduced.
+#define kMySampleSeed	0x5DEECE66DULL
+
+/* Parse a page number, which must be at least 1. */
+static bool parsePageNumber(const char **string, size_t *pageNum)
+{
+    char *end;
+    unsigned long value;
+    
+    if(**string < '0' || **string > '9')
+		return false;
+    value = strtoul(*string, &end, 10);
+    if(value < 1)
+		return false;
+    *pageNum = value;
+    *string = end;
+    return true;
+}
+
+bool parsePageRanges(const char *list, MyPageSelection *selection)
+{
+    const char *p = list;
+    
+    for(;;){
+		MyPageRange range, *ranges;
+		
+		if(!parsePageNumber(&p, &range.first))
+			return false;
+		range.last = range.first;
+		if(*p == '-'){
+			p++;
+			if(*p == ',' || *p == '\0')
+				range.last = 0;
+			else if(!parsePageNumber(&p, &range.last) || 
+					range.last < range.first)
+				return false;
+		}
+		ranges = realloc(selection->ranges, 
+				(selection->numRanges + 1) * sizeof(MyPageRange));
+		if(!ranges)
+			return false;
+		ranges[selection->numRanges++] = range;
+		selection->ranges = ranges;
+		
+		if(*p == '\0')
+			return true;
+		if(*p++ != ',')
+			return false;
+    }
+}
+
+void freePageSelection(MyPageSelection *selection)
+{
+    free(selection->ranges);
+    selection->ranges = NULL;
+    selection->numRanges = 0;
+}
+
+/* A small generator of our own, rather than random(), so that samples
+    are the same on every system. This is xorshift64*. */
+static unsigned long long nextRandom(unsigned long long *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+static int comparePageNumbers(const void *a, const void *b)
+{
+    size_t pageA = *(const size_t *)a, pageB = *(const size_t *)b;
+    return pageA < pageB ? -1 : pageA > pageB;
+}
+
+size_t *createSelectedPageList(const MyPageSelection *selection, 
+			size_t numPages, size_t *count)
+{
+    bool *selected;
+    size_t *pages, i, n = 0;
+    
+    *count = 0;
+    if(!numPages)
+		return NULL;
+    selected = calloc(numPages + 1, sizeof(bool));
+    if(!selected)
+		return NULL;
+    // Marking pages merges overlapping ranges and puts them in order.
+    if(!selection->numRanges)
+		for(i = 1; i <= numPages; i++)
+			selected[i] = true;
+    for(i = 0; i < selection->numRanges; i++){
+		size_t page, last = selection->ranges[i].last;
+		if(!last || last > numPages)
+			last = numPages;
+		for(page = selection->ranges[i].first; page <= last; page++)
+			selected[page] = true;
+    }
+    for(i = 1; i <= numPages; i++)
+		n += selected[i];
+    pages = n ? malloc(n * sizeof(size_t)) : NULL;
+    if(!pages){
+		free(selected);
+		return NULL;
+    }
+    n = 0;
+    for(i = 1; i <= numPages; i++)
+		if(selected[i])
+			pages[n++] = i;
+    free(selected);
+    
+    if(selection->every > 1){
+		size_t kept = 0;
+		for(i = 0; i < n; i += selection->every)
+			pages[kept++] = pages[i];
+		n = kept;
+    }
+    
+    if(selection->sampleSize && selection->sampleSize < n){
+		unsigned long long state = kMySampleSeed;
+		// Shuffle a random sample into the front of the list, then
+		// put it back in page order.
+		for(i = 0; i < selection->sampleSize; i++){
+			size_t j = i + nextRandom(&state) % (n - i);
+			size_t page = pages[i];
+			pages[i] = pages[j];
+			pages[j] = page;
+		}
+		n = selection->sampleSize;
+		qsort(pages, n, sizeof(size_t), comparePageNumbers);
+    }
+    *count = n;
+    return pages;
+}
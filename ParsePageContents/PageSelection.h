@@ -0,0 +1,77 @@
+/*
+*  File:    PageSelection.h
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef __PageSelection__
+#define __PageSelection__
+
+#include <ApplicationServices/ApplicationServices.h>
+
+/* One range of page numbers. A last page of 0 means the range runs to
+    the end of the document. */
+typedef struct MyPageRange
+{
+    size_t first;
+    size_t last;
+}MyPageRange;
+
+/*  Which pages of a document to scan. The pages in the ranges, or all
+    pages if there are none, are narrowed to every nth page of those 
+    if every is more than 1 and then to a random sample of sampleSize
+    of those if sampleSize is not 0. The sample is drawn with a fixed 
+    seed so the same options always select the same pages. */
+typedef struct MyPageSelection
+{
+    MyPageRange *ranges;
+    size_t numRanges;
+    size_t every;
+    size_t sampleSize;
+}MyPageSelection;
+
+/* Add the ranges in a list such as "10-200,500" or "7-" to the 
+    selection. Returns false if the list is malformed. */
+bool parsePageRanges(const char *list, MyPageSelection *selection);
+void freePageSelection(MyPageSelection *selection);
+
+/* Return the numbers of the selected pages of a document with numPages
+    pages in increasing order, setting *count. Pages beyond the end of
+    the document are ignored. The caller must free the result, which 
+    is NULL if no pages are selected or on failure. */
+size_t *createSelectedPageList(const MyPageSelection *selection, 
+			size_t numPages, size_t *count);
+
+#endif	// __PageSelection__
@@ -0,0 +1,389 @@
+/*
+*  File:    RGBConversion.c
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#include "RGBConversion.h"
+#include <pthread.h>
+#include <math.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+typedef enum MyRGBConversionKind
+{
+    kMyConvertCMYK,
+    kMyConvertLab,
+    kMyConvertIndexed
+}MyRGBConversionKind;
+
+struct MyRGBConverter
+{
+    MyRGBConversionKind kind;
+    /* For Lab, the terms of the CIE formulas that depend on one 
+	component each, with the Decode values applied: (L*+16)/116, 
+	a* /500 and b* /200. */
+    float fyFromL[256];
+    float fxOffsetFromA[256];
+    float fzOffsetFromB[256];
+    /* For indexed samples, the lookup table converted to RGB with a 
+	fourth, unused byte so each entry can be copied as one word. */
+    UInt32 palette[256];
+};
+
+/* Linear RGB values from 0 to 1 are looked up in this table, in steps
+    of 1/(kMyGammaTableSize - 1), to apply the sRGB transfer function. */
+#define kMyGammaTableSize	4096
+static UInt8 gSRGBFromLinear[kMyGammaTableSize];
+static pthread_once_t gGammaTableOnce = PTHREAD_ONCE_INIT;
+
+static void buildGammaTable(void)
+{
+    int i;
+    
+    for(i = 0; i < kMyGammaTableSize; i++){
+		double linear = (double)i / (kMyGammaTableSize - 1);
+		double value = (linear <= 0.0031308) ? 12.92 * linear :
+				1.055 * pow(linear, 1/2.4) - 0.055;
+		gSRGBFromLinear[i] = (UInt8)(255. * value + 0.5);
+    }
+}
+
+/*  Lab is converted to XYZ relative to the color space's white point
+    and then to sRGB, whose white point is D65. The white points are 
+    matched by scaling XYZ, so the color space's own white point 
+    cancels out: X and Z come out as D65's white times the inverse of
+    the CIE f function. The D65 white is folded into the matrix from 
+    XYZ to linear sRGB. */
+#define kMyD65X	0.9505f
+#define kMyD65Z	1.0890f
+static const float kMyLabToLinearRGB[3][3] = {
+    {  3.2406f*kMyD65X, -1.5372f, -0.4986f*kMyD65Z },
+    { -0.9689f*kMyD65X,  1.8758f,  0.0415f*kMyD65Z },
+    {  0.0557f*kMyD65X, -0.2040f,  1.0570f*kMyD65Z }
+};
+
+// Where the CIE f function switches from a cube to a straight line.
+#define kMyLabDelta	(6.f/29.f)
+
+static float inverseLabF(float t)
+{
+    if(t > kMyLabDelta)
+		return t*t*t;
+    return 3.f*kMyLabDelta*kMyLabDelta*(t - 4.f/29.f);
+}
+
+static UInt8 linearToSRGB(float linear)
+{
+    if(!(linear > 0.f))
+		return 0;
+    if(linear >= 1.f)
+		return 255;
+    return gSRGBFromLinear[(int)(linear*(kMyGammaTableSize - 1) + 0.5f)];
+}
+
+static MyRGBConverter *createConverter(MyRGBConversionKind kind)
+{
+    MyRGBConverter *converter = calloc(1, sizeof(MyRGBConverter));
+    
+    if(converter)
+		converter->kind = kind;
+    return converter;
+}
+
+MyRGBConverter *createCMYKToRGBConverter(void)
+{
+    return createConverter(kMyConvertCMYK);
+}
+
+MyRGBConverter *createLabToRGBConverter(const CGFloat decode[6])
+{
+    MyRGBConverter *converter = createConverter(kMyConvertLab);
+    int u;
+    
+    if(!converter)
+		return NULL;
+    pthread_once(&gGammaTableOnce, buildGammaTable);
+    for(u = 0; u < 256; u++){
+		double L = decode[0] + u*(decode[1] - decode[0])/255.;
+		double a = decode[2] + u*(decode[3] - decode[2])/255.;
+		double b = decode[4] + u*(decode[5] - decode[4])/255.;
+		converter->fyFromL[u] = (L + 16.)/116.;
+		converter->fxOffsetFromA[u] = a/500.;
+		converter->fzOffsetFromB[u] = b/200.;
+    }
+    return converter;
+}
+
+/* Convert one CMYK color to RGB, returning the bytes in memory order
+    in a word as the palette holds them. */
+static UInt32 packedRGBFromCMYK(const UInt8 cmyk[4])
+{
+    UInt8 rgbx[4];
+    UInt32 packed;
+    int i;
+    
+    for(i = 0; i < 3; i++){
+		int sum = cmyk[i] + cmyk[3];
+		rgbx[i] = (sum >= 255) ? 0 : 255 - sum;
+    }
+    rgbx[3] = 0;
+    memcpy(&packed, rgbx, sizeof(packed));
+    return packed;
+}
+
+MyRGBConverter *createIndexedToRGBConverter(CGColorSpaceRef colorSpace)
+{
+    CGColorSpaceRef base = CGColorSpaceGetBaseColorSpace(colorSpace);
+    size_t count = CGColorSpaceGetColorTableCount(colorSpace);
+    size_t baseComponents, i;
+    MyRGBConverter *converter;
+    UInt8 *table;
+    
+    if(!base || count < 1 || count > 256)
+		return NULL;
+    switch(CGColorSpaceGetModel(base)){
+		case kCGColorSpaceModelMonochrome:
+		case kCGColorSpaceModelRGB:
+		case kCGColorSpaceModelCMYK:
+			break;
+		default:
+			return NULL;
+    }
+    baseComponents = CGColorSpaceGetNumberOfComponents(base);
+    table = malloc(count * baseComponents);
+    converter = table ? createConverter(kMyConvertIndexed) : NULL;
+    if(!converter){
+		free(table);
+		return NULL;
+    }
+    // This is the lookup table colorSpaceFromPDFArray read from the 
+    // document, one byte per component of the base color space.
+    CGColorSpaceGetColorTable(colorSpace, table);
+    for(i = 0; i < count; i++){
+		const UInt8 *entry = table + i*baseComponents;
+		UInt8 rgbx[4] = { 0, 0, 0, 0 };
+		
+		if(baseComponents == 4)
+			converter->palette[i] = packedRGBFromCMYK(entry);
+		else{
+			if(baseComponents == 1)
+				rgbx[0] = rgbx[1] = rgbx[2] = entry[0];
+			else
+				memcpy(rgbx, entry, 3);
+			memcpy(&converter->palette[i], rgbx, sizeof(UInt32));
+		}
+    }
+    // The rest of the palette is already black.
+    free(table);
+    return converter;
+}
+
+void releaseRGBConverter(MyRGBConverter *converter)
+{
+    free(converter);
+}
+
+size_t rgbConverterGetInputComponents(const MyRGBConverter *converter)
+{
+    switch(converter->kind){
+		case kMyConvertCMYK:
+			return 4;
+		case kMyConvertLab:
+			return 3;
+		default:
+			return 1;
+    }
+}
+
+/*  The SSE2 loops below produce four pixels at a time with a fourth,
+    unused byte each, and storeRGBFromRGBX squeezes those 16 bytes into
+    the 12 bytes of four RGB pixels. SSE2 has no byte shuffle, so this 
+    is done with shifts and masks: first each pair of pixels is joined
+    within its 64 bit half and then the two halves are joined. The 
+    store writes 16 bytes, so the loops stop while there are at least 
+    two pixels of room left in the row past the four being written. */
+#if defined(__SSE2__)
+static void storeRGBFromRGBX(UInt8 *dst, __m128i v)
+{
+    const __m128i firstPixel = _mm_set_epi32(0, 0x00FFFFFF, 0, 0x00FFFFFF);
+    const __m128i secondPixel = _mm_set_epi32(0x0000FFFF, (int)0xFF000000,
+					0x0000FFFF, (int)0xFF000000);
+    const __m128i lowHalf = _mm_set_epi32(0, 0, 0x0000FFFF, (int)0xFFFFFFFF);
+    const __m128i highHalf = _mm_set_epi32(0, (int)0xFFFFFFFF, 
+					(int)0xFFFF0000, 0);
+    
+    v = _mm_or_si128(_mm_and_si128(v, firstPixel), 
+			_mm_and_si128(_mm_srli_epi64(v, 8), secondPixel));
+    v = _mm_or_si128(_mm_and_si128(v, lowHalf), 
+			_mm_and_si128(_mm_srli_si128(v, 2), highHalf));
+    _mm_storeu_si128((__m128i *)dst, v);
+}
+#endif
+
+static void convertCMYKRow(const UInt8 *src, UInt8 *dst, size_t width)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i allOnes = _mm_set1_epi8((char)0xFF);
+    for(; i + 6 <= width; i += 4){
+		__m128i cmyk = _mm_loadu_si128((const __m128i *)(src + 4*i));
+		// Copy each pixel's black into its other three bytes, add it
+		// with saturation and take the complement.
+		__m128i k = _mm_srli_epi32(cmyk, 24);
+		k = _mm_or_si128(_mm_or_si128(k, _mm_slli_epi32(k, 8)), 
+					_mm_slli_epi32(k, 16));
+		storeRGBFromRGBX(dst + 3*i, 
+				_mm_xor_si128(_mm_adds_epu8(cmyk, k), allOnes));
+    }
+#endif
+    for(; i < width; i++){
+		UInt32 packed = packedRGBFromCMYK(src + 4*i);
+		memcpy(dst + 3*i, &packed, 3);
+    }
+}
+
+static void convertIndexedRow(const MyRGBConverter *converter, 
+			const UInt8 *src, UInt8 *dst, size_t width)
+{
+    const UInt32 *palette = converter->palette;
+    size_t i = 0;
+#if defined(__SSE2__)
+    // SSE2 can't gather either, so the palette entries are loaded one 
+    // at a time and only the packing is done four pixels at once.
+    for(; i + 6 <= width; i += 4)
+		storeRGBFromRGBX(dst + 3*i, 
+			_mm_setr_epi32((int)palette[src[i]], (int)palette[src[i + 1]],
+					(int)palette[src[i + 2]], (int)palette[src[i + 3]]));
+#endif
+    for(; i < width; i++)
+		memcpy(dst + 3*i, &palette[src[i]], 3);
+}
+
+static void convertLabPixel(const MyRGBConverter *converter, 
+			const UInt8 *lab, UInt8 *rgb)
+{
+    float fy = converter->fyFromL[lab[0]];
+    float xyz[3], linear;
+    int c;
+    
+    xyz[0] = inverseLabF(fy + converter->fxOffsetFromA[lab[1]]);
+    xyz[1] = inverseLabF(fy);
+    xyz[2] = inverseLabF(fy - converter->fzOffsetFromB[lab[2]]);
+    for(c = 0; c < 3; c++){
+		linear = kMyLabToLinearRGB[c][0]*xyz[0] + 
+				kMyLabToLinearRGB[c][1]*xyz[1] + 
+				kMyLabToLinearRGB[c][2]*xyz[2];
+		rgb[c] = linearToSRGB(linear);
+    }
+}
+
+#if defined(__SSE2__)
+static __m128 inverseLabF4(__m128 t)
+{
+    __m128 cube = _mm_mul_ps(_mm_mul_ps(t, t), t);
+    __m128 line = _mm_mul_ps(_mm_sub_ps(t, _mm_set1_ps(4.f/29.f)), 
+				_mm_set1_ps(3.f*kMyLabDelta*kMyLabDelta));
+    __m128 isCube = _mm_cmpgt_ps(t, _mm_set1_ps(kMyLabDelta));
+    
+    return _mm_or_ps(_mm_and_ps(isCube, cube), _mm_andnot_ps(isCube, line));
+}
+#endif
+
+static void convertLabRow(const MyRGBConverter *converter, 
+			const UInt8 *src, UInt8 *dst, size_t width)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    // Four pixels are converted at once with one component of each in 
+    // a register. The per component terms and the transfer function 
+    // are table lookups, which SSE2 has to do one lane at a time.
+    const __m128 scale = _mm_set1_ps(kMyGammaTableSize - 1);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    for(; i + 4 <= width; i += 4){
+		const UInt8 *p = src + 3*i;
+		__m128 fy = _mm_setr_ps(converter->fyFromL[p[0]], 
+				converter->fyFromL[p[3]], converter->fyFromL[p[6]], 
+				converter->fyFromL[p[9]]);
+		__m128 fx = _mm_add_ps(fy, _mm_setr_ps(
+				converter->fxOffsetFromA[p[1]], 
+				converter->fxOffsetFromA[p[4]], 
+				converter->fxOffsetFromA[p[7]], 
+				converter->fxOffsetFromA[p[10]]));
+		__m128 fz = _mm_sub_ps(fy, _mm_setr_ps(
+				converter->fzOffsetFromB[p[2]], 
+				converter->fzOffsetFromB[p[5]], 
+				converter->fzOffsetFromB[p[8]], 
+				converter->fzOffsetFromB[p[11]]));
+		__m128 x = inverseLabF4(fx), y = inverseLabF4(fy), 
+				z = inverseLabF4(fz);
+		int c, j;
+		
+		for(c = 0; c < 3; c++){
+			__m128 linear = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_set1_ps(kMyLabToLinearRGB[c][0]), x),
+				_mm_mul_ps(_mm_set1_ps(kMyLabToLinearRGB[c][1]), y)),
+				_mm_mul_ps(_mm_set1_ps(kMyLabToLinearRGB[c][2]), z));
+			union { __m128i v; int i[4]; } index;
+			
+			linear = _mm_min_ps(_mm_max_ps(linear, zero), one);
+			index.v = _mm_cvttps_epi32(_mm_add_ps(
+					_mm_mul_ps(linear, scale), _mm_set1_ps(0.5f)));
+			for(j = 0; j < 4; j++)
+				dst[3*(i + j) + c] = gSRGBFromLinear[index.i[j]];
+		}
+    }
+#endif
+    for(; i < width; i++)
+		convertLabPixel(converter, src + 3*i, dst + 3*i);
+}
+
+void convertRowToRGB(const MyRGBConverter *converter, 
+			const UInt8 *src, UInt8 *dst, size_t width)
+{
+    switch(converter->kind){
+		case kMyConvertCMYK:
+			convertCMYKRow(src, dst, width);
+			break;
+		case kMyConvertLab:
+			convertLabRow(converter, src, dst, width);
+			break;
+		case kMyConvertIndexed:
+			convertIndexedRow(converter, src, dst, width);
+			break;
+    }
+}
@@ -0,0 +1,77 @@
+/*
+*  File:    RGBConversion.h
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef __RGBConversion__
+#define __RGBConversion__
+
+#include <ApplicationServices/ApplicationServices.h>
+
+/*  An RGB converter turns rows of unpacked image samples, one byte per
+    component as produced by unpackRawImageRow, into rows of 8 bit RGB
+    so that extracted images needn't be converted again by whatever 
+    reads them. CMYK, Lab and indexed samples are handled. 
+    
+    A converter holds only tables computed when it is created, so one 
+    converter may be used by several threads at once. */
+typedef struct MyRGBConverter MyRGBConverter;
+
+/* Convert CMYK samples the way the PDF Reference describes for 
+    DeviceCMYK to DeviceRGB: each of red, green and blue is one minus 
+    the sum of its complement and black. */
+MyRGBConverter *createCMYKToRGBConverter(void);
+
+/* Convert Lab samples to sRGB. decode holds the L*, a* and b* values
+    that samples of 0 and 255 stand for, in the order of a Lab image's
+    Decode array: [Lmin Lmax amin amax bmin bmax]. */
+MyRGBConverter *createLabToRGBConverter(const CGFloat decode[6]);
+
+/* Convert indexes to the colors of the lookup table of an indexed 
+    color space. Returns NULL unless the base color space is gray, RGB 
+    or CMYK. Indexes past the end of the table become black. */
+MyRGBConverter *createIndexedToRGBConverter(CGColorSpaceRef colorSpace);
+
+void releaseRGBConverter(MyRGBConverter *converter);
+
+/* The number of components per pixel the converter expects. */
+size_t rgbConverterGetInputComponents(const MyRGBConverter *converter);
+
+/* Convert width pixels from src to 3*width bytes at dst. */
+void convertRowToRGB(const MyRGBConverter *converter, 
+			const UInt8 *src, UInt8 *dst, size_t width);
+
+#endif	// __RGBConversion__
@@ -0,0 +1,584 @@
+/*
+*  File:    RawImageExport.c
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#include "RawImageExport.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+struct MyRawImageUnpacker
+{
+    MyRawImage image;
+    // False if the Decode array maps every sample to itself, in which
+    // case the tables are not used.
+    bool applyDecode;
+    UInt8 decodeTables[kMyMaxComponents][256];
+};
+
+/*  The kernels below expand packed samples into one byte per sample.
+    When scaling, a sample with n bits is multiplied by 255/(2^n - 1)
+    so that 1 becomes 255 for 1 bit samples, 85 for 2 bit samples and
+    17 for 4 bit samples. The SSE2 loops handle 16 source bytes at a
+    time and the scalar loops finish the row. */
+
+static void unpack1BitSamples(const UInt8 *src, UInt8 *dst, 
+			size_t numSamples, bool scale)
+{
+    size_t i = 0;
+    UInt8 one = scale ? 255 : 1;
+#if defined(__SSE2__)
+    const __m128i bits = _mm_setr_epi8((char)0x80, 0x40, 0x20, 0x10, 
+					8, 4, 2, 1, (char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1);
+    const __m128i ones = _mm_set1_epi8((char)one);
+    for(; i + 128 <= numSamples; i += 128){
+		const UInt8 *s = src + i/8;
+		int j;
+		// Each source byte is spread across 8 lanes and each lane
+		// tests one of its bits.
+		for(j = 0; j < 16; j += 2){
+			__m128i v = _mm_unpacklo_epi64(_mm_set1_epi8((char)s[j]), 
+						_mm_set1_epi8((char)s[j + 1]));
+			v = _mm_cmpeq_epi8(_mm_and_si128(v, bits), bits);
+			_mm_storeu_si128((__m128i *)(dst + i + 8*j), 
+						_mm_and_si128(v, ones));
+		}
+    }
+#endif
+    for(; i < numSamples; i++)
+		dst[i] = ((src[i >> 3] >> (7 - (i & 7))) & 1) ? one : 0;
+}
+
+static void unpack2BitSamples(const UInt8 *src, UInt8 *dst, 
+			size_t numSamples, bool scale)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi8(3);
+    for(; i + 64 <= numSamples; i += 64){
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i/4));
+		__m128i f0 = _mm_and_si128(_mm_srli_epi16(v, 6), mask);
+		__m128i f1 = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+		__m128i f2 = _mm_and_si128(_mm_srli_epi16(v, 2), mask);
+		__m128i f3 = _mm_and_si128(v, mask);
+		__m128i f01, f23, out[4];
+		int j;
+		// Interleave the four fields of each byte back into order.
+		f01 = _mm_unpacklo_epi8(f0, f1);
+		f23 = _mm_unpacklo_epi8(f2, f3);
+		out[0] = _mm_unpacklo_epi16(f01, f23);
+		out[1] = _mm_unpackhi_epi16(f01, f23);
+		f01 = _mm_unpackhi_epi8(f0, f1);
+		f23 = _mm_unpackhi_epi8(f2, f3);
+		out[2] = _mm_unpacklo_epi16(f01, f23);
+		out[3] = _mm_unpackhi_epi16(f01, f23);
+		for(j = 0; j < 4; j++){
+			if(scale){
+				// Each lane holds at most 3 so the shifts can't 
+				// carry into the neighbouring lane.
+				out[j] = _mm_or_si128(
+					_mm_or_si128(_mm_slli_epi16(out[j], 6), 
+						_mm_slli_epi16(out[j], 4)),
+					_mm_or_si128(_mm_slli_epi16(out[j], 2), out[j]));
+			}
+			_mm_storeu_si128((__m128i *)(dst + i + 16*j), out[j]);
+		}
+    }
+#endif
+    for(; i < numSamples; i++){
+		UInt8 v = (src[i >> 2] >> (6 - 2*(i & 3))) & 3;
+		dst[i] = scale ? v*85 : v;
+    }
+}
+
+static void unpack4BitSamples(const UInt8 *src, UInt8 *dst, 
+			size_t numSamples, bool scale)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    for(; i + 32 <= numSamples; i += 32){
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i/2));
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+		__m128i lo = _mm_and_si128(v, mask);
+		__m128i a = _mm_unpacklo_epi8(hi, lo);
+		__m128i b = _mm_unpackhi_epi8(hi, lo);
+		if(scale){
+			a = _mm_or_si128(_mm_slli_epi16(a, 4), a);
+			b = _mm_or_si128(_mm_slli_epi16(b, 4), b);
+		}
+		_mm_storeu_si128((__m128i *)(dst + i), a);
+		_mm_storeu_si128((__m128i *)(dst + i + 16), b);
+    }
+#endif
+    for(; i < numSamples; i++){
+		UInt8 v = (src[i >> 1] >> ((i & 1) ? 0 : 4)) & 0x0F;
+		dst[i] = scale ? v*17 : v;
+    }
+}
+
+/* 16 bit samples are big endian so the most significant byte of each
+    is the first. Keeping only that byte scales the sample to 8 bits. */
+static void unpack16BitSamples(const UInt8 *src, UInt8 *dst, 
+			size_t numSamples)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    // Loaded as little endian 16 bit lanes, the first byte of each
+    // sample is the low byte of its lane.
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    for(; i + 16 <= numSamples; i += 16){
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + 2*i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + 2*i + 16));
+		_mm_storeu_si128((__m128i *)(dst + i), 
+			_mm_packus_epi16(_mm_and_si128(a, mask), 
+					_mm_and_si128(b, mask)));
+    }
+#endif
+    for(; i < numSamples; i++)
+		dst[i] = src[2*i];
+}
+
+static UInt8 clampToByte(double value)
+{
+    if(value <= 0.)
+		return 0;
+    if(value >= 255.)
+		return 255;
+    return (UInt8)(value + 0.5);
+}
+
+MyRawImageUnpacker *createRawImageUnpacker(const MyRawImage *image)
+{
+    MyRawImageUnpacker *unpacker;
+    size_t c, maxIndex;
+    int u;
+    
+    switch(image->bitsPerComponent){
+		case 1: case 2: case 4: case 8: case 16:
+			break;
+		default:
+			fprintf(stderr, "Unsupported bits per component %zd!\n", 
+					image->bitsPerComponent);
+			return NULL;
+    }
+    if(image->componentsPerPixel < 1 || 
+		image->componentsPerPixel > kMyMaxComponents ||
+		(image->isIndexed && image->bitsPerComponent > 8))
+		return NULL;
+    
+    unpacker = malloc(sizeof(MyRawImageUnpacker));
+    if(!unpacker)
+		return NULL;
+    unpacker->image = *image;
+    unpacker->applyDecode = false;
+    
+    // Build a table per component mapping each unpacked sample to its
+    // decoded value. Components without Decode values map to themselves.
+    maxIndex = (1 << image->bitsPerComponent) - 1;
+    for(c = 0; c < image->componentsPerPixel; c++){
+		bool haveDecode = image->decode && image->decodeCount >= 2*c + 2;
+		CGFloat dmin = haveDecode ? image->decode[2*c] : 0;
+		CGFloat dmax = haveDecode ? image->decode[2*c + 1] : 0;
+		
+		for(u = 0; u < 256; u++){
+			UInt8 value = u;
+			if(haveDecode){
+				if(image->isIndexed){
+					// Decode maps indexes to other indexes.
+					if((size_t)u <= maxIndex)
+						value = clampToByte(dmin + u*(dmax - dmin)/maxIndex);
+				}else
+					// Decode maps the range 0-1 to the range dmin-dmax.
+					value = clampToByte(255.*(dmin + (u/255.)*(dmax - dmin)));
+			}
+			unpacker->decodeTables[c][u] = value;
+			if(value != u)
+				unpacker->applyDecode = true;
+		}
+    }
+    unpacker->image.decode = NULL;
+    return unpacker;
+}
+
+void releaseRawImageUnpacker(MyRawImageUnpacker *unpacker)
+{
+    free(unpacker);
+}
+
+void unpackRawImageRow(const MyRawImageUnpacker *unpacker, 
+			const UInt8 *src, UInt8 *dst)
+{
+    const MyRawImage *image = &unpacker->image;
+    size_t numSamples = image->width * image->componentsPerPixel;
+    bool scale = !image->isIndexed;
+    
+    switch(image->bitsPerComponent){
+		case 1:
+			unpack1BitSamples(src, dst, numSamples, scale);
+			break;
+		case 2:
+			unpack2BitSamples(src, dst, numSamples, scale);
+			break;
+		case 4:
+			unpack4BitSamples(src, dst, numSamples, scale);
+			break;
+		case 8:
+			memcpy(dst, src, numSamples);
+			break;
+		case 16:
+			unpack16BitSamples(src, dst, numSamples);
+			break;
+    }
+    
+    if(unpacker->applyDecode){
+		size_t i, c, spp = image->componentsPerPixel;
+		for(i = 0; i < numSamples; i += spp)
+			for(c = 0; c < spp; c++)
+				dst[i + c] = unpacker->decodeTables[c][dst[i + c]];
+    }
+}
+
+// Pixels are unpacked for the PNG encoder a band of rows at a time, 
+// each band holding about this many bytes.
+#define kMyBandSize	(256*1024)
+
+/* The state of a sequential data provider that supplies the unpacked
+    pixels of a raw image to Quartz. Only the current band of rows is
+    ever unpacked, so converting an image needs memory for one band 
+    rather than for a second copy of the whole image. */
+typedef struct MyBandedPixels
+{
+    MyRawImageUnpacker *unpacker;
+    // Converts the unpacked rows to RGB, if not NULL, by way of row.
+    const MyRGBConverter *converter;
+    UInt8 *row;
+    size_t width;
+    const UInt8 *samples;
+    size_t srcBytesPerRow;
+    size_t bytesPerRow;
+    size_t height;
+    size_t maxBandRows;
+    UInt8 *band;
+    size_t bandFirstRow;
+    size_t bandNumRows;
+    off_t position;		// Offset into the unpacked image.
+}MyBandedPixels;
+
+static void unpackBand(MyBandedPixels *pixels, size_t firstRow)
+{
+    size_t row;
+    
+    pixels->bandFirstRow = firstRow;
+    pixels->bandNumRows = pixels->height - firstRow;
+    if(pixels->bandNumRows > pixels->maxBandRows)
+		pixels->bandNumRows = pixels->maxBandRows;
+    for(row = 0; row < pixels->bandNumRows; row++){
+		const UInt8 *src = 
+				pixels->samples + (firstRow + row)*pixels->srcBytesPerRow;
+		UInt8 *dst = pixels->band + row*pixels->bytesPerRow;
+		
+		if(pixels->converter){
+			unpackRawImageRow(pixels->unpacker, src, pixels->row);
+			convertRowToRGB(pixels->converter, pixels->row, dst, 
+					pixels->width);
+		}else
+			unpackRawImageRow(pixels->unpacker, src, dst);
+    }
+}
+
+static size_t getBandedPixelBytes(void *info, void *buffer, size_t count)
+{
+    MyBandedPixels *pixels = info;
+    off_t total = (off_t)pixels->bytesPerRow * pixels->height;
+    size_t copied = 0;
+    
+    while(copied < count && pixels->position < total){
+		size_t row = pixels->position / pixels->bytesPerRow;
+		size_t offset, available;
+		
+		if(row < pixels->bandFirstRow || 
+			row >= pixels->bandFirstRow + pixels->bandNumRows)
+			unpackBand(pixels, row);
+		offset = pixels->position - 
+				(off_t)pixels->bandFirstRow * pixels->bytesPerRow;
+		available = pixels->bandNumRows * pixels->bytesPerRow - offset;
+		if(available > count - copied)
+			available = count - copied;
+		memcpy((UInt8 *)buffer + copied, pixels->band + offset, available);
+		copied += available;
+		pixels->position += available;
+    }
+    return copied;
+}
+
+static off_t skipBandedPixelBytes(void *info, off_t count)
+{
+    MyBandedPixels *pixels = info;
+    off_t remaining = (off_t)pixels->bytesPerRow * pixels->height - 
+				pixels->position;
+    
+    if(count > remaining)
+		count = remaining;
+    pixels->position += count;
+    return count;
+}
+
+static void rewindBandedPixels(void *info)
+{
+    ((MyBandedPixels *)info)->position = 0;
+}
+
+static void releaseBandedPixels(void *info)
+{
+    MyBandedPixels *pixels = info;
+    
+    releaseRawImageUnpacker(pixels->unpacker);
+    free(pixels->row);
+    free(pixels->band);
+    free(pixels);
+}
+
+/* Create a sequential data provider for the unpacked pixels of an 
+    image, converted to RGB if converter isn't NULL. The samples and 
+    the converter must outlive the provider. */
+static CGDataProviderRef createBandedPixelProvider(const MyRawImage *image,
+			const MyRGBConverter *converter, const UInt8 *samples)
+{
+    static const CGDataProviderSequentialCallbacks callbacks = {
+		0, getBandedPixelBytes, skipBandedPixelBytes, 
+		rewindBandedPixels, releaseBandedPixels
+    };
+    MyBandedPixels *pixels = calloc(1, sizeof(MyBandedPixels));
+    CGDataProviderRef provider;
+    
+    if(!pixels)
+		return NULL;
+    pixels->samples = samples;
+    pixels->srcBytesPerRow = image->bytesPerRow;
+    pixels->width = image->width;
+    pixels->converter = converter;
+    pixels->bytesPerRow = image->width * 
+			(converter ? 3 : image->componentsPerPixel);
+    pixels->height = image->height;
+    pixels->maxBandRows = kMyBandSize / pixels->bytesPerRow;
+    if(pixels->maxBandRows < 1)
+		pixels->maxBandRows = 1;
+    if(pixels->maxBandRows > image->height)
+		pixels->maxBandRows = image->height;
+    pixels->unpacker = createRawImageUnpacker(image);
+    pixels->band = malloc(pixels->maxBandRows * pixels->bytesPerRow);
+    if(converter)
+		pixels->row = malloc(image->width * image->componentsPerPixel);
+    if(!pixels->unpacker || !pixels->band || (converter && !pixels->row)){
+		releaseBandedPixels(pixels);
+		return NULL;
+    }
+    // The provider owns the pixel state from here on.
+    provider = CGDataProviderCreateSequential(pixels, &callbacks);
+    if(!provider)
+		releaseBandedPixels(pixels);
+    return provider;
+}
+
+/* Passes the bytes written to a data consumer on to a write function,
+    remembering whether any write failed. */
+typedef struct MyImageOutput
+{
+    MyImageWriteFunction writeFunction;
+    void *info;
+    bool failed;
+}MyImageOutput;
+
+static size_t putImageOutputBytes(void *info, const void *buffer, size_t count)
+{
+    MyImageOutput *output = info;
+    
+    if(output->failed || !output->writeFunction(output->info, buffer, count)){
+		output->failed = true;
+		return 0;
+    }
+    return count;
+}
+
+bool writePNGFromRawImage(const MyRawImage *image, 
+			CGColorSpaceRef colorSpace, const MyRGBConverter *converter,
+			const UInt8 *samples, size_t length,
+			MyImageWriteFunction writeFunction, void *info)
+{
+    static const CGDataConsumerCallbacks callbacks = { 
+		putImageOutputBytes, NULL 
+    };
+    MyImageOutput output = { writeFunction, info, false };
+    CGDataProviderRef provider;
+    CGDataConsumerRef consumer;
+    CGImageRef cgImage;
+    CGImageDestinationRef imageDestination;
+    size_t components = converter ? 3 : image->componentsPerPixel;
+    bool success;
+    
+    if(!image->width || !image->height || !image->bytesPerRow ||
+		length / image->bytesPerRow < image->height)
+    {
+		fprintf(stderr, "Image data is shorter than its dimensions!\n");
+		return false;
+    }
+    if(converter && 
+		rgbConverterGetInputComponents(converter) != image->componentsPerPixel)
+    {
+		fprintf(stderr, "Image has the wrong components to convert to RGB!\n");
+		return false;
+    }
+    provider = createBandedPixelProvider(image, converter, samples);
+    if(!provider)
+		return false;
+    cgImage = CGImageCreate(image->width, image->height, 8, 
+				8 * components, image->width * components, 
+				colorSpace, kCGImageAlphaNone, provider, NULL, 
+				false, kCGRenderingIntentDefault);
+    CGDataProviderRelease(provider);
+    if(!cgImage){
+		fprintf(stderr, "Couldn't create image to encode as PNG!\n");
+		return false;
+    }
+    
+    // The encoder hands its output to the write function as it goes
+    // rather than accumulating the whole file in memory.
+    consumer = CGDataConsumerCreate(&output, &callbacks);
+    imageDestination = consumer ? 
+		CGImageDestinationCreateWithDataConsumer(consumer, kUTTypePNG, 1, NULL)
+		: NULL;
+    if(!imageDestination){
+		fprintf(stderr, "Couldn't create image destination!\n");
+		if(consumer)
+			CGDataConsumerRelease(consumer);
+		CGImageRelease(cgImage);
+		return false;
+    }
+    CGImageDestinationAddImage(imageDestination, cgImage, NULL);
+    success = CGImageDestinationFinalize(imageDestination);
+    CFRelease(imageDestination);
+    CGDataConsumerRelease(consumer);
+    CGImageRelease(cgImage);
+    if(!success || output.failed){
+		fprintf(stderr, "Couldn't encode PNG data!\n");
+		return false;
+    }
+    return true;
+}
+
+/* TIFF field types and tags used by writeTIFFFromBilevelImage. */
+enum {
+    kMyTIFFShort = 3,
+    kMyTIFFLong = 4,
+    kMyTIFFRational = 5
+};
+
+static UInt8 *putTIFF16(UInt8 *p, UInt16 value)
+{
+    p[0] = value & 0xFF;
+    p[1] = value >> 8;
+    return p + 2;
+}
+
+static UInt8 *putTIFF32(UInt8 *p, UInt32 value)
+{
+    p = putTIFF16(p, value & 0xFFFF);
+    return putTIFF16(p, value >> 16);
+}
+
+/* Write a 12 byte IFD entry holding a single value. SHORT values sit
+    in the first two bytes of the value field. */
+static UInt8 *putTIFFEntry(UInt8 *p, UInt16 tag, UInt16 type, UInt32 value)
+{
+    p = putTIFF16(p, tag);
+    p = putTIFF16(p, type);
+    p = putTIFF32(p, 1);
+    if(type == kMyTIFFShort){
+		p = putTIFF16(p, value);
+		return putTIFF16(p, 0);
+    }
+    return putTIFF32(p, value);
+}
+
+bool writeTIFFFromBilevelImage(const MyRawImage *image, 
+			bool blackIsZero, const UInt8 *samples, size_t length,
+			MyImageWriteFunction writeFunction, void *info)
+{
+    // A little endian header, one IFD of 12 entries and the two 
+    // resolution rationals precede the samples.
+    enum {
+		kNumEntries = 12,
+		ifdOffset = 8,
+		rationalOffset = ifdOffset + 2 + 12*kNumEntries + 4,
+		dataOffset = rationalOffset + 16
+    };
+    UInt8 header[dataOffset], *p = header;
+    size_t dataLength = image->bytesPerRow * image->height;
+    
+    if(image->bitsPerComponent != 1 || image->componentsPerPixel != 1 ||
+		!image->height || !image->bytesPerRow || 
+		length / image->bytesPerRow < image->height ||
+		dataLength > 0xFFFFFFFFUL - dataOffset)
+		return false;
+    
+    *p++ = 'I'; *p++ = 'I';
+    p = putTIFF16(p, 42);
+    p = putTIFF32(p, ifdOffset);
+    
+    // Entries must be in increasing tag order.
+    p = putTIFF16(p, kNumEntries);
+    p = putTIFFEntry(p, 256, kMyTIFFLong, image->width);	// ImageWidth
+    p = putTIFFEntry(p, 257, kMyTIFFLong, image->height);	// ImageLength
+    p = putTIFFEntry(p, 258, kMyTIFFShort, 1);			// BitsPerSample
+    p = putTIFFEntry(p, 259, kMyTIFFShort, 1);			// Compression: none
+    p = putTIFFEntry(p, 262, kMyTIFFShort, blackIsZero ? 1 : 0); // Photometric
+    p = putTIFFEntry(p, 273, kMyTIFFLong, dataOffset);		// StripOffsets
+    p = putTIFFEntry(p, 277, kMyTIFFShort, 1);			// SamplesPerPixel
+    p = putTIFFEntry(p, 278, kMyTIFFLong, image->height);	// RowsPerStrip
+    p = putTIFFEntry(p, 279, kMyTIFFLong, dataLength);		// StripByteCounts
+    p = putTIFFEntry(p, 282, kMyTIFFRational, rationalOffset);	// XResolution
+    p = putTIFFEntry(p, 283, kMyTIFFRational, rationalOffset + 8); // YResolution
+    p = putTIFFEntry(p, 296, kMyTIFFShort, 1);			// ResolutionUnit: none
+    p = putTIFF32(p, 0);	// No further IFDs.
+    p = putTIFF32(p, 72); p = putTIFF32(p, 1);
+    p = putTIFF32(p, 72); p = putTIFF32(p, 1);
+    
+    // The samples are passed on in place, never copied.
+    return writeFunction(info, header, dataOffset) &&
+		writeFunction(info, samples, dataLength);
+}
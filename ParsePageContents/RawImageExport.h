@@ -0,0 +1,109 @@
+/*
+*  File:    RawImageExport.h
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef __RawImageExport__
+#define __RawImageExport__
+
+#include <ApplicationServices/ApplicationServices.h>
+#include "RGBConversion.h"
+
+// The most components per pixel this code handles (DeviceN can have up
+// to 32).
+#define kMyMaxComponents 32
+
+/* A description of the samples of an image XObject whose stream data
+    is CGPDFDataFormatRaw. As in PDF, samples are packed most
+    significant bit first and each row starts on a byte boundary. */
+typedef struct MyRawImage
+{
+    size_t width;
+    size_t height;
+    size_t bitsPerComponent;	// 1, 2, 4, 8 or 16.
+    size_t componentsPerPixel;
+    size_t bytesPerRow;
+    // True if samples are indexes into a lookup table rather than 
+    // color values. Indexes are never rescaled.
+    bool isIndexed;
+    // The image's Decode array, two values per component, or NULL if
+    // the image uses the default decoding for its color space.
+    const CGFloat *decode;
+    size_t decodeCount;
+}MyRawImage;
+
+/* Unpacks rows of a raw image into 8 bits per component with the
+    image's Decode array applied. Color values of any bit depth are 
+    scaled to the range 0-255; indexes keep their values. */
+typedef struct MyRawImageUnpacker MyRawImageUnpacker;
+
+MyRawImageUnpacker *createRawImageUnpacker(const MyRawImage *image);
+void releaseRawImageUnpacker(MyRawImageUnpacker *unpacker);
+
+/* Unpack one row of bytesPerRow bytes from src into 
+    width*componentsPerPixel bytes at dst. */
+void unpackRawImageRow(const MyRawImageUnpacker *unpacker, 
+			const UInt8 *src, UInt8 *dst);
+
+/* Receives the encoded bytes of an image as they are produced. 
+    Returns false if the bytes couldn't be written, which stops the
+    encoding. */
+typedef bool (*MyImageWriteFunction)(void *info, 
+			const void *bytes, size_t length);
+
+/* Encode a raw image in the supplied color space, which must have 
+    componentsPerPixel components, as PNG. Samples are unpacked a band
+    of rows at a time as the encoder asks for them, and the encoded 
+    bytes are passed to writeFunction as they are produced, so memory 
+    use doesn't grow with the size of the image. If converter isn't 
+    NULL each row is converted to RGB as it is unpacked, and colorSpace
+    must be an RGB color space instead. Returns false if the samples 
+    are too short for the image or can't be encoded. */
+bool writePNGFromRawImage(const MyRawImage *image, 
+			CGColorSpaceRef colorSpace, const MyRGBConverter *converter,
+			const UInt8 *samples, size_t length,
+			MyImageWriteFunction writeFunction, void *info);
+
+/* Write an uncompressed TIFF holding a 1 bit per pixel gray image. 
+    The samples are written as they are, behind a TIFF header, so this
+    is almost free compared with encoding a PNG. If blackIsZero is 
+    false, samples of 0 are white. Returns false if the samples are 
+    too short or couldn't be written. */
+bool writeTIFFFromBilevelImage(const MyRawImage *image, 
+			bool blackIsZero, const UInt8 *samples, size_t length,
+			MyImageWriteFunction writeFunction, void *info);
+
+#endif	// __RawImageExport__
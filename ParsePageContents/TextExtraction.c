@@ -0,0 +1,1146 @@
+/*
+*  File:    TextExtraction.c
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+#include <pthread.h>
+#include <math.h>
+#include "TextExtraction.h"
+
+/* The UTF-8 text of one glyph, NUL terminated. Only a ToUnicode map
+    can give a glyph more text than this holds, and such text is cut 
+    short. An empty string means the glyph has no known text. */
+typedef char MyGlyphText[8];
+
+// Codes are looked up in pages of 256, allocated as they're needed.
+#define kMyCodePageSize	256
+#define kMyNumCodePages	256
+
+// The width assumed for glyphs of fonts without widths, such as the 
+// standard 14 fonts, in thousandths of the font size.
+#define kMyDefaultGlyphWidth	500
+
+/* What is needed to decode and advance past the strings shown with a
+    font. Once created a font is never changed, so any number of text
+    scans can use it at once. */
+typedef struct MyFont
+{
+    bool twoByte;		// Codes are two bytes, as in most Type0 fonts.
+    bool codesAreUnicode;	// Codes with no text are UCS-2 values.
+    MyGlyphText *text[kMyNumCodePages];
+    float *widths[kMyNumCodePages];	// In units of the font size.
+    float defaultWidth;
+}MyFont;
+
+struct MyFontCache
+{
+    CFMutableDictionaryRef fonts;	// MyFont pointers.
+    pthread_mutex_t lock;
+};
+
+/* The parts of the text state a form inherits from whatever uses it. */
+enum
+{
+    kMyTextStateFont = 1 << 0,		// The font and its size.
+    kMyTextStateCharSpacing = 1 << 1,
+    kMyTextStateWordSpacing = 1 << 2,
+    kMyTextStateHorizontalScale = 1 << 3,
+    kMyTextStateLeading = 1 << 4,
+    kMyTextStateAll = (1 << 5) - 1
+};
+
+struct MyTextScan
+{
+    MyFontCache *fonts;
+    // The text state, apart from the rise and rendering mode, which 
+    // don't affect what the text says.
+    const MyFont *font;		// NULL until a font is set.
+    CGFloat fontSize;
+    CGFloat charSpacing;
+    CGFloat wordSpacing;
+    CGFloat horizontalScale;
+    CGFloat leading;
+    CGAffineTransform textMatrix;
+    CGAffineTransform lineMatrix;
+    // The parts of the text state a form's scan still has from its
+    // parent, and whether any text has depended on them.
+    unsigned inheritedState;
+    bool usedInheritedState;
+    // Where the last string shown ended, in the space the text matrix
+    // maps to.
+    bool haveLastPosition;
+    CGFloat lastX;
+    CGFloat lastY;
+    // The text so far, NUL terminated.
+    char *text;
+    size_t length;
+    size_t capacity;
+    size_t numUndecoded;
+};
+
+const char * const kMyTextOperatorNames[kMyNumTextOperators] = {
+    "BT", "Tc", "Tw", "Tz", "TL", "Tf", "Td", "TD", "Tm", "T*",
+    "Tj", "TJ", "'", "\""
+};
+
+// WinAnsiEncoding from 0x80 to 0x9F. Its other codes are Latin-1.
+static const unsigned short kMyWinAnsiHigh[32] = {
+    0x20AC, 0,      0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0,      0x017D, 0,
+    0,      0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0,      0x017E, 0x0178
+};
+
+// MacRomanEncoding from 0x80 to 0xFF. Its other codes are ASCII.
+static const unsigned short kMyMacRomanHigh[128] = {
+    0x00C4, 0x00C5, 0x00C7, 0x00C9, 0x00D1, 0x00D6, 0x00DC, 0x00E1,
+    0x00E0, 0x00E2, 0x00E4, 0x00E3, 0x00E5, 0x00E7, 0x00E9, 0x00E8,
+    0x00EA, 0x00EB, 0x00ED, 0x00EC, 0x00EE, 0x00EF, 0x00F1, 0x00F3,
+    0x00F2, 0x00F4, 0x00F6, 0x00F5, 0x00FA, 0x00F9, 0x00FB, 0x00FC,
+    0x2020, 0x00B0, 0x00A2, 0x00A3, 0x00A7, 0x2022, 0x00B6, 0x00DF,
+    0x00AE, 0x00A9, 0x2122, 0x00B4, 0x00A8, 0x2260, 0x00C6, 0x00D8,
+    0x221E, 0x00B1, 0x2264, 0x2265, 0x00A5, 0x00B5, 0x2202, 0x2211,
+    0x220F, 0x03C0, 0x222B, 0x00AA, 0x00BA, 0x03A9, 0x00E6, 0x00F8,
+    0x00BF, 0x00A1, 0x00AC, 0x221A, 0x0192, 0x2248, 0x2206, 0x00AB,
+    0x00BB, 0x2026, 0x00A0, 0x00C0, 0x00C3, 0x00D5, 0x0152, 0x0153,
+    0x2013, 0x2014, 0x201C, 0x201D, 0x2018, 0x2019, 0x00F7, 0x25CA,
+    0x00FF, 0x0178, 0x2044, 0x20AC, 0x2039, 0x203A, 0xFB01, 0xFB02,
+    0x2021, 0x00B7, 0x201A, 0x201E, 0x2030, 0x00C2, 0x00CA, 0x00C1,
+    0x00CB, 0x00C8, 0x00CD, 0x00CE, 0x00CF, 0x00CC, 0x00D3, 0x00D4,
+    0xF8FF, 0x00D2, 0x00DA, 0x00DB, 0x00D9, 0x0131, 0x02C6, 0x02DC,
+    0x00AF, 0x02D8, 0x02D9, 0x02DA, 0x00B8, 0x02DD, 0x02DB, 0x02C7
+};
+
+// The glyph names of the printable ASCII characters from 0x20, other
+// than the letters, whose names are the letters themselves.
+static const char * const kMyASCIIGlyphNames[95] = {
+    "space", "exclam", "quotedbl", "numbersign", "dollar", "percent",
+    "ampersand", "quotesingle", "parenleft", "parenright", "asterisk",
+    "plus", "comma", "hyphen", "period", "slash", "zero", "one", "two",
+    "three", "four", "five", "six", "seven", "eight", "nine", "colon",
+    "semicolon", "less", "equal", "greater", "question", "at",
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 
+    NULL, NULL, NULL, NULL,
+    "bracketleft", "backslash", "bracketright", "asciicircum", 
+    "underscore", "grave",
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, 
+    NULL, NULL, NULL, NULL,
+    "braceleft", "bar", "braceright", "asciitilde"
+};
+
+// The glyph names of the Latin-1 characters from 0xA1.
+static const char * const kMyLatin1GlyphNames[95] = {
+    "exclamdown", "cent", "sterling", "currency", "yen", "brokenbar",
+    "section", "dieresis", "copyright", "ordfeminine", "guillemotleft",
+    "logicalnot", NULL, "registered", "macron", "degree", "plusminus",
+    "twosuperior", "threesuperior", "acute", "mu", "paragraph",
+    "periodcentered", "cedilla", "onesuperior", "ordmasculine",
+    "guillemotright", "onequarter", "onehalf", "threequarters",
+    "questiondown", "Agrave", "Aacute", "Acircumflex", "Atilde",
+    "Adieresis", "Aring", "AE", "Ccedilla", "Egrave", "Eacute",
+    "Ecircumflex", "Edieresis", "Igrave", "Iacute", "Icircumflex",
+    "Idieresis", "Eth", "Ntilde", "Ograve", "Oacute", "Ocircumflex",
+    "Otilde", "Odieresis", "multiply", "Oslash", "Ugrave", "Uacute",
+    "Ucircumflex", "Udieresis", "Yacute", "Thorn", "germandbls",
+    "agrave", "aacute", "acircumflex", "atilde", "adieresis", "aring",
+    "ae", "ccedilla", "egrave", "eacute", "ecircumflex", "edieresis",
+    "igrave", "iacute", "icircumflex", "idieresis", "eth", "ntilde",
+    "ograve", "oacute", "ocircumflex", "otilde", "odieresis", "divide",
+    "oslash", "ugrave", "uacute", "ucircumflex", "udieresis", "yacute",
+    "thorn", "ydieresis"
+};
+
+// Other glyph names often found in Differences arrays.
+static const struct
+{
+    const char *name;
+    unsigned short unicode;
+}kMyOtherGlyphNames[] = {
+    { "quoteleft", 0x2018 }, { "quoteright", 0x2019 },
+    { "quotesinglbase", 0x201A }, { "quotedblleft", 0x201C },
+    { "quotedblright", 0x201D }, { "quotedblbase", 0x201E },
+    { "endash", 0x2013 }, { "emdash", 0x2014 }, { "bullet", 0x2022 },
+    { "ellipsis", 0x2026 }, { "dagger", 0x2020 }, { "daggerdbl", 0x2021 },
+    { "perthousand", 0x2030 }, { "guilsinglleft", 0x2039 },
+    { "guilsinglright", 0x203A }, { "trademark", 0x2122 },
+    { "Euro", 0x20AC }, { "minus", 0x2212 }, { "fraction", 0x2044 },
+    { "florin", 0x0192 }, { "circumflex", 0x02C6 }, { "tilde", 0x02DC },
+    { "OE", 0x0152 }, { "oe", 0x0153 }, { "Scaron", 0x0160 },
+    { "scaron", 0x0161 }, { "Zcaron", 0x017D }, { "zcaron", 0x017E },
+    { "Ydieresis", 0x0178 }, { "Lslash", 0x0141 }, { "lslash", 0x0142 },
+    { "dotlessi", 0x0131 }, { "ff", 0xFB00 }, { "fi", 0xFB01 },
+    { "fl", 0xFB02 }, { "ffi", 0xFB03 }, { "ffl", 0xFB04 },
+    { "nbspace", 0x00A0 }, { "sfthyphen", 0x00AD }
+};
+
+/* Write a code point as UTF-8, returning the number of bytes used. */
+static size_t encodeUTF8(unsigned long c, char *bytes)
+{
+    if(c < 0x80){
+		bytes[0] = c;
+		return 1;
+    }
+    if(c < 0x800){
+		bytes[0] = 0xC0 | c >> 6;
+		bytes[1] = 0x80 | (c & 0x3F);
+		return 2;
+    }
+    if(c < 0x10000){
+		bytes[0] = 0xE0 | c >> 12;
+		bytes[1] = 0x80 | (c >> 6 & 0x3F);
+		bytes[2] = 0x80 | (c & 0x3F);
+		return 3;
+    }
+    bytes[0] = 0xF0 | c >> 18;
+    bytes[1] = 0x80 | (c >> 12 & 0x3F);
+    bytes[2] = 0x80 | (c >> 6 & 0x3F);
+    bytes[3] = 0x80 | (c & 0x3F);
+    return 4;
+}
+
+/* Whether a code point is one that belongs in extracted text. */
+static bool isTextCodePoint(unsigned long c)
+{
+    return c >= 0x20 && c != 0x7F && !(c >= 0xD800 && c < 0xE000) && 
+			c <= 0x10FFFF;
+}
+
+/* Give a glyph the text made of the supplied code points. */
+static void setGlyphText(MyFont *font, unsigned long code, 
+			const unsigned long *codePoints, size_t numCodePoints)
+{
+    MyGlyphText *page;
+    char bytes[4];
+    size_t i, length = 0, n;
+    
+    if(code >= (font->twoByte ? 0x10000UL : 0x100UL))
+		return;
+    page = font->text[code / kMyCodePageSize];
+    if(!page){
+		page = calloc(kMyCodePageSize, sizeof(MyGlyphText));
+		if(!page)
+			return;
+		font->text[code / kMyCodePageSize] = page;
+    }
+    for(i = 0; i < numCodePoints; i++){
+		if(!isTextCodePoint(codePoints[i]))
+			continue;
+		n = encodeUTF8(codePoints[i], bytes);
+		if(length + n >= sizeof(MyGlyphText))
+			break;
+		memcpy(&page[code % kMyCodePageSize][length], bytes, n);
+		length += n;
+    }
+    page[code % kMyCodePageSize][length] = '\0';
+}
+
+/* Return the text of a glyph, or NULL if it has none. The text may be
+    made in the supplied buffer. */
+static const char *glyphText(const MyFont *font, unsigned long code, 
+			MyGlyphText buffer)
+{
+    const MyGlyphText *page;
+    
+    // Without a font, assume the common case of ASCII.
+    if(!font){
+		if(code < 0x20 || code >= 0x7F)
+			return NULL;
+		buffer[0] = code;
+		buffer[1] = '\0';
+		return buffer;
+    }
+    page = font->text[code / kMyCodePageSize];
+    if(page && page[code % kMyCodePageSize][0])
+		return page[code % kMyCodePageSize];
+    if(font->codesAreUnicode && isTextCodePoint(code)){
+		buffer[encodeUTF8(code, buffer)] = '\0';
+		return buffer;
+    }
+    return NULL;
+}
+
+static void setGlyphWidth(MyFont *font, unsigned long code, float width)
+{
+    float *page;
+    size_t i;
+    
+    if(code >= (font->twoByte ? 0x10000UL : 0x100UL))
+		return;
+    page = font->widths[code / kMyCodePageSize];
+    if(!page){
+		page = malloc(kMyCodePageSize * sizeof(float));
+		if(!page)
+			return;
+		for(i = 0; i < kMyCodePageSize; i++)
+			page[i] = font->defaultWidth;
+		font->widths[code / kMyCodePageSize] = page;
+    }
+    page[code % kMyCodePageSize] = width;
+}
+
+static float glyphWidth(const MyFont *font, unsigned long code)
+{
+    const float *page;
+    
+    if(!font)
+		return kMyDefaultGlyphWidth/1000.f;
+    page = font->widths[code / kMyCodePageSize];
+    return page ? page[code % kMyCodePageSize] : font->defaultWidth;
+}
+
+static bool isHexDigit(int c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') || 
+			(c >= 'a' && c <= 'f');
+}
+
+/* Return the code point a glyph name stands for, or 0 if it isn't one
+    this code knows. Names are looked up without any suffix such as the
+    ".sc" of small capitals. */
+static unsigned long unicodeForGlyphName(const char *glyphName)
+{
+    char name[64];
+    size_t i, length;
+    unsigned long c;
+    
+    strlcpy(name, glyphName, sizeof(name));
+    name[strcspn(name, ".")] = '\0';
+    length = strlen(name);
+    // Letters are named by themselves.
+    if(length == 1 && name[0] > 0x20 && name[0] < 0x7F)
+		return (unsigned char)name[0];
+    // Names such as "uni0041" and "u1F600" give the code point.
+    if((length == 7 && strncmp(name, "uni", 3) == 0) ||
+		(length >= 5 && length <= 7 && name[0] == 'u'))
+    {
+		const char *digits = name[1] == 'n' ? name + 3 : name + 1;
+		for(i = 0; digits[i]; i++)
+			if(!isHexDigit(digits[i]))
+				break;
+		if(!digits[i]){
+			c = strtoul(digits, NULL, 16);
+			return isTextCodePoint(c) ? c : 0;
+		}
+    }
+    for(i = 0; i < sizeof(kMyASCIIGlyphNames)/sizeof(kMyASCIIGlyphNames[0]); i++)
+		if(kMyASCIIGlyphNames[i] && strcmp(name, kMyASCIIGlyphNames[i]) == 0)
+			return 0x20 + i;
+    for(i = 0; i < sizeof(kMyLatin1GlyphNames)/sizeof(kMyLatin1GlyphNames[0]); i++)
+		if(kMyLatin1GlyphNames[i] && strcmp(name, kMyLatin1GlyphNames[i]) == 0)
+			return 0xA1 + i;
+    for(i = 0; i < sizeof(kMyOtherGlyphNames)/sizeof(kMyOtherGlyphNames[0]); i++)
+		if(strcmp(name, kMyOtherGlyphNames[i].name) == 0)
+			return kMyOtherGlyphNames[i].unicode;
+    return 0;
+}
+
+/* Return the code point a code stands for in a base encoding, or 0 if
+    it stands for none. Only the ASCII half of StandardEncoding, which
+    is the default, is used; its upper half is rarely relied on. */
+static unsigned long unicodeInBaseEncoding(const char *encoding, 
+			unsigned long code)
+{
+    if(code < 0x20 || code == 0x7F)
+		return 0;
+    if(strcmp(encoding, "WinAnsiEncoding") == 0){
+		if(code >= 0x80 && code < 0xA0)
+			return kMyWinAnsiHigh[code - 0x80];
+		return code;
+    }
+    if(strcmp(encoding, "MacRomanEncoding") == 0)
+		return code < 0x80 ? code : kMyMacRomanHigh[code - 0x80];
+    if(code >= 0x80)
+		return 0;
+    // StandardEncoding has curly single quotes.
+    if(code == 0x27)
+		return 0x2019;
+    if(code == 0x60)
+		return 0x2018;
+    return code;
+}
+
+/* Decode the codes of a simple font through its Encoding entry, which
+    is either the name of a base encoding or a dictionary that modifies
+    one with a Differences array. */
+static void loadSimpleEncoding(MyFont *font, CGPDFDictionaryRef fontDict)
+{
+    const char *encoding = "StandardEncoding", *name;
+    CGPDFDictionaryRef encodingDict;
+    CGPDFArrayRef differences = NULL;
+    unsigned long code, c;
+    size_t i;
+    
+    if(!CGPDFDictionaryGetName(fontDict, "Encoding", &encoding) &&
+		CGPDFDictionaryGetDictionary(fontDict, "Encoding", &encodingDict))
+    {
+		(void)CGPDFDictionaryGetName(encodingDict, "BaseEncoding", 
+				&encoding);
+		(void)CGPDFDictionaryGetArray(encodingDict, "Differences", 
+				&differences);
+    }
+    for(code = 0; code < 0x100; code++){
+		c = unicodeInBaseEncoding(encoding, code);
+		if(c)
+			setGlyphText(font, code, &c, 1);
+    }
+    // Differences are runs of glyph names, each run preceded by the
+    // code of its first glyph.
+    if(differences){
+		CGPDFInteger first;
+		code = 0x100;
+		for(i = 0; i < CGPDFArrayGetCount(differences); i++){
+			if(CGPDFArrayGetInteger(differences, i, &first))
+				code = first >= 0 ? (unsigned long)first : 0x100;
+			else if(CGPDFArrayGetName(differences, i, &name)){
+				c = unicodeForGlyphName(name);
+				setGlyphText(font, code++, &c, c ? 1 : 0);
+			}
+		}
+    }
+}
+
+/* Load the widths of a simple font from its Widths array. Type 3 
+    glyph widths are in glyph space, which the font's FontMatrix maps 
+    to text space; other fonts' are in thousandths of the font size. */
+static void loadSimpleWidths(MyFont *font, CGPDFDictionaryRef fontDict,
+			bool isType3)
+{
+    CGPDFArrayRef widths, fontMatrix;
+    CGPDFDictionaryRef descriptor;
+    CGPDFInteger firstChar = 0;
+    CGPDFReal width, scale = 0.001;
+    size_t i;
+    
+    if(isType3 && CGPDFDictionaryGetArray(fontDict, "FontMatrix", &fontMatrix))
+		(void)CGPDFArrayGetNumber(fontMatrix, 0, &scale);
+    if(!CGPDFDictionaryGetArray(fontDict, "Widths", &widths)){
+		font->defaultWidth = kMyDefaultGlyphWidth/1000.f;
+		return;
+    }
+    width = 0;
+    if(CGPDFDictionaryGetDictionary(fontDict, "FontDescriptor", &descriptor))
+		(void)CGPDFDictionaryGetNumber(descriptor, "MissingWidth", &width);
+    font->defaultWidth = width*scale;
+    (void)CGPDFDictionaryGetInteger(fontDict, "FirstChar", &firstChar);
+    for(i = 0; i < CGPDFArrayGetCount(widths); i++){
+		if(firstChar + (CGPDFInteger)i >= 0 && 
+				CGPDFArrayGetNumber(widths, i, &width))
+			setGlyphWidth(font, firstChar + i, width*scale);
+    }
+}
+
+/* Load the widths of a Type0 font from its descendant CIDFont. The W
+    array holds runs that are either a first code and an array of 
+    widths or a first code, a last code and one width for them all. */
+static void loadCompositeWidths(MyFont *font, CGPDFDictionaryRef fontDict)
+{
+    CGPDFArrayRef descendants, w, run;
+    CGPDFDictionaryRef cidFont;
+    CGPDFReal width = 1000;
+    CGPDFInteger first, last;
+    size_t i, j;
+    
+    font->defaultWidth = width/1000;
+    if(!CGPDFDictionaryGetArray(fontDict, "DescendantFonts", &descendants) ||
+		!CGPDFArrayGetDictionary(descendants, 0, &cidFont))
+		return;
+    if(CGPDFDictionaryGetNumber(cidFont, "DW", &width))
+		font->defaultWidth = width/1000;
+    if(!CGPDFDictionaryGetArray(cidFont, "W", &w))
+		return;
+    for(i = 0; i + 1 < CGPDFArrayGetCount(w); ){
+		if(!CGPDFArrayGetInteger(w, i, &first) || first < 0)
+			break;
+		if(CGPDFArrayGetArray(w, i + 1, &run)){
+			for(j = 0; j < CGPDFArrayGetCount(run); j++)
+				if(CGPDFArrayGetNumber(run, j, &width))
+					setGlyphWidth(font, first + j, width/1000);
+			i += 2;
+		}else{
+			if(!CGPDFArrayGetInteger(w, i + 1, &last) || last < first ||
+					!CGPDFArrayGetNumber(w, i + 2, &width))
+				break;
+			// Codes beyond two bytes are ignored by setGlyphWidth.
+			if(last > 0xFFFF)
+				last = 0xFFFF;
+			for(; first <= last; first++)
+				setGlyphWidth(font, first, width/1000);
+			i += 3;
+		}
+    }
+}
+
+/*  The few parts of the CMap syntax a ToUnicode map uses. */
+typedef enum MyCMapTokenType
+{
+    kMyCMapEnd,
+    kMyCMapHexString,
+    kMyCMapKeyword,
+    kMyCMapArrayStart,
+    kMyCMapArrayEnd,
+    kMyCMapOther
+}MyCMapTokenType;
+
+typedef struct MyCMapToken
+{
+    MyCMapTokenType type;
+    const UInt8 *start;
+    size_t length;
+}MyCMapToken;
+
+static bool isCMapWhitespace(UInt8 c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || 
+			c == '\f' || c == '\0';
+}
+
+static bool isCMapDelimiter(UInt8 c)
+{
+    return isCMapWhitespace(c) || strchr("()<>[]{}/%", c) != NULL;
+}
+
+/* Read the next token, advancing *p. */
+static MyCMapTokenType nextCMapToken(const UInt8 **p, const UInt8 *end,
+			MyCMapToken *token)
+{
+    const UInt8 *s = *p;
+    int depth;
+    
+    for(;;){
+		while(s < end && isCMapWhitespace(*s))
+			s++;
+		if(s < end && *s == '%'){
+			while(s < end && *s != '\r' && *s != '\n')
+				s++;
+			continue;
+		}
+		break;
+    }
+    token->start = s;
+    if(s >= end)
+		token->type = kMyCMapEnd;
+    else if(*s == '<' && s + 1 < end && s[1] != '<'){
+		token->type = kMyCMapHexString;
+		token->start = ++s;
+		while(s < end && *s != '>')
+			s++;
+		token->length = s - token->start;
+		if(s < end)
+			s++;
+    }else if(*s == '[' || *s == ']'){
+		token->type = *s++ == '[' ? kMyCMapArrayStart : kMyCMapArrayEnd;
+    }else if(*s == '('){
+		// Strings only appear in the parts of a CMap skipped here.
+		token->type = kMyCMapOther;
+		for(depth = 0; s < end; s++){
+			if(*s == '\\')
+				s++;
+			else if(*s == '(')
+				depth++;
+			else if(*s == ')' && --depth == 0){
+				s++;
+				break;
+			}
+		}
+    }else if(isCMapDelimiter(*s)){
+		token->type = kMyCMapOther;
+		s++;
+		// A name runs to the next delimiter.
+		if(s[-1] == '/')
+			while(s < end && !isCMapDelimiter(*s))
+				s++;
+    }else{
+		token->type = kMyCMapKeyword;
+		while(s < end && !isCMapDelimiter(*s))
+			s++;
+		token->length = s - token->start;
+    }
+    *p = s;
+    return token->type;
+}
+
+static bool isCMapKeyword(const MyCMapToken *token, const char *keyword)
+{
+    return token->type == kMyCMapKeyword && 
+			token->length == strlen(keyword) &&
+			memcmp(token->start, keyword, token->length) == 0;
+}
+
+/* Convert a hex string token to bytes, returning how many there are. */
+static size_t hexTokenBytes(const MyCMapToken *token, UInt8 *bytes, 
+			size_t maxBytes)
+{
+    size_t i, n = 0;
+    int value, digits = 0, nibble = 0;
+    
+    for(i = 0; i < token->length && n < maxBytes; i++){
+		int c = token->start[i];
+		if(c >= '0' && c <= '9')
+			value = c - '0';
+		else if(c >= 'A' && c <= 'F')
+			value = c - 'A' + 10;
+		else if(c >= 'a' && c <= 'f')
+			value = c - 'a' + 10;
+		else
+			continue;
+		if(digits++ % 2 == 0)
+			nibble = value;
+		else
+			bytes[n++] = nibble << 4 | value;
+    }
+    // An odd final digit is followed by an implied zero.
+    if(digits % 2 && n < maxBytes)
+		bytes[n++] = nibble << 4;
+    return n;
+}
+
+/* Return the code a hex string stands for. Codes longer than two 
+    bytes aren't supported and are returned as 0x10000, which no font
+    here has. */
+static unsigned long hexTokenCode(const MyCMapToken *token)
+{
+    UInt8 bytes[4];
+    size_t n = hexTokenBytes(token, bytes, sizeof(bytes));
+    
+    if(n == 1)
+		return bytes[0];
+    if(n == 2)
+		return bytes[0] << 8 | bytes[1];
+    return 0x10000;
+}
+
+/* Convert a hex string holding UTF-16BE text to code points, returning
+    how many there are. */
+static size_t hexTokenCodePoints(const MyCMapToken *token, 
+			unsigned long *codePoints, size_t maxCodePoints)
+{
+    UInt8 bytes[64];
+    size_t i, n = 0, length = hexTokenBytes(token, bytes, sizeof(bytes));
+    
+    for(i = 0; i + 1 < length && n < maxCodePoints; i += 2){
+		unsigned long c = bytes[i] << 8 | bytes[i + 1];
+		if(c >= 0xD800 && c < 0xDC00 && i + 3 < length){
+			unsigned long low = bytes[i + 2] << 8 | bytes[i + 3];
+			if(low >= 0xDC00 && low < 0xE000){
+				c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+				i += 2;
+			}
+		}
+		codePoints[n++] = c;
+    }
+    return n;
+}
+
+/* Give glyphs the text their font's ToUnicode map assigns. */
+static void loadToUnicode(MyFont *font, CGPDFStreamRef stream)
+{
+    CGPDFDataFormat format;
+    CFDataRef data = CGPDFStreamCopyData(stream, &format);
+    const UInt8 *p, *end;
+    MyCMapToken token, low, high;
+    unsigned long codePoints[16], code, last;
+    size_t n;
+    
+    if(!data)
+		return;
+    p = CFDataGetBytePtr(data);
+    end = p + CFDataGetLength(data);
+    while(nextCMapToken(&p, end, &token) != kMyCMapEnd){
+		if(isCMapKeyword(&token, "beginbfchar")){
+			// Pairs of a code and its text up to "endbfchar".
+			while(nextCMapToken(&p, end, &low) == kMyCMapHexString &&
+					nextCMapToken(&p, end, &token) == kMyCMapHexString)
+			{
+				n = hexTokenCodePoints(&token, codePoints, 16);
+				setGlyphText(font, hexTokenCode(&low), codePoints, n);
+			}
+		}else if(isCMapKeyword(&token, "beginbfrange")){
+			/*	Ranges of codes up to "endbfrange", each given either
+			the text of its first code, which the following codes 
+			increment, or an array with the text of every code. */
+			while(nextCMapToken(&p, end, &low) == kMyCMapHexString &&
+					nextCMapToken(&p, end, &high) == kMyCMapHexString)
+			{
+				code = hexTokenCode(&low);
+				last = hexTokenCode(&high);
+				if(last > 0xFFFF)
+					last = 0xFFFF;
+				if(nextCMapToken(&p, end, &token) == kMyCMapHexString){
+					n = hexTokenCodePoints(&token, codePoints, 16);
+					for(; n && code <= last; code++){
+						setGlyphText(font, code, codePoints, n);
+						codePoints[n - 1]++;
+					}
+				}else if(token.type == kMyCMapArrayStart){
+					while(nextCMapToken(&p, end, &token) == 
+							kMyCMapHexString)
+					{
+						n = hexTokenCodePoints(&token, codePoints, 16);
+						if(code <= last)
+							setGlyphText(font, code++, codePoints, n);
+					}
+				}else
+					break;
+			}
+		}
+    }
+    CFRelease(data);
+}
+
+static void freeFont(MyFont *font)
+{
+    size_t i;
+    
+    for(i = 0; i < kMyNumCodePages; i++){
+		free(font->text[i]);
+		free(font->widths[i]);
+    }
+    free(font);
+}
+
+static MyFont *createFont(CGPDFDictionaryRef fontDict)
+{
+    MyFont *font = calloc(1, sizeof(MyFont));
+    const char *subtype = "", *encoding;
+    CGPDFStreamRef toUnicode;
+    
+    if(!font)
+		return NULL;
+    (void)CGPDFDictionaryGetName(fontDict, "Subtype", &subtype);
+    if(strcmp(subtype, "Type0") == 0){
+		// The codes of Type0 fonts are assumed to be two bytes, as 
+		// they are with Identity-H and most other CMaps. 
+		font->twoByte = true;
+		font->codesAreUnicode = 
+			CGPDFDictionaryGetName(fontDict, "Encoding", &encoding) &&
+			(strstr(encoding, "UCS2") || strstr(encoding, "UTF16"));
+		loadCompositeWidths(font, fontDict);
+    }else{
+		loadSimpleEncoding(font, fontDict);
+		loadSimpleWidths(font, fontDict, strcmp(subtype, "Type3") == 0);
+    }
+    // A ToUnicode map overrides whatever the encoding gives.
+    if(CGPDFDictionaryGetStream(fontDict, "ToUnicode", &toUnicode))
+		loadToUnicode(font, toUnicode);
+    return font;
+}
+
+MyFontCache *createFontCache(void)
+{
+    MyFontCache *cache = calloc(1, sizeof(MyFontCache));
+    
+    if(!cache)
+		return NULL;
+    // The font dictionary pointers are the keys so no callbacks are
+    // needed.
+    cache->fonts = CFDictionaryCreateMutable(NULL, 0, NULL, NULL);
+    if(!cache->fonts){
+		free(cache);
+		return NULL;
+    }
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+static void freeFontCacheEntry(const void *key, const void *value, 
+				void *context)
+{
+    freeFont((MyFont *)value);
+}
+
+void releaseFontCache(MyFontCache *cache)
+{
+    if(!cache)
+		return;
+    CFDictionaryApplyFunction(cache->fonts, freeFontCacheEntry, NULL);
+    CFRelease(cache->fonts);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
+
+/* Return the decoded font for a font dictionary, decoding it the first
+    time it is used. Fonts are decoded without holding the lock; should
+    two workers decode the same font at once, the first to finish wins. */
+static const MyFont *fontCacheGetFont(MyFontCache *cache, 
+			CGPDFDictionaryRef fontDict)
+{
+    MyFont *font, *newFont;
+    
+    pthread_mutex_lock(&cache->lock);
+    font = (MyFont *)CFDictionaryGetValue(cache->fonts, fontDict);
+    pthread_mutex_unlock(&cache->lock);
+    if(font)
+		return font;
+    
+    newFont = createFont(fontDict);
+    if(!newFont)
+		return NULL;
+    pthread_mutex_lock(&cache->lock);
+    font = (MyFont *)CFDictionaryGetValue(cache->fonts, fontDict);
+    if(!font){
+		CFDictionarySetValue(cache->fonts, fontDict, newFont);
+		font = newFont;
+		newFont = NULL;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    if(newFont)
+		freeFont(newFont);
+    return font;
+}
+
+MyTextScan *createTextScan(MyFontCache *fonts)
+{
+    MyTextScan *scan = calloc(1, sizeof(MyTextScan));
+    
+    if(!scan)
+		return NULL;
+    scan->fonts = fonts;
+    scan->horizontalScale = 1;
+    scan->textMatrix = scan->lineMatrix = CGAffineTransformIdentity;
+    return scan;
+}
+
+MyTextScan *createFormTextScan(const MyTextScan *parent)
+{
+    MyTextScan *scan = createTextScan(parent->fonts);
+    
+    if(!scan)
+		return NULL;
+    scan->font = parent->font;
+    scan->fontSize = parent->fontSize;
+    scan->charSpacing = parent->charSpacing;
+    scan->wordSpacing = parent->wordSpacing;
+    scan->horizontalScale = parent->horizontalScale;
+    scan->leading = parent->leading;
+    scan->inheritedState = kMyTextStateAll;
+    return scan;
+}
+
+void releaseTextScan(MyTextScan *scan)
+{
+    if(!scan)
+		return;
+    free(scan->text);
+    free(scan);
+}
+
+static void appendText(MyTextScan *scan, const char *bytes, size_t length)
+{
+    if(scan->length + length + 1 > scan->capacity){
+		size_t newCapacity = scan->capacity ? 2*scan->capacity : 4096;
+		char *newText;
+		while(scan->length + length + 1 > newCapacity)
+			newCapacity *= 2;
+		newText = realloc(scan->text, newCapacity);
+		if(!newText)
+			return;
+		scan->text = newText;
+		scan->capacity = newCapacity;
+    }
+    memcpy(scan->text + scan->length, bytes, length);
+    scan->length += length;
+    scan->text[scan->length] = '\0';
+}
+
+/* End the current line, unless it is empty. */
+static void breakLine(MyTextScan *scan)
+{
+    if(scan->length && scan->text[scan->length - 1] != '\n')
+		appendText(scan, "\n", 1);
+}
+
+/* Separate the next word from the last, unless something already does. */
+static void breakWord(MyTextScan *scan)
+{
+    if(scan->length && scan->text[scan->length - 1] != '\n' &&
+		scan->text[scan->length - 1] != ' ')
+		appendText(scan, " ", 1);
+}
+
+/* A gap between strings on a line wider than this fraction of the 
+    font size is taken to be a space between words. */
+#define kMyWordGap	0.15
+
+/* Before a string is shown, compare where it starts with where the 
+    last one ended, measured along and across the direction of the 
+    text, to decide whether it starts a new line or a new word. */
+static void positionText(MyTextScan *scan)
+{
+    CGAffineTransform m = scan->textMatrix;
+    CGFloat width = hypot(m.a, m.b);
+    CGFloat height = fabs(scan->fontSize) * hypot(m.c, m.d);
+    CGFloat dx, dy, along, across;
+    
+    if(!scan->haveLastPosition || width == 0 || height == 0)
+		return;
+    dx = m.tx - scan->lastX;
+    dy = m.ty - scan->lastY;
+    along = (dx*m.a + dy*m.b)/width;
+    across = (dy*m.a - dx*m.b)/width;
+    if(fabs(across) > 0.5*height)
+		breakLine(scan);
+    else if(along > kMyWordGap*height || along < -height)
+		breakWord(scan);
+}
+
+/* Note that the supplied parts of the text state are about to be used. */
+static void useTextState(MyTextScan *scan, unsigned state)
+{
+    if(scan->inheritedState & state)
+		scan->usedInheritedState = true;
+}
+
+/* Note that the supplied parts of the text state have been set. */
+static void setTextState(MyTextScan *scan, unsigned state)
+{
+    scan->inheritedState &= ~state;
+}
+
+/* Move along the line by tx in unscaled text space units. */
+static void moveText(MyTextScan *scan, CGFloat tx)
+{
+    scan->textMatrix.tx += tx*scan->textMatrix.a;
+    scan->textMatrix.ty += tx*scan->textMatrix.b;
+}
+
+/* Start a new line offset from the start of the current one. */
+static void moveLine(MyTextScan *scan, CGFloat tx, CGFloat ty)
+{
+    CGAffineTransform *l = &scan->lineMatrix;
+    
+    l->tx += tx*l->a + ty*l->c;
+    l->ty += tx*l->b + ty*l->d;
+    scan->textMatrix = *l;
+}
+
+static void showString(MyTextScan *scan, CGPDFStringRef string)
+{
+    const unsigned char *bytes = CGPDFStringGetBytePtr(string);
+    size_t i, length = CGPDFStringGetLength(string);
+    size_t codeLength = scan->font && scan->font->twoByte ? 2 : 1;
+    CGFloat advance = 0;
+    MyGlyphText buffer;
+    
+    if(!bytes)
+		return;
+    useTextState(scan, kMyTextStateFont | kMyTextStateCharSpacing | 
+			kMyTextStateWordSpacing | kMyTextStateHorizontalScale);
+    positionText(scan);
+    for(i = 0; i + codeLength <= length; i += codeLength){
+		unsigned long code = codeLength == 2 ? 
+				(unsigned long)bytes[i] << 8 | bytes[i + 1] : bytes[i];
+		const char *text = glyphText(scan->font, code, buffer);
+		
+		if(text)
+			appendText(scan, text, strlen(text));
+		else
+			scan->numUndecoded++;
+		advance += glyphWidth(scan->font, code)*scan->fontSize + 
+				scan->charSpacing;
+		// Word spacing applies only to the single byte code 32.
+		if(codeLength == 1 && code == ' ')
+			advance += scan->wordSpacing;
+    }
+    moveText(scan, advance*scan->horizontalScale);
+    scan->lastX = scan->textMatrix.tx;
+    scan->lastY = scan->textMatrix.ty;
+    scan->haveLastPosition = true;
+}
+
+/* Show the strings of a TJ array, moving back along the line by the 
+    numbers between them, which are in thousandths of the font size. */
+static void showStrings(MyTextScan *scan, CGPDFArrayRef array)
+{
+    CGPDFStringRef string;
+    CGPDFReal adjustment;
+    size_t i;
+    
+    for(i = 0; i < CGPDFArrayGetCount(array); i++){
+		if(CGPDFArrayGetString(array, i, &string))
+			showString(scan, string);
+		else if(CGPDFArrayGetNumber(array, i, &adjustment))
+			moveText(scan, -adjustment/1000*scan->fontSize*
+					scan->horizontalScale);
+    }
+}
+
+static void setFont(MyTextScan *scan, CGPDFScannerRef s, const char *name)
+{
+    CGPDFObjectRef object = CGPDFContentStreamGetResource(
+				CGPDFScannerGetContentStream(s), "Font", name);
+    CGPDFDictionaryRef fontDict;
+    
+    scan->font = NULL;
+    if(object && 
+		CGPDFObjectGetValue(object, kCGPDFObjectTypeDictionary, &fontDict))
+		scan->font = fontCacheGetFont(scan->fonts, fontDict);
+}
+
+/* Operators whose operands are missing or of the wrong type are 
+    ignored, as a viewer would. */
+void textScanOperator(MyTextScan *scan, CGPDFScannerRef s, 
+			MyTextOperator op)
+{
+    CGPDFReal n[6];
+    CGPDFStringRef string;
+    CGPDFArrayRef array;
+    const char *name;
+    int i;
+    
+    switch(op){
+		case kMyTextOperatorBT:
+			scan->textMatrix = scan->lineMatrix = 
+					CGAffineTransformIdentity;
+			break;
+		case kMyTextOperatorTc:
+			if(CGPDFScannerPopNumber(s, &n[0])){
+				scan->charSpacing = n[0];
+				setTextState(scan, kMyTextStateCharSpacing);
+			}
+			break;
+		case kMyTextOperatorTw:
+			if(CGPDFScannerPopNumber(s, &n[0])){
+				scan->wordSpacing = n[0];
+				setTextState(scan, kMyTextStateWordSpacing);
+			}
+			break;
+		case kMyTextOperatorTz:
+			if(CGPDFScannerPopNumber(s, &n[0])){
+				scan->horizontalScale = n[0]/100;
+				setTextState(scan, kMyTextStateHorizontalScale);
+			}
+			break;
+		case kMyTextOperatorTL:
+			if(CGPDFScannerPopNumber(s, &n[0])){
+				scan->leading = n[0];
+				setTextState(scan, kMyTextStateLeading);
+			}
+			break;
+		case kMyTextOperatorTf:
+			if(CGPDFScannerPopNumber(s, &n[0]) && 
+					CGPDFScannerPopName(s, &name))
+			{
+				scan->fontSize = n[0];
+				setFont(scan, s, name);
+				setTextState(scan, kMyTextStateFont);
+			}
+			break;
+		case kMyTextOperatorTd:
+		case kMyTextOperatorTD:
+			if(CGPDFScannerPopNumber(s, &n[1]) && 
+					CGPDFScannerPopNumber(s, &n[0]))
+			{
+				if(op == kMyTextOperatorTD){
+					scan->leading = -n[1];
+					setTextState(scan, kMyTextStateLeading);
+				}
+				moveLine(scan, n[0], n[1]);
+			}
+			break;
+		case kMyTextOperatorTm:
+			// The operands are popped last first.
+			for(i = 5; i >= 0; i--)
+				if(!CGPDFScannerPopNumber(s, &n[i]))
+					break;
+			if(i < 0)
+				scan->textMatrix = scan->lineMatrix = 
+					CGAffineTransformMake(n[0], n[1], n[2], n[3], 
+							n[4], n[5]);
+			break;
+		case kMyTextOperatorTStar:
+			useTextState(scan, kMyTextStateLeading);
+			moveLine(scan, 0, -scan->leading);
+			break;
+		case kMyTextOperatorTj:
+			if(CGPDFScannerPopString(s, &string))
+				showString(scan, string);
+			break;
+		case kMyTextOperatorTJ:
+			if(CGPDFScannerPopArray(s, &array))
+				showStrings(scan, array);
+			break;
+		case kMyTextOperatorQuote:
+			if(CGPDFScannerPopString(s, &string)){
+				useTextState(scan, kMyTextStateLeading);
+				moveLine(scan, 0, -scan->leading);
+				showString(scan, string);
+			}
+			break;
+		case kMyTextOperatorDoubleQuote:
+			if(CGPDFScannerPopString(s, &string) &&
+					CGPDFScannerPopNumber(s, &n[1]) &&
+					CGPDFScannerPopNumber(s, &n[0]))
+			{
+				scan->wordSpacing = n[0];
+				scan->charSpacing = n[1];
+				setTextState(scan, kMyTextStateWordSpacing | 
+						kMyTextStateCharSpacing);
+				useTextState(scan, kMyTextStateLeading);
+				moveLine(scan, 0, -scan->leading);
+				showString(scan, string);
+			}
+			break;
+		default:
+			break;
+    }
+}
+
+void textScanAppendText(MyTextScan *scan, const char *text, 
+			size_t numUndecoded)
+{
+    if(*text){
+		breakLine(scan);
+		appendText(scan, text, strlen(text));
+		breakLine(scan);
+    }
+    scan->numUndecoded += numUndecoded;
+}
+
+const char *textScanGetText(const MyTextScan *scan)
+{
+    return scan->text ? scan->text : "";
+}
+
+size_t textScanGetUndecodedCount(const MyTextScan *scan)
+{
+    return scan->numUndecoded;
+}
+
+bool textScanUsedInheritedState(const MyTextScan *scan)
+{
+    return scan->usedInheritedState;
+}
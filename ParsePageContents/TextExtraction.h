@@ -0,0 +1,113 @@
+/*
+*  File:    TextExtraction.h
+*  
+*  Copyright:  Copyright © 2005 Apple Computer, Inc., All Rights Reserved
+* 
+*  Disclaimer:  IMPORTANT:  This Apple software is supplied to you by Apple Computer, Inc. ("Apple") in 
+*        consideration of your agreement to the following terms, and your use, installation, modification 
+*        or redistribution of this Apple software constitutes acceptance of these terms.  If you do 
+*        not agree with these terms, please do not use, install, modify or redistribute this Apple 
+*        software.
+*
+*        In consideration of your agreement to abide by the following terms, and subject to these terms, 
+*        Apple grants you a personal, non-exclusive license, under Apple's copyrights in this 
+*        original Apple software (the "Apple Software"), to use, reproduce, modify and redistribute the 
+*        Apple Software, with or without modifications, in source and/or binary forms; provided that if you 
+*        redistribute the Apple Software in its entirety and without modifications, you must retain this 
+*        notice and the following text and disclaimers in all such redistributions of the Apple Software. 
+*        Neither the name, trademarks, service marks or logos of Apple Computer, Inc. may be used to 
+*        endorse or promote products derived from the Apple Software without specific prior written 
+*        permission from Apple.  Except as expressly stated in this notice, no other rights or 
+*        licenses, express or implied, are granted by Apple herein, including but not limited to any 
+*        patent rights that may be infringed by your derivative works or by other works in which the 
+*        Apple Software may be incorporated.
+*
+*        The Apple Software is provided by Apple on an "AS IS" basis.  APPLE MAKES NO WARRANTIES, EXPRESS OR 
+*        IMPLIED, INCLUDING WITHOUT LIMITATION THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY 
+*        AND FITNESS FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND OPERATION ALONE 
+*        OR IN COMBINATION WITH YOUR PRODUCTS.
+*
+*        IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL OR CONSEQUENTIAL 
+*        DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS 
+*        OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, 
+*        REPRODUCTION, MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED AND WHETHER 
+*        UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), STRICT LIABILITY OR OTHERWISE, EVEN 
+*        IF APPLE HAS BEEN ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+#ifndef __TextExtraction__
+#define __TextExtraction__
+
+#include <ApplicationServices/ApplicationServices.h>
+
+/*  Text extraction follows the text showing and text state operators
+    of a content stream, decoding each string shown through its font's
+    ToUnicode map or, failing that, its encoding, and tracking the text
+    matrix well enough to tell where words and lines break. The layout
+    is judged in text space without the CTM, which doesn't affect 
+    whether one string follows another on the same line. */
+
+/* The decoded fonts of one document, keyed by the identity of each
+    font dictionary so a font used on many pages is decoded once. A
+    font cache may be used from several threads at once. */
+typedef struct MyFontCache MyFontCache;
+
+MyFontCache *createFontCache(void);
+void releaseFontCache(MyFontCache *cache);
+
+/* The operators text extraction needs callbacks for. */
+typedef enum MyTextOperator
+{
+    kMyTextOperatorBT,
+    kMyTextOperatorTc,
+    kMyTextOperatorTw,
+    kMyTextOperatorTz,
+    kMyTextOperatorTL,
+    kMyTextOperatorTf,
+    kMyTextOperatorTd,
+    kMyTextOperatorTD,
+    kMyTextOperatorTm,
+    kMyTextOperatorTStar,
+    kMyTextOperatorTj,
+    kMyTextOperatorTJ,
+    kMyTextOperatorQuote,
+    kMyTextOperatorDoubleQuote,
+    kMyNumTextOperators
+}MyTextOperator;
+
+extern const char * const kMyTextOperatorNames[kMyNumTextOperators];
+
+/* The text of one page or form, collected as UTF-8 while its content
+    stream is scanned. A text scan may be used by one thread at a time. */
+typedef struct MyTextScan MyTextScan;
+
+MyTextScan *createTextScan(MyFontCache *fonts);
+void releaseTextScan(MyTextScan *scan);
+
+/* Create the text scan of a form used by the scan supplied, starting 
+    with the font, spacing, scaling and leading the form inherits from 
+    it. */
+MyTextScan *createFormTextScan(const MyTextScan *parent);
+
+/* Handle one operator, popping its operands from the scanner. */
+void textScanOperator(MyTextScan *scan, CGPDFScannerRef s, 
+			MyTextOperator op);
+
+/* Add text extracted separately, such as that of a form used by the 
+    page, on lines of its own. numUndecoded is the number of glyphs in
+    it that couldn't be decoded. */
+void textScanAppendText(MyTextScan *scan, const char *text, 
+			size_t numUndecoded);
+
+/* The text so far, which is never NULL, and the number of glyphs that 
+    couldn't be decoded because their fonts give no way to map them to
+    Unicode. */
+const char *textScanGetText(const MyTextScan *scan);
+size_t textScanGetUndecodedCount(const MyTextScan *scan);
+
+/* Whether any text of a form's scan depended on text state inherited
+    rather than set by the form itself, so that the same form may say
+    something else where it is used with other text state. */
+bool textScanUsedInheritedState(const MyTextScan *scan);
+
+#endif	// __TextExtraction__
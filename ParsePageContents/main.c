@@ -38,15 +38,294 @@
 
 //#import <AppKit/AppKit.h>
 #include <ApplicationServices/ApplicationServices.h>
+#include <pthread.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <errno.h>
+#include "ExtractionStore.h"
+#include "MemoryBudget.h"
+#include "OperatorProfile.h"
+#include "NDJSONWriter.h"
+#include "PageSelection.h"
+#include "RawImageExport.h"
+#include "TextExtraction.h"
+#include "ImageIndex.h"
+
+struct MyDocScan;
+struct MyFormCacheEntry;
+struct MyImageCacheEntry;
+
+/* A use of an image XObject. The resource name of an image used from
+    inside a form is a path such as "Fm1/Im0" relative to the resources
+    of the page or form that used it. */
+typedef struct MyImageReference
+{
+    char *resourceName;
+    const struct MyImageCacheEntry *image;
+}MyImageReference;
+
+typedef struct MyImageReferenceList
+{
+    MyImageReference *references;
+    size_t count;
+    size_t capacity;
+}MyImageReferenceList;
+
+// Forms nested deeper than this are assumed to be malformed.
+#define kMyMaxFormDepth 32
+
+/* Why a page was abandoned before its content stream was scanned to 
+    the end, if it was. */
+typedef enum MyOverBudget
+{
+    kMyWithinBudget,
+    kMyOverTimeBudget,
+    kMyOverMemoryBudget
+}MyOverBudget;
+
+/* What a page has used of its budget so far. The scans of the forms 
+    drawn on a page share the page's budget. */
+typedef struct MyPageBudget
+{
+    CFAbsoluteTime deadline;		// 0 if there is no time limit.
+    unsigned long long memoryUsed;	// Image data decoded so far.
+    size_t operatorsSinceCheck;
+    MyOverBudget overBudget;
+}MyPageBudget;
+
 typedef struct MyDataScan
 {
     size_t numImagesWithColorThisPage;
     size_t numImageMasksThisPage;
     size_t numImagesMaskedWithMaskThisPage;
     size_t numImagesMaskedWithColorsThisPage;
+    // References to image and form XObjects, including those made
+    // from inside forms used on the page.
+    size_t numImageXObjectRefsThisPage;
+    size_t numFormXObjectRefsThisPage;
+    size_t numInlineImagesThisPage;
+    // The document and page number being scanned.
+    struct MyDocScan *docScan;
+    size_t pageNum;
+    /* When scanning a form XObject rather than a page, the form's
+	stream, the cache entry collecting the form's image references
+	and the scan of the page or form that used it. */
+    CGPDFStreamRef formStream;
+    struct MyFormCacheEntry *formEntry;
+    struct MyDataScan *parent;
+    int formDepth;
+    // Where the costs of the page are recorded when profiling, else NULL.
+    MyPageProfile *profile;
+    // The images used on a page, kept for NDJSON output and the index.
+    MyImageReferenceList pageImages;
+    // The text of the page or form when extracting text, else NULL.
+    MyTextScan *text;
+    // The budget of the page being scanned, or NULL if it has none.
+    MyPageBudget *pageBudget;
+    // Set once a page has been abandoned, when its results are empty.
+    MyOverBudget overBudget;
 }MyDataScan;
 
-int findex=0;
+/* The kinds of image this code distinguishes between. */
+typedef enum MyImageType
+{
+    kMyImageMalformed,
+    kMyImageWithColor,
+    kMyImageMask,
+    kMyImageMaskedWithMask,
+    kMyImageMaskedWithColors
+}MyImageType;
+
+/* What is known about one image XObject stream once it has been
+    seen. Repeated references to the same stream reuse this rather
+    than decoding and extracting the image again. */
+typedef struct MyImageCacheEntry
+{
+    MyImageType imageType;
+    bool ready;		// False until the first reference has extracted it.
+    // Set if the first reference ran out of page budget before the
+    // image could be extracted. Such an entry has been taken out of 
+    // the cache and is freed by the last worker waiting on it.
+    bool abandoned;
+    size_t numWaiters;
+    char blobID[kMyBlobIDSize];	// Empty if extraction failed.
+    // As given in the image dictionary, for reporting.
+    size_t width;
+    size_t height;
+    size_t bitsPerComponent;
+    char filter[32];		// The last filter; empty if none.
+    char colorSpaceFamily[32];	// Such as "DeviceRGB" or "ICCBased".
+}MyImageCacheEntry;
+
+/* The results of scanning one form XObject. A form used on many pages
+    is scanned once and these results are added to each page using it. */
+typedef struct MyFormCacheEntry
+{
+    bool ready;		// False until the form has been scanned.
+    MyDataScan counts;	// Only the counters are used.
+    MyImageReferenceList references;
+    // The form's text when extracting text, added to every page using it.
+    char *text;
+    size_t numUndecoded;
+}MyFormCacheEntry;
+
+/* How results are written. */
+typedef enum MyOutputFormat
+{
+    kMyOutputText,	// Sentences for people to read.
+    kMyOutputNDJSON	// One JSON record per page and per document.
+}MyOutputFormat;
+
+/* The options controlling how a document is scanned. */
+typedef struct MyScanOptions
+{
+    int numWorkers;
+    MyOutputFormat format;
+    // All NDJSON records go through this writer.
+    MyNDJSONWriter *writer;
+    // Where extracted images go. NULL if images aren't extracted.
+    MyExtractionStore *store;
+    // Bounds the image data held by all workers at once.
+    MyMemoryBudget *budget;
+    // Convert CMYK, Lab and indexed images to RGB as they are extracted.
+    bool toRGB;
+    /* A page that takes longer than pageSeconds to scan, or that would
+	decode more than pageMemory bytes of image data, is abandoned. 
+	Either limit is unused if it is 0. */
+    double pageSeconds;
+    unsigned long long pageMemory;
+    // Count every operator and time every page.
+    bool profile;
+    // Which pages to scan.
+    MyPageSelection selection;
+    // Extract the text of each page instead of its images.
+    bool text;
+    // Write an image index next to each document scanned.
+    bool writeIndex;
+    /* Answer a query from each document's image index instead of
+	scanning it. Images match if either dimension is at least 
+	minImageSize and their color space family contains colorSpace; 
+	either test is skipped if it is 0 or NULL. */
+    bool query;
+    size_t minImageSize;
+    const char *colorSpace;
+}MyScanOptions;
+
+/* This is the state shared by all of the workers scanning the pages
+    of one document. Workers take the next unscanned page number under
+    the lock, scan that page into its own MyDataScan and then print
+    every page whose predecessors have all finished. Results therefore
+    come out in page order whatever the number of workers. */
+typedef struct MyDocScan
+{
+    CGPDFDocumentRef pdfDoc;
+    char docName[PATH_MAX];
+    const MyScanOptions *options;
+    CGPDFOperatorTableRef table;
+    FILE *outFile;
+    size_t totPages;
+    // The numbers of the pages selected for scanning, in order. No 
+    // other page is ever loaded.
+    size_t *pages;
+    size_t numPages;
+    // Indexes into pages.
+    size_t nextPageToScan;
+    size_t nextPageToPrint;
+    size_t totalImages;
+    size_t pagesOverBudget;
+    MyDataScan *pageResults;	// Indexed like pages.
+    bool *pageDone;		// Indexed like pages.
+    MyPageProfile *pageProfiles;	// Likewise, or NULL if not profiling.
+    bool failed;
+    pthread_mutex_t lock;
+    
+    size_t imageReferences;
+    size_t formReferences;
+    
+    /* Image and form XObjects keyed by the identity of their 
+	CGPDFStreamRef, which is the same for every reference to the same
+	object in a document. Values are MyImageCacheEntry and 
+	MyFormCacheEntry pointers. Both caches share one lock. */
+    CFMutableDictionaryRef imageCache;
+    CFMutableDictionaryRef formCache;
+    /* Inline images have no identity of their own, so extracted inline
+	images are keyed by blob ID. Each distinct one has an entry that
+	its uses refer to. */
+    CFMutableDictionaryRef inlineImageCache;
+    pthread_mutex_t cacheLock;
+    pthread_cond_t imageCacheReady;
+    
+    /* Color spaces built from color space arrays, keyed by the identity
+	of the CGPDFArrayRef. Arrays that don't produce a color space map
+	to kCFNull so they aren't parsed again either. The device color
+	spaces are created once per document. All are guarded by 
+	cacheLock. */
+    CFMutableDictionaryRef colorSpaceCache;
+    size_t colorSpaceHits;
+    size_t colorSpaceMisses;
+    CGColorSpaceRef deviceRGB;
+    CGColorSpaceRef deviceCMYK;
+    CGColorSpaceRef deviceGray;
+    
+    // The fonts used by the document, when extracting text.
+    MyFontCache *fonts;
+    size_t textCharacters;
+    size_t undecodedGlyphs;
+    
+    // Where the image index is being built, or NULL.
+    MyImageIndexWriter *index;
+}MyDocScan;
+
+static void usage(const char *name){
+    fprintf(stderr, "Usage: %s [-j workers] [-o directory] [-m bytes] [-p] [-t]\n"
+			"       [-f text|ndjson] [--to-rgb] [--pages list] [--every n] [--sample k]\n"
+			"       [--page-time seconds] [--page-memory bytes]\n"
+			"       [--index | --query [--min-size n] [--color-space name]]\n"
+			"       [-b list [-c checkpoint] | inputfile]\n", name);
+    fprintf(stderr, "    -j workers   scan pages on this many threads "
+			"(0 uses one per processor)\n");
+    fprintf(stderr, "    -o directory store extracted images in this "
+			"directory (default .)\n");
+    fprintf(stderr, "    -m bytes     hold at most this much image data "
+			"in memory at once;\n"
+			"                 a K, M or G suffix multiplies by 1024, "
+			"1024^2 or 1024^3\n");
+    fprintf(stderr, "    -p           report the slowest pages and the "
+			"most frequent operators\n");
+    fprintf(stderr, "    -t           extract the text of each page "
+			"instead of its images\n");
+    fprintf(stderr, "    -f format    text (the default) or ndjson for one "
+			"JSON record per page\n"
+			"                 and per document\n");
+    fprintf(stderr, "    --to-rgb     convert CMYK, Lab and indexed images "
+			"to RGB as they are\n"
+			"                 extracted\n");
+    fprintf(stderr, "    --pages list scan only these pages, such as "
+			"10-200,500 or 7-\n");
+    fprintf(stderr, "    --every n    scan only every nth selected page\n");
+    fprintf(stderr, "    --sample k   scan k selected pages chosen at "
+			"random, the same ones every run\n");
+    fprintf(stderr, "    --page-time seconds\n"
+			"                 abandon any page that takes longer than "
+			"this to scan\n");
+    fprintf(stderr, "    --page-memory bytes\n"
+			"                 abandon any page that would decode more "
+			"image data than this\n");
+    fprintf(stderr, "    --index      write an image index next to "
+			"each document scanned in full\n");
+    fprintf(stderr, "    --query      list the images in each "
+			"document's image index instead of\n"
+			"                 scanning it, optionally only those with "
+			"a side of at least\n"
+			"                 --min-size pixels or a color space "
+			"family containing --color-space\n");
+    fprintf(stderr, "    -b list      scan the documents named in this "
+			"file, one per line, with\n"
+			"                 -j documents at a time\n");
+    fprintf(stderr, "    -c file      record finished documents of a "
+			"batch in this file and skip\n"
+			"                 those already in it (default list.done)\n");
+}
 
 static void printPageResults(FILE *outFile, MyDataScan myData, size_t pageNum)
 {
@@ -72,21 +351,146 @@ static void printPageResults(FILE *outFile, MyDataScan myData, size_t pageNum)
 			pageNum);
 }
 
-static void printDocResults(FILE *outFile, size_t totPages, 
-				    size_t totImages)
+static const char *overBudgetName(MyOverBudget overBudget)
+{
+    return overBudget == kMyOverTimeBudget ? "time" : "memory";
+}
+
+static void printOverBudgetPage(FILE *outFile, const MyDataScan *myData)
 {
+    fprintf(outFile, "Page %zd went over its %s budget and was abandoned.\n",
+			myData->pageNum, overBudgetName(myData->overBudget));
+}
+
+static void printDocResults(FILE *outFile, const MyDocScan *docScan)
+{
+    if(docScan->numPages == docScan->totPages)
+		fprintf(outFile, 
+			"\nSummary: %zd page document contains %zd images.\n", 
+				docScan->totPages, docScan->totalImages);
+    else
+		fprintf(outFile, 
+			"\nSummary: %zd of %zd pages scanned contain %zd images.\n", 
+				docScan->numPages, docScan->totPages, docScan->totalImages);
+    fprintf(outFile, 
+		"Image XObjects: %zd references, %zd unique images.\n", 
+			docScan->imageReferences, 
+			CFDictionaryGetCount(docScan->imageCache));
     fprintf(outFile, 
-		"\nSummary: %zd page document contains %zd images.\n\n", 
-			totPages, totImages);
+		"Form XObjects: %zd references, %zd unique forms.\n", 
+			docScan->formReferences, 
+			CFDictionaryGetCount(docScan->formCache));
+    if(docScan->pagesOverBudget)
+		fprintf(outFile, "Pages over budget: %zd abandoned.\n", 
+				docScan->pagesOverBudget);
+    fprintf(outFile, 
+		"Color spaces: %zd parsed, %zd reused.\n\n", 
+			docScan->colorSpaceMisses, docScan->colorSpaceHits);
+}
+
+/* Print the text of one page, leaving a blank line after it. */
+static void printPageText(FILE *outFile, const char *text, size_t pageNum)
+{
+    size_t length = strlen(text);
+    
+    fprintf(outFile, "Text of Page %zd:\n", pageNum);
+    fwrite(text, 1, length, outFile);
+    fputs(length && text[length - 1] == '\n' ? "\n" : "\n\n", outFile);
+}
+
+static void printDocTextResults(FILE *outFile, const MyDocScan *docScan)
+{
+    if(docScan->numPages == docScan->totPages)
+		fprintf(outFile, 
+			"Summary: %zd page document contains %zd characters of "
+			"text.\n", docScan->totPages, docScan->textCharacters);
+    else
+		fprintf(outFile, 
+			"Summary: %zd of %zd pages scanned contain %zd characters "
+			"of text.\n", docScan->numPages, docScan->totPages, 
+			docScan->textCharacters);
+    if(docScan->undecodedGlyphs)
+		fprintf(outFile, 
+			"%zd glyphs couldn't be decoded to text.\n", 
+			docScan->undecodedGlyphs);
+    if(docScan->pagesOverBudget)
+		fprintf(outFile, "%zd pages went over budget and were abandoned.\n",
+				docScan->pagesOverBudget);
+    fprintf(outFile, "\n");
+}
+
+/* Inline images may abbreviate the keys of their dictionaries. Return
+    the abbreviation of an image dictionary key, or NULL if it has none. */
+static const char *abbreviatedImageKey(const char *key)
+{
+    static const char * const keys[][2] = {
+		{ "BitsPerComponent", "BPC" }, { "ColorSpace", "CS" },
+		{ "Decode", "D" }, { "DecodeParms", "DP" }, { "Filter", "F" },
+		{ "Height", "H" }, { "ImageMask", "IM" }, { "Interpolate", "I" },
+		{ "Width", "W" }
+    };
+    size_t i;
+    
+    for(i = 0; i < sizeof(keys)/sizeof(keys[0]); i++)
+		if(strcmp(key, keys[i][0]) == 0)
+			return keys[i][1];
+    return NULL;
+}
+
+/* These get an entry of an image dictionary by its full key or, 
+    failing that, by its abbreviation. */
+static bool getImageInteger(CGPDFDictionaryRef dict, const char *key, 
+			CGPDFInteger *value)
+{
+    const char *abbreviation = abbreviatedImageKey(key);
+    return CGPDFDictionaryGetInteger(dict, key, value) ||
+		(abbreviation && CGPDFDictionaryGetInteger(dict, abbreviation, value));
+}
+
+static bool getImageBoolean(CGPDFDictionaryRef dict, const char *key, 
+			CGPDFBoolean *value)
+{
+    const char *abbreviation = abbreviatedImageKey(key);
+    return CGPDFDictionaryGetBoolean(dict, key, value) ||
+		(abbreviation && CGPDFDictionaryGetBoolean(dict, abbreviation, value));
+}
+
+static bool getImageName(CGPDFDictionaryRef dict, const char *key, 
+			const char **value)
+{
+    const char *abbreviation = abbreviatedImageKey(key);
+    return CGPDFDictionaryGetName(dict, key, value) ||
+		(abbreviation && CGPDFDictionaryGetName(dict, abbreviation, value));
+}
 
+static bool getImageArray(CGPDFDictionaryRef dict, const char *key, 
+			CGPDFArrayRef *value)
+{
+    const char *abbreviation = abbreviatedImageKey(key);
+    return CGPDFDictionaryGetArray(dict, key, value) ||
+		(abbreviation && CGPDFDictionaryGetArray(dict, abbreviation, value));
 }
 
+/* Inline images may also abbreviate the names of the device color 
+    spaces and of Indexed. Return the full name. */
+static const char *expandedColorSpaceName(const char *name)
+{
+    if(strcmp(name, "G") == 0)
+		return "DeviceGray";
+    if(strcmp(name, "RGB") == 0)
+		return "DeviceRGB";
+    if(strcmp(name, "CMYK") == 0)
+		return "DeviceCMYK";
+    if(strcmp(name, "I") == 0)
+		return "Indexed";
+    return name;
+}
 
 CGFloat *decodeValuesFromImageDictionary(CGPDFDictionaryRef dict, CGColorSpaceRef cgColorSpace, int bitsPerComponent) {
     CGFloat *decodeValues = NULL;
     CGPDFArrayRef decodeArray = NULL;
 	
-    if (CGPDFDictionaryGetArray(dict, "Decode", &decodeArray)) {
+    if (getImageArray(dict, "Decode", &decodeArray)) {
         size_t count = CGPDFArrayGetCount(decodeArray);
         decodeValues = malloc(sizeof(CGFloat) * count);
         CGPDFReal realValue;
@@ -144,13 +548,12 @@ CGFloat *decodeValuesFromImageDictionary(CGPDFDictionaryRef dict, CGColorSpaceRe
     return (CGFloat *)CFMakeCollectable(decodeValues);
 }
 
-void checkImageType(CGPDFDictionaryRef imageDict, 
-								MyDataScan *myScanDataP)
+/* Work out which kind of image the image dictionary describes. */
+static MyImageType classifyImage(CGPDFDictionaryRef imageDict)
 {
     CGPDFBoolean isMask;
     bool hasMaskKey;
     CGPDFObjectRef object;
-	CGPDFDictionaryGetObject(imageDict,"", &object);
     /* If it is an image mask, the dictionary has a key 
 		/ImageMask with a boolean true or it has
 		a key /IM with a boolean true. */
@@ -158,17 +561,14 @@ void checkImageType(CGPDFDictionaryRef imageDict,
 	if(!hasMaskKey)
 		hasMaskKey = CGPDFDictionaryGetBoolean(imageDict, "IM", &isMask);
 	
-    if(hasMaskKey && isMask){
-	    myScanDataP->numImageMasksThisPage++;
-	    return;
-    }
+    if(hasMaskKey && isMask)
+	    return kMyImageMask;
     
     // If image is masked with an alpha image it has an SMask entry.
     if(CGPDFDictionaryGetObject(imageDict, "SMask", &object)){
 		// This object must be an XObject that is an image.
 		// This code assumes the PDF is well formed in this regard.
-	    myScanDataP->numImagesMaskedWithMaskThisPage++;
-	    return;
+	    return kMyImageMaskedWithMask;
     }
 
     // If this image is masked with an image or with colors it has 
@@ -179,17 +579,95 @@ void checkImageType(CGPDFDictionaryRef imageDict,
 		CGPDFObjectType type = CGPDFObjectGetType(object);
 		// Check if it is a stream type which it must be to be an XObject.
 		if(type == kCGPDFObjectTypeStream)
-	    		myScanDataP->numImagesMaskedWithMaskThisPage++;
+	    		return kMyImageMaskedWithMask;
 		else if(type == kCGPDFObjectTypeArray)
-	    		myScanDataP->numImagesMaskedWithColorsThisPage++;
-		else
-			fprintf(stderr,	"Mask entry in Image object is not well formed!\n");
+	    		return kMyImageMaskedWithColors;
 		
-		return;
+		fprintf(stderr,	"Mask entry in Image object is not well formed!\n");
+		return kMyImageMalformed;
     }
     // This image is not a mask, is not masked with another image or 
     // color so it must be an image with intrinsic color with no mask.
-    myScanDataP->numImagesWithColorThisPage++;
+    return kMyImageWithColor;
+}
+
+/* Return the name of the last filter applied to an image's data, 
+    which is the one that determines its encoding, or NULL if the data
+    isn't filtered. Inline images may use abbreviated filter names. */
+static const char *imageFilterName(CGPDFDictionaryRef dict)
+{
+    const char *name = NULL;
+    CGPDFArrayRef filters;
+    size_t count;
+    
+    if(CGPDFDictionaryGetName(dict, "Filter", &name) ||
+		CGPDFDictionaryGetName(dict, "F", &name))
+		return name;
+    if((CGPDFDictionaryGetArray(dict, "Filter", &filters) ||
+		CGPDFDictionaryGetArray(dict, "F", &filters)) &&
+		(count = CGPDFArrayGetCount(filters)) > 0 &&
+		CGPDFArrayGetName(filters, count - 1, &name))
+		return name;
+    return NULL;
+}
+
+/* Record the properties of an image that are reported in NDJSON 
+    output. These come straight from the image dictionary so nothing 
+    needs to be decoded. */
+static void describeImageForOutput(CGPDFDictionaryRef dict, 
+			MyImageCacheEntry *entry)
+{
+    CGPDFInteger value;
+    CGPDFBoolean isMask = false;
+    CGPDFArrayRef colorSpaceArray;
+    const char *name;
+    
+    if(getImageInteger(dict, "Width", &value) && value > 0)
+		entry->width = value;
+    if(getImageInteger(dict, "Height", &value) && value > 0)
+		entry->height = value;
+    (void)getImageBoolean(dict, "ImageMask", &isMask);
+    if(isMask)
+		entry->bitsPerComponent = 1;
+    else if(getImageInteger(dict, "BitsPerComponent", &value) && 
+			value > 0)
+		entry->bitsPerComponent = value;
+    name = imageFilterName(dict);
+    if(name)
+		strlcpy(entry->filter, name, sizeof(entry->filter));
+    // A color space is either a name or an array starting with one.
+    if(getImageName(dict, "ColorSpace", &name) ||
+		(getImageArray(dict, "ColorSpace", &colorSpaceArray) &&
+			CGPDFArrayGetName(colorSpaceArray, 0, &name)))
+		strlcpy(entry->colorSpaceFamily, expandedColorSpaceName(name), 
+				sizeof(entry->colorSpaceFamily));
+}
+
+/* Add one image of the supplied kind to the counts for the page. */
+static void countImageType(MyImageType imageType, MyDataScan *myScanDataP)
+{
+    switch(imageType){
+		case kMyImageWithColor:
+			myScanDataP->numImagesWithColorThisPage++;
+			break;
+		case kMyImageMask:
+			myScanDataP->numImageMasksThisPage++;
+			break;
+		case kMyImageMaskedWithMask:
+			myScanDataP->numImagesMaskedWithMaskThisPage++;
+			break;
+		case kMyImageMaskedWithColors:
+			myScanDataP->numImagesMaskedWithColorsThisPage++;
+			break;
+		default:
+			break;
+    }
+}
+
+void checkImageType(CGPDFDictionaryRef imageDict, 
+								MyDataScan *myScanDataP)
+{
+    countImageType(classifyImage(imageDict), myScanDataP);
 }
 
 /*	The "Do" operator consumes one value off the stack, the name of 
@@ -199,8 +677,9 @@ void checkImageType(CGPDFDictionaryRef imageDict,
  	Form objects or Image objects. This code only counts images.
     
 	Note that forms, patterns, and potentially other resources contain
-	images. This code only counts the top level images in a PDF document,
-	not images embedded in other resources. */
+	images. This code counts the images drawn by forms by scanning each
+	form's content stream, but not images embedded in patterns or other
+	resources. */
 
 CGColorSpaceRef colorSpaceFromPDFArray(CGPDFArrayRef colorSpaceArray){
 	CGColorSpaceRef       cgColorSpace = NULL, alternateColorSpace = NULL;
@@ -213,6 +692,7 @@ CGColorSpaceRef colorSpaceFromPDFArray(CGPDFArrayRef colorSpaceArray){
 	CGPDFArrayRef        rangeArray;
 	
 	if (CGPDFArrayGetName(colorSpaceArray, 0, &colorSpaceName)) {
+		colorSpaceName = expandedColorSpaceName(colorSpaceName);
 		if (strcmp(colorSpaceName, "ICCBased") == 0) {
 			if (CGPDFArrayGetStream(colorSpaceArray, 1, &stream)) {
 				dict = CGPDFStreamGetDictionary(stream);
@@ -263,7 +743,7 @@ CGColorSpaceRef colorSpaceFromPDFArray(CGPDFArrayRef colorSpaceArray){
 					range = malloc(numberOfComponents * 2 * sizeof(CGFloat));
 					if (!CGPDFDictionaryGetArray(dict, "Range", &rangeArray)) {
 						int i = 0;
-						for (; i < numberOfComponents * 2; i += 2) {
+						for (; i < numberOfComponents * 2; i++) {
 							range[i] = (i % 2 == 0) ? 0.0 : 1.0;
 						}
 					} else {
@@ -279,6 +759,7 @@ CGColorSpaceRef colorSpaceFromPDFArray(CGPDFArrayRef colorSpaceArray){
 					cgColorSpace = CGColorSpaceCreateICCBased(numberOfComponents, range, profile, 
 															  alternateColorSpace);
 					CGDataProviderRelease(profile);
+					CFRelease(colorSpaceDataPtr);
 					free(range);
 					if (cgColorSpace) {
 						// Since we have a preferential color space, we no 
@@ -295,18 +776,20 @@ CGColorSpaceRef colorSpaceFromPDFArray(CGPDFArrayRef colorSpaceArray){
 				}
 			}
 		} else if (strcmp(colorSpaceName, "Indexed") == 0) {
-			CGColorSpaceRef baseSpace;
+			CGColorSpaceRef baseSpace = NULL;
 			CGPDFArrayRef    base = NULL;
 			CGPDFInteger    highValue = 0;
 			CGPDFStreamRef    stream = NULL;
 			CGPDFStringRef    string;
-			const unsigned char *chars;
+			CFDataRef        lookupData = NULL;
+			const unsigned char *chars = NULL;
 			const char        *namedColorSpaceName;
 			
 			if (CGPDFArrayGetArray(colorSpaceArray, 1, &base)) {
 				baseSpace = colorSpaceFromPDFArray(base);
 			} else if (CGPDFArrayGetName(colorSpaceArray, 1, 
 										 &namedColorSpaceName)) {
+				namedColorSpaceName = expandedColorSpaceName(namedColorSpaceName);
 				if (strcmp(namedColorSpaceName, "DeviceRGB") == 0) {
 					baseSpace = CGColorSpaceCreateDeviceRGB();
 				} else if (strcmp(namedColorSpaceName, "DeviceGray") == 0) {
@@ -319,7 +802,9 @@ CGColorSpaceRef colorSpaceFromPDFArray(CGPDFArrayRef colorSpaceArray){
 			retrieved = CGPDFArrayGetInteger(colorSpaceArray, 2, &highValue);
 			
 			if (CGPDFArrayGetStream(colorSpaceArray, 3, &stream)) {
-				chars = CFDataGetBytePtr(CGPDFStreamCopyData(stream, NULL));
+				lookupData = CGPDFStreamCopyData(stream, NULL);
+				if (lookupData)
+					chars = CFDataGetBytePtr(lookupData);
 			} else if (CGPDFArrayGetString(colorSpaceArray, 3, &string)) {
 				chars = CGPDFStringGetBytePtr(string);
 			} else {
@@ -327,23 +812,837 @@ CGColorSpaceRef colorSpaceFromPDFArray(CGPDFArrayRef colorSpaceArray){
 				// TODO: Raise some error state?
 			}
 			
-			cgColorSpace = CGColorSpaceCreateIndexed(baseSpace, highValue, 
-													 chars);
+			if (baseSpace && chars)
+				cgColorSpace = CGColorSpaceCreateIndexed(baseSpace, highValue, 
+														 chars);
+			// The indexed color space keeps its own copy of the table.
+			if (lookupData)
+				CFRelease(lookupData);
+			CGColorSpaceRelease(baseSpace);
 		}
 	}
 	
 	return (CGColorSpaceRef)CFMakeCollectable(cgColorSpace);
 }
 
+/* Find the cache entry for an image XObject stream. If this is the 
+    first reference to the stream, a new entry is added and *isNew is
+    set; the caller must then fill it in and pass it to 
+    publishImageCacheEntry or abandonImageCacheEntry. Otherwise this 
+    waits until whichever worker saw the first reference has finished
+    with the entry, and should that worker abandon it, takes over as 
+    the first reference. */
+static MyImageCacheEntry *lookupImageCacheEntry(MyDocScan *docScan, 
+				CGPDFStreamRef stream, bool *isNew)
+{
+    MyImageCacheEntry *entry;
+    
+    pthread_mutex_lock(&docScan->cacheLock);
+    for(;;){
+		entry = (MyImageCacheEntry *)CFDictionaryGetValue(
+					docScan->imageCache, stream);
+		if(!entry){
+			*isNew = true;
+			entry = calloc(1, sizeof(MyImageCacheEntry));
+			if(entry)
+				CFDictionarySetValue(docScan->imageCache, stream, entry);
+			break;
+		}
+		entry->numWaiters++;
+		while(!entry->ready)
+			pthread_cond_wait(&docScan->imageCacheReady, 
+					&docScan->cacheLock);
+		entry->numWaiters--;
+		if(!entry->abandoned){
+			*isNew = false;
+			break;
+		}
+		if(entry->numWaiters == 0)
+			free(entry);
+    }
+    pthread_mutex_unlock(&docScan->cacheLock);
+    return entry;
+}
+
+/* Mark a new cache entry as complete and wake any workers waiting 
+    for it. */
+static void publishImageCacheEntry(MyDocScan *docScan, 
+				MyImageCacheEntry *entry)
+{
+    pthread_mutex_lock(&docScan->cacheLock);
+    entry->ready = true;
+    pthread_cond_broadcast(&docScan->imageCacheReady);
+    pthread_mutex_unlock(&docScan->cacheLock);
+}
+
+/* Take a new cache entry out of the cache without filling it in, so 
+    that the next reference to the image tries again. */
+static void abandonImageCacheEntry(MyDocScan *docScan, 
+				CGPDFStreamRef stream, MyImageCacheEntry *entry)
+{
+    pthread_mutex_lock(&docScan->cacheLock);
+    CFDictionaryRemoveValue(docScan->imageCache, stream);
+    entry->abandoned = true;
+    entry->ready = true;
+    pthread_cond_broadcast(&docScan->imageCacheReady);
+    if(entry->numWaiters == 0)
+		free(entry);
+    pthread_mutex_unlock(&docScan->cacheLock);
+}
+
+static void freeImageCacheEntry(const void *key, const void *value, 
+				void *context)
+{
+    free((void *)value);
+}
+
+static void freeImageReferences(MyImageReferenceList *list)
+{
+    size_t i;
+    for(i = 0; i < list->count; i++)
+		free(list->references[i].resourceName);
+    free(list->references);
+    memset(list, 0, sizeof(MyImageReferenceList));
+}
+
+static void freeFormCacheEntryContents(MyFormCacheEntry *entry)
+{
+    freeImageReferences(&entry->references);
+    free(entry->text);
+}
+
+static void freeFormCacheEntry(const void *key, const void *value, 
+				void *context)
+{
+    freeFormCacheEntryContents((MyFormCacheEntry *)value);
+    free((void *)value);
+}
+
+/* Add the counters of one scan to those of another. */
+static void addScanCounts(MyDataScan *to, const MyDataScan *from)
+{
+    to->numImagesWithColorThisPage += from->numImagesWithColorThisPage;
+    to->numImageMasksThisPage += from->numImageMasksThisPage;
+    to->numImagesMaskedWithMaskThisPage += 
+			from->numImagesMaskedWithMaskThisPage;
+    to->numImagesMaskedWithColorsThisPage += 
+			from->numImagesMaskedWithColorsThisPage;
+    to->numImageXObjectRefsThisPage += from->numImageXObjectRefsThisPage;
+    to->numFormXObjectRefsThisPage += from->numFormXObjectRefsThisPage;
+    to->numInlineImagesThisPage += from->numInlineImagesThisPage;
+}
+
+static void appendImageReference(MyImageReferenceList *list,
+			const char *resourceName, const MyImageCacheEntry *image)
+{
+    MyImageReference *reference;
+    
+    if(list->count == list->capacity){
+		size_t newCapacity = list->capacity ? 2*list->capacity : 8;
+		reference = realloc(list->references, 
+				newCapacity * sizeof(MyImageReference));
+		if(!reference)
+			return;
+		list->references = reference;
+		list->capacity = newCapacity;
+    }
+    reference = &list->references[list->count];
+    reference->resourceName = strdup(resourceName);
+    if(!reference->resourceName)
+		return;
+    reference->image = image;
+    list->count++;
+}
+
+/* Record a use of an image. Uses on a page go to the manifest if the
+    image was extracted and are kept for the page's NDJSON record; uses
+    inside a form are kept with the form's cached results. */
+static void recordImageReference(MyDataScan *myData, 
+				const char *resourceName, const MyImageCacheEntry *image)
+{
+    const MyScanOptions *options = myData->docScan->options;
+    
+    if(myData->formEntry){
+		appendImageReference(&myData->formEntry->references, 
+				resourceName, image);
+		return;
+    }
+    if(options->store && image->blobID[0])
+		extractionStoreRecordReference(options->store, 
+			myData->docScan->docName, myData->pageNum, 
+			resourceName, image->blobID);
+    if(options->format == kMyOutputNDJSON || myData->docScan->index)
+		appendImageReference(&myData->pageImages, resourceName, image);
+}
+
+/* Add the results of scanning a form to the scan of the page or form
+    that used it under the supplied resource name. */
+static void addFormResults(MyDataScan *myData, 
+			const MyFormCacheEntry *entry, const char *formName)
+{
+    char resourceName[1024];
+    size_t i;
+    
+    addScanCounts(myData, &entry->counts);
+    if(myData->text && entry->text)
+		textScanAppendText(myData->text, entry->text, entry->numUndecoded);
+    for(i = 0; i < entry->references.count; i++){
+		snprintf(resourceName, sizeof(resourceName), "%s/%s", 
+				formName, entry->references.references[i].resourceName);
+		recordImageReference(myData, resourceName, 
+				entry->references.references[i].image);
+    }
+}
+
+/* Scan the content stream of a form XObject with the form's own 
+    resources and add its results to myData. The results are cached
+    the first time the form is scanned so later uses of the same form
+    cost only a cache lookup. A form without resources of its own 
+    names its images and fonts through whatever uses it, so the same 
+    stream can draw different things in different places; such forms,
+    and those whose text depends on the text state they inherit, are
+    scanned every time instead. */
+static void scanFormXObject(CGPDFScannerRef s, MyDataScan *myData,
+			CGPDFStreamRef stream, CGPDFDictionaryRef dict, 
+			const char *formName)
+{
+    MyDocScan *docScan = myData->docScan;
+    MyFormCacheEntry *entry, privateEntry;
+    MyDataScan formData;
+    CGPDFDictionaryRef resources = NULL;
+    CGPDFContentStreamRef cs;
+    CGPDFScannerRef scanner;
+    const MyDataScan *p;
+    bool isNew = false, ready = false, hasResources, inheritsText = false;
+    
+    // A form that directly or indirectly uses itself would otherwise
+    // recurse forever.
+    for(p = myData; p; p = p->parent){
+		if(p->formStream == stream){
+			fprintf(stderr, "Form XObject %s uses itself!\n", formName);
+			return;
+		}
+    }
+    if(myData->formDepth >= kMyMaxFormDepth){
+		fprintf(stderr, "Form XObject %s is nested too deeply!\n", 
+				formName);
+		return;
+    }
+    
+    // Resources not present in the form are inherited from the page.
+    hasResources = CGPDFDictionaryGetDictionary(dict, "Resources", 
+				&resources);
+    
+    pthread_mutex_lock(&docScan->cacheLock);
+    entry = hasResources ? (MyFormCacheEntry *)CFDictionaryGetValue(
+				docScan->formCache, stream) : NULL;
+    if(!entry && hasResources){
+		entry = calloc(1, sizeof(MyFormCacheEntry));
+		if(entry){
+			CFDictionarySetValue(docScan->formCache, stream, entry);
+			isNew = true;
+		}
+    }else if(entry)
+		ready = entry->ready;
+    pthread_mutex_unlock(&docScan->cacheLock);
+    
+    // Cached results never change once ready so they can be read 
+    // without holding the lock.
+    if(ready){
+		addFormResults(myData, entry, formName);
+		return;
+    }
+    
+    /*	If another worker is still scanning this form, scan it again
+	here rather than wait. Waiting could deadlock on forms that use
+	each other, and this only happens while the form is first seen.
+	Forms that aren't cached are always scanned privately. */
+    if(!isNew){
+		memset(&privateEntry, 0, sizeof(privateEntry));
+		entry = &privateEntry;
+    }
+    
+    memset(&formData, 0, sizeof(formData));
+    formData.docScan = docScan;
+    formData.pageNum = myData->pageNum;
+    formData.profile = myData->profile;
+    formData.formStream = stream;
+    formData.formEntry = entry;
+    formData.parent = myData;
+    formData.formDepth = myData->formDepth + 1;
+    formData.pageBudget = myData->pageBudget;
+    if(myData->text)
+		formData.text = createFormTextScan(myData->text);
+    
+    cs = CGPDFContentStreamCreateWithStream(stream, resources, 
+			CGPDFScannerGetContentStream(s));
+    scanner = cs ? CGPDFScannerCreate(cs, docScan->table, &formData) : NULL;
+    if(scanner){
+		if(!CGPDFScannerScan(scanner) && (!myData->pageBudget ||
+				myData->pageBudget->overBudget == kMyWithinBudget))
+			fprintf(stderr, "Scanner couldn't scan all of form %s!\n", 
+					formName);
+		CGPDFScannerRelease(scanner);
+    }else
+		fprintf(stderr, "Couldn't create scanner for form %s!\n", 
+				formName);
+    if(cs)
+		CGPDFContentStreamRelease(cs);
+    
+    /*	A form cut short by the page's budget has partial results, which
+	mustn't be cached. Dropping the entry lets a later page scan the 
+	form again; the page that ran out is abandoned anyway. */
+    if(myData->pageBudget && 
+		myData->pageBudget->overBudget != kMyWithinBudget)
+    {
+		releaseTextScan(formData.text);
+		if(isNew){
+			pthread_mutex_lock(&docScan->cacheLock);
+			CFDictionaryRemoveValue(docScan->formCache, stream);
+			pthread_mutex_unlock(&docScan->cacheLock);
+		}
+		freeFormCacheEntryContents(entry);
+		if(entry != &privateEntry)
+			free(entry);
+		return;
+    }
+    entry->counts = formData;
+    entry->counts.text = NULL;
+    entry->counts.pageBudget = NULL;
+    if(formData.text){
+		entry->text = strdup(textScanGetText(formData.text));
+		entry->numUndecoded = textScanGetUndecodedCount(formData.text);
+		inheritsText = textScanUsedInheritedState(formData.text);
+		releaseTextScan(formData.text);
+    }
+    /*	Text shown with the font or spacing of whatever used the form 
+	may read differently elsewhere, so such a form is dropped from 
+	the cache and scanned again each time it is used. */
+    if(isNew){
+		pthread_mutex_lock(&docScan->cacheLock);
+		if(inheritsText)
+			CFDictionaryRemoveValue(docScan->formCache, stream);
+		else
+			entry->ready = true;
+		pthread_mutex_unlock(&docScan->cacheLock);
+    }
+    addFormResults(myData, entry, formName);
+    if(entry == &privateEntry || inheritsText){
+		freeFormCacheEntryContents(entry);
+		if(entry != &privateEntry)
+			free(entry);
+    }
+}
+
+/* Return the color space for a color space array, creating it with
+    colorSpaceFromPDFArray only the first time the array is seen in the
+    document. The caller must release the result, which is NULL if the
+    array doesn't describe a usable color space. */
+static CGColorSpaceRef copyCachedColorSpace(MyDocScan *docScan, 
+				CGPDFArrayRef colorSpaceArray)
+{
+    CGColorSpaceRef colorSpace;
+    CFTypeRef cached;
+    
+    pthread_mutex_lock(&docScan->cacheLock);
+    cached = CFDictionaryGetValue(docScan->colorSpaceCache, colorSpaceArray);
+    if(cached){
+		docScan->colorSpaceHits++;
+		colorSpace = (cached == kCFNull) ? NULL : 
+				CGColorSpaceRetain((CGColorSpaceRef)cached);
+		pthread_mutex_unlock(&docScan->cacheLock);
+		return colorSpace;
+    }
+    pthread_mutex_unlock(&docScan->cacheLock);
+    
+    // Parse without holding the lock; ICC profiles can be large.
+    colorSpace = colorSpaceFromPDFArray(colorSpaceArray);
+    
+    pthread_mutex_lock(&docScan->cacheLock);
+    docScan->colorSpaceMisses++;
+    cached = CFDictionaryGetValue(docScan->colorSpaceCache, colorSpaceArray);
+    if(cached){
+		// Another worker parsed the same array meanwhile; use its result.
+		CGColorSpaceRelease(colorSpace);
+		colorSpace = (cached == kCFNull) ? NULL : 
+				CGColorSpaceRetain((CGColorSpaceRef)cached);
+    }else
+		CFDictionarySetValue(docScan->colorSpaceCache, colorSpaceArray,
+				colorSpace ? (CFTypeRef)colorSpace : kCFNull);
+    pthread_mutex_unlock(&docScan->cacheLock);
+    return colorSpace;
+}
+
+/* Return the number of components of the color space described by a
+    color space array, or 0 if it isn't recognised. This is used for
+    color spaces colorSpaceFromPDFArray can't create. */
+static size_t componentsInColorSpaceArray(CGPDFArrayRef colorSpaceArray)
+{
+    const char *family;
+    CGPDFArrayRef names;
+    CGPDFStreamRef stream;
+    CGPDFInteger n;
+    
+    if(!CGPDFArrayGetName(colorSpaceArray, 0, &family))
+		return 0;
+    family = expandedColorSpaceName(family);
+    if(strcmp(family, "CalGray") == 0 || strcmp(family, "Separation") == 0 ||
+		strcmp(family, "Indexed") == 0)
+		return 1;
+    if(strcmp(family, "CalRGB") == 0 || strcmp(family, "Lab") == 0)
+		return 3;
+    if(strcmp(family, "DeviceN") == 0 && 
+		CGPDFArrayGetArray(colorSpaceArray, 1, &names))
+		return CGPDFArrayGetCount(names);
+    if(strcmp(family, "ICCBased") == 0 && 
+		CGPDFArrayGetStream(colorSpaceArray, 1, &stream) &&
+		CGPDFDictionaryGetInteger(CGPDFStreamGetDictionary(stream), "N", &n) &&
+		n > 0)
+		return n;
+    return 0;
+}
+
+/* Return a device color space with the supplied number of components,
+    or NULL if there isn't one. */
+static CGColorSpaceRef copyDeviceColorSpaceWithComponents(
+				MyDocScan *docScan, size_t components)
+{
+    switch(components){
+		case 1:
+			return CGColorSpaceRetain(docScan->deviceGray);
+		case 3:
+			return CGColorSpaceRetain(docScan->deviceRGB);
+		case 4:
+			return CGColorSpaceRetain(docScan->deviceCMYK);
+		default:
+			return NULL;
+    }
+}
+
+/* Return true if a color space array describes a Lab color space,
+    which colorSpaceFromPDFArray doesn't create. */
+static bool isLabColorSpaceArray(CGPDFArrayRef colorSpaceArray)
+{
+    const char *family;
+    
+    return CGPDFArrayGetName(colorSpaceArray, 0, &family) && 
+		strcmp(family, "Lab") == 0;
+}
+
+/* Create the converter --to-rgb uses for the samples of an image in
+    the supplied color space, or return NULL if they are left as they 
+    are. Only CMYK, Lab and indexed images are converted. labArray is
+    the color space array of a Lab image, whose samples the converter
+    decodes itself, and NULL otherwise. */
+static MyRGBConverter *createImageRGBConverter(CGPDFDictionaryRef dict,
+				CGPDFArrayRef labArray, CGColorSpaceRef colorSpace)
+{
+    // Samples run over L* 0-100 and the a* and b* of the color space's
+    // Range unless the image's Decode array says otherwise.
+    CGFloat decode[6] = { 0, 100, -100, 100, -100, 100 };
+    CGPDFDictionaryRef labDict;
+    CGPDFArrayRef array;
+    size_t i;
+    
+    if(labArray){
+		if(CGPDFArrayGetDictionary(labArray, 1, &labDict) &&
+			CGPDFDictionaryGetArray(labDict, "Range", &array))
+			for(i = 0; i < 4; i++)
+				(void)CGPDFArrayGetNumber(array, i, &decode[2 + i]);
+		if(getImageArray(dict, "Decode", &array))
+			for(i = 0; i < 6; i++)
+				(void)CGPDFArrayGetNumber(array, i, &decode[i]);
+		return createLabToRGBConverter(decode);
+    }
+    switch(CGColorSpaceGetModel(colorSpace)){
+		case kCGColorSpaceModelCMYK:
+			return createCMYKToRGBConverter();
+		case kCGColorSpaceModelIndexed:
+			return createIndexedToRGBConverter(colorSpace);
+		default:
+			return NULL;
+    }
+}
+
+/* Fill in the description of a raw image's samples along with the 
+    color space to interpret them in and its Decode values, which are
+    NULL unless the image has a Decode array that should be applied. 
+    An inline image may name a color space in the resources of the 
+    content stream it is drawn from, which is NULL for image XObjects.
+    With --to-rgb, *converter is set for samples to be converted to 
+    RGB. The caller must release the color space and the converter and
+    free the Decode values. Returns false if the image can't be 
+    described. */
+static bool describeRawImageXObject(MyDocScan *docScan, 
+			CGPDFDictionaryRef dict, CGPDFContentStreamRef resources,
+			MyRawImage *image, CGColorSpaceRef *colorSpace, 
+			CGFloat **decode, MyRGBConverter **converter)
+{
+    CGPDFArrayRef colorSpaceArray = NULL;
+    CGPDFObjectRef colorSpaceResource;
+    const char *colorSpaceName = NULL;
+    CGColorSpaceRef cgColorSpace = NULL;
+    CGPDFInteger width, height, bps;
+    CGPDFBoolean isMask = false;
+    CGFloat *decodeValues;
+    CGPDFArrayRef decodeArray;
+    size_t spp = 0;
+    bool isLab = false;
+    
+    *converter = NULL;
+    if (!getImageInteger(dict, "Width", &width) ||
+		!getImageInteger(dict, "Height", &height) ||
+		width <= 0 || height <= 0)
+		return false;
+    
+    (void)getImageBoolean(dict, "ImageMask", &isMask);
+    if (isMask) {
+		// An image mask is always 1 bit per sample and has no color 
+		// space. Exporting it as gray keeps its shape visible.
+		bps = 1;
+		cgColorSpace = CGColorSpaceRetain(docScan->deviceGray);
+		spp = 1;
+    } else {
+		if (!getImageInteger(dict, "BitsPerComponent", &bps))
+			return false;
+		
+		if (!getImageArray(dict, "ColorSpace", &colorSpaceArray) &&
+			getImageName(dict, "ColorSpace", &colorSpaceName))
+		{
+			colorSpaceName = expandedColorSpaceName(colorSpaceName);
+			// Any name but a device color space's is a resource.
+			if (resources && strncmp(colorSpaceName, "Device", 6) != 0 &&
+				(colorSpaceResource = CGPDFContentStreamGetResource(
+					resources, "ColorSpace", colorSpaceName)) &&
+				!CGPDFObjectGetValue(colorSpaceResource, 
+					kCGPDFObjectTypeArray, &colorSpaceArray))
+				(void)CGPDFObjectGetValue(colorSpaceResource, 
+					kCGPDFObjectTypeName, &colorSpaceName);
+		}
+		
+		// Color spaces come from the document's caches rather than 
+		// being created again for every image.
+		if (colorSpaceArray) {
+			isLab = isLabColorSpaceArray(colorSpaceArray);
+			cgColorSpace = copyCachedColorSpace(docScan, colorSpaceArray);
+			if (cgColorSpace)
+				spp = CGColorSpaceGetNumberOfComponents(cgColorSpace);
+			else {
+				// Not a color space this code can build, so use the
+				// device color space with the same number of components
+				// to keep the samples viewable.
+				spp = componentsInColorSpaceArray(colorSpaceArray);
+				cgColorSpace = copyDeviceColorSpaceWithComponents(docScan, spp);
+			}
+		} else if (colorSpaceName) {
+			if (strcmp(colorSpaceName, "DeviceRGB") == 0) {
+				cgColorSpace = CGColorSpaceRetain(docScan->deviceRGB);
+				//          CGColorSpaceCreateWithName(kCGColorSpaceGenericRGB);
+				spp = 3;
+			} else if (strcmp(colorSpaceName, "DeviceCMYK") == 0) {     
+				cgColorSpace = CGColorSpaceRetain(docScan->deviceCMYK);
+				//          CGColorSpaceCreateWithName(kCGColorSpaceGenericCMYK);
+				spp = 4;
+			} else if (strcmp(colorSpaceName, "DeviceGray") == 0) {
+				cgColorSpace = CGColorSpaceRetain(docScan->deviceGray);
+				//          CGColorSpaceCreateWithName(kCGColorSpaceGenericGray);
+				spp = 1;
+			}
+		}
+		if (!cgColorSpace && bps == 1) { // if there's no colorspace entry, there's still one we can infer from bps
+			cgColorSpace = CGColorSpaceRetain(docScan->deviceGray);
+			//          colorSpace = NSDeviceBlackColorSpace;
+			spp = 1;
+		}
+		if (!cgColorSpace){
+			fprintf(stderr, "Can't determine color space of raw image!\n");
+			return false;
+		}
+    }
+    
+    // The sample sizes PDF allows, and rows whose length fits, are all
+    // the code below can lay out.
+    if ((bps != 1 && bps != 2 && bps != 4 && bps != 8 && bps != 16) ||
+		spp == 0 || 
+		(unsigned long long)width > (SIZE_MAX - 7) / ((size_t)bps * spp))
+    {
+		fprintf(stderr, "Raw image has an unusable sample layout!\n");
+		CGColorSpaceRelease(cgColorSpace);
+		return false;
+    }
+    
+    memset(image, 0, sizeof(MyRawImage));
+    image->width = width;
+    image->height = height;
+    image->bitsPerComponent = bps;
+    image->componentsPerPixel = spp;
+    // pdf image row lengths are padded to byte-alignment
+    image->bytesPerRow = (bps * spp * width + 7) / 8;
+    image->isIndexed = 
+		(CGColorSpaceGetModel(cgColorSpace) == kCGColorSpaceModelIndexed);
+    
+    // Only an explicit Decode array changes the samples. The defaults
+    // from decodeValuesFromImageDictionary map every sample to itself.
+    // Lab samples don't have the range 0-1 so their Decode arrays are
+    // left alone.
+    decodeValues = NULL;
+    if (getImageArray(dict, "Decode", &decodeArray) && !isLab &&
+		CGColorSpaceGetModel(cgColorSpace) != kCGColorSpaceModelLab)
+    {
+		decodeValues = decodeValuesFromImageDictionary(dict, cgColorSpace, bps);
+		image->decode = decodeValues;
+		image->decodeCount = CGPDFArrayGetCount(decodeArray);
+    }
+    if (docScan->options->toRGB && !isMask)
+		*converter = createImageRGBConverter(dict, 
+					isLab ? colorSpaceArray : NULL, cgColorSpace);
+    *colorSpace = cgColorSpace;
+    *decode = decodeValues;
+    return true;
+}
+
+static bool writeToBlob(void *info, const void *bytes, size_t length)
+{
+    return blobWriterAppend((MyBlobWriter *)info, bytes, length);
+}
+
+static bool writeToData(void *info, const void *bytes, size_t length)
+{
+    CFDataAppendBytes((CFMutableDataRef)info, bytes, length);
+    return true;
+}
+
+/* Store the samples of an image XObject whose data Quartz returned as
+    CGPDFDataFormatRaw as an image file, returning its blob ID. 
+    
+    Quartz decodes every filter except DCT and JPX, so the CCITT and 
+    JBIG2 encoded bytes of bilevel scans aren't available. Their 
+    decoded samples already have the layout of an uncompressed TIFF 
+    strip, so they get a TIFF header and are otherwise used as they 
+    are. Anything else is unpacked to 8 bits per component with its 
+    Decode array applied, converted to RGB if there is a converter, 
+    and encoded as PNG. Either way the file is 
+    streamed into the store as it is produced rather than built in 
+    memory first, unless it is to be packed: the small files of inline
+    images are built in memory and packed together. Returns false if 
+    nothing was stored. */
+static bool storeRawImageXObject(MyDocScan *docScan, 
+			CGPDFDictionaryRef dict, const MyRawImage *image, 
+			CGColorSpaceRef colorSpace, const MyRGBConverter *converter,
+			CFDataRef data, bool packed, char blobID[kMyBlobIDSize])
+{
+    const char *filter = imageFilterName(dict);
+    MyBlobWriter *writer = NULL;
+    CFMutableDataRef fileData = NULL;
+    MyImageWriteFunction writeFunction;
+    void *info;
+    const char *extension;
+    bool written, stored;
+    
+    if(packed){
+		fileData = CFDataCreateMutable(NULL, 0);
+		writeFunction = writeToData;
+		info = fileData;
+    }else{
+		writer = extractionStoreBeginBlob(docScan->options->store);
+		writeFunction = writeToBlob;
+		info = writer;
+    }
+    if(!info)
+		return false;
+    if(filter && (strcmp(filter, "CCITTFaxDecode") == 0 || 
+		strcmp(filter, "CCF") == 0 || strcmp(filter, "JBIG2Decode") == 0) &&
+		image->bitsPerComponent == 1 && image->componentsPerPixel == 1 && 
+		!image->isIndexed)
+    {
+		// A Decode array of [1 0] makes 0 samples white.
+		bool blackIsZero = !(image->decode && image->decodeCount >= 2 && 
+					image->decode[0] > image->decode[1]);
+		written = writeTIFFFromBilevelImage(image, blackIsZero,
+				CFDataGetBytePtr(data), CFDataGetLength(data),
+				writeFunction, info);
+		extension = "tif";
+    }else{
+		written = writePNGFromRawImage(image, 
+				converter ? docScan->deviceRGB : colorSpace, converter,
+				CFDataGetBytePtr(data), CFDataGetLength(data),
+				writeFunction, info);
+		extension = "png";
+    }
+    if(packed){
+		stored = written && extractionStoreAddPackedBlob(
+				docScan->options->store, CFDataGetBytePtr(fileData), 
+				CFDataGetLength(fileData), extension, blobID);
+		CFRelease(fileData);
+		return stored;
+    }
+    if(!written){
+		extractionStoreCancelBlob(writer);
+		return false;
+    }
+    return extractionStoreFinishBlob(writer, extension, blobID);
+}
+
+/* JPX data is either a JP2 file, which starts with a signature box, 
+    or a bare JPEG 2000 codestream. Pick the matching extension. */
+static const char *jpeg2000Extension(CFDataRef data)
+{
+    static const UInt8 jp2Signature[] = 
+		{ 0x00, 0x00, 0x00, 0x0C, 0x6A, 0x50, 0x20, 0x20 };
+    
+    if(CFDataGetLength(data) >= (CFIndex)sizeof(jp2Signature) &&
+		memcmp(CFDataGetBytePtr(data), jp2Signature, 
+			sizeof(jp2Signature)) == 0)
+		return "jp2";
+    return "j2k";
+}
+
+// Room for the band of unpacked rows and the buffers used while an
+// image is converted and written, on top of its data.
+#define kMyImageWorkingSize	(1024*1024)
+
+/* Add the data of an image to the extraction store, returning its 
+    blob ID. Inline images pass the content stream they are drawn from,
+    for the color spaces they name, and are packed; image XObjects pass
+    NULL. Returns false if nothing was stored.
+    
+    Quartz only hands out image data as a single CFData, so the memory
+    an image needs is reserved from the budget before its data is 
+    copied: the encoded stream, which Quartz reads in full, plus the 
+    decoded samples for anything Quartz decodes. The output is written
+    in chunks, or streamed from bands of rows for raw images, so it 
+    adds only a fixed amount on top. The same amount is charged to the
+    budget of the page being scanned, if it has one; an image that 
+    would take the page over its budget isn't extracted and the page is
+    marked as over budget. */
+static bool extractImage(MyDocScan *docScan, CGPDFStreamRef stream, 
+			CGPDFDictionaryRef dict, CGPDFContentStreamRef resources,
+			MyPageBudget *pageBudget, char blobID[kMyBlobIDSize])
+{
+    MyExtractionStore *store = docScan->options->store;
+    bool packed = (resources != NULL);
+    MyMemoryBudget *budget = docScan->options->budget;
+    const char *filter = imageFilterName(dict);
+    CGPDFDataFormat format;
+    CFDataRef data;
+    CGPDFInteger encodedLength;
+    unsigned long long needed;
+    MyRawImage image;
+    CGColorSpaceRef colorSpace = NULL;
+    CGFloat *decodeValues = NULL;
+    MyRGBConverter *converter = NULL;
+    bool described = false, stored;
+    
+    blobID[0] = '\0';
+    if(!CGPDFDictionaryGetInteger(dict, "Length", &encodedLength) ||
+		encodedLength < 0)
+		encodedLength = 0;
+    needed = encodedLength + kMyImageWorkingSize;
+    if(!filter || (strcmp(filter, "DCTDecode") != 0 && 
+		strcmp(filter, "DCT") != 0 && strcmp(filter, "JPXDecode") != 0))
+    {
+		described = describeRawImageXObject(docScan, dict, resources, 
+					&image, &colorSpace, &decodeValues, &converter);
+		if(!described)
+			return false;
+		needed += (unsigned long long)image.bytesPerRow * image.height;
+    }
+    if(pageBudget && docScan->options->pageMemory){
+		if(pageBudget->memoryUsed + needed > docScan->options->pageMemory){
+			pageBudget->overBudget = kMyOverMemoryBudget;
+			free(decodeValues);
+			releaseRGBConverter(converter);
+			CGColorSpaceRelease(colorSpace);
+			return false;
+		}
+		pageBudget->memoryUsed += needed;
+    }
+    if(!memoryBudgetReserve(budget, needed)){
+		fprintf(stderr, "Image in %s needs %llu bytes, more than the "
+			"memory ceiling; not extracted.\n", docScan->docName, needed);
+		free(decodeValues);
+		releaseRGBConverter(converter);
+		CGColorSpaceRelease(colorSpace);
+		return false;
+    }
+    
+    data = CGPDFStreamCopyData(stream, &format);
+    if(!data)
+		stored = false;
+    else if(format == CGPDFDataFormatJPEGEncoded ||
+		format == CGPDFDataFormatJPEG2000)
+    {
+		// DCT data is a complete JPEG file and JPX data a JPEG 2000 
+		// file or codestream; store them unchanged.
+		const char *extension = (format == CGPDFDataFormatJPEGEncoded) ?
+				"jpg" : jpeg2000Extension(data);
+		if(packed)
+			stored = extractionStoreAddPackedBlob(store, 
+				CFDataGetBytePtr(data), CFDataGetLength(data), 
+				extension, blobID);
+		else
+			stored = extractionStoreAddBlob(store, 
+				CFDataGetBytePtr(data), CFDataGetLength(data), 
+				extension, blobID);
+    }else if(described)
+		stored = storeRawImageXObject(docScan, dict, &image, colorSpace,
+				converter, data, packed, blobID);
+    else
+		// The filter said DCT or JPX but Quartz decoded the data anyway,
+		// so it wasn't budgeted for; don't convert it.
+		stored = false;
+    
+    if(data)
+		CFRelease(data);
+    memoryBudgetRelinquish(budget, needed);
+    free(decodeValues);
+    releaseRGBConverter(converter);
+    CGColorSpaceRelease(colorSpace);
+    if(!stored)
+		blobID[0] = '\0';
+    return stored;
+}
+
+// The clock is read once for this many operators on a page.
+#define kMyBudgetCheckInterval 64
+
+/* Return true if the page being scanned has gone over its budget, 
+    stopping the scanner so that the rest of the content stream is 
+    skipped. The time budget is checked here, from the operator 
+    callbacks; the memory budget is charged by extractImage. */
+static bool pageIsOverBudget(CGPDFScannerRef s, MyDataScan *myData)
+{
+    MyPageBudget *budget = myData->pageBudget;
+    
+    if(!budget)
+		return false;
+    if(budget->overBudget == kMyWithinBudget && budget->deadline &&
+		++budget->operatorsSinceCheck >= kMyBudgetCheckInterval)
+    {
+		budget->operatorsSinceCheck = 0;
+		if(CFAbsoluteTimeGetCurrent() > budget->deadline)
+			budget->overBudget = kMyOverTimeBudget;
+    }
+    if(budget->overBudget == kMyWithinBudget)
+		return false;
+    CGPDFScannerStop(s);
+    return true;
+}
+
 void myOperator_Do(CGPDFScannerRef s, void *info)
 {
     // Check to see if this is an image or not.
-    const char *name;
+    const char *name, *resourceName;
     CGPDFObjectRef xobject;
     CGPDFDictionaryRef dict;
     CGPDFStreamRef stream;
     CGPDFContentStreamRef cs = CGPDFScannerGetContentStream(s);
+    MyDataScan *myData = (MyDataScan *)info;
+    MyImageCacheEntry *entry;
+    bool isNew;
     
+    if(pageIsOverBudget(s, myData))
+		return;
     // The Do operator takes a name. Pop the name off the
     // stack. If this fails then the argument to the 
     // Do operator is not a name and is therefore invalid!
@@ -351,6 +1650,7 @@ void myOperator_Do(CGPDFScannerRef s, void *info)
 		fprintf(stderr, "Couldn't pop name off stack!\n"); 
 		return;
     }
+    resourceName = name;
     // Get the resource with type "XObject" and the name
     // obtained from the stack.
     xobject = CGPDFContentStreamGetResource(cs, "XObject", name);
@@ -379,125 +1679,116 @@ void myOperator_Do(CGPDFScannerRef s, void *info)
 		return;
     }
 	
+    // Forms can themselves draw images, so scan their content too.
+    if(strcmp(name, "Form") == 0){
+		myData->numFormXObjectRefsThisPage++;
+		scanFormXObject(s, myData, stream, dict, resourceName);
+		return;
+    }
 	
     // This code is interested in the "Image" Subtype of an XObject.
     // Check whether this object has Subtype of "Image".
-	printf("%s\n",name);
     if(strcmp(name, "Image") != 0){
-		// The Subtype is not "Image" so this must be a form 
-		// or other type of XObject.
+		// The Subtype is not "Image" so this must be some
+		// other type of XObject.
 		return;
-    } else {
-		CGPDFArrayRef colorSpaceArray;
-		CGPDFDictionaryGetArray(dict,"ColorSpace" ,&colorSpaceArray);
-		CGColorSpaceRef colorSpace=NULL;
-		colorSpace=colorSpaceFromPDFArray(colorSpaceArray);
-		
-		CGPDFDataFormat format;
-		const char *name = NULL, *colorSpaceName = NULL,*renderingIntentName = NULL;;
-		CFDataRef data=CGPDFStreamCopyData(stream,&format);
-		if (format == CGPDFDataFormatRaw){
-			CGColorSpaceRef cgColorSpace;
-			CGPDFInteger width, height, bps, spp;
-			CGColorRenderingIntent renderingIntent;
-			CGPDFBoolean interpolation = 0;
-			CGDataProviderRef dataProvider = CGDataProviderCreateWithCFData(data);
-			
-			if (!CGPDFDictionaryGetInteger(dict, "Width", &width))
-				return ;
-			
-			if (!CGPDFDictionaryGetInteger(dict, "Height", &height))
-				return ;
-			
-			if (!CGPDFDictionaryGetInteger(dict, "BitsPerComponent", &bps))
-				return ;
-			
-			if (!CGPDFDictionaryGetBoolean(dict, "Interpolate", &interpolation))
-				interpolation = 0;
-			
-			if (!CGPDFDictionaryGetName(dict, "Intent", &renderingIntentName))
-				renderingIntent = kCGRenderingIntentDefault;
-			else{
-				renderingIntent = kCGRenderingIntentDefault;
-				//      renderingIntent = renderingIntentFromName(renderingIntentName);
-			}
-			
-			if (CGPDFDictionaryGetArray(dict, "ColorSpace", &colorSpaceArray)) {
-				cgColorSpace = CGColorSpaceCreateDeviceRGB();
-				//      cgColorSpace = colorSpaceFromPDFArray(colorSpaceArray);
-				spp = CGColorSpaceGetNumberOfComponents(cgColorSpace);
-			} else if (CGPDFDictionaryGetName(dict, "ColorSpace", &colorSpaceName)) {
-				if (strcmp(colorSpaceName, "DeviceRGB") == 0) {
-					cgColorSpace = CGColorSpaceCreateDeviceRGB();
-					//          CGColorSpaceCreateWithName(kCGColorSpaceGenericRGB);
-					spp = 3;
-				} else if (strcmp(colorSpaceName, "DeviceCMYK") == 0) {     
-					cgColorSpace = CGColorSpaceCreateDeviceCMYK();
-					//          CGColorSpaceCreateWithName(kCGColorSpaceGenericCMYK);
-					spp = 4;
-				} else if (strcmp(colorSpaceName, "DeviceGray") == 0) {
-					cgColorSpace = CGColorSpaceCreateDeviceGray();
-					//          CGColorSpaceCreateWithName(kCGColorSpaceGenericGray);
-					spp = 1;
-				} else if (bps == 1) { // if there's no colorspace entry, there's still one we can infer from bps
-					cgColorSpace = CGColorSpaceCreateDeviceGray();
-					//          colorSpace = NSDeviceBlackColorSpace;
-					spp = 1;
-				}
-			}
-			 CGFloat *decodeValues = NULL;
-			decodeValues = decodeValuesFromImageDictionary(dict, cgColorSpace, bps);
-			
-			int rowBits = bps * spp * width;
-			int rowBytes = rowBits / 8;
-			// pdf image row lengths are padded to byte-alignment
-			if (rowBits % 8 != 0)
-				++rowBytes;
-			CGImageRef sourceImage = CGImageCreate(width, height, bps, bps * spp, rowBytes, cgColorSpace, 0, dataProvider, decodeValues, interpolation, renderingIntent);
-			CGDataProviderRelease(dataProvider);
-			
-			
-			CGDataProviderRef dataProvider2 = CGImageGetDataProvider(sourceImage);
-			CFDataRef data = CGDataProviderCopyData(dataProvider2);
-			int fd;
-			findex;
-			char file[256];
-			memset(file,0,sizeof(file));
-			sprintf(file,"%d.jpg",findex);	   
-			fd=open(file, O_RDWR|O_CREAT);
-			write(fd, CFDataGetBytePtr(data), CFDataGetLength(data));
-			findex++;
-			close(fd);
-			
-			//[[NSImage alloc] initWithCGImage:sourceImage size:NSMakeSize(0, 0)];
-		}else {
-			int fd;
-			findex;
-			char file[256];
-			memset(file,0,sizeof(file));
-			sprintf(file,"%d.jpg",findex);	   
-			fd=open(file, O_RDWR|O_CREAT);
-			write(fd, CFDataGetBytePtr(data), CFDataGetLength(data));
-			findex++;
-			close(fd);
+    }
+    if(myData->profile){
+		CGPDFInteger length;
+		if(CGPDFDictionaryGetInteger(dict, "Length", &length) && length > 0)
+			myData->profile->imageBytes += length;
+    }
+    // When extracting text, images are only measured for a profile.
+    if(myData->docScan->options->text)
+		return;
+    myData->numImageXObjectRefsThisPage++;
+    
+    // Pages that share an image reference the same stream object so
+    // only the first reference in the document classifies and 
+    // extracts it. Later references just reuse the result.
+    entry = lookupImageCacheEntry(myData->docScan, stream, &isNew);
+    if(!entry){
+		// Couldn't cache it; fall back to handling it directly.
+		checkImageType(dict, myData);
+		return;
+    }
+    if(isNew){
+		// This is an Image so figure out what variety of image it is.
+		entry->imageType = classifyImage(dict);
+		describeImageForOutput(dict, entry);
+		if(myData->docScan->options->store)
+			(void)extractImage(myData->docScan, stream, dict, NULL, 
+					myData->pageBudget, entry->blobID);
+		// An image this page had no budget left for is left for a 
+		// later page to extract; this page is abandoned anyway.
+		if(myData->pageBudget && 
+			myData->pageBudget->overBudget != kMyWithinBudget)
+		{
+			abandonImageCacheEntry(myData->docScan, stream, entry);
+			CGPDFScannerStop(s);
+			return;
 		}
+		publishImageCacheEntry(myData->docScan, entry);
+    }
+    countImageType(entry->imageType, myData);
+    // Every reference is recorded so the manifest lists all the places
+    // each image is used.
+    recordImageReference(myData, resourceName, entry);
+}
 
-
-		
-	}
-
+// This callback handles inline images. Inline images end with the 
+// "EI" operator.
+/* Extract an inline image and record its use like that of an image 
+    XObject, under a name such as "Inline3" for the third inline image
+    on the page or in the form. Pages of scanned documents can hold
+    thousands of small inline images, so they are packed into the 
+    store rather than written to files of their own. */
+static void extractInlineImage(CGPDFScannerRef s, MyDataScan *myData,
+			CGPDFStreamRef stream, CGPDFDictionaryRef dict)
+{
+    MyDocScan *docScan = myData->docScan;
+    char blobID[kMyBlobIDSize], resourceName[32];
+    MyImageCacheEntry *entry;
+    CFStringRef blobKey;
     
-    // This is an Image so figure out what variety of image it is.
-    checkImageType(dict, (MyDataScan *)info);
+    if(!extractImage(docScan, stream, dict, 
+			CGPDFScannerGetContentStream(s), myData->pageBudget, blobID))
+		return;
+    blobKey = CFStringCreateWithCString(NULL, blobID, kCFStringEncodingASCII);
+    if(!blobKey)
+		return;
+    pthread_mutex_lock(&docScan->cacheLock);
+    entry = (MyImageCacheEntry *)CFDictionaryGetValue(
+				docScan->inlineImageCache, blobKey);
+    if(!entry){
+		entry = calloc(1, sizeof(MyImageCacheEntry));
+		if(entry){
+			entry->imageType = classifyImage(dict);
+			entry->ready = true;
+			strlcpy(entry->blobID, blobID, sizeof(entry->blobID));
+			describeImageForOutput(dict, entry);
+			CFDictionarySetValue(docScan->inlineImageCache, blobKey, entry);
+		}
+    }
+    pthread_mutex_unlock(&docScan->cacheLock);
+    CFRelease(blobKey);
     
+    if(entry){
+		snprintf(resourceName, sizeof(resourceName), "Inline%zd", 
+				myData->numInlineImagesThisPage);
+		recordImageReference(myData, resourceName, entry);
+    }
 }
 
-// This callback handles inline images. Inline images end with the 
-// "EI" operator.
 void myOperator_EI(CGPDFScannerRef s, void *info)
 {
     CGPDFStreamRef stream;
     CGPDFDictionaryRef dict;
+    bool textOnly = ((MyDataScan *)info)->docScan->options->text;
+    // Only a profile looks at inline images when extracting text.
+    if((textOnly && !((MyDataScan *)info)->profile) ||
+		pageIsOverBudget(s, (MyDataScan *)info))
+		return;
     // When the scanner encounters the EI operator, it has a
     // stream corresponding to the image on the operand stack.
     // This code pops the stream off the stack in order to
@@ -513,134 +1804,1254 @@ void myOperator_EI(CGPDFScannerRef s, void *info)
 		return;
     }
     // By definition the stream passed to EI is an image so
-    // pass it to the code to check the type of image.
-    checkImageType(dict, (MyDataScan *)info);
+    // pass it to the code to check the type of image. Text records
+    // don't count images, so when extracting text it is only measured.
+    if(!textOnly){
+		checkImageType(dict, (MyDataScan *)info);
+		((MyDataScan *)info)->numInlineImagesThisPage++;
+		if(((MyDataScan *)info)->docScan->options->store)
+			extractInlineImage(s, (MyDataScan *)info, stream, dict);
+    }
+    // Inline image data has no Length so measure it. Inline images
+    // are meant to be small, so copying the data is cheap.
+    if(((MyDataScan *)info)->profile){
+		CFDataRef data = CGPDFStreamCopyData(stream, NULL);
+		if(data){
+			((MyDataScan *)info)->profile->imageBytes += 
+					CFDataGetLength(data);
+			CFRelease(data);
+		}
+    }
 
 }
 
-static CGPDFOperatorTableRef createMyOperatorTable(void)
+/* When profiling, every operator has a callback that counts it and 
+    then does whatever the operator's usual callback would. The scanner
+    doesn't tell a callback which operator it is handling, so each 
+    operator gets its own small callback that supplies the index. The
+    same callbacks are used to watch the clock when pages have a time
+    budget. */
+static void profileOperator(CGPDFScannerRef s, void *info, size_t op)
+{
+    MyDataScan *myData = (MyDataScan *)info;
+    
+    if(myData->profile)
+		myData->profile->operatorCounts[op]++;
+    // Do and EI check the budget themselves, and each operator should
+    // count toward the next look at the clock only once.
+    if(op == kMyOperatorDo)
+		myOperator_Do(s, info);
+    else if(op == kMyOperatorEI)
+		myOperator_EI(s, info);
+    else
+		(void)pageIsOverBudget(s, myData);
+}
+
+#define MY_PROFILE_CALLBACK(n) \
+    static void profileOperator##n(CGPDFScannerRef s, void *info) \
+		{ profileOperator(s, info, n); }
+
+MY_PROFILE_CALLBACK(0)  MY_PROFILE_CALLBACK(1)  MY_PROFILE_CALLBACK(2)
+MY_PROFILE_CALLBACK(3)  MY_PROFILE_CALLBACK(4)  MY_PROFILE_CALLBACK(5)
+MY_PROFILE_CALLBACK(6)  MY_PROFILE_CALLBACK(7)  MY_PROFILE_CALLBACK(8)
+MY_PROFILE_CALLBACK(9)  MY_PROFILE_CALLBACK(10) MY_PROFILE_CALLBACK(11)
+MY_PROFILE_CALLBACK(12) MY_PROFILE_CALLBACK(13) MY_PROFILE_CALLBACK(14)
+MY_PROFILE_CALLBACK(15) MY_PROFILE_CALLBACK(16) MY_PROFILE_CALLBACK(17)
+MY_PROFILE_CALLBACK(18) MY_PROFILE_CALLBACK(19) MY_PROFILE_CALLBACK(20)
+MY_PROFILE_CALLBACK(21) MY_PROFILE_CALLBACK(22) MY_PROFILE_CALLBACK(23)
+MY_PROFILE_CALLBACK(24) MY_PROFILE_CALLBACK(25) MY_PROFILE_CALLBACK(26)
+MY_PROFILE_CALLBACK(27) MY_PROFILE_CALLBACK(28) MY_PROFILE_CALLBACK(29)
+MY_PROFILE_CALLBACK(30) MY_PROFILE_CALLBACK(31) MY_PROFILE_CALLBACK(32)
+MY_PROFILE_CALLBACK(33) MY_PROFILE_CALLBACK(34) MY_PROFILE_CALLBACK(35)
+MY_PROFILE_CALLBACK(36) MY_PROFILE_CALLBACK(37) MY_PROFILE_CALLBACK(38)
+MY_PROFILE_CALLBACK(39) MY_PROFILE_CALLBACK(40) MY_PROFILE_CALLBACK(41)
+MY_PROFILE_CALLBACK(42) MY_PROFILE_CALLBACK(43) MY_PROFILE_CALLBACK(44)
+MY_PROFILE_CALLBACK(45) MY_PROFILE_CALLBACK(46) MY_PROFILE_CALLBACK(47)
+MY_PROFILE_CALLBACK(48) MY_PROFILE_CALLBACK(49) MY_PROFILE_CALLBACK(50)
+MY_PROFILE_CALLBACK(51) MY_PROFILE_CALLBACK(52) MY_PROFILE_CALLBACK(53)
+MY_PROFILE_CALLBACK(54) MY_PROFILE_CALLBACK(55) MY_PROFILE_CALLBACK(56)
+MY_PROFILE_CALLBACK(57) MY_PROFILE_CALLBACK(58) MY_PROFILE_CALLBACK(59)
+MY_PROFILE_CALLBACK(60) MY_PROFILE_CALLBACK(61) MY_PROFILE_CALLBACK(62)
+MY_PROFILE_CALLBACK(63) MY_PROFILE_CALLBACK(64) MY_PROFILE_CALLBACK(65)
+MY_PROFILE_CALLBACK(66) MY_PROFILE_CALLBACK(67) MY_PROFILE_CALLBACK(68)
+MY_PROFILE_CALLBACK(69) MY_PROFILE_CALLBACK(70) MY_PROFILE_CALLBACK(71)
+MY_PROFILE_CALLBACK(72)
+
+static const CGPDFOperatorCallback kMyProfileCallbacks[kMyNumPDFOperators] = {
+    profileOperator0,  profileOperator1,  profileOperator2,  profileOperator3,
+    profileOperator4,  profileOperator5,  profileOperator6,  profileOperator7,
+    profileOperator8,  profileOperator9,  profileOperator10, profileOperator11,
+    profileOperator12, profileOperator13, profileOperator14, profileOperator15,
+    profileOperator16, profileOperator17, profileOperator18, profileOperator19,
+    profileOperator20, profileOperator21, profileOperator22, profileOperator23,
+    profileOperator24, profileOperator25, profileOperator26, profileOperator27,
+    profileOperator28, profileOperator29, profileOperator30, profileOperator31,
+    profileOperator32, profileOperator33, profileOperator34, profileOperator35,
+    profileOperator36, profileOperator37, profileOperator38, profileOperator39,
+    profileOperator40, profileOperator41, profileOperator42, profileOperator43,
+    profileOperator44, profileOperator45, profileOperator46, profileOperator47,
+    profileOperator48, profileOperator49, profileOperator50, profileOperator51,
+    profileOperator52, profileOperator53, profileOperator54, profileOperator55,
+    profileOperator56, profileOperator57, profileOperator58, profileOperator59,
+    profileOperator60, profileOperator61, profileOperator62, profileOperator63,
+    profileOperator64, profileOperator65, profileOperator66, profileOperator67,
+    profileOperator68, profileOperator69, profileOperator70, profileOperator71,
+    profileOperator72
+};
+
+/* When extracting text, each text operator likewise gets a callback 
+    that passes it on to the page's or form's text scan. Text operators
+    are counted here when profiling since these callbacks replace the
+    counting ones. */
+static const size_t kMyTextOperatorProfileIndexes[kMyNumTextOperators] = {
+    7, 54, 64, 65, 60, 57, 55, 56, 61, 53, 58, 59, 71, 72
+};
+
+static void textOperator(CGPDFScannerRef s, void *info, MyTextOperator op)
+{
+    MyDataScan *myData = (MyDataScan *)info;
+    
+    if(myData->profile)
+		myData->profile->operatorCounts[kMyTextOperatorProfileIndexes[op]]++;
+    if(pageIsOverBudget(s, myData))
+		return;
+    // A form's text scan may have failed to be created.
+    if(myData->text)
+		textScanOperator(myData->text, s, op);
+}
+
+#define MY_TEXT_CALLBACK(n) \
+    static void textOperator##n(CGPDFScannerRef s, void *info) \
+		{ textOperator(s, info, n); }
+
+MY_TEXT_CALLBACK(0)  MY_TEXT_CALLBACK(1)  MY_TEXT_CALLBACK(2)
+MY_TEXT_CALLBACK(3)  MY_TEXT_CALLBACK(4)  MY_TEXT_CALLBACK(5)
+MY_TEXT_CALLBACK(6)  MY_TEXT_CALLBACK(7)  MY_TEXT_CALLBACK(8)
+MY_TEXT_CALLBACK(9)  MY_TEXT_CALLBACK(10) MY_TEXT_CALLBACK(11)
+MY_TEXT_CALLBACK(12) MY_TEXT_CALLBACK(13)
+
+static const CGPDFOperatorCallback kMyTextCallbacks[kMyNumTextOperators] = {
+    textOperator0,  textOperator1,  textOperator2,  textOperator3,
+    textOperator4,  textOperator5,  textOperator6,  textOperator7,
+    textOperator8,  textOperator9,  textOperator10, textOperator11,
+    textOperator12, textOperator13
+};
+
+/* Create the operator table. With everyOperator, which profiling and
+    time budgets need, every operator has a callback. */
+static CGPDFOperatorTableRef createMyOperatorTable(bool everyOperator, 
+				bool text)
 {
     // Create a new operator table.
     CGPDFOperatorTableRef myTable = CGPDFOperatorTableCreate();
-    // Add a callback for the "Do" operator.
-    CGPDFOperatorTableSetCallback(myTable, "Do", myOperator_Do);
-    // Add a callback for the "EI" operator.
-    CGPDFOperatorTableSetCallback(myTable, "EI", myOperator_EI);
+    size_t i;
+    
+    if(!myTable)
+		return NULL;
+    if(everyOperator){
+		// Add a counting callback for every operator.
+		for(i = 0; i < kMyNumPDFOperators; i++)
+			CGPDFOperatorTableSetCallback(myTable, kMyPDFOperatorNames[i],
+					kMyProfileCallbacks[i]);
+    }else{
+		// Add a callback for the "Do" operator, which is needed for
+		// the text of forms too.
+		CGPDFOperatorTableSetCallback(myTable, "Do", myOperator_Do);
+		// Add a callback for the "EI" operator.
+		if(!text)
+			CGPDFOperatorTableSetCallback(myTable, "EI", myOperator_EI);
+    }
+    if(text){
+		for(i = 0; i < kMyNumTextOperators; i++)
+			CGPDFOperatorTableSetCallback(myTable, kMyTextOperatorNames[i],
+					kMyTextCallbacks[i]);
+    }
     return myTable;
 }
 
-void dumpPageStreams(CFURLRef url, FILE *outFile)
+/* Scan the content stream of the selected page with the supplied 
+    index, accumulating the image counts for that page in myData. A 
+    page that goes over its budget is abandoned: its results are 
+    dropped and myData->overBudget says why. Returns false if the page
+    couldn't be scanned at all. */
+static bool scanPage(MyDocScan *docScan, size_t index, MyDataScan *myData)
 {
-    CGPDFDocumentRef pdfDoc = NULL;
-    CGPDFOperatorTableRef table = NULL;
-    MyDataScan myData;
-    size_t totalImages, totPages, i;
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    const MyScanOptions *options = docScan->options;
+    size_t pageNum = docScan->pages[index];
+    MyPageBudget budget;
+    CGPDFScannerRef scanner = NULL;
+    // Get the PDF page for this page in the document.
+    CGPDFPageRef p = CGPDFDocumentGetPage(docScan->pdfDoc, pageNum);
+    // Create a reference to the content stream for this page.
+    CGPDFContentStreamRef cs = CGPDFContentStreamCreateWithPage(p);
+    if(!cs){
+		fprintf(stderr, 
+		"Couldn't create content stream for page #%zd!\n", pageNum);
+		return false;
+    }
+    // Create a scanner for this PDF document page.
+    scanner = CGPDFScannerCreate(cs, docScan->table, myData);
+    if(!scanner){
+		CGPDFContentStreamRelease(cs);
+		fprintf(stderr, "Couldn't create scanner for page #%zd!\n", pageNum);
+		return false;
+    }
+    // Initialize the counters of images for this page.
+    memset(myData, 0, sizeof(MyDataScan));
+    myData->docScan = docScan;
+    myData->pageNum = pageNum;
+    if(docScan->options->text){
+		myData->text = createTextScan(docScan->fonts);
+		if(!myData->text){
+			CGPDFScannerRelease(scanner);
+			CGPDFContentStreamRelease(cs);
+			fprintf(stderr, "Couldn't allocate text for page #%zd!\n", 
+					pageNum);
+			return false;
+		}
+    }
+    if(docScan->pageProfiles){
+		myData->profile = &docScan->pageProfiles[index];
+		myData->profile->pageNum = pageNum;
+    }
+    // The page's time starts with opening it.
+    memset(&budget, 0, sizeof(budget));
+    if(options->pageSeconds > 0)
+		budget.deadline = startTime + options->pageSeconds;
+    if(budget.deadline || options->pageMemory)
+		myData->pageBudget = &budget;
 
-    // Create a CGPDFDocumentRef from the input PDF file.
-    pdfDoc = CGPDFDocumentCreateWithURL(url);
-    if(!pdfDoc){
-		fprintf(stderr, "Couldn't open PDF document!\n"); return;
+    /* 	CGPDFScannerScan causes Quartz to scan the content stream,
+		calling the callbacks in the table when the corresponding
+		operator is encountered. Once the content stream for the
+		page has been consumed or Quartz detects a malformed 
+		content stream, CGPDFScannerScan returns. 
+    */
+    if(!CGPDFScannerScan(scanner) && budget.overBudget == kMyWithinBudget){
+		fprintf(stderr, "Scanner couldn't scan all of page #%zd!\n", pageNum);
     }
-    // Create the operator table with the needed callbacks.
-    table = createMyOperatorTable();
-    if(!table){
-		CGPDFDocumentRelease(pdfDoc);
-		fprintf(stderr, "Couldn't create operator table\n!"); return;
+    // Once the page has been scanned, release the 
+    // scanner for this page.
+    CGPDFScannerRelease(scanner);
+    // Release the content stream for this page.
+    CGPDFContentStreamRelease(cs);
+    myData->pageBudget = NULL;
+    if(budget.overBudget != kMyWithinBudget){
+		MyPageProfile *profile = myData->profile;
+		
+		releaseTextScan(myData->text);
+		freeImageReferences(&myData->pageImages);
+		memset(myData, 0, sizeof(MyDataScan));
+		myData->docScan = docScan;
+		myData->pageNum = pageNum;
+		myData->profile = profile;
+		myData->overBudget = budget.overBudget;
     }
-    // Initialize the count of the images.
-    totalImages = 0;
+    if(myData->profile)
+		myData->profile->seconds = CFAbsoluteTimeGetCurrent() - startTime;
+    return true;
+}
 
-    // Obtain the total number of pages for the document.
-    totPages = CGPDFDocumentGetNumberOfPages(pdfDoc);
-
-    // Loop over all the pages in the document, scanning the
-    // content stream of each one.
-    for(i = 1; i <= totPages; i++){
-		CGPDFScannerRef scanner = NULL;
-		// Get the PDF page for this page in the document.
-		CGPDFPageRef p = CGPDFDocumentGetPage(pdfDoc, i);
-		// Create a reference to the content stream for this page.
-		CGPDFContentStreamRef cs = CGPDFContentStreamCreateWithPage(p);
-		if(!cs){
-			CGPDFOperatorTableRelease(table);
-			CGPDFDocumentRelease(pdfDoc);
-			fprintf(stderr, 
-			"Couldn't create content stream for page #%zd!\n", i);
-			return;
-		}
-		// Create a scanner for this PDF document page.
-		scanner = CGPDFScannerCreate(cs, table, &myData);
-		if(!scanner){
-			CGPDFContentStreamRelease(cs);
-			CGPDFOperatorTableRelease(table);
-			CGPDFDocumentRelease(pdfDoc);
-			fprintf(stderr, "Couldn't create scanner for page #%zd!\n", i);
+static const char *imageTypeName(unsigned imageType)
+{
+    switch(imageType){
+		case kMyImageWithColor:		return "color";
+		case kMyImageMask:		return "mask";
+		case kMyImageMaskedWithMask:	return "maskedWithMask";
+		case kMyImageMaskedWithColors:	return "maskedWithColors";
+		default:			return "malformed";
+    }
+}
+
+/* Describe a use of an image as the image index does, which is also 
+    how it is written in NDJSON records. */
+static void describeImageReference(const MyImageReference *reference,
+			MyImageIndexEntry *entry)
+{
+    const MyImageCacheEntry *image = reference->image;
+    
+    entry->resourceName = reference->resourceName;
+    entry->filter = image->filter[0] ? image->filter : NULL;
+    entry->colorSpace = 
+			image->colorSpaceFamily[0] ? image->colorSpaceFamily : NULL;
+    entry->blobID = image->blobID[0] ? image->blobID : NULL;
+    entry->width = image->width;
+    entry->height = image->height;
+    entry->bitsPerComponent = image->bitsPerComponent;
+    entry->kind = image->imageType;
+}
+
+static void writeImageObject(MyNDJSONWriter *writer, 
+			const MyImageIndexEntry *image)
+{
+    ndjsonBeginObject(writer, NULL);
+    ndjsonAddString(writer, "name", image->resourceName);
+    ndjsonAddString(writer, "kind", imageTypeName(image->kind));
+    ndjsonAddInteger(writer, "width", image->width);
+    ndjsonAddInteger(writer, "height", image->height);
+    ndjsonAddInteger(writer, "bitsPerComponent", image->bitsPerComponent);
+    ndjsonAddString(writer, "filter", image->filter);
+    ndjsonAddString(writer, "colorSpace", image->colorSpace);
+    ndjsonAddString(writer, "blob", image->blobID);
+    ndjsonEndObject(writer);
+}
+
+/* Write the NDJSON record for one page: its image counts and every 
+    image XObject it uses, directly or through forms. */
+static void writePageRecord(MyNDJSONWriter *writer, 
+			const MyDocScan *docScan, const MyDataScan *myData, 
+			size_t pageNum)
+{
+    size_t i;
+    
+    ndjsonBeginRecord(writer);
+    ndjsonAddString(writer, "type", "page");
+    ndjsonAddString(writer, "document", docScan->docName);
+    ndjsonAddInteger(writer, "page", pageNum);
+    ndjsonAddInteger(writer, "imagesWithColor", 
+			myData->numImagesWithColorThisPage);
+    ndjsonAddInteger(writer, "imageMasks", myData->numImageMasksThisPage);
+    ndjsonAddInteger(writer, "imagesMaskedWithMask", 
+			myData->numImagesMaskedWithMaskThisPage);
+    ndjsonAddInteger(writer, "imagesMaskedWithColors", 
+			myData->numImagesMaskedWithColorsThisPage);
+    ndjsonAddInteger(writer, "imageReferences", 
+			myData->numImageXObjectRefsThisPage);
+    ndjsonAddInteger(writer, "formReferences", 
+			myData->numFormXObjectRefsThisPage);
+    ndjsonAddInteger(writer, "inlineImages", 
+			myData->numInlineImagesThisPage);
+    ndjsonBeginArray(writer, "images");
+    for(i = 0; i < myData->pageImages.count; i++){
+		MyImageIndexEntry image;
+		describeImageReference(&myData->pageImages.references[i], &image);
+		writeImageObject(writer, &image);
+    }
+    ndjsonEndArray(writer);
+    ndjsonEndRecord(writer);
+}
+
+/* Write the NDJSON record for a page that was abandoned, which says 
+    only which budget it went over. */
+static void writeOverBudgetPageRecord(MyNDJSONWriter *writer, 
+			const MyDocScan *docScan, const MyDataScan *myData)
+{
+    ndjsonBeginRecord(writer);
+    ndjsonAddString(writer, "type", "page");
+    ndjsonAddString(writer, "document", docScan->docName);
+    ndjsonAddInteger(writer, "page", myData->pageNum);
+    ndjsonAddString(writer, "overBudget", 
+			overBudgetName(myData->overBudget));
+    ndjsonEndRecord(writer);
+}
+
+/* Write the NDJSON record for the text of one page. */
+static void writePageTextRecord(MyNDJSONWriter *writer, 
+			const MyDocScan *docScan, const MyDataScan *myData, 
+			size_t numCharacters)
+{
+    ndjsonBeginRecord(writer);
+    ndjsonAddString(writer, "type", "page");
+    ndjsonAddString(writer, "document", docScan->docName);
+    ndjsonAddInteger(writer, "page", myData->pageNum);
+    ndjsonAddInteger(writer, "characters", numCharacters);
+    ndjsonAddInteger(writer, "undecodedGlyphs", 
+			textScanGetUndecodedCount(myData->text));
+    ndjsonAddString(writer, "text", textScanGetText(myData->text));
+    ndjsonEndRecord(writer);
+}
+
+/* Count the characters in UTF-8 text. */
+static size_t countCharacters(const char *text)
+{
+    size_t count = 0;
+    
+    for(; *text; text++)
+		if((*text & 0xC0) != 0x80)
+			count++;
+    return count;
+}
+
+/* Write out the text of a page and add it to the document's totals. */
+static void flushPageText(MyDocScan *docScan, MyDataScan *myData)
+{
+    const char *text = textScanGetText(myData->text);
+    size_t numCharacters = countCharacters(text);
+    
+    if(docScan->options->format == kMyOutputNDJSON)
+		writePageTextRecord(docScan->options->writer, docScan, myData,
+				numCharacters);
+    else
+		printPageText(docScan->outFile, text, myData->pageNum);
+    docScan->textCharacters += numCharacters;
+    docScan->undecodedGlyphs += textScanGetUndecodedCount(myData->text);
+    // The page's text is only held until it has been written.
+    releaseTextScan(myData->text);
+    myData->text = NULL;
+}
+
+/* Write the NDJSON record summarizing a document. */
+static void writeDocRecord(MyNDJSONWriter *writer, const MyDocScan *docScan)
+{
+    ndjsonBeginRecord(writer);
+    ndjsonAddString(writer, "type", "document");
+    ndjsonAddString(writer, "document", docScan->docName);
+    ndjsonAddInteger(writer, "pages", docScan->totPages);
+    ndjsonAddInteger(writer, "pagesScanned", docScan->numPages);
+    ndjsonAddInteger(writer, "images", docScan->totalImages);
+    ndjsonAddInteger(writer, "imageReferences", docScan->imageReferences);
+    ndjsonAddInteger(writer, "uniqueImages", 
+			CFDictionaryGetCount(docScan->imageCache));
+    ndjsonAddInteger(writer, "formReferences", docScan->formReferences);
+    ndjsonAddInteger(writer, "uniqueForms", 
+			CFDictionaryGetCount(docScan->formCache));
+    ndjsonAddInteger(writer, "colorSpacesParsed", docScan->colorSpaceMisses);
+    ndjsonAddInteger(writer, "colorSpacesReused", docScan->colorSpaceHits);
+    ndjsonAddInteger(writer, "pagesOverBudget", docScan->pagesOverBudget);
+    if(docScan->options->text){
+		ndjsonAddInteger(writer, "characters", docScan->textCharacters);
+		ndjsonAddInteger(writer, "undecodedGlyphs", 
+				docScan->undecodedGlyphs);
+    }
+    ndjsonEndRecord(writer);
+}
+
+/* Add a page and the images it uses to the image index. */
+static void addPageToIndex(MyImageIndexWriter *index, 
+			const MyDataScan *myData)
+{
+    MyImageIndexEntry image;
+    size_t i;
+    
+    if(!imageIndexAddPage(index, myData->pageNum))
+		return;
+    for(i = 0; i < myData->pageImages.count; i++){
+		describeImageReference(&myData->pageImages.references[i], &image);
+		if(!imageIndexAddImage(index, &image))
 			return;
-		}
-		// Initialize the counters of images for this page.
-		myData.numImagesWithColorThisPage = 0;
-		myData.numImageMasksThisPage =  0;
-		myData.numImagesMaskedWithMaskThisPage =  0;
-		myData.numImagesMaskedWithColorsThisPage = 0;
-	
-		/* 	CGPDFScannerScan causes Quartz to scan the content stream,
-			calling the callbacks in the table when the corresponding
-			operator is encountered. Once the content stream for the
-			page has been consumed or Quartz detects a malformed 
-			content stream, CGPDFScannerScan returns. 
-		*/
-		if(!CGPDFScannerScan(scanner)){
-			fprintf(stderr, "Scanner couldn't scan all of page #%zd!\n", i);
-		}
+    }
+}
+
+/* Print the results of every finished page that follows the last page
+    printed, stopping at the first page still being scanned. The caller
+    must hold docScan->lock. */
+static void flushPageResults(MyDocScan *docScan)
+{
+    while(docScan->nextPageToPrint < docScan->numPages &&
+		docScan->pageDone[docScan->nextPageToPrint])
+    {
+		MyDataScan *myData = 
+			&docScan->pageResults[docScan->nextPageToPrint];
 		// Print the results for this page.
-		printPageResults(outFile, myData, i);
+		if(myData->overBudget != kMyWithinBudget){
+			if(docScan->options->format == kMyOutputNDJSON)
+				writeOverBudgetPageRecord(docScan->options->writer, 
+						docScan, myData);
+			else
+				printOverBudgetPage(docScan->outFile, myData);
+			docScan->pagesOverBudget++;
+			// An index missing a page's images would answer queries
+			// wrongly.
+			if(docScan->index){
+				fprintf(stderr, "Not writing an image index since a page "
+						"was abandoned.\n");
+				cancelImageIndex(docScan->index);
+				docScan->index = NULL;
+			}
+		}else if(myData->text)
+			flushPageText(docScan, myData);
+		else if(docScan->options->format == kMyOutputNDJSON)
+			writePageRecord(docScan->options->writer, docScan, myData,
+				myData->pageNum);
+		else
+			printPageResults(docScan->outFile, *myData, myData->pageNum);
+		if(docScan->index)
+			addPageToIndex(docScan->index, myData);
+		freeImageReferences(&myData->pageImages);
 		
 		// Update the total count of images with the count of the
 		// images on this page.
-		totalImages += 
-			myData.numImagesWithColorThisPage + 
-			myData.numImageMasksThisPage +
-			myData.numImagesMaskedWithMaskThisPage +
-			myData.numImagesMaskedWithColorsThisPage;
+		docScan->totalImages += 
+			myData->numImagesWithColorThisPage + 
+			myData->numImageMasksThisPage +
+			myData->numImagesMaskedWithMaskThisPage +
+			myData->numImagesMaskedWithColorsThisPage;
+		docScan->imageReferences += myData->numImageXObjectRefsThisPage;
+		docScan->formReferences += myData->numFormXObjectRefsThisPage;
+		docScan->nextPageToPrint++;
+    }
+}
+
+/* The body of each worker thread. With a single worker this is called
+    directly on the main thread. */
+static void *scanPagesWorker(void *info)
+{
+    MyDocScan *docScan = (MyDocScan *)info;
+    
+    for(;;){
+		size_t index;
+		bool scanned;
+		
+		pthread_mutex_lock(&docScan->lock);
+		// Stop taking pages once all have been handed out or 
+		// once any page has failed to scan.
+		if(docScan->failed || docScan->nextPageToScan >= docScan->numPages){
+			pthread_mutex_unlock(&docScan->lock);
+			break;
+		}
+		index = docScan->nextPageToScan++;
+		pthread_mutex_unlock(&docScan->lock);
+		
+		scanned = scanPage(docScan, index, &docScan->pageResults[index]);
+		
+		pthread_mutex_lock(&docScan->lock);
+		if(scanned){
+			docScan->pageDone[index] = true;
+			flushPageResults(docScan);
+		}else
+			docScan->failed = true;
+		pthread_mutex_unlock(&docScan->lock);
+    }
+    return NULL;
+}
+
+bool dumpPageStreams(CFURLRef url, FILE *outFile, 
+			const MyScanOptions *options)
+{
+    MyDocScan docScan;
+    pthread_t *workers = NULL;
+    CFAbsoluteTime startTime, elapsed;
+    int i, numWorkers = options->numWorkers, numStarted = 0;
+    bool scanned;
+
+    memset(&docScan, 0, sizeof(docScan));
+    docScan.outFile = outFile;
+    docScan.options = options;
+    // The document name identifies where extracted images came from.
+    if(!CFURLGetFileSystemRepresentation(url, true, 
+			(UInt8 *)docScan.docName, sizeof(docScan.docName)))
+		strcpy(docScan.docName, "?");
+    // Create a CGPDFDocumentRef from the input PDF file.
+    docScan.pdfDoc = CGPDFDocumentCreateWithURL(url);
+    if(!docScan.pdfDoc){
+		fprintf(stderr, "Couldn't open PDF document!\n"); return false;
+    }
+    // Create the operator table with the needed callbacks. The table
+    // is only read while scanning so all workers share it.
+    docScan.table = createMyOperatorTable(
+				options->profile || options->pageSeconds > 0, options->text);
+    if(!docScan.table){
+		CGPDFDocumentRelease(docScan.pdfDoc);
+		fprintf(stderr, "Couldn't create operator table\n!"); return false;
+    }
+
+    // Obtain the total number of pages for the document.
+    docScan.totPages = CGPDFDocumentGetNumberOfPages(docScan.pdfDoc);
+    // Only the page count is needed to choose pages.
+    docScan.pages = createSelectedPageList(&options->selection, 
+				docScan.totPages, &docScan.numPages);
+    if(!docScan.pages){
+		CGPDFOperatorTableRelease(docScan.table);
+		CGPDFDocumentRelease(docScan.pdfDoc);
+		fprintf(stderr, "No pages of the document are selected!\n"); return false;
+    }
+    docScan.nextPageToScan = docScan.nextPageToPrint = 0;
+    docScan.pageResults = calloc(docScan.numPages, sizeof(MyDataScan));
+    docScan.pageDone = calloc(docScan.numPages, sizeof(bool));
+    if(options->profile)
+		docScan.pageProfiles = calloc(docScan.numPages, 
+					sizeof(MyPageProfile));
+    // The stream pointers are the keys so no callbacks are needed. 
+    docScan.imageCache = CFDictionaryCreateMutable(NULL, 0, NULL, NULL);
+    docScan.formCache = CFDictionaryCreateMutable(NULL, 0, NULL, NULL);
+    docScan.inlineImageCache = CFDictionaryCreateMutable(NULL, 0, 
+				&kCFTypeDictionaryKeyCallBacks, NULL);
+    docScan.colorSpaceCache = CFDictionaryCreateMutable(NULL, 0, NULL, 
+				&kCFTypeDictionaryValueCallBacks);
+    if(options->text)
+		docScan.fonts = createFontCache();
+    if(!docScan.pageResults || !docScan.pageDone || 
+		(options->profile && !docScan.pageProfiles) ||
+		!docScan.imageCache || !docScan.formCache ||
+		!docScan.inlineImageCache || !docScan.colorSpaceCache ||
+		(options->text && !docScan.fonts))
+    {
+		free(docScan.pages);
+		free(docScan.pageResults);
+		free(docScan.pageDone);
+		free(docScan.pageProfiles);
+		if(docScan.imageCache)
+			CFRelease(docScan.imageCache);
+		if(docScan.formCache)
+			CFRelease(docScan.formCache);
+		if(docScan.inlineImageCache)
+			CFRelease(docScan.inlineImageCache);
+		if(docScan.colorSpaceCache)
+			CFRelease(docScan.colorSpaceCache);
+		releaseFontCache(docScan.fonts);
+		CGPDFOperatorTableRelease(docScan.table);
+		CGPDFDocumentRelease(docScan.pdfDoc);
+		fprintf(stderr, "Couldn't allocate page results!\n"); return false;
+    }
+    pthread_mutex_init(&docScan.lock, NULL);
+    pthread_mutex_init(&docScan.cacheLock, NULL);
+    docScan.deviceRGB = CGColorSpaceCreateDeviceRGB();
+    docScan.deviceCMYK = CGColorSpaceCreateDeviceCMYK();
+    docScan.deviceGray = CGColorSpaceCreateDeviceGray();
+    pthread_cond_init(&docScan.imageCacheReady, NULL);
+
+    // An index must list every page for queries to be answered from it.
+    if(options->writeIndex && !options->text){
+		if(docScan.numPages == docScan.totPages)
+			docScan.index = createImageIndexWriter(docScan.docName);
+		else
+			fprintf(stderr, "Not writing an image index since not every "
+					"page is scanned.\n");
+    }
+
+    // There is no point starting more workers than there are pages.
+    if(numWorkers > 1 && (size_t)numWorkers > docScan.numPages)
+		numWorkers = (int)docScan.numPages;
 	
-		// Once the page has been scanned, release the 
-		// scanner for this page.
-		CGPDFScannerRelease(scanner);
-		// Release the content stream for this page.
-		CGPDFContentStreamRelease(cs);
-		// Done with this page; loop to next page.
+    startTime = CFAbsoluteTimeGetCurrent();
+    if(numWorkers > 1)
+		workers = malloc(numWorkers * sizeof(pthread_t));
+    if(workers){
+		for(i = 0; i < numWorkers; i++){
+			if(pthread_create(&workers[numStarted], NULL, 
+					scanPagesWorker, &docScan) == 0)
+				numStarted++;
+			else
+				fprintf(stderr, "Couldn't start worker thread #%d!\n", i);
+		}
+		for(i = 0; i < numStarted; i++)
+			pthread_join(workers[i], NULL);
+		free(workers);
+    }
+    // Scan on this thread when running serially or to pick up any 
+    // pages left over because no worker thread could be started.
+    scanPagesWorker(&docScan);
+    elapsed = CFAbsoluteTimeGetCurrent() - startTime;
+
+    scanned = !docScan.failed;
+    if(scanned){
+		if(options->format == kMyOutputNDJSON){
+			writeDocRecord(options->writer, &docScan);
+			ndjsonFlush(options->writer);
+		}else if(options->text)
+			printDocTextResults(outFile, &docScan);
+		else
+			printDocResults(outFile, &docScan);
+		// The profile is for people so it stays out of NDJSON output.
+		if(docScan.pageProfiles)
+			printOperatorProfile(
+					options->format == kMyOutputNDJSON ? stderr : outFile,
+					docScan.pageProfiles, docScan.numPages, 10, 20);
     }
-    printDocResults(outFile, totPages, totalImages);
 
+    // Report the scanning throughput separately from the results so 
+    // that the results are identical for any number of workers.
+    fprintf(stderr, "Scanned %zd pages in %.3f seconds "
+			"(%.1f pages/sec) with %d worker%s.\n",
+			docScan.nextPageToPrint, elapsed,
+			elapsed > 0 ? docScan.nextPageToPrint/elapsed : 0.,
+			numStarted ? numStarted : 1, numStarted > 1 ? "s" : "");
+    if(options->text)
+		fprintf(stderr, "Extracted %zd characters of text "
+			"(%.0f characters/sec).\n", docScan.textCharacters,
+			elapsed > 0 ? docScan.textCharacters/elapsed : 0.);
+    if(docScan.index){
+		if(scanned)
+			(void)finishImageIndex(docScan.index);
+		else
+			cancelImageIndex(docScan.index);
+    }
+    // Pages left unwritten by a failure still hold their text.
+    for(i = 0; i < (int)docScan.numPages; i++)
+		releaseTextScan(docScan.pageResults[i].text);
+
+    pthread_mutex_destroy(&docScan.lock);
+    pthread_cond_destroy(&docScan.imageCacheReady);
+    pthread_mutex_destroy(&docScan.cacheLock);
+    CFDictionaryApplyFunction(docScan.imageCache, freeImageCacheEntry, NULL);
+    CFRelease(docScan.imageCache);
+    CFDictionaryApplyFunction(docScan.formCache, freeFormCacheEntry, NULL);
+    CFRelease(docScan.formCache);
+    CFDictionaryApplyFunction(docScan.inlineImageCache, freeImageCacheEntry, 
+				NULL);
+    CFRelease(docScan.inlineImageCache);
+    CFRelease(docScan.colorSpaceCache);
+    CGColorSpaceRelease(docScan.deviceRGB);
+    CGColorSpaceRelease(docScan.deviceCMYK);
+    CGColorSpaceRelease(docScan.deviceGray);
+    releaseFontCache(docScan.fonts);
+    free(docScan.pages);
+    free(docScan.pageResults);
+    free(docScan.pageDone);
+    free(docScan.pageProfiles);
     // Release the operator table this code created.
-    CGPDFOperatorTableRelease(table);
+    CGPDFOperatorTableRelease(docScan.table);
     // Release the input PDF CGPDFDocumentRef.
-    CGPDFDocumentRelease(pdfDoc);
+    CGPDFDocumentRelease(docScan.pdfDoc);
+    return scanned;
+}
+
+static bool imageMatchesQuery(const MyImageIndexEntry *image, 
+			const MyScanOptions *options)
+{
+    if(options->minImageSize && image->width < options->minImageSize &&
+		image->height < options->minImageSize)
+		return false;
+    if(options->colorSpace && 
+		(!image->colorSpace || !strstr(image->colorSpace, options->colorSpace)))
+		return false;
+    return true;
+}
+
+/* Answer a query about the images of a document from its image index,
+    writing the matching images of each page to outFile. Returns false
+    if the document has no usable index. */
+static bool queryDocument(const char *path, FILE *outFile, 
+			const MyScanOptions *options)
+{
+    MyImageIndex *index = openImageIndex(path);
+    MyImageIndexEntry image;
+    size_t i, j, pageNum, firstImage, numImages;
+    size_t numPages, matchingPages = 0, matchingImages = 0;
+    bool pageMatched;
+    
+    if(!index)
+		return false;
+    numPages = imageIndexGetPageCount(index);
+    for(i = 0; i < numPages; i++){
+		imageIndexGetPage(index, i, &pageNum, &firstImage, &numImages);
+		pageMatched = false;
+		for(j = firstImage; j < firstImage + numImages; j++){
+			imageIndexGetImage(index, j, &image);
+			if(!imageMatchesQuery(&image, options))
+				continue;
+			if(options->format == kMyOutputNDJSON){
+				if(!pageMatched){
+					ndjsonBeginRecord(options->writer);
+					ndjsonAddString(options->writer, "type", "page");
+					ndjsonAddString(options->writer, "document", path);
+					ndjsonAddInteger(options->writer, "page", pageNum);
+					ndjsonBeginArray(options->writer, "images");
+				}
+				writeImageObject(options->writer, &image);
+			}else
+				fprintf(outFile, "Page %zd: %s is %zd by %zd, %zd bits "
+					"per component, %s, %s.\n", pageNum, 
+					image.resourceName ? image.resourceName : "?",
+					image.width, image.height, image.bitsPerComponent,
+					image.filter ? image.filter : "unfiltered",
+					image.colorSpace ? image.colorSpace : 
+						"unknown color space");
+			pageMatched = true;
+			matchingImages++;
+		}
+		if(pageMatched){
+			if(options->format == kMyOutputNDJSON){
+				ndjsonEndArray(options->writer);
+				ndjsonEndRecord(options->writer);
+			}
+			matchingPages++;
+		}
+    }
+    if(options->format == kMyOutputNDJSON){
+		ndjsonBeginRecord(options->writer);
+		ndjsonAddString(options->writer, "type", "document");
+		ndjsonAddString(options->writer, "document", path);
+		ndjsonAddInteger(options->writer, "pagesIndexed", numPages);
+		ndjsonAddInteger(options->writer, "matchingPages", matchingPages);
+		ndjsonAddInteger(options->writer, "matchingImages", matchingImages);
+		ndjsonEndRecord(options->writer);
+		ndjsonFlush(options->writer);
+    }else
+		fprintf(outFile, "\nQuery: %zd images on %zd of %zd pages "
+				"match.\n\n", matchingImages, matchingPages, numPages);
+    closeImageIndex(index);
+    return true;
+}
+
+/* Scan one document, writing its results to outFile. Returns false if
+    the document couldn't be scanned. */
+static bool scanDocument(const char *path, FILE *outFile, 
+			const MyScanOptions *options)
+{
+    MyScanOptions docOptions = *options;
+    CFURLRef url;
+    bool scanned;
+    
+    if(options->format == kMyOutputText)
+		fprintf(outFile, "Beginning Document \"%s\"\n", path);
+    url = CFURLCreateFromFileSystemRepresentation(NULL, (const UInt8 *)path, 
+				strlen(path), false);
+    if(!url){
+		fprintf(stderr, "Couldn't create URL for input file %s!\n", path);
+		return false;
+    }
+    // Each document's records go through a writer of its own so that
+    // documents scanned at once never share one.
+    if(options->format == kMyOutputNDJSON){
+		docOptions.writer = createNDJSONWriter(outFile);
+		if(!docOptions.writer){
+			CFRelease(url);
+			return false;
+		}
+    }
+    if(options->query)
+		scanned = queryDocument(path, outFile, &docOptions);
+    else
+		scanned = dumpPageStreams(url, outFile, &docOptions);
+    releaseNDJSONWriter(docOptions.writer);
+    CFRelease(url);
+    return scanned;
+}
+
+/*  A batch scans the documents named in a list file, one path per 
+    line, on a bounded pool of worker threads. Each worker scans whole
+    documents one at a time, so the number of workers is the number of
+    documents scanned at once. A document's results are collected in 
+    a temporary file, so that even a document with a great deal of
+    text holds little of it in memory, and copied out in one piece 
+    once it is done, so documents never interleave in the output. Its
+    path is then appended to 
+    the checkpoint file if it scanned successfully. Documents already
+    in the checkpoint file are skipped, so a batch that is stopped can
+    be run again with the same arguments to carry on where it left off
+    and to retry the documents that failed. A document whose results
+    were written just as the batch was stopped may be scanned twice. */
+// A document's results are copied to the output this much at a time.
+#define kMyBatchCopySize	(256*1024)
+
+typedef struct MyBatch
+{
+    const MyScanOptions *options;
+    FILE *list;
+    FILE *outFile;
+    FILE *checkpoint;
+    CFMutableSetRef done;	// Paths from the checkpoint, as CFStrings.
+    size_t numScanned;
+    size_t numFailed;
+    size_t numSkipped;
+    pthread_mutex_t lock;	// Guards everything above.
+}MyBatch;
+
+static CFStringRef createPathString(const char *path)
+{
+    return CFStringCreateWithFileSystemRepresentation(NULL, path);
+}
+
+/* Read the paths of the documents completed by earlier runs. */
+static bool loadCheckpoint(MyBatch *batch, const char *checkpointPath)
+{
+    FILE *checkpoint = fopen(checkpointPath, "r");
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    
+    if(!checkpoint)
+		return errno == ENOENT;
+    while((length = getline(&line, &capacity, checkpoint)) > 0){
+		CFStringRef path;
+		// A line without a newline was cut short; it isn't complete.
+		if(line[length - 1] != '\n')
+			break;
+		line[length - 1] = '\0';
+		path = createPathString(line);
+		if(path){
+			CFSetAddValue(batch->done, path);
+			CFRelease(path);
+		}
+    }
+    free(line);
+    fclose(checkpoint);
+    return true;
+}
+
+/* Return the path of the next document in the list still to be 
+    scanned, or NULL once the list is exhausted. The caller must free
+    the path. */
+static char *copyNextBatchPath(MyBatch *batch)
+{
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    
+    pthread_mutex_lock(&batch->lock);
+    while((length = getline(&line, &capacity, batch->list)) > 0){
+		CFStringRef path;
+		bool done;
+		
+		while(length && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+			line[--length] = '\0';
+		if(!length)
+			continue;
+		path = createPathString(line);
+		done = path && CFSetContainsValue(batch->done, path);
+		if(path)
+			CFRelease(path);
+		if(!done){
+			pthread_mutex_unlock(&batch->lock);
+			return line;
+		}
+		batch->numSkipped++;
+    }
+    pthread_mutex_unlock(&batch->lock);
+    free(line);
+    return NULL;
+}
+
+/* Copy a document's results from its temporary file to the batch's
+    output. Returns false if they couldn't all be copied. The caller 
+    must hold batch->lock. */
+static bool copyBatchResults(MyBatch *batch, FILE *docOut, char *buffer)
+{
+    size_t length;
+    
+    rewind(docOut);
+    while((length = fread(buffer, 1, kMyBatchCopySize, docOut)) > 0){
+		if(fwrite(buffer, 1, length, batch->outFile) != length)
+			return false;
+    }
+    return !ferror(docOut) && fflush(batch->outFile) == 0;
+}
+
+static void *scanBatchWorker(void *info)
+{
+    MyBatch *batch = (MyBatch *)info;
+    MyScanOptions docOptions = *batch->options;
+    char *path, *buffer = malloc(kMyBatchCopySize);
+    
+    if(!buffer){
+		fprintf(stderr, "Couldn't allocate batch worker!\n");
+		return NULL;
+    }
+    // Pages are scanned on the worker's own thread.
+    docOptions.numWorkers = 1;
+    while((path = copyNextBatchPath(batch)) != NULL){
+		FILE *docOut = tmpfile();
+		bool scanned;
+		
+		if(!docOut){
+			fprintf(stderr, "Couldn't create temporary file for %s: %s\n", 
+					path, strerror(errno));
+			free(path);
+			continue;
+		}
+		scanned = scanDocument(path, docOut, &docOptions);
+		if(fflush(docOut) != 0){
+			fprintf(stderr, "Couldn't buffer results for %s: %s\n", 
+					path, strerror(errno));
+			scanned = false;
+		}
+		
+		pthread_mutex_lock(&batch->lock);
+		if(!copyBatchResults(batch, docOut, buffer)){
+			fprintf(stderr, "Couldn't write results for %s!\n", path);
+			scanned = false;
+		}
+		// Only once its results are out is a document done, and a 
+		// document that failed, perhaps for want of memory or a file
+		// that couldn't be opened, is left for the next run to retry.
+		if(scanned){
+			fprintf(batch->checkpoint, "%s\n", path);
+			fflush(batch->checkpoint);
+		}else
+			batch->numFailed++;
+		batch->numScanned++;
+		pthread_mutex_unlock(&batch->lock);
+		
+		fclose(docOut);
+		free(path);
+    }
+    free(buffer);
+    return NULL;
+}
+
+/* Scan every document in a list file that isn't already in the 
+    checkpoint file, which defaults to the list's path with ".done" 
+    appended. Returns the exit status for the tool. */
+static int scanBatch(const char *listPath, const char *checkpointPath,
+			FILE *outFile, const MyScanOptions *options)
+{
+    MyBatch batch;
+    char defaultCheckpointPath[PATH_MAX];
+    pthread_t *workers = NULL;
+    CFAbsoluteTime startTime, elapsed;
+    int i, numStarted = 0;
+    
+    if(!checkpointPath){
+		snprintf(defaultCheckpointPath, sizeof(defaultCheckpointPath), 
+				"%s.done", listPath);
+		checkpointPath = defaultCheckpointPath;
+    }
+    memset(&batch, 0, sizeof(batch));
+    batch.options = options;
+    batch.outFile = outFile;
+    batch.done = CFSetCreateMutable(NULL, 0, &kCFTypeSetCallBacks);
+    if(!batch.done)
+		return 1;
+    if(!loadCheckpoint(&batch, checkpointPath)){
+		fprintf(stderr, "Couldn't read checkpoint file %s: %s\n", 
+				checkpointPath, strerror(errno));
+		CFRelease(batch.done);
+		return 1;
+    }
+    batch.list = fopen(listPath, "r");
+    batch.checkpoint = fopen(checkpointPath, "a");
+    if(!batch.list || !batch.checkpoint){
+		fprintf(stderr, "Couldn't open %s: %s\n", 
+				batch.list ? checkpointPath : listPath, strerror(errno));
+		if(batch.list)
+			fclose(batch.list);
+		if(batch.checkpoint)
+			fclose(batch.checkpoint);
+		CFRelease(batch.done);
+		return 1;
+    }
+    pthread_mutex_init(&batch.lock, NULL);
+    
+    startTime = CFAbsoluteTimeGetCurrent();
+    if(options->numWorkers > 1)
+		workers = malloc(options->numWorkers * sizeof(pthread_t));
+    if(workers){
+		for(i = 0; i < options->numWorkers; i++){
+			if(pthread_create(&workers[numStarted], NULL, 
+					scanBatchWorker, &batch) == 0)
+				numStarted++;
+			else
+				fprintf(stderr, "Couldn't start worker thread #%d!\n", i);
+		}
+		for(i = 0; i < numStarted; i++)
+			pthread_join(workers[i], NULL);
+		free(workers);
+    }
+    // As with pages, this thread picks up whatever is left.
+    scanBatchWorker(&batch);
+    elapsed = CFAbsoluteTimeGetCurrent() - startTime;
+    
+    fprintf(stderr, "Batch: %zd documents scanned (%zd failed) and %zd "
+			"already done in %.3f seconds (%.1f documents/sec).\n",
+			batch.numScanned, batch.numFailed, batch.numSkipped, elapsed,
+			elapsed > 0 ? batch.numScanned/elapsed : 0.);
+    
+    pthread_mutex_destroy(&batch.lock);
+    fclose(batch.list);
+    if(fclose(batch.checkpoint) != 0)
+		fprintf(stderr, "Couldn't write checkpoint file %s!\n", 
+				checkpointPath);
+    CFRelease(batch.done);
+    return batch.numFailed ? 1 : 0;
+}
+
+// Values returned by getopt_long for options with only a long name.
+enum {
+    kMyPagesOption = 256,
+    kMyEveryOption,
+    kMySampleOption,
+    kMyIndexOption,
+    kMyQueryOption,
+    kMyMinSizeOption,
+    kMyColorSpaceOption,
+    kMyToRGBOption,
+    kMyPageTimeOption,
+    kMyPageMemoryOption
+};
+
+/* Parse a count of bytes with an optional K, M or G suffix. */
+static bool parseByteCount(const char *string, unsigned long long *count)
+{
+    char *end;
+    unsigned long long value = strtoull(string, &end, 10);
+    
+    if(end == string)
+		return false;
+    switch(*end){
+		case 'G': case 'g':
+			value *= 1024;
+		case 'M': case 'm':
+			value *= 1024;
+		case 'K': case 'k':
+			value *= 1024;
+			end++;
+			break;
+    }
+    if(*end != '\0')
+		return false;
+    *count = value;
+    return true;
 }
 
 int main (int argc, const char * argv[]) {
-    const char *inputFileName = NULL;
-    char *outputFileName = NULL;
-    CFURLRef inURL = NULL;
+    const char *storeDirectory = ".";
+    const char *batchList = NULL, *checkpointPath = NULL;
+    unsigned long long memoryLimit = 0;
+    MyScanOptions options;
+    FILE *summaryFile;
+    int ch, status;
+    static struct option longOptions[] = {
+		{ "jobs",	required_argument,	NULL,	'j' },
+		{ "output",	required_argument,	NULL,	'o' },
+		{ "memory-limit",	required_argument,	NULL,	'm' },
+		{ "profile",	no_argument,		NULL,	'p' },
+		{ "format",	required_argument,	NULL,	'f' },
+		{ "pages",	required_argument,	NULL,	kMyPagesOption },
+		{ "every",	required_argument,	NULL,	kMyEveryOption },
+		{ "sample",	required_argument,	NULL,	kMySampleOption },
+		{ "batch",	required_argument,	NULL,	'b' },
+		{ "checkpoint",	required_argument,	NULL,	'c' },
+		{ "text",	no_argument,		NULL,	't' },
+		{ "index",	no_argument,		NULL,	kMyIndexOption },
+		{ "query",	no_argument,		NULL,	kMyQueryOption },
+		{ "min-size",	required_argument,	NULL,	kMyMinSizeOption },
+		{ "color-space",	required_argument,	NULL,	kMyColorSpaceOption },
+		{ "to-rgb",	no_argument,		NULL,	kMyToRGBOption },
+		{ "page-time",	required_argument,	NULL,	kMyPageTimeOption },
+		{ "page-memory",	required_argument,	NULL,	kMyPageMemoryOption },
+		{ NULL,		0,			NULL,	0 }
+    };
     
-    if(argc != 2){
-		fprintf(stderr, "Usage: %s [inputfile] \n", argv[0]);
+    memset(&options, 0, sizeof(options));
+    options.numWorkers = 1;
+    while((ch = getopt_long(argc, (char * const *)argv, "j:o:m:pf:b:c:t", 
+				longOptions, NULL)) != -1){
+		switch(ch){
+			case 'j':
+				options.numWorkers = atoi(optarg);
+				// Zero means use one worker per processor.
+				if(options.numWorkers == 0)
+					options.numWorkers = 
+						(int)sysconf(_SC_NPROCESSORS_ONLN);
+				if(options.numWorkers < 1){
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'o':
+				storeDirectory = optarg;
+				break;
+			case 'p':
+				options.profile = true;
+				break;
+			case 't':
+				options.text = true;
+				break;
+			case 'f':
+				if(strcmp(optarg, "text") == 0)
+					options.format = kMyOutputText;
+				else if(strcmp(optarg, "ndjson") == 0)
+					options.format = kMyOutputNDJSON;
+				else{
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'b':
+				batchList = optarg;
+				break;
+			case 'c':
+				checkpointPath = optarg;
+				break;
+			case kMyIndexOption:
+				options.writeIndex = true;
+				break;
+			case kMyQueryOption:
+				options.query = true;
+				break;
+			case kMyMinSizeOption:
+				options.minImageSize = strtoul(optarg, NULL, 10);
+				break;
+			case kMyColorSpaceOption:
+				options.colorSpace = optarg;
+				break;
+			case kMyToRGBOption:
+				options.toRGB = true;
+				break;
+			case kMyPageTimeOption:
+				options.pageSeconds = strtod(optarg, NULL);
+				if(!(options.pageSeconds > 0)){
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case kMyPageMemoryOption:
+				if(!parseByteCount(optarg, &options.pageMemory) || 
+					!options.pageMemory)
+				{
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case kMyPagesOption:
+				if(!parsePageRanges(optarg, &options.selection)){
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case kMyEveryOption:
+				options.selection.every = strtoul(optarg, NULL, 10);
+				if(options.selection.every < 1){
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case kMySampleOption:
+				options.selection.sampleSize = strtoul(optarg, NULL, 10);
+				if(options.selection.sampleSize < 1){
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'm':
+				if(!parseByteCount(optarg, &memoryLimit) || !memoryLimit){
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+    }
+    
+    // A batch takes its documents from the list instead.
+    if(argc - optind != (batchList ? 0 : 1)){
+		usage(argv[0]);
         return 1;
     }
 
-    inputFileName = argv[1];
-    fprintf(stdout, "Beginning Document \"%s\"\n", inputFileName);
-
-    inURL = CFURLCreateFromFileSystemRepresentation(NULL, inputFileName, 
-				strlen(inputFileName), false);
-    if(!inURL){
-		fprintf(stderr, "Couldn't create URL for input file!\n");
+    // No images are extracted along with text or by queries.
+    if(options.query)
+		options.text = false;
+    if(!options.text && !options.query)
+		options.store = createExtractionStore(storeDirectory);
+    options.budget = createMemoryBudget(memoryLimit);
+    if((!options.text && !options.query && !options.store) || 
+		!options.budget)
+    {
+		releaseExtractionStore(options.store);
+		releaseMemoryBudget(options.budget);
 		return 1;
     }
     
-    dumpPageStreams(inURL, stdout);
+    if(batchList)
+		status = scanBatch(batchList, checkpointPath, stdout, &options);
+    else
+		status = scanDocument(argv[optind], stdout, &options) ? 0 : 1;
     
-    CFRelease(inURL);
+    // Only records go to stdout in NDJSON output.
+    summaryFile = options.format == kMyOutputNDJSON ? stderr : stdout;
+    if(options.store)
+		printExtractionStoreResults(summaryFile, options.store);
+    if(memoryLimit)
+		printMemoryBudgetResults(summaryFile, options.budget);
     
-    return 0;
+    releaseExtractionStore(options.store);
+    releaseMemoryBudget(options.budget);
+    freePageSelection(&options.selection);
+    
+    return status;
 }